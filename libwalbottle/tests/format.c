@@ -0,0 +1,146 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include "wbl-format.h"
+
+/* Test that every example string for each format has the validity it is
+ * listed with. */
+static void
+test_format_examples (void)
+{
+	WblFormat format;
+
+	for (format = WBL_FORMAT_DATE_TIME; format <= WBL_FORMAT_URI;
+	     format++) {
+		const WblFormatExample *examples;
+		gsize n_examples, i;
+		gboolean seen_valid = FALSE, seen_invalid = FALSE;
+
+		examples = wbl_format_get_examples (format, &n_examples);
+		g_assert_cmpuint (n_examples, >, 0);
+		g_assert (wbl_format_get_section (format) != NULL);
+
+		for (i = 0; i < n_examples; i++) {
+			g_test_message ("Format %u: %s", format,
+			                examples[i].value);
+
+			g_assert_cmpint (wbl_format_validate (format,
+			                                      examples[i].value,
+			                                      strlen (examples[i].value)),
+			                 ==, examples[i].valid);
+
+			if (examples[i].valid) {
+				seen_valid = TRUE;
+			} else {
+				seen_invalid = TRUE;
+			}
+		}
+
+		g_assert (seen_valid);
+		g_assert (seen_invalid);
+	}
+}
+
+/* Test validating strings which are not in the example tables, including
+ * embedded nul bytes and unknown formats. */
+static void
+test_format_validate (void)
+{
+	guint i;
+
+	const struct {
+		WblFormat format;
+		const gchar *value;
+		gboolean valid;
+	} vectors[] = {
+		{ WBL_FORMAT_DATE_TIME, "2016-02-29T00:00:00Z", TRUE },
+		{ WBL_FORMAT_DATE_TIME, "2015-02-29T00:00:00Z", FALSE },
+		{ WBL_FORMAT_DATE_TIME, "2016-12-31T23:59:60Z", TRUE },
+		{ WBL_FORMAT_DATE_TIME, "2016-01-01t12:00:00.5+01:30", TRUE },
+		{ WBL_FORMAT_DATE_TIME, "2016-01-01T24:00:00Z", FALSE },
+		{ WBL_FORMAT_DATE_TIME, "2016-01-01T12:00:00", FALSE },
+		{ WBL_FORMAT_DATE_TIME, "2016-01-01", FALSE },
+		{ WBL_FORMAT_EMAIL, "a.b+c@example.com", TRUE },
+		{ WBL_FORMAT_EMAIL, "\"a b\"@example.com", TRUE },
+		{ WBL_FORMAT_EMAIL, "a..b@example.com", FALSE },
+		{ WBL_FORMAT_EMAIL, "a@", FALSE },
+		{ WBL_FORMAT_EMAIL, "@example.com", FALSE },
+		{ WBL_FORMAT_HOSTNAME, "a", TRUE },
+		{ WBL_FORMAT_HOSTNAME, "a-b.c", TRUE },
+		{ WBL_FORMAT_HOSTNAME, "-a.c", FALSE },
+		{ WBL_FORMAT_HOSTNAME, "a..c", FALSE },
+		{ WBL_FORMAT_HOSTNAME, "", FALSE },
+		{ WBL_FORMAT_IPV4, "0.0.0.0", TRUE },
+		{ WBL_FORMAT_IPV4, "1.2.3", FALSE },
+		{ WBL_FORMAT_IPV4, "1.2.3.4.5", FALSE },
+		{ WBL_FORMAT_IPV4, "1.2.3.0004", FALSE },
+		{ WBL_FORMAT_IPV6, "::", TRUE },
+		{ WBL_FORMAT_IPV6, "::ffff:192.0.2.1", TRUE },
+		{ WBL_FORMAT_IPV6, "1:2:3:4:5:6:7:8", TRUE },
+		{ WBL_FORMAT_IPV6, "1:2:3:4:5:6:7:8:9", FALSE },
+		{ WBL_FORMAT_IPV6, "1::2::3", FALSE },
+		{ WBL_FORMAT_IPV6, "12345::", FALSE },
+		{ WBL_FORMAT_URI, "http://[::1]:80/a?b#c", TRUE },
+		{ WBL_FORMAT_URI, "urn:isbn:0451450523", TRUE },
+		{ WBL_FORMAT_URI, "http://example.com/%7e", TRUE },
+		{ WBL_FORMAT_URI, "http://example.com/%7", FALSE },
+		{ WBL_FORMAT_URI, "/relative", FALSE },
+		{ WBL_FORMAT_URI, "http://a b", FALSE },
+		{ WBL_FORMAT_UNKNOWN, "anything", TRUE },
+	};
+
+	for (i = 0; i < G_N_ELEMENTS (vectors); i++) {
+		g_test_message ("Format %u: %s", vectors[i].format,
+		                vectors[i].value);
+
+		g_assert_cmpint (wbl_format_validate (vectors[i].format,
+		                                      vectors[i].value,
+		                                      strlen (vectors[i].value)),
+		                 ==, vectors[i].valid);
+	}
+
+	/* Embedded nul bytes are never valid. */
+	g_assert (!wbl_format_validate (WBL_FORMAT_IPV4, "1.2.3.4\0", 8));
+	g_assert (!wbl_format_validate (WBL_FORMAT_HOSTNAME, "a\0b", 3));
+
+	/* Looking up formats by name. */
+	g_assert_cmpint (wbl_format_from_string ("date-time"), ==,
+	                 WBL_FORMAT_DATE_TIME);
+	g_assert_cmpint (wbl_format_from_string ("uri"), ==, WBL_FORMAT_URI);
+	g_assert_cmpint (wbl_format_from_string ("uri-reference"), ==,
+	                 WBL_FORMAT_UNKNOWN);
+	g_assert_cmpint (wbl_format_from_string (""), ==, WBL_FORMAT_UNKNOWN);
+}
+
+int
+main (int argc, char *argv[])
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/format/examples", test_format_examples);
+	g_test_add_func ("/format/validate", test_format_validate);
+
+	return g_test_run ();
+}
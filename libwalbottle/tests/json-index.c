@@ -0,0 +1,463 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include "wbl-json-index.h"
+
+/* Build an index over @data both with and without SIMD instructions, and
+ * check they agree. */
+static void
+assert_indexes_match (const gchar *data,
+                      gsize        length)
+{
+	WblJsonIndex simd, scalar;
+	GError *simd_error = NULL, *scalar_error = NULL;
+	gboolean simd_success, scalar_success;
+
+	simd_success = wbl_json_index_init (&simd, data, length,
+	                                    WBL_JSON_INDEX_NONE, &simd_error);
+	scalar_success = wbl_json_index_init (&scalar, data, length,
+	                                      WBL_JSON_INDEX_SCALAR,
+	                                      &scalar_error);
+
+	g_assert_cmpint (simd_success, ==, scalar_success);
+	g_assert_cmpuint (simd.n_positions, ==, scalar.n_positions);
+
+	if (simd.n_positions > 0) {
+		g_assert (memcmp (simd.positions, scalar.positions,
+		                  simd.n_positions * sizeof (*simd.positions)) == 0);
+	}
+
+	g_clear_error (&simd_error);
+	g_clear_error (&scalar_error);
+	wbl_json_index_clear (&simd);
+	wbl_json_index_clear (&scalar);
+}
+
+/* Test the positions in the index for a small document. */
+static void
+test_index_positions (void)
+{
+	WblJsonIndex json_index;
+	GError *error = NULL;
+	const gchar *data = "{ \"a\\\"[\": [ 12, true ],\"b\":-1e5 }";
+	const guint32 expected[] = {
+		0, 2, 7, 8, 10, 12, 14, 16, 21, 22, 23, 25, 26, 27, 32,
+	};
+
+	wbl_json_index_init (&json_index, data, strlen (data),
+	                     WBL_JSON_INDEX_NONE, &error);
+	g_assert_no_error (error);
+
+	g_assert_cmpuint (json_index.n_positions, ==, G_N_ELEMENTS (expected));
+	g_assert (memcmp (json_index.positions, expected,
+	                  sizeof (expected)) == 0);
+
+	wbl_json_index_clear (&json_index);
+
+	/* An unterminated string. */
+	wbl_json_index_init (&json_index, "[\"a\\\"]", 6, WBL_JSON_INDEX_NONE,
+	                     &error);
+	g_assert_error (error, JSON_PARSER_ERROR, JSON_PARSER_ERROR_PARSE);
+	g_assert_cmpuint (json_index.n_positions, ==, 0);
+	g_clear_error (&error);
+}
+
+/* Test that the SIMD and byte-by-byte indexes agree on random data made up of
+ * the characters which matter for indexing. This particularly exercises runs
+ * of backslashes and strings which cross the 64-byte block boundaries. */
+static void
+test_index_simd (void)
+{
+	const gchar alphabet[] = "{}[]:,\"\" \n\\\\\\ab01";
+	gchar data[300];
+	GRand *prng = NULL;  /* owned */
+	guint i;
+
+	prng = g_rand_new_with_seed (42);
+
+	for (i = 0; i < 20000; i++) {
+		gsize length, j;
+
+		length = g_rand_int_range (prng, 0, sizeof (data));
+
+		for (j = 0; j < length; j++) {
+			data[j] = alphabet[g_rand_int_range (prng, 0,
+			                                     sizeof (alphabet) - 1)];
+		}
+
+		assert_indexes_match (data, length);
+	}
+
+	g_rand_free (prng);
+}
+
+static gchar *
+node_to_string (JsonNode *node)
+{
+	JsonGenerator *generator = NULL;  /* owned */
+	gchar *str = NULL;  /* owned */
+
+	generator = json_generator_new ();
+	json_generator_set_root (generator, node);
+	str = json_generator_to_data (generator, NULL);
+	g_object_unref (generator);
+
+	return str;
+}
+
+/* Test that parsing using the index gives the same nodes as #JsonParser. */
+static void
+test_parse_valid (void)
+{
+	JsonParser *parser = NULL;  /* owned */
+	guint i;
+
+	const gchar *valid_documents[] = {
+		"null",
+		"true",
+		"false",
+		"0",
+		"-0",
+		"123",
+		"-123",
+		"1.5",
+		"-2.25e-3",
+		"1E+2",
+		"\"\"",
+		"\"abc\"",
+		"\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"",
+		"\"\\u00e9\\u20AC\\ud83d\\ude00\"",
+		"\"é€😀\"",
+		"[]",
+		"{}",
+		" \t\n\r[ 1 , \"a\" , [ ] , { } ]\n",
+		"{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"e\"}}",
+		"{\"a\": 1, \"a\": 2}",
+		"[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]",
+		"[\"a long string which crosses a 64-byte boundary, with \\\\ "
+		"escaped \\\" characters\", \"and another\\\\\"]",
+	};
+
+	parser = json_parser_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (valid_documents); i++) {
+		JsonNode *node = NULL;  /* owned */
+		gchar *expected = NULL, *actual = NULL;  /* owned */
+		GError *error = NULL;
+
+		g_test_message ("Document: %s", valid_documents[i]);
+
+		json_parser_load_from_data (parser, valid_documents[i], -1,
+		                            &error);
+		g_assert_no_error (error);
+
+		node = wbl_json_index_parse (valid_documents[i],
+		                             strlen (valid_documents[i]),
+		                             &error);
+		g_assert_no_error (error);
+		g_assert (node != NULL);
+
+		expected = node_to_string (json_parser_get_root (parser));
+		actual = node_to_string (node);
+		g_assert_cmpstr (actual, ==, expected);
+
+		g_free (actual);
+		g_free (expected);
+		json_node_free (node);
+	}
+
+	g_object_unref (parser);
+}
+
+/* Test that malformed documents are rejected. */
+static void
+test_parse_invalid (void)
+{
+	guint i;
+	gchar *deep = NULL;  /* owned */
+
+	const gchar *invalid_documents[] = {
+		"",
+		" ",
+		"nul",
+		"True",
+		"01",
+		"-",
+		"1.",
+		".5",
+		"1e",
+		"+1",
+		"0x10",
+		"1 2",
+		"\"abc",
+		"\"\\x\"",
+		"\"\\u12\"",
+		"\"\\ud83d\"",
+		"\"\\ude00\"",
+		"\"\\u0000\"",
+		"{\"a\\u0000b\": 1}",
+		"\"\t\"",
+		"\"\xff\"",
+		"[",
+		"]",
+		"[1,]",
+		"[1 2]",
+		"[,1]",
+		"{",
+		"{1: 2}",
+		"{\"a\"}",
+		"{\"a\" 1}",
+		"{\"a\": 1,}",
+		"{\"a\": 1 \"b\": 2}",
+		"{\"a\": }",
+		"[1]]",
+		"[1] x",
+	};
+
+	for (i = 0; i < G_N_ELEMENTS (invalid_documents); i++) {
+		JsonNode *node = NULL;  /* owned */
+		GError *error = NULL;
+
+		g_test_message ("Document: %s", invalid_documents[i]);
+
+		node = wbl_json_index_parse (invalid_documents[i],
+		                             strlen (invalid_documents[i]),
+		                             &error);
+		g_assert (node == NULL);
+		g_assert (error != NULL);
+		g_assert (error->domain == JSON_PARSER_ERROR);
+		g_clear_error (&error);
+	}
+
+	/* Too deeply nested. */
+	deep = g_strnfill (2000, '[');
+	g_assert (wbl_json_index_parse (deep, strlen (deep), NULL) == NULL);
+	g_free (deep);
+}
+
+/* Test that a nul character is rejected rather than truncating the string,
+ * wherever it appears. */
+static void
+test_parse_nul (void)
+{
+	JsonNode *node = NULL;  /* owned */
+	GError *error = NULL;
+	const gchar *data = "[\"a\", \"b\\u0000c\"]";
+
+	node = wbl_json_index_parse (data, strlen (data), &error);
+	g_assert_error (error, JSON_PARSER_ERROR,
+	                JSON_PARSER_ERROR_INVALID_DATA);
+	g_assert (node == NULL);
+	g_clear_error (&error);
+
+	/* Other control characters are fine when escaped. */
+	data = "\"b\\u0001c\"";
+
+	node = wbl_json_index_parse (data, strlen (data), &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (strlen (json_node_get_string (node)), ==, 3);
+	json_node_free (node);
+}
+
+/* Skip members called `skip`, and odd-numbered array elements. */
+static gpointer
+skip_filter (gpointer      context,
+             const gchar  *member_name,
+             guint         element_index,
+             gpointer      user_data)
+{
+	guint *n_calls = user_data;
+
+	*n_calls = *n_calls + 1;
+
+	if (member_name != NULL && strcmp (member_name, "skip") == 0)
+		return NULL;
+	if (member_name == NULL && element_index % 2 == 1)
+		return NULL;
+
+	return context;
+}
+
+/* Test that values skipped by a filter are replaced by nulls, without
+ * affecting the rest of the document, and that they are still checked for
+ * errors. */
+static void
+test_parse_filtered (void)
+{
+	JsonNode *node = NULL;  /* owned */
+	JsonObject *object;
+	JsonArray *array;
+	guint i, n_calls = 0;
+	GError *error = NULL;
+	const gchar *data = "{\"keep\": [1, {\"skip\": [\"x\"]}, \"b\"], "
+	                    "\"skip\": {\"a\": [true, 1.5e3, \"\\u00e9\"]}}";
+
+	const gchar *invalid_documents[] = {
+		"{\"skip\": tru}",
+		"{\"skip\": [1,]}",
+		"{\"skip\": \"\\x\"}",
+		"{\"skip\": \"\\u0000\"}",
+		"{\"skip\": {\"a\\u0000b\": 1}}",
+		"{\"skip\": 01}",
+		"[1, \"\\ud83d\"]",
+		"[1, \"\xff\"]",
+	};
+
+	node = wbl_json_index_parse_filtered (data, strlen (data), skip_filter,
+	                                      GUINT_TO_POINTER (1), &n_calls,
+	                                      &error);
+	g_assert_no_error (error);
+	g_assert (JSON_NODE_HOLDS_OBJECT (node));
+
+	/* The filter is only called for values in decoded containers. */
+	g_assert_cmpuint (n_calls, ==, 5);
+
+	object = json_node_get_object (node);
+	g_assert (JSON_NODE_HOLDS_NULL (json_object_get_member (object,
+	                                                        "skip")));
+
+	array = json_object_get_array_member (object, "keep");
+	g_assert_cmpuint (json_array_get_length (array), ==, 3);
+	g_assert_cmpint (json_array_get_int_element (array, 0), ==, 1);
+	g_assert (JSON_NODE_HOLDS_NULL (json_array_get_element (array, 1)));
+	g_assert_cmpstr (json_array_get_string_element (array, 2), ==, "b");
+
+	json_node_free (node);
+
+	/* Malformed skipped values are still errors. */
+	for (i = 0; i < G_N_ELEMENTS (invalid_documents); i++) {
+		g_test_message ("Document: %s", invalid_documents[i]);
+
+		node = wbl_json_index_parse_filtered (invalid_documents[i],
+		                                      strlen (invalid_documents[i]),
+		                                      skip_filter,
+		                                      GUINT_TO_POINTER (1),
+		                                      &n_calls, &error);
+		g_assert (node == NULL);
+		g_assert (error != NULL);
+		g_assert (error->domain == JSON_PARSER_ERROR);
+		g_clear_error (&error);
+	}
+}
+
+/* Build an array of @n_objects objects, with a mix of all the value types and
+ * some escaped strings, for benchmarking. */
+static gchar *
+build_benchmark_document (guint n_objects)
+{
+	GString *str = NULL;  /* owned */
+	guint i;
+
+	str = g_string_new ("[");
+
+	for (i = 0; i < n_objects; i++) {
+		g_string_append_printf (str,
+		                        "%s{\"id\": %u, \"name\": \"item %u\", "
+		                        "\"price\": %u.25, \"in_stock\": %s, "
+		                        "\"tags\": [\"a\", \"b\\n\", null], "
+		                        "\"notes\": \"caf\\u00e9 \\\"quoted\\\"\"}",
+		                        (i > 0) ? ", " : "", i, i, i,
+		                        (i % 2 == 0) ? "true" : "false");
+	}
+
+	g_string_append (str, "]");
+
+	return g_string_free (str, FALSE);
+}
+
+/* Compare the time taken to parse a large document with #JsonParser and with
+ * the index. This is only added in perf mode (`-m perf`). */
+static void
+test_parse_perf (void)
+{
+	JsonParser *parser = NULL;  /* owned */
+	gchar *data = NULL;  /* owned */
+	gsize length;
+	gdouble parser_time, index_time;
+	guint i;
+	const guint n_iterations = 20;
+
+	data = build_benchmark_document (20000);
+	length = strlen (data);
+	parser = json_parser_new ();
+
+	g_test_timer_start ();
+
+	for (i = 0; i < n_iterations; i++) {
+		GError *error = NULL;
+
+		json_parser_load_from_data (parser, data, length, &error);
+		g_assert_no_error (error);
+	}
+
+	parser_time = g_test_timer_elapsed () / n_iterations;
+
+	g_test_timer_start ();
+
+	for (i = 0; i < n_iterations; i++) {
+		JsonNode *node = NULL;  /* owned */
+		GError *error = NULL;
+
+		node = wbl_json_index_parse (data, length, &error);
+		g_assert_no_error (error);
+		json_node_free (node);
+	}
+
+	index_time = g_test_timer_elapsed () / n_iterations;
+
+	g_test_message ("Parsing %" G_GSIZE_FORMAT " bytes: JsonParser %.2f ms, "
+	                "index %.2f ms", length, parser_time * 1000.0,
+	                index_time * 1000.0);
+	g_test_minimized_result (index_time / parser_time,
+	                         "Index parse time relative to JsonParser: "
+	                         "%.2f", index_time / parser_time);
+
+	g_object_unref (parser);
+	g_free (data);
+}
+
+int
+main (int argc, char *argv[])
+{
+#if !GLIB_CHECK_VERSION (2, 35, 0)
+	g_type_init ();
+#endif
+
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/json-index/positions", test_index_positions);
+	g_test_add_func ("/json-index/simd", test_index_simd);
+	g_test_add_func ("/json-index/parse/valid", test_parse_valid);
+	g_test_add_func ("/json-index/parse/invalid", test_parse_invalid);
+	g_test_add_func ("/json-index/parse/nul", test_parse_nul);
+	g_test_add_func ("/json-index/parse/filtered", test_parse_filtered);
+
+	if (g_test_perf ()) {
+		g_test_add_func ("/json-index/parse/perf", test_parse_perf);
+	}
+
+	return g_test_run ();
+}
@@ -660,6 +660,64 @@ test_schema_keywords_min_length (void)
 	                       invalid_instances, expected_instances);
 }
 
+/* maxLength and minLength on long strings of mixed-width characters, which
+ * are counted in vectors and whose lengths are cached while applying. The
+ * same string is checked by several subschemas. */
+static void
+test_schema_keywords_length_long (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonNode *instance = NULL;  /* owned */
+	GString *str = NULL;  /* owned */
+	guint i, n_chars;
+	GError *error = NULL;
+
+	const gchar *characters[] = {
+		"a",
+		"é",
+		"€",
+		"🐵",
+	};
+
+	schema = wbl_schema_new ();
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"maxLength\": 5000,"
+			"\"allOf\": ["
+				"{ \"minLength\": 5000 },"
+				"{ \"maxLength\": 5000, \"minLength\": 4999 }"
+			"]"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	instance = json_node_new (JSON_NODE_VALUE);
+
+	for (n_chars = 4999; n_chars <= 5001; n_chars++) {
+		str = g_string_new ("");
+
+		for (i = 0; i < n_chars; i++) {
+			g_string_append (str,
+			                 characters[(i * 7) % G_N_ELEMENTS (characters)]);
+		}
+
+		json_node_set_string (instance, str->str);
+		g_string_free (str, TRUE);
+
+		wbl_schema_apply (schema, instance, &error);
+
+		if (n_chars == 5000) {
+			g_assert_no_error (error);
+		} else {
+			g_assert_error (error,
+			                WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+			g_clear_error (&error);
+		}
+	}
+
+	json_node_free (instance);
+	g_object_unref (schema);
+}
+
 /* pattern. draft-fge-json-schema-validation-00§5.2.3. */
 static void
 test_schema_keywords_pattern (void)
@@ -2283,6 +2341,8 @@ main (int argc, char *argv[])
 	                 test_schema_keywords_max_length);
 	g_test_add_func ("/schema/keywords/min-length",
 	                 test_schema_keywords_min_length);
+	g_test_add_func ("/schema/keywords/length/long",
+	                 test_schema_keywords_length_long);
 	g_test_add_func ("/schema/keywords/pattern",
 	                 test_schema_keywords_pattern);
 	g_test_add_func ("/schema/keywords/additional-items/true",
@@ -511,214 +511,2782 @@ test_schema_parsing_varied (gconstpointer user_data)
 	g_object_unref (schema);
 }
 
-/* Test applying a schema to an instance using items and additionalItems.
- * Taken from draft-fge-json-schema-validation-00§5.3.1.3. */
+/* Test loading a schema in place from a #GMappedFile and a #GBytes. */
 static void
-test_schema_application (void)
+test_schema_parsing_memory (void)
+{
+	gchar *path = NULL;
+	GMappedFile *mapped_file = NULL;  /* owned */
+	GBytes *bytes = NULL;  /* owned */
+	WblSchema *schema = NULL;  /* owned */
+	GError *error = NULL;
+
+	path = g_test_build_filename (G_TEST_DIST, "example2.schema.json",
+	                              NULL);
+	mapped_file = g_mapped_file_new (path, FALSE, &error);
+	g_assert_no_error (error);
+	g_free (path);
+
+	/* Mapped file. */
+	schema = wbl_schema_new ();
+	wbl_schema_load_from_mapped_file (schema, mapped_file, &error);
+	g_assert_no_error (error);
+	g_assert (wbl_schema_get_root (schema) != NULL);
+
+	/* Bytes. The schema must not keep a reference to them. */
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	g_mapped_file_unref (mapped_file);
+
+	wbl_schema_load_from_bytes (schema, bytes, &error);
+	g_assert_no_error (error);
+	g_bytes_unref (bytes);
+
+	g_assert (wbl_schema_get_root (schema) != NULL);
+	g_assert (wbl_schema_node_get_root (wbl_schema_get_root (schema)) != NULL);
+
+	/* Invalid and empty documents. */
+	bytes = g_bytes_new_static ("{ \"type\": ", 10);
+	wbl_schema_load_from_bytes (schema, bytes, &error);
+	g_assert (error != NULL);
+	g_assert (wbl_schema_get_root (schema) == NULL);
+	g_clear_error (&error);
+	g_bytes_unref (bytes);
+
+	bytes = g_bytes_new_static (NULL, 0);
+	wbl_schema_load_from_bytes (schema, bytes, &error);
+	g_assert (error != NULL);
+	g_assert (wbl_schema_get_root (schema) == NULL);
+	g_clear_error (&error);
+	g_bytes_unref (bytes);
+
+	g_object_unref (schema);
+}
+
+/* Test loading several schemas concurrently, with the results in order. */
+static void
+test_schema_parsing_files (void)
+{
+	const gchar *basenames[] = {
+		"google-youtube-v3.json",
+		"does-not-exist.json",
+		"google-drive-v3.json",
+		"example2.schema.json",
+		"schema-instance-generation-simple.json",
+		"json-api.schema.json",
+	};
+	gchar *filenames[G_N_ELEMENTS (basenames)];
+	WblSchema *schemas[G_N_ELEMENTS (basenames)];
+	GError *errors[G_N_ELEMENTS (basenames)] = { NULL, };
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS (basenames); i++) {
+		filenames[i] = g_test_build_filename (G_TEST_DIST, basenames[i],
+		                                      NULL);
+		schemas[i] = wbl_schema_new ();
+	}
+
+	wbl_schema_load_from_files (schemas,
+	                            (const gchar * const *) filenames,
+	                            G_N_ELEMENTS (basenames), NULL, errors);
+
+	/* The file which does not exist should fail, as should the list of
+	 * generated instances, which is not a single JSON document. */
+	for (i = 0; i < G_N_ELEMENTS (basenames); i++) {
+		if (i == 1 || i == 4) {
+			g_assert (errors[i] != NULL);
+			g_assert (wbl_schema_get_root (schemas[i]) == NULL);
+			g_clear_error (&errors[i]);
+		} else {
+			g_assert_no_error (errors[i]);
+			g_assert (wbl_schema_get_root (schemas[i]) != NULL);
+		}
+
+		g_object_unref (schemas[i]);
+		g_free (filenames[i]);
+	}
+}
+
+/* Test loading an invalid schema without validating it, or validating it
+ * lazily. */
+static void
+test_schema_parsing_load_modes (void)
 {
 	WblSchema *schema = NULL;  /* owned */
 	JsonParser *parser = NULL;  /* owned */
+	GPtrArray/*<owned GError>*/ *verdicts = NULL;  /* owned */
+	JsonNode *nodes[3];
+	GError *error = NULL;
+
+	/* The ‘b’ and ‘c’ subschemas are invalid, as minimum must be a
+	 * number. */
+	const gchar *schema_data =
+		"{"
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"a\": {\"type\": \"integer\"},"
+				"\"b\": {\"minimum\": \"x\"}"
+			"},"
+			"\"not\": {\"required\": [\"c\"], \"minimum\": \"x\"}"
+		"}";
+
+	parser = json_parser_new ();
+
+	json_parser_load_from_data (parser, "{\"a\": 1}", -1, &error);
+	g_assert_no_error (error);
+	nodes[0] = json_node_copy (json_parser_get_root (parser));
+
+	json_parser_load_from_data (parser, "{\"b\": 1}", -1, &error);
+	g_assert_no_error (error);
+	nodes[1] = json_node_copy (json_parser_get_root (parser));
+
+	json_parser_load_from_data (parser, "{\"a\": \"x\"}", -1, &error);
+	g_assert_no_error (error);
+	nodes[2] = json_node_copy (json_parser_get_root (parser));
+
+	g_object_unref (parser);
+
+	schema = wbl_schema_new ();
+	g_assert_cmpint (wbl_schema_get_load_mode (schema), ==,
+	                 WBL_SCHEMA_LOAD_MODE_VALIDATE);
+
+	/* Validated when loaded. */
+	wbl_schema_load_from_data (schema, schema_data, -1, &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+	g_assert (wbl_schema_get_root (schema) == NULL);
+
+	/* Trusted: loads, and the messages are available on demand. */
+	wbl_schema_set_load_mode (schema, WBL_SCHEMA_LOAD_MODE_TRUSTED);
+	wbl_schema_load_from_data (schema, schema_data, -1, &error);
+	g_assert_no_error (error);
+	g_assert (wbl_schema_get_root (schema) != NULL);
+
+	wbl_schema_apply (schema, nodes[0], &error);
+	g_assert_no_error (error);
+
+	g_assert (wbl_schema_get_validation_messages (schema) != NULL);
+
+	/* Lazy: only the subschemas which are reached are validated. The
+	 * invalid ‘not’ subschema is always reached, so replace it. */
+	wbl_schema_set_load_mode (schema, WBL_SCHEMA_LOAD_MODE_LAZY);
+	wbl_schema_load_from_data (schema, schema_data, -1, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply (schema, nodes[0], &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"a\": {\"type\": \"integer\"},"
+				"\"b\": {\"minimum\": \"x\"}"
+			"}"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply (schema, nodes[0], &error);
+	g_assert_no_error (error);
+	wbl_schema_apply (schema, nodes[1], &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+	wbl_schema_apply (schema, nodes[2], &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_clear_error (&error);
+
+	verdicts = wbl_schema_apply_batch (schema, nodes, G_N_ELEMENTS (nodes));
+	g_assert_no_error (verdicts->pdata[0]);
+	g_assert_error (verdicts->pdata[1], WBL_SCHEMA_ERROR,
+	                WBL_SCHEMA_ERROR_MALFORMED);
+	g_assert_error (verdicts->pdata[2], WBL_SCHEMA_ERROR,
+	                WBL_SCHEMA_ERROR_INVALID);
+	g_ptr_array_unref (verdicts);
+
+	g_assert (wbl_schema_get_validation_messages (schema) != NULL);
+
+	json_node_free (nodes[2]);
+	json_node_free (nodes[1]);
+	json_node_free (nodes[0]);
+	g_object_unref (schema);
+}
+
+/* Test saving a schema to a snapshot and loading it again, that invalid
+ * snapshots are rejected, and that a snapshot’s record of being validated is
+ * only used if the caller trusts it. */
+static void
+test_schema_parsing_snapshot (void)
+{
+	WblSchema *schema = NULL, *loaded = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	GBytes *snapshot = NULL, *bytes = NULL;  /* owned */
+	guint8 *data = NULL;  /* owned */
+	gsize length;
+	guint32 version, flags;
+	JsonNode *nodes[3];
 	guint i;
 	GError *error = NULL;
 
-	const gchar *valid_cases[] = {
-		"[]",
-		"[ [ 1, 2, 3, 4 ], [ 5, 6, 7, 8 ] ]",
-		"[ 1, 2, 3 ]",
+	const gchar *schema_data =
+		"{"
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"a\": {\"type\": \"integer\", \"minimum\": 0},"
+				"\"b\": {\"pattern\": \"^[a-z]+$\"}"
+			"},"
+			"\"required\": [\"a\"]"
+		"}";
+	const gchar *instances[] = {
+		"{\"a\": 1, \"b\": \"xyz\"}",
+		"{\"a\": -1}",
+		"{\"a\": 1, \"b\": \"X\"}",
 	};
 
-	const gchar *invalid_cases[] = {
-		"[ 1, 2, 3, 4 ]",
-		"[ null, { \"a\": \"b\" }, true, 31.000002020013 ]",
+	parser = json_parser_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (instances); i++) {
+		json_parser_load_from_data (parser, instances[i], -1, &error);
+		g_assert_no_error (error);
+		nodes[i] = json_node_copy (json_parser_get_root (parser));
+	}
+
+	g_object_unref (parser);
+
+	schema = wbl_schema_new ();
+	loaded = wbl_schema_new ();
+
+	/* Nothing to snapshot yet. */
+	g_assert (wbl_schema_dup_snapshot (schema) == NULL);
+
+	wbl_schema_load_from_data (schema, schema_data, -1, &error);
+	g_assert_no_error (error);
+
+	snapshot = wbl_schema_dup_snapshot (schema);
+	g_assert (snapshot != NULL);
+
+	/* Load it validated, and trusted. */
+	for (i = 0; i < 2; i++) {
+		guint j;
+
+		wbl_schema_set_load_mode (loaded,
+		                          (i == 0) ? WBL_SCHEMA_LOAD_MODE_VALIDATE :
+		                                     WBL_SCHEMA_LOAD_MODE_TRUSTED);
+		wbl_schema_load_from_snapshot (loaded, snapshot, &error);
+
+		g_assert_no_error (error);
+		g_assert (wbl_schema_get_root (loaded) != NULL);
+
+		for (j = 0; j < G_N_ELEMENTS (nodes); j++) {
+			GError *expected_error = NULL;
+
+			wbl_schema_apply (schema, nodes[j], &expected_error);
+			wbl_schema_apply (loaded, nodes[j], &error);
+
+			if (expected_error == NULL) {
+				g_assert_no_error (error);
+			} else {
+				g_assert_error (error, expected_error->domain,
+				                expected_error->code);
+			}
+
+			g_clear_error (&expected_error);
+			g_clear_error (&error);
+		}
+
+		/* Validation messages are available either way. */
+		g_assert ((wbl_schema_get_validation_messages (loaded) == NULL) ==
+		          (wbl_schema_get_validation_messages (schema) == NULL));
+	}
+
+	/* The loaders for JSON do not load snapshots. */
+	wbl_schema_load_from_bytes (loaded, snapshot, &error);
+	g_assert (error != NULL);
+	g_clear_error (&error);
+	g_assert (wbl_schema_get_root (loaded) == NULL);
+
+	g_bytes_unref (snapshot);
+
+	/* A snapshot of an invalid schema is validated when it is loaded,
+	 * even if it is trusted. */
+	wbl_schema_set_load_mode (schema, WBL_SCHEMA_LOAD_MODE_TRUSTED);
+	wbl_schema_load_from_data (schema, "{\"minimum\": \"x\"}", -1, &error);
+	g_assert_no_error (error);
+	g_assert (wbl_schema_get_validation_messages (schema) != NULL);
+
+	snapshot = wbl_schema_dup_snapshot (schema);
+	wbl_schema_load_from_snapshot (loaded, snapshot, &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+	g_assert (wbl_schema_get_root (loaded) == NULL);
+
+	/* A snapshot which claims to have been validated is only believed if
+	 * it is trusted. The flags follow the 8-byte magic and the version. */
+	data = g_bytes_unref_to_data (snapshot, &length);
+	memcpy (&flags, data + 12, sizeof (flags));
+	flags |= 1;
+	memcpy (data + 12, &flags, sizeof (flags));
+	snapshot = g_bytes_new_take (data, length);
+
+	wbl_schema_set_load_mode (loaded, WBL_SCHEMA_LOAD_MODE_VALIDATE);
+	wbl_schema_load_from_snapshot (loaded, snapshot, &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+	g_assert (wbl_schema_get_root (loaded) == NULL);
+
+	wbl_schema_set_load_mode (loaded, WBL_SCHEMA_LOAD_MODE_TRUSTED);
+	wbl_schema_load_from_snapshot (loaded, snapshot, &error);
+	g_assert_no_error (error);
+	g_assert (wbl_schema_get_root (loaded) != NULL);
+
+	/* Corrupt snapshots. */
+	data = g_bytes_unref_to_data (snapshot, &length);
+
+	bytes = g_bytes_new_static (data, 16);
+	wbl_schema_load_from_snapshot (loaded, bytes, &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+	g_clear_error (&error);
+	g_bytes_unref (bytes);
+
+	bytes = g_bytes_new_static ("{}", 2);
+	wbl_schema_load_from_snapshot (loaded, bytes, &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+	g_clear_error (&error);
+	g_bytes_unref (bytes);
+
+	/* The version follows the 8-byte magic. */
+	memcpy (&version, data + 8, sizeof (version));
+	version++;
+	memcpy (data + 8, &version, sizeof (version));
+
+	bytes = g_bytes_new_static (data, length);
+	wbl_schema_load_from_snapshot (loaded, bytes, &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+	g_clear_error (&error);
+	g_bytes_unref (bytes);
+
+	g_free (data);
+
+	for (i = 0; i < G_N_ELEMENTS (nodes); i++) {
+		json_node_free (nodes[i]);
+	}
+
+	g_object_unref (loaded);
+	g_object_unref (schema);
+}
+
+/* Test that identical subtrees within and between instances get the same
+ * verdicts as each other, with and without memoising subtree verdicts,
+ * including when they reach an invalid subschema while the schema is being
+ * validated lazily. */
+static void
+test_schema_application_repeated_subtrees (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	GPtrArray/*<owned GError>*/ *verdicts = NULL;  /* owned */
+	JsonNode *nodes[5];
+	guint i, j;
+	GError *error = NULL;
+
+	const gboolean memoise[] = { FALSE, TRUE };
+
+	const struct {
+		const gchar *instance;
+		gboolean valid;
+	} vectors[] = {
+		{ "[{\"kind\": \"x\"}, {\"kind\": \"x\"}, {\"kind\": \"x\"}]", TRUE },
+		{ "[{\"kind\": \"x\"}, {\"kind\": \"x\"}, {\"kind\": 1}]", FALSE },
+		{ "[{\"kind\": \"x\"}, {}, {\"kind\": \"x\"}]", FALSE },
+		{ "[[{\"kind\": \"x\"}], {\"kind\": \"x\"}]", FALSE },
+		{ "[{\"kind\": \"x\", \"a\": [1]}, {\"a\": [1], \"kind\": \"x\"}]", TRUE },
 	};
 
+	G_STATIC_ASSERT (G_N_ELEMENTS (vectors) == G_N_ELEMENTS (nodes));
+
+	parser = json_parser_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (vectors); i++) {
+		json_parser_load_from_data (parser, vectors[i].instance, -1,
+		                            &error);
+		g_assert_no_error (error);
+		nodes[i] = json_node_copy (json_parser_get_root (parser));
+	}
+
+	g_object_unref (parser);
+
+	schema = wbl_schema_new ();
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"items\": {"
+				"\"type\": \"object\","
+				"\"properties\": {\"kind\": {\"type\": \"string\"}},"
+				"\"required\": [\"kind\"]"
+			"}"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	g_assert (!wbl_schema_get_memoise_subtrees (schema));
+
+	for (j = 0; j < G_N_ELEMENTS (memoise); j++) {
+		wbl_schema_set_memoise_subtrees (schema, memoise[j]);
+		g_assert_cmpint (wbl_schema_get_memoise_subtrees (schema), ==,
+		                 memoise[j]);
+
+		verdicts = wbl_schema_apply_batch (schema, nodes,
+		                                   G_N_ELEMENTS (nodes));
+
+		for (i = 0; i < G_N_ELEMENTS (vectors); i++) {
+			g_test_message ("Memoising %d, instance %u: %s",
+			                memoise[j], i, vectors[i].instance);
+
+			wbl_schema_apply (schema, nodes[i], &error);
+
+			if (vectors[i].valid) {
+				g_assert_no_error (error);
+				g_assert_no_error (verdicts->pdata[i]);
+			} else {
+				g_assert_error (error, WBL_SCHEMA_ERROR,
+				                WBL_SCHEMA_ERROR_INVALID);
+				g_assert_error (verdicts->pdata[i],
+				                WBL_SCHEMA_ERROR,
+				                WBL_SCHEMA_ERROR_INVALID);
+				g_clear_error (&error);
+			}
+		}
+
+		g_ptr_array_unref (verdicts);
+	}
+
+	/* The items subschema is invalid, as minimum must be a number, so
+	 * every instance which reaches it must fail, even if an identical
+	 * subtree has already reached it. */
+	wbl_schema_set_load_mode (schema, WBL_SCHEMA_LOAD_MODE_LAZY);
+	wbl_schema_load_from_data (schema,
+		"{\"items\": {\"not\": {\"minimum\": \"x\"}}}", -1, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply (schema, nodes[0], &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+
+	verdicts = wbl_schema_apply_batch (schema, nodes, 2);
+	g_assert_error (verdicts->pdata[0], WBL_SCHEMA_ERROR,
+	                WBL_SCHEMA_ERROR_MALFORMED);
+	g_assert_error (verdicts->pdata[1], WBL_SCHEMA_ERROR,
+	                WBL_SCHEMA_ERROR_MALFORMED);
+	g_ptr_array_unref (verdicts);
+
+	for (i = 0; i < G_N_ELEMENTS (nodes); i++) {
+		json_node_free (nodes[i]);
+	}
+
+	g_object_unref (schema);
+}
+
+static void
+apply_x_count (WblSchema   *schema,
+               JsonObject  *root,
+               JsonNode    *schema_node,
+               JsonNode    *instance_node,
+               GError     **error,
+               gpointer     user_data)
+{
+	guint *n_calls = user_data;
+
+	*n_calls = *n_calls + 1;
+}
+
+/* Test that memoising subtree verdicts applies each subschema only once to
+ * identical subtrees, independently of the verdict cache for whole instances,
+ * which is left disabled. */
+static void
+test_schema_application_repeated_subtrees_memoised (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	guint n_calls = 0;
+	GError *error = NULL;
+
+	schema = wbl_schema_new ();
+	wbl_schema_add_keyword (schema, "x-count", NULL, apply_x_count, NULL,
+	                        &n_calls, NULL);
+	wbl_schema_load_from_data (schema, "{\"items\": {\"x-count\": true}}",
+	                           -1, &error);
+	g_assert_no_error (error);
+
+	parser = json_parser_new ();
+	json_parser_load_from_data (parser,
+	                            "[{\"a\": 1}, {\"a\": 1}, {\"a\": 2}, "
+	                            "{\"a\": 1}]", -1, &error);
+	g_assert_no_error (error);
+
+	g_assert_cmpuint (wbl_schema_get_verdict_cache_size (schema), ==, 0);
+
+	/* Without memoising, the keyword is applied to every item. */
+	wbl_schema_apply (schema, json_parser_get_root (parser), &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (n_calls, ==, 4);
+
+	/* With it, only to each distinct item, and again on each call. */
+	wbl_schema_set_memoise_subtrees (schema, TRUE);
+	n_calls = 0;
+
+	wbl_schema_apply (schema, json_parser_get_root (parser), &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (n_calls, ==, 2);
+
+	wbl_schema_apply (schema, json_parser_get_root (parser), &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (n_calls, ==, 4);
+
+	g_object_unref (parser);
+	g_object_unref (schema);
+}
+
+/* Build an array of @n_items objects, which are all identical if @repeated is
+ * %TRUE, and all different otherwise. */
+static JsonNode *
+build_subtree_benchmark_instance (guint    n_items,
+                                  gboolean repeated)
+{
+	JsonParser *parser = NULL;  /* owned */
+	JsonNode *node = NULL;  /* owned */
+	GString *str = NULL;  /* owned */
+	guint i;
+	GError *error = NULL;
+
+	str = g_string_new ("[");
+
+	for (i = 0; i < n_items; i++) {
+		g_string_append_printf (str,
+		                        "%s{\"id\": %u, \"name\": \"item\", "
+		                        "\"tags\": [\"a\", \"b\", \"c\"]}",
+		                        (i > 0) ? ", " : "",
+		                        repeated ? 0 : i);
+	}
+
+	g_string_append (str, "]");
+
+	parser = json_parser_new ();
+	json_parser_load_from_data (parser, str->str, str->len, &error);
+	g_assert_no_error (error);
+	node = json_node_copy (json_parser_get_root (parser));
+
+	g_object_unref (parser);
+	g_string_free (str, TRUE);
+
+	return node;
+}
+
+/* Compare the time taken to apply a schema to instances with and without
+ * repeated subtrees, with and without memoising subtree verdicts. This is only
+ * added in perf mode (`-m perf`). */
+static void
+test_schema_application_repeated_subtrees_perf (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	guint i, j, k;
+	const guint n_iterations = 20;
+	GError *error = NULL;
+
+	const gboolean repeated[] = { TRUE, FALSE };
+
+	schema = wbl_schema_new ();
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"items\": {"
+				"\"type\": \"object\","
+				"\"properties\": {"
+					"\"id\": {\"type\": \"integer\", \"minimum\": 0},"
+					"\"name\": {\"type\": \"string\", \"maxLength\": 16},"
+					"\"tags\": {"
+						"\"type\": \"array\","
+						"\"items\": {\"enum\": [\"a\", \"b\", \"c\"]},"
+						"\"uniqueItems\": true"
+					"}"
+				"},"
+				"\"required\": [\"id\", \"name\"]"
+			"}"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	for (i = 0; i < G_N_ELEMENTS (repeated); i++) {
+		JsonNode *instance = NULL;  /* owned */
+		gdouble times[2];
+
+		instance = build_subtree_benchmark_instance (5000, repeated[i]);
+
+		for (j = 0; j < G_N_ELEMENTS (times); j++) {
+			wbl_schema_set_memoise_subtrees (schema, (j > 0));
+
+			g_test_timer_start ();
+
+			for (k = 0; k < n_iterations; k++) {
+				GPtrArray/*<owned GError>*/ *verdicts = NULL;  /* owned */
+
+				verdicts = wbl_schema_apply_batch (schema,
+				                                   &instance, 1);
+				g_assert_no_error (verdicts->pdata[0]);
+				g_ptr_array_unref (verdicts);
+			}
+
+			times[j] = g_test_timer_elapsed () / n_iterations;
+		}
+
+		g_test_message ("%s subtrees: %.2f ms without memoising, "
+		                "%.2f ms with", repeated[i] ? "Repeated" : "Distinct",
+		                times[0] * 1000.0, times[1] * 1000.0);
+		g_test_minimized_result (times[1] / times[0],
+		                         "Apply time with memoising relative to "
+		                         "without, %s subtrees: %.2f",
+		                         repeated[i] ? "repeated" : "distinct",
+		                         times[1] / times[0]);
+
+		json_node_free (instance);
+	}
+
+	g_object_unref (schema);
+}
+
+/* Test that cached verdicts are the same as uncached ones, and that the cache
+ * is cleared when anything which affects verdicts changes. */
+static void
+test_schema_application_verdict_cache (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	JsonNode *nodes[3];
+	guint i, j;
+	GError *error = NULL;
+
+	const gchar *instances[] = {
+		"{\"a\": 1}",
+		"{\"a\": \"x\"}",
+		"{\"a\": \"1.2.3.4\"}",
+	};
+
+	parser = json_parser_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (instances); i++) {
+		json_parser_load_from_data (parser, instances[i], -1, &error);
+		g_assert_no_error (error);
+		nodes[i] = json_node_copy (json_parser_get_root (parser));
+	}
+
+	g_object_unref (parser);
+
+	schema = wbl_schema_new ();
+	g_assert_cmpuint (wbl_schema_get_verdict_cache_size (schema), ==, 0);
+
+	wbl_schema_set_verdict_cache_size (schema, 2);
+	g_assert_cmpuint (wbl_schema_get_verdict_cache_size (schema), ==, 2);
+
+	wbl_schema_load_from_data (schema,
+	                           "{\"properties\": {\"a\": {\"type\": \"integer\"}}}",
+	                           -1, &error);
+	g_assert_no_error (error);
+
+	/* Apply each instance several times, so that some verdicts are
+	 * evicted and recalculated. */
+	for (j = 0; j < 3; j++) {
+		for (i = 0; i < G_N_ELEMENTS (nodes); i++) {
+			wbl_schema_apply (schema, nodes[i], &error);
+
+			if (i == 0) {
+				g_assert_no_error (error);
+			} else {
+				g_assert_error (error, WBL_SCHEMA_ERROR,
+				                WBL_SCHEMA_ERROR_INVALID);
+				g_clear_error (&error);
+			}
+
+			wbl_schema_apply_data (schema, instances[i], -1, &error);
+
+			if (i == 0) {
+				g_assert_no_error (error);
+			} else {
+				g_assert_error (error, WBL_SCHEMA_ERROR,
+				                WBL_SCHEMA_ERROR_INVALID);
+				g_clear_error (&error);
+			}
+		}
+
+		/* Parse errors are cached too. */
+		wbl_schema_apply_data (schema, "{\"a\": ", -1, &error);
+		g_assert_error (error, JSON_PARSER_ERROR, JSON_PARSER_ERROR_PARSE);
+		g_clear_error (&error);
+	}
+
+	/* Loading a new schema clears the cache. */
+	wbl_schema_load_from_data (schema,
+	                           "{\"properties\": {\"a\": {\"type\": \"string\", "
+	                           "\"format\": \"ipv4\"}}}",
+	                           -1, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply (schema, nodes[0], &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_clear_error (&error);
+	wbl_schema_apply (schema, nodes[1], &error);
+	g_assert_no_error (error);
+	wbl_schema_apply_data (schema, instances[1], -1, &error);
+	g_assert_no_error (error);
+
+	/* As does checking formats. */
+	wbl_schema_set_check_formats (schema, TRUE);
+
+	wbl_schema_apply (schema, nodes[1], &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_clear_error (&error);
+	wbl_schema_apply_data (schema, instances[1], -1, &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_clear_error (&error);
+	wbl_schema_apply (schema, nodes[2], &error);
+	g_assert_no_error (error);
+
+	/* Disabling the cache. */
+	wbl_schema_set_verdict_cache_size (schema, 0);
+	g_assert_cmpuint (wbl_schema_get_verdict_cache_size (schema), ==, 0);
+
+	wbl_schema_apply (schema, nodes[2], &error);
+	g_assert_no_error (error);
+
+	for (i = 0; i < G_N_ELEMENTS (nodes); i++) {
+		json_node_free (nodes[i]);
+	}
+
+	g_object_unref (schema);
+}
+
+/* Test applying a schema to an instance using items and additionalItems.
+ * Taken from draft-fge-json-schema-validation-00§5.3.1.3. */
+static void
+test_schema_application (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	guint i;
+	GError *error = NULL;
+
+	const gchar *valid_cases[] = {
+		"[]",
+		"[ [ 1, 2, 3, 4 ], [ 5, 6, 7, 8 ] ]",
+		"[ 1, 2, 3 ]",
+	};
+
+	const gchar *invalid_cases[] = {
+		"[ 1, 2, 3, 4 ]",
+		"[ null, { \"a\": \"b\" }, true, 31.000002020013 ]",
+	};
+
+	schema = wbl_schema_new ();
+	parser = json_parser_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"items\": [ {}, {}, {} ],"
+			"\"additionalItems\": false"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	/* Valid cases. */
+	for (i = 0; i < G_N_ELEMENTS (valid_cases); i++) {
+		json_parser_load_from_data (parser, valid_cases[i], -1, &error);
+		g_assert_no_error (error);
+
+		wbl_schema_apply (schema,
+		                  json_parser_get_root (parser), &error);
+		g_assert_no_error (error);
+	}
+
+	/* Invalid cases. */
+	for (i = 0; i < G_N_ELEMENTS (invalid_cases); i++) {
+		json_parser_load_from_data (parser,
+		                            invalid_cases[i], -1, &error);
+		g_assert_no_error (error);
+
+		wbl_schema_apply (schema,
+		                  json_parser_get_root (parser), &error);
+		g_assert_error (error,
+		                WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+		g_clear_error (&error);
+	}
+
+	g_object_unref (parser);
+	g_object_unref (schema);
+}
+
+static void
+async_result_cb (GObject      *source_object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+	GAsyncResult **result_out = user_data;
+
+	*result_out = g_object_ref (result);
+}
+
+static GAsyncResult *
+wait_for_result (GAsyncResult **result)
+{
+	while (*result == NULL) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	return *result;
+}
+
+/* Test applying a schema asynchronously, singly and in batches. */
+static void
+test_schema_application_async (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	JsonNode *instances[4];
+	GPtrArray/*<owned nullable GError>*/ *verdicts = NULL;  /* owned */
+	GAsyncResult *result = NULL;  /* owned */
+	GCancellable *cancellable = NULL;  /* owned */
+	guint i;
+	GError *error = NULL;
+
+	const gchar *cases[] = {
+		"[ 1, 2, 3 ]",
+		"[ 1, 2, 3, 4 ]",
+		"[]",
+		"[ null, { \"a\": \"b\" }, true, 31.000002020013 ]",
+	};
+
+	G_STATIC_ASSERT (G_N_ELEMENTS (cases) == G_N_ELEMENTS (instances));
+
+	schema = wbl_schema_new ();
+	parser = json_parser_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"items\": [ {}, {}, {} ],"
+			"\"additionalItems\": false"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+		json_parser_load_from_data (parser, cases[i], -1, &error);
+		g_assert_no_error (error);
+		instances[i] = json_node_copy (json_parser_get_root (parser));
+	}
+
+	/* Single valid and invalid instances. */
+	wbl_schema_apply_async (schema, instances[0], NULL, async_result_cb,
+	                        &result);
+	wbl_schema_apply_finish (schema, wait_for_result (&result), &error);
+	g_assert_no_error (error);
+	g_clear_object (&result);
+
+	wbl_schema_apply_async (schema, instances[1], NULL, async_result_cb,
+	                        &result);
+	wbl_schema_apply_finish (schema, wait_for_result (&result), &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_clear_error (&error);
+	g_clear_object (&result);
+
+	/* A batch, with the verdicts in order. */
+	wbl_schema_apply_batch_async (schema, instances,
+	                              G_N_ELEMENTS (instances), NULL,
+	                              async_result_cb, &result);
+	verdicts = wbl_schema_apply_batch_finish (schema,
+	                                          wait_for_result (&result),
+	                                          &error);
+	g_assert_no_error (error);
+	g_clear_object (&result);
+
+	g_assert_cmpuint (verdicts->len, ==, G_N_ELEMENTS (instances));
+	g_assert_no_error (verdicts->pdata[0]);
+	g_assert_error (verdicts->pdata[1],
+	                WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_assert_no_error (verdicts->pdata[2]);
+	g_assert_error (verdicts->pdata[3],
+	                WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_ptr_array_unref (verdicts);
+
+	/* Cancellation. */
+	cancellable = g_cancellable_new ();
+	g_cancellable_cancel (cancellable);
+
+	wbl_schema_apply_batch_async (schema, instances,
+	                              G_N_ELEMENTS (instances), cancellable,
+	                              async_result_cb, &result);
+	verdicts = wbl_schema_apply_batch_finish (schema,
+	                                          wait_for_result (&result),
+	                                          &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert (verdicts == NULL);
+	g_clear_error (&error);
+	g_clear_object (&result);
+	g_object_unref (cancellable);
+
+	/* The worker threads may not have dropped their references yet. */
+	for (i = 0; i < G_N_ELEMENTS (instances); i++) {
+		json_node_unref (instances[i]);
+	}
+
+	g_object_unref (parser);
+	g_object_unref (schema);
+}
+
+/* Test that reloading a lazily validated schema while an asynchronous apply
+ * is pending does not affect it: the apply uses the old schema, and its lazy
+ * verdicts, and the new schema starts with none. */
+static void
+test_schema_application_async_reload (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	JsonNode *instance = NULL;  /* owned */
+	GAsyncResult *result = NULL;  /* owned */
+	GError *error = NULL;
+
+	schema = wbl_schema_new ();
+	parser = json_parser_new ();
+
+	json_parser_load_from_data (parser, "{ \"a\": 1 }", -1, &error);
+	g_assert_no_error (error);
+	instance = json_node_copy (json_parser_get_root (parser));
+
+	wbl_schema_set_load_mode (schema, WBL_SCHEMA_LOAD_MODE_LAZY);
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"properties\": {"
+				"\"a\": {\"minimum\": \"x\"}"
+			"}"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply_async (schema, instance, NULL, async_result_cb,
+	                        &result);
+
+	/* Reload before the result is collected; the worker may or may not
+	 * have run yet. */
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"properties\": {"
+				"\"a\": {\"minimum\": 0}"
+			"}"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply_finish (schema, wait_for_result (&result), &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+	g_clear_object (&result);
+
+	wbl_schema_apply (schema, instance, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply_async (schema, instance, NULL, async_result_cb,
+	                        &result);
+	wbl_schema_apply_finish (schema, wait_for_result (&result), &error);
+	g_assert_no_error (error);
+	g_clear_object (&result);
+
+	json_node_unref (instance);
+	g_object_unref (parser);
+	g_object_unref (schema);
+}
+
+/* Test that applying a schema to a batch of instances gives the same verdicts
+ * as applying it to each of them in turn. */
+static void
+test_schema_application_batch (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	JsonNode *instances[10];
+	GPtrArray/*<owned nullable GError>*/ *verdicts = NULL;  /* owned */
+	guint i;
+	GError *error = NULL;
+
+	const struct {
+		const gchar *json;
+		gboolean is_valid;
+	} cases[] = {
+		{ "5", TRUE },
+		{ "10", FALSE },
+		{ "-3.5", FALSE },
+		{ "-3", TRUE },
+		{ "9.99", TRUE },
+		{ "\"abc\"", TRUE },
+		{ "\"a\"", FALSE },
+		{ "\"abcde\"", FALSE },
+		{ "{ \"a\": \"b\" }", FALSE },
+		{ "null", FALSE },
+	};
+
+	G_STATIC_ASSERT (G_N_ELEMENTS (cases) == G_N_ELEMENTS (instances));
+
+	schema = wbl_schema_new ();
+	parser = json_parser_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"type\": [ \"number\", \"string\", \"object\" ],"
+			"\"maximum\": 10,"
+			"\"exclusiveMaximum\": true,"
+			"\"minimum\": -3,"
+			"\"maxLength\": 4,"
+			"\"minLength\": 2,"
+			"\"properties\": { \"a\": { \"type\": \"integer\" } }"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+		json_parser_load_from_data (parser, cases[i].json, -1, &error);
+		g_assert_no_error (error);
+		instances[i] = json_node_copy (json_parser_get_root (parser));
+	}
+
+	verdicts = wbl_schema_apply_batch (schema, instances,
+	                                   G_N_ELEMENTS (instances));
+	g_assert_cmpuint (verdicts->len, ==, G_N_ELEMENTS (instances));
+
+	for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+		wbl_schema_apply (schema, instances[i], &error);
+
+		if (cases[i].is_valid) {
+			g_assert_no_error (error);
+			g_assert_no_error (verdicts->pdata[i]);
+		} else {
+			g_assert_error (error,
+			                WBL_SCHEMA_ERROR,
+			                WBL_SCHEMA_ERROR_INVALID);
+			g_assert_error (verdicts->pdata[i],
+			                WBL_SCHEMA_ERROR,
+			                WBL_SCHEMA_ERROR_INVALID);
+			g_clear_error (&error);
+		}
+	}
+
+	g_ptr_array_unref (verdicts);
+
+	/* An empty batch. */
+	verdicts = wbl_schema_apply_batch (schema, NULL, 0);
+	g_assert_cmpuint (verdicts->len, ==, 0);
+	g_ptr_array_unref (verdicts);
+
+	for (i = 0; i < G_N_ELEMENTS (instances); i++) {
+		json_node_free (instances[i]);
+	}
+
+	g_object_unref (parser);
+	g_object_unref (schema);
+}
+
+/* Test that applying a schema to serialised instances gives the same verdicts
+ * as parsing them with #JsonParser and applying it to the result, and that
+ * malformed instances are rejected. */
+static void
+test_schema_application_data (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstance>*/ *instances = NULL;  /* owned */
+	guint i;
+	GError *error = NULL;
+
+	const gchar *malformed[] = {
+		"",
+		"  ",
+		"☠",
+		"[1,]",
+		"{ \"a\" 1 }",
+		"{ \"a\": 1, }",
+		"[1 2]",
+		"01",
+		"1.",
+		"tru",
+		"\"abc",
+		"\"a\\qb\"",
+		"[1] 2",
+		"{ \"length\": 1",
+	};
+
+	schema = wbl_schema_new ();
+	parser = json_parser_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"type\": \"array\","
+			"\"items\": {"
+				"\"type\": \"object\","
+				"\"properties\": {"
+					"\"name\": { \"type\": \"string\", \"maxLength\": 3 },"
+					"\"price\": { \"type\": \"number\", \"minimum\": 0 },"
+					"\"tags\": {"
+						"\"type\": \"array\","
+						"\"items\": { \"enum\": [ \"a\", \"b\\n\", 1.5 ] },"
+						"\"uniqueItems\": true"
+					"}"
+				"},"
+				"\"required\": [ \"name\" ]"
+			"}"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	g_assert_cmpuint (instances->len, >, 0);
+
+	for (i = 0; i < instances->len; i++) {
+		const gchar *json;
+		gboolean expected_is_valid;
+
+		json = wbl_generated_instance_get_json (instances->pdata[i]);
+		g_test_message ("Instance: %s", json);
+
+		json_parser_load_from_data (parser, json, -1, &error);
+		g_assert_no_error (error);
+
+		wbl_schema_apply (schema, json_parser_get_root (parser),
+		                  &error);
+		expected_is_valid = (error == NULL);
+		g_clear_error (&error);
+
+		wbl_schema_apply_data (schema, json, -1, &error);
+
+		if (expected_is_valid) {
+			g_assert_no_error (error);
+		} else {
+			g_assert_error (error,
+			                WBL_SCHEMA_ERROR,
+			                WBL_SCHEMA_ERROR_INVALID);
+			g_clear_error (&error);
+		}
+	}
+
+	g_ptr_array_unref (instances);
+
+	/* Escapes and non-ASCII characters in strings, and whitespace. */
+	wbl_schema_apply_data (schema,
+	                       " [ { \"name\" : \"\\u00e9t\\u00E9\" ,"
+	                       "\"tags\":[\"b\\n\", 1.5e0, \"\\u0061\"] },"
+	                       "\n{\"n\\u0061me\":\"\xf0\x9f\x98\x80\"}\t] ",
+	                       -1, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply_data (schema, "[{ \"name\": \"\\\"\\\\\\/x\" }]",
+	                       -1, &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_clear_error (&error);
+
+	/* Explicit lengths. */
+	wbl_schema_apply_data (schema, "[][", 2, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply_data (schema, "[]", 1, &error);
+	g_assert_error (error, JSON_PARSER_ERROR, JSON_PARSER_ERROR_PARSE);
+	g_clear_error (&error);
+
+	for (i = 0; i < G_N_ELEMENTS (malformed); i++) {
+		g_test_message ("Malformed instance: %s", malformed[i]);
+
+		wbl_schema_apply_data (schema, malformed[i], -1, &error);
+		g_assert (error != NULL);
+		g_assert (error->domain == JSON_PARSER_ERROR);
+		g_clear_error (&error);
+	}
+
+	g_object_unref (parser);
+	g_object_unref (schema);
+}
+
+/* Test that applying a schema to serialised instances only decodes the parts
+ * the schema can examine, without changing any verdicts: skipped values must
+ * still be checked for errors, and subschemas which are reached must still be
+ * validated in lazy mode. */
+static void
+test_schema_application_data_filtered (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	guint i, j;
+	GError *error = NULL;
+
+	const gchar *schemas[] = {
+		/* Only a few members are constrained. */
+		"{"
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"id\": {\"type\": \"integer\", \"minimum\": 0},"
+				"\"nested\": {"
+					"\"properties\": {\"inner\": {\"type\": \"string\"}},"
+					"\"additionalProperties\": false"
+				"},"
+				"\"list\": {\"items\": {\"type\": \"integer\"}},"
+				"\"tuple\": {"
+					"\"items\": [{\"type\": \"string\"}],"
+					"\"additionalItems\": false,"
+					"\"minItems\": 1"
+				"},"
+				"\"whole\": {\"enum\": [[1, \"a\"], {\"b\": null}]}"
+			"},"
+			"\"required\": [\"id\"],"
+			"\"dependencies\": {\"list\": [\"tuple\"]},"
+			"\"maxProperties\": 4"
+		"}",
+		/* The schema for unnamed members is an object. */
+		"{"
+			"\"properties\": {\"id\": {}},"
+			"\"additionalProperties\": {"
+				"\"properties\": {\"deep\": {\"type\": \"array\"}}"
+			"}"
+		"}",
+		/* Everything has to be decoded. */
+		"{"
+			"\"properties\": {\"id\": {\"type\": \"integer\"}},"
+			"\"patternProperties\": {\"^o\": {\"type\": \"object\"}}"
+		"}",
+		"{\"uniqueItems\": true}",
+		"{}",
+	};
+	const gchar *instances[] = {
+		"{\"id\": 1}",
+		"{\"id\": -1}",
+		"{\"id\": 1.5}",
+		"{\"other\": 5}",
+		"{\"id\": 1, \"other\": {\"deep\": [1, 2, \"x\"]}, \"more\": \"t\"}",
+		"{\"id\": 1, \"other\": {\"deep\": 5}}",
+		"{\"id\": 1, \"other\": 5, \"more\": null, \"most\": [], \"x\": 1}",
+		"{\"id\": 1, \"nested\": {\"inner\": 5}}",
+		"{\"id\": 1, \"nested\": {\"inner\": \"s\", \"extra\": [1]}}",
+		"{\"id\": 1, \"list\": [1, 2, \"x\"], \"tuple\": [\"a\"]}",
+		"{\"id\": 1, \"list\": [1, 2, 3], \"tuple\": [\"a\"]}",
+		"{\"id\": 1, \"list\": [1, 2, 3]}",
+		"{\"id\": 1, \"tuple\": [\"a\", {\"b\": 1}]}",
+		"{\"id\": 1, \"tuple\": [1]}",
+		"{\"id\": 1, \"tuple\": []}",
+		"{\"id\": 1, \"whole\": [1, \"a\"]}",
+		"{\"id\": 1, \"whole\": {\"b\": null}}",
+		"{\"id\": 1, \"whole\": {\"b\": 0}}",
+		"[{\"id\": 1}, {\"id\": 1}]",
+		"[{\"id\": 1}, {\"id\": 2}]",
+		"\"not an object\"",
+	};
+	const gchar *malformed[] = {
+		"{\"id\": 1, \"other\": tru}",
+		"{\"id\": 1, \"other\": \"\\u0000\"}",
+		"{\"id\": 1, \"other\": \"\\q\"}",
+		"{\"id\": 1, \"other\": [1,]}",
+		"{\"id\": 1, \"other\": {\"a\" 1}}",
+		"{\"id\": 1, \"nested\": {\"skipped\": 01}}",
+		"{\"id\": 1, \"tuple\": [\"a\", \"\xff\"]}",
+	};
+
+	schema = wbl_schema_new ();
+	parser = json_parser_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (schemas); i++) {
+		wbl_schema_load_from_data (schema, schemas[i], -1, &error);
+		g_assert_no_error (error);
+
+		for (j = 0; j < G_N_ELEMENTS (instances); j++) {
+			gboolean expected_is_valid;
+
+			g_test_message ("Schema %u, instance: %s", i,
+			                instances[j]);
+
+			json_parser_load_from_data (parser, instances[j], -1,
+			                            &error);
+			g_assert_no_error (error);
+
+			wbl_schema_apply (schema, json_parser_get_root (parser),
+			                  &error);
+			expected_is_valid = (error == NULL);
+			g_clear_error (&error);
+
+			wbl_schema_apply_data (schema, instances[j], -1,
+			                       &error);
+
+			if (expected_is_valid) {
+				g_assert_no_error (error);
+			} else {
+				g_assert_error (error,
+				                WBL_SCHEMA_ERROR,
+				                WBL_SCHEMA_ERROR_INVALID);
+				g_clear_error (&error);
+			}
+		}
+
+		for (j = 0; j < G_N_ELEMENTS (malformed); j++) {
+			g_test_message ("Schema %u, malformed instance: %s", i,
+			                malformed[j]);
+
+			wbl_schema_apply_data (schema, malformed[j], -1,
+			                       &error);
+			g_assert (error != NULL);
+			g_assert (error->domain == JSON_PARSER_ERROR);
+			g_clear_error (&error);
+		}
+	}
+
+	/* An invalid subschema is still reported when the member it applies
+	 * to is present, even though the other members are skipped. */
+	wbl_schema_set_load_mode (schema, WBL_SCHEMA_LOAD_MODE_LAZY);
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"properties\": {"
+				"\"a\": {\"type\": \"integer\"},"
+				"\"b\": {\"minimum\": \"x\"}"
+			"}"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply_data (schema, "{\"a\": 1, \"c\": [\"x\"]}", -1,
+	                       &error);
+	g_assert_no_error (error);
+
+	wbl_schema_apply_data (schema, "{\"a\": 1, \"b\": {\"c\": 1}}", -1,
+	                       &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+
+	g_object_unref (parser);
+	g_object_unref (schema);
+}
+
+/* Build an array of @n_objects objects, of which a schema might only look at
+ * the `id` member, for benchmarking. */
+static gchar *
+build_apply_data_benchmark_document (guint n_objects)
+{
+	GString *str = NULL;  /* owned */
+	guint i;
+
+	str = g_string_new ("[");
+
+	for (i = 0; i < n_objects; i++) {
+		g_string_append_printf (str,
+		                        "%s{\"id\": %u, \"name\": \"item %u\", "
+		                        "\"price\": %u.25, \"in_stock\": %s, "
+		                        "\"tags\": [\"a\", \"b\\n\", null], "
+		                        "\"notes\": \"caf\\u00e9 \\\"quoted\\\"\", "
+		                        "\"size\": {\"w\": 1.5, \"h\": 2e1}}",
+		                        (i > 0) ? ", " : "", i, i, i,
+		                        (i % 2 == 0) ? "true" : "false");
+	}
+
+	g_string_append (str, "]");
+
+	return g_string_free (str, FALSE);
+}
+
+/* Compare the time taken to apply a schema which only looks at one member of
+ * each object to a large serialised document: by parsing it with #JsonParser
+ * and applying the schema to the result; with wbl_schema_apply_data() when it
+ * has to decode everything (because of the `allOf`); and with
+ * wbl_schema_apply_data() when it can skip the members the schema cannot
+ * examine. This is only added in perf mode (`-m perf`). */
+static void
+test_schema_application_data_perf (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	gchar *data = NULL;  /* owned */
+	gsize length;
+	gdouble times[3];
+	guint i, j;
+	const guint n_iterations = 20;
+	GError *error = NULL;
+
+	const gchar *schemas[] = {
+		"{"
+			"\"items\": {"
+				"\"allOf\": [{"
+					"\"properties\": {"
+						"\"id\": {\"type\": \"integer\", \"minimum\": 0}"
+					"},"
+					"\"required\": [\"id\"]"
+				"}]"
+			"}"
+		"}",
+		"{"
+			"\"items\": {"
+				"\"properties\": {"
+					"\"id\": {\"type\": \"integer\", \"minimum\": 0}"
+				"},"
+				"\"required\": [\"id\"]"
+			"}"
+		"}",
+	};
+
+	data = build_apply_data_benchmark_document (20000);
+	length = strlen (data);
+	parser = json_parser_new ();
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema, schemas[1], -1, &error);
+	g_assert_no_error (error);
+
+	g_test_timer_start ();
+
+	for (i = 0; i < n_iterations; i++) {
+		json_parser_load_from_data (parser, data, length, &error);
+		g_assert_no_error (error);
+
+		wbl_schema_apply (schema, json_parser_get_root (parser),
+		                  &error);
+		g_assert_no_error (error);
+	}
+
+	times[0] = g_test_timer_elapsed () / n_iterations;
+
+	for (j = 0; j < G_N_ELEMENTS (schemas); j++) {
+		wbl_schema_load_from_data (schema, schemas[j], -1, &error);
+		g_assert_no_error (error);
+
+		g_test_timer_start ();
+
+		for (i = 0; i < n_iterations; i++) {
+			wbl_schema_apply_data (schema, data, length, &error);
+			g_assert_no_error (error);
+		}
+
+		times[j + 1] = g_test_timer_elapsed () / n_iterations;
+	}
+
+	g_test_message ("Applying to %" G_GSIZE_FORMAT " bytes: JsonParser "
+	                "%.2f ms, decoding everything %.2f ms, decoding only "
+	                "what is examined %.2f ms", length, times[0] * 1000.0,
+	                times[1] * 1000.0, times[2] * 1000.0);
+	g_test_minimized_result (times[2] / times[1],
+	                         "Apply data time when skipping unexamined "
+	                         "values relative to decoding everything: %.2f",
+	                         times[2] / times[1]);
+	g_test_minimized_result (times[2] / times[0],
+	                         "Apply data time when skipping unexamined "
+	                         "values relative to JsonParser: %.2f",
+	                         times[2] / times[0]);
+
+	g_object_unref (schema);
+	g_object_unref (parser);
+	g_free (data);
+}
+
+/* Test generating instances for a simple schema. */
+static void
+test_schema_instance_generation_simple (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GError *error = NULL;
+
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"title\": \"Example Schema\","
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"firstName\": {"
+					"\"type\": \"string\""
+				"},"
+				"\"lastName\": {"
+					"\"type\": \"string\""
+				"},"
+				"\"age\": {"
+					"\"description\": \"Age in years\","
+					"\"type\": \"integer\","
+					"\"minimum\": 0"
+				"}"
+			"},"
+			"\"required\": [\"firstName\", \"lastName\"]"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	wbl_test_assert_generated_instances_match_file (instances,
+	                                                "schema-instance-generation-simple.json");
+	g_ptr_array_unref (instances);
+
+	g_object_unref (schema);
+}
+
+/* Test generating instances for a complex schema. */
+static void
+test_schema_instance_generation_complex (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GError *error = NULL;
+
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"$schema\": \"http://json-schema.org/draft-04/schema#\","
+			"\"title\": \"Product set\","
+			"\"type\": \"array\","
+			"\"items\": {"
+				"\"title\": \"Product\","
+				"\"type\": \"object\","
+				"\"properties\": {"
+					"\"id\": {"
+						"\"description\": \"The unique identifier for a product\","
+						"\"type\": \"number\""
+					"},"
+					"\"name\": {"
+						"\"type\": \"string\""
+					"},"
+					"\"price\": {"
+						"\"type\": \"number\","
+						"\"minimum\": 0,"
+						"\"exclusiveMinimum\": true"
+					"},"
+					"\"tags\": {"
+						"\"type\": \"array\","
+						"\"items\": {"
+							"\"type\": \"string\""
+						"},"
+						"\"minItems\": 1,"
+						"\"uniqueItems\": true"
+					"},"
+					"\"dimensions\": {"
+						"\"type\": \"object\","
+						"\"properties\": {"
+							"\"length\": {\"type\": \"number\"},"
+							"\"width\": {\"type\": \"number\"},"
+							"\"height\": {\"type\": \"number\"}"
+						"},"
+						"\"required\": [\"length\", \"width\", \"height\"]"
+					"},"
+					"\"warehouseLocation\": {"
+						"\"description\": \"Coordinates of the warehouse with the product\","
+						"\"$ref\": \"http://json-schema.org/geo\""
+					"}"
+				"},"
+				"\"required\": [\"id\", \"name\", \"price\"]"
+			"}"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	wbl_test_assert_generated_instances_match_file (instances,
+	                                                "schema-instance-generation-complex.json");
+	g_ptr_array_unref (instances);
+
+	g_object_unref (schema);
+}
+
+/* Test generating instances for the JSON Schema meta-schema.
+ * http://json-schema.org/schema */
+static void
+test_schema_instance_generation_schema (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GError *error = NULL;
+
+	/* FIXME: This needs a lot of mollycoddling to get it doing the right
+	 * thing. */
+	schema = wbl_meta_schema_load_schema (WBL_META_SCHEMA_META_SCHEMA,
+	                                      &error);
+	g_assert_no_error (error);
+
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	wbl_test_assert_generated_instances_match_file (instances,
+	                                                "schema-instance-generation-schema.json");
+	g_ptr_array_unref (instances);
+
+	g_object_unref (schema);
+}
+
+/* Test generating instances for the JSON Hyper Schema meta-schema.
+ * http://json-schema.org/hyper-schema */
+static void
+test_schema_instance_generation_hyper_schema (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GError *error = NULL;
+
+	/* FIXME: This needs a lot of mollycoddling to get it doing the right
+	 * thing. */
+	schema = wbl_meta_schema_load_schema (WBL_META_SCHEMA_HYPER_META_SCHEMA,
+	                                      &error);
+	g_assert_no_error (error);
+
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	wbl_test_assert_generated_instances_match_file (instances,
+	                                                "schema-instance-generation-hyper-schema.json");
+	g_ptr_array_unref (instances);
+
+	g_object_unref (schema);
+}
+
+/* Test that allocation estimation produces estimates for each subschema,
+ * and does not affect the generated instances. */
+static void
+test_schema_instance_generation_allocations (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GPtrArray/*<owned WblSchemaInfo>*/ *infos = NULL;  /* owned */
+	guint root_id;
+	gboolean found_root = FALSE;
+	guint i;
+	GError *error = NULL;
+
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"title\": \"Example Schema\","
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"firstName\": {"
+					"\"type\": \"string\""
+				"},"
+				"\"lastName\": {"
+					"\"type\": \"string\""
+				"},"
+				"\"age\": {"
+					"\"description\": \"Age in years\","
+					"\"type\": \"integer\","
+					"\"minimum\": 0"
+				"}"
+			"},"
+			"\"required\": [\"firstName\", \"lastName\"]"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_ESTIMATE_ALLOCATIONS);
+	wbl_test_assert_generated_instances_match_file (instances,
+	                                                "schema-instance-generation-simple.json");
+	g_ptr_array_unref (instances);
+
+	root_id = GPOINTER_TO_UINT (wbl_schema_node_get_root (wbl_schema_get_root (schema)));
+	infos = wbl_schema_get_schema_info (schema);
+	g_assert_cmpuint (infos->len, >, 1);
+
+	for (i = 0; i < infos->len; i++) {
+		WblSchemaInfo *info = infos->pdata[i];
+		guint64 n_nodes, n_objects, n_hash_tables, n_bytes, n_peak_bytes;
+		guint64 n_keyword_nodes, n_keyword_objects, n_keyword_hash_tables;
+		gchar **keywords = NULL;
+
+		g_assert (wbl_schema_info_get_allocation_estimates (info, NULL,
+		                                                    &n_nodes,
+		                                                    &n_objects,
+		                                                    NULL,
+		                                                    &n_hash_tables,
+		                                                    &n_bytes,
+		                                                    &n_peak_bytes));
+		g_assert_cmpuint (n_nodes, >=,
+		                  wbl_schema_info_get_n_instances_generated (info));
+		g_assert_cmpuint (n_hash_tables, >=, n_objects + 1);
+		g_assert_cmpuint (n_bytes, >, 0);
+		g_assert_cmpuint (n_peak_bytes, >, 0);
+		g_assert_cmpuint (n_peak_bytes, <=, n_bytes);
+
+		keywords = wbl_schema_info_dup_allocation_keywords (info);
+		g_assert (keywords[0] != NULL);
+		g_assert (wbl_schema_info_get_allocation_estimates (info,
+		                                                    keywords[0],
+		                                                    &n_keyword_nodes,
+		                                                    NULL, NULL,
+		                                                    NULL, NULL, NULL));
+		g_assert_cmpuint (n_keyword_nodes, <=, n_nodes);
+
+		/* The object instances of the root schema come from the
+		 * properties keywords. */
+		if (wbl_schema_info_get_id (info) == root_id) {
+			g_assert (g_strv_contains ((const gchar * const *) keywords,
+			                           "properties"));
+			g_assert_cmpuint (n_objects, >, 0);
+
+			/* The intermediate instance sets which the properties
+			 * generator combines are accounted to it, so there are
+			 * more hash tables than just those in its objects. */
+			g_assert (wbl_schema_info_get_allocation_estimates (info,
+			                                                    "properties",
+			                                                    NULL,
+			                                                    &n_keyword_objects,
+			                                                    NULL,
+			                                                    &n_keyword_hash_tables,
+			                                                    NULL, NULL));
+			g_assert_cmpuint (n_keyword_hash_tables, >=,
+			                  n_keyword_objects + 2);
+
+			found_root = TRUE;
+		}
+
+		g_assert (!wbl_schema_info_get_allocation_estimates (info,
+		                                                     "not-a-keyword",
+		                                                     &n_nodes, NULL,
+		                                                     NULL, NULL,
+		                                                     NULL, NULL));
+		g_assert_cmpuint (n_nodes, ==, 0);
+
+		g_strfreev (keywords);
+	}
+
+	g_assert (found_root);
+
+	g_ptr_array_unref (infos);
+	g_object_unref (schema);
+
+	/* Without the flag, no estimates should be recorded. */
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema, "{ \"type\": \"string\" }", -1,
+	                           &error);
+	g_assert_no_error (error);
+
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	g_ptr_array_unref (instances);
+
+	infos = wbl_schema_get_schema_info (schema);
+
+	for (i = 0; i < infos->len; i++) {
+		gchar **keywords = NULL;
+
+		g_assert (!wbl_schema_info_get_allocation_estimates (infos->pdata[i],
+		                                                     NULL, NULL,
+		                                                     NULL, NULL,
+		                                                     NULL, NULL, NULL));
+		keywords = wbl_schema_info_dup_allocation_keywords (infos->pdata[i]);
+		g_assert (keywords[0] == NULL);
+		g_strfreev (keywords);
+	}
+
+	g_ptr_array_unref (infos);
+	g_object_unref (schema);
+}
+
+/* Find the estimate for the subschema at @path in @estimates. */
+static WblSchemaEstimate *
+find_estimate (GPtrArray/*<owned WblSchemaEstimate>*/  *estimates,
+               const gchar                            *path)
+{
+	guint i;
+
+	for (i = 0; i < estimates->len; i++) {
+		WblSchemaEstimate *estimate = estimates->pdata[i];
+
+		if (g_strcmp0 (wbl_schema_estimate_get_path (estimate),
+		               path) == 0) {
+			return estimate;
+		}
+	}
+
+	return NULL;
+}
+
+/* Test that generation estimates cover each subschema, and flag the expensive
+ * ones without generating anything. */
+static void
+test_schema_instance_generation_estimate (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GPtrArray/*<owned WblSchemaInfo>*/ *infos = NULL;  /* owned */
+	GPtrArray/*<owned WblSchemaEstimate>*/ *estimates = NULL;  /* owned */
+	WblSchemaEstimate *root, *estimate;
+	guint64 total_cost;
+	guint i;
+	GError *error = NULL;
+
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"title\": \"Example Schema\","
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"firstName\": {"
+					"\"type\": \"string\""
+				"},"
+				"\"lastName\": {"
+					"\"type\": \"string\""
+				"},"
+				"\"age\": {"
+					"\"description\": \"Age in years\","
+					"\"type\": \"integer\","
+					"\"minimum\": 0"
+				"}"
+			"},"
+			"\"required\": [\"firstName\", \"lastName\"]"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	/* One estimate per subschema which is generated. */
+	estimates = wbl_schema_estimate_generation (schema);
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	infos = wbl_schema_get_schema_info (schema);
+	g_assert_cmpuint (estimates->len, ==, infos->len);
+
+	root = estimates->pdata[0];
+	g_assert_cmpstr (wbl_schema_estimate_get_path (root), ==, "$");
+	g_assert_cmpuint (wbl_schema_estimate_get_depth (root), ==, 0);
+	g_assert_cmpstr (wbl_schema_estimate_get_keyword (root), ==,
+	                 "properties");
+	g_assert_cmpuint (wbl_schema_estimate_get_n_instances (root), >, 0);
+
+	total_cost = 0;
+
+	for (i = 0; i < estimates->len; i++) {
+		estimate = estimates->pdata[i];
+
+		g_assert_cmpuint (wbl_schema_estimate_get_n_instances (estimate),
+		                  >, 0);
+		g_assert_cmpuint (wbl_schema_estimate_get_total_cost (estimate),
+		                  >=, wbl_schema_estimate_get_cost (estimate));
+		g_assert_cmpuint (wbl_schema_estimate_get_flags (estimate) &
+		                  ~WBL_SCHEMA_ESTIMATE_DOMINANT, ==,
+		                  WBL_SCHEMA_ESTIMATE_NONE);
+
+		/* Sorted by decreasing cost after the root. */
+		if (i > 1) {
+			g_assert_cmpuint (wbl_schema_estimate_get_cost (estimate),
+			                  <=,
+			                  wbl_schema_estimate_get_cost (estimates->pdata[i - 1]));
+		}
+
+		total_cost += wbl_schema_estimate_get_cost (estimate);
+	}
+
+	g_assert_cmpuint (wbl_schema_estimate_get_total_cost (root), ==,
+	                  total_cost);
+
+	estimate = find_estimate (estimates, "$['properties']['age']");
+	g_assert (estimate != NULL);
+	g_assert_cmpuint (wbl_schema_estimate_get_total_cost (estimate), ==,
+	                  wbl_schema_estimate_get_cost (estimate));
+
+	g_ptr_array_unref (infos);
+	g_ptr_array_unref (instances);
+	g_ptr_array_unref (estimates);
+	g_object_unref (schema);
+
+	/* A schema which would be infeasible to generate from. */
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"type\": \"array\","
+			"\"maxItems\": 9000000000000000000,"
+			"\"items\": {"
+				"\"type\": \"string\","
+				"\"maxLength\": 100000"
+			"},"
+			"\"anyOf\": [{"
+				"\"anyOf\": [{"
+					"\"anyOf\": [{"
+						"\"not\": { \"type\": \"null\" }"
+					"}]"
+				"}]"
+			"}],"
+			"\"additionalProperties\": {},"
+			"\"maxProperties\": 1000"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	estimates = wbl_schema_estimate_generation (schema);
+	g_assert_cmpuint (estimates->len, ==, 6);
+
+	root = estimates->pdata[0];
+	g_assert_cmpuint (wbl_schema_estimate_get_flags (root), ==,
+	                  WBL_SCHEMA_ESTIMATE_DOMINANT |
+	                  WBL_SCHEMA_ESTIMATE_LARGE_ARRAYS |
+	                  WBL_SCHEMA_ESTIMATE_MANY_PROPERTIES);
+	g_assert_cmpstr (wbl_schema_estimate_get_keyword (root), ==, "items");
+	g_assert_cmpuint (wbl_schema_estimate_get_total_cost (root), ==,
+	                  G_MAXUINT64);
+
+	estimate = find_estimate (estimates, "$['items']");
+	g_assert (estimate != NULL);
+	g_assert (wbl_schema_estimate_get_flags (estimate) &
+	          WBL_SCHEMA_ESTIMATE_LARGE_STRINGS);
+	g_assert_cmpstr (wbl_schema_estimate_get_keyword (estimate), ==,
+	                 "maxLength");
+
+	estimate = find_estimate (estimates,
+	                          "$['anyOf'][0]['anyOf'][0]['anyOf'][0]['not']");
+	g_assert (estimate != NULL);
+	g_assert_cmpuint (wbl_schema_estimate_get_depth (estimate), ==, 4);
+	g_assert (wbl_schema_estimate_get_flags (estimate) &
+	          WBL_SCHEMA_ESTIMATE_DEEP_NESTING);
+
+	estimate = find_estimate (estimates, "$['anyOf'][0]");
+	g_assert (estimate != NULL);
+	g_assert_cmpuint (wbl_schema_estimate_get_depth (estimate), ==, 1);
+	g_assert_cmpuint (wbl_schema_estimate_get_flags (estimate), ==,
+	                  WBL_SCHEMA_ESTIMATE_NONE);
+
+	g_ptr_array_unref (estimates);
+	g_object_unref (schema);
+}
+
+/* Get the number of instances generated for the root schema of @schema by the
+ * last call to generate instances. */
+static guint
+get_n_root_instances_generated (WblSchema *schema)
+{
+	GPtrArray/*<owned WblSchemaInfo>*/ *infos = NULL;  /* owned */
+	guint root_id, n_instances = 0;
+	guint i;
+
+	root_id = GPOINTER_TO_UINT (wbl_schema_node_get_root (wbl_schema_get_root (schema)));
+	infos = wbl_schema_get_schema_info (schema);
+
+	for (i = 0; i < infos->len; i++) {
+		if (wbl_schema_info_get_id (infos->pdata[i]) == root_id) {
+			n_instances = wbl_schema_info_get_n_instances_generated (infos->pdata[i]);
+		}
+	}
+
+	g_ptr_array_unref (infos);
+
+	return n_instances;
+}
+
+/* Test that sharded generation divides the work of generating the root schema
+ * between the shards, and that together they return the instances returned by
+ * wbl_schema_generate_instances(). */
+static void
+test_schema_instance_generation_sharded (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GHashTable/*<owned utf8, unowned utf8>*/ *unsharded = NULL;  /* owned */
+	GHashTable/*<owned utf8, unowned utf8>*/ *seen = NULL;  /* owned */
+	guint i, j, n_root_instances;
+	const guint n_shards = 3;
+	GError *error = NULL;
+
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"name\": {\"type\": \"string\", \"maxLength\": 5},"
+				"\"tags\": {"
+					"\"type\": \"array\","
+					"\"items\": {\"type\": \"integer\"},"
+					"\"maxItems\": 3"
+				"},"
+				"\"age\": {\"type\": \"integer\", \"minimum\": 0}"
+			"},"
+			"\"required\": [\"name\"]"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	/* Key each instance on its validity and JSON. */
+	unsharded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+	                                   NULL);
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_INVALID_JSON);
+
+	for (i = 0; i < instances->len; i++) {
+		WblGeneratedInstance *instance = instances->pdata[i];
+
+		g_hash_table_add (unsharded,
+		                  g_strdup_printf ("%u%s",
+		                                   wbl_generated_instance_is_valid (instance),
+		                                   wbl_generated_instance_get_json (instance)));
+	}
+
+	g_assert_cmpuint (g_hash_table_size (unsharded), >, n_shards);
+	g_ptr_array_unref (instances);
+
+	n_root_instances = get_n_root_instances_generated (schema);
+
+	/* Every instance should appear in at least one shard. Mutations of
+	 * instances from different shards may coincide, so an instance may
+	 * appear in more than one. */
+	seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	for (j = 0; j < n_shards; j++) {
+		instances = wbl_schema_generate_instances_sharded (schema,
+		                                                   WBL_GENERATE_INSTANCE_INVALID_JSON,
+		                                                   j, n_shards);
+
+		/* Each shard should only have generated part of the root
+		 * schema’s instances. */
+		g_assert_cmpuint (get_n_root_instances_generated (schema), <,
+		                  n_root_instances);
+
+		for (i = 0; i < instances->len; i++) {
+			WblGeneratedInstance *instance = instances->pdata[i];
+			gchar *key = NULL;
+
+			key = g_strdup_printf ("%u%s",
+			                       wbl_generated_instance_is_valid (instance),
+			                       wbl_generated_instance_get_json (instance));
+
+			g_assert (g_hash_table_contains (unsharded, key));
+			g_hash_table_add (seen, key);  /* transfer */
+
+			/* The invalid JSON instance is always in shard 0. */
+			if (g_strcmp0 (wbl_generated_instance_get_json (instance),
+			               "☠") == 0) {
+				g_assert_cmpuint (j, ==, 0);
+			}
+		}
+
+		g_ptr_array_unref (instances);
+	}
+
+	g_assert_cmpuint (g_hash_table_size (seen), ==,
+	                  g_hash_table_size (unsharded));
+
+	/* A single shard is the same as no sharding. */
+	instances = wbl_schema_generate_instances_sharded (schema,
+	                                                   WBL_GENERATE_INSTANCE_INVALID_JSON,
+	                                                   0, 1);
+	g_assert_cmpuint (instances->len, ==, g_hash_table_size (unsharded));
+	g_assert_cmpuint (get_n_root_instances_generated (schema), ==,
+	                  n_root_instances);
+	g_ptr_array_unref (instances);
+
+	g_hash_table_unref (seen);
+	g_hash_table_unref (unsharded);
+	g_object_unref (schema);
+}
+
+/* Count the valid instances generated for @schema with @flags, and record
+ * which of the properties named ‘pN’ are present in each of them in
+ * @present_sets (if non-%NULL), as a bitmask with bit N set for property pN. */
+static guint
+count_valid_object_instances (WblSchema                *schema,
+                              WblGenerateInstanceFlags  flags,
+                              GArray/*<guint64>*/      *present_sets)
+{
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	guint i, n_valid = 0;
+
+	parser = json_parser_new ();
+	instances = wbl_schema_generate_instances (schema, flags);
+
+	for (i = 0; i < instances->len; i++) {
+		WblGeneratedInstance *instance = instances->pdata[i];
+		JsonObject *obj;
+		JsonObjectIter iter;
+		const gchar *member_name;
+		guint64 present = 0;
+		GError *error = NULL;
+
+		if (!wbl_generated_instance_is_valid (instance)) {
+			continue;
+		}
+
+		n_valid++;
+
+		json_parser_load_from_data (parser,
+		                            wbl_generated_instance_get_json (instance),
+		                            -1, &error);
+		g_assert_no_error (error);
+
+		obj = json_node_get_object (json_parser_get_root (parser));
+		json_object_iter_init (&iter, obj);
+
+		while (json_object_iter_next (&iter, &member_name, NULL)) {
+			guint64 n;
+
+			g_assert (member_name[0] == 'p');
+			n = g_ascii_strtoull (member_name + 1, NULL, 10);
+			g_assert_cmpuint (n, <, 64);
+			present |= G_GUINT64_CONSTANT (1) << n;
+		}
+
+		if (present_sets != NULL) {
+			g_array_append_val (present_sets, present);
+		}
+	}
+
+	g_ptr_array_unref (instances);
+	g_object_unref (parser);
+
+	return n_valid;
+}
+
+/* Test that generating instances with
+ * %WBL_GENERATE_INSTANCE_PAIRWISE_PROPERTIES covers all four combinations of
+ * presence and absence for every pair of properties, using fewer instances
+ * than testing each property on its own. */
+static void
+test_schema_instance_generation_pairwise (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GString *schema_json = NULL;  /* owned */
+	GArray/*<guint64>*/ *present_sets = NULL;  /* owned */
+	guint i, j, k, n_pairwise, n_singletons;
+	const guint n_properties = 40;
+	GError *error = NULL;
+
+	/* Build an object schema with lots of integer properties. Additional
+	 * properties are disallowed so that the mutated instances are always
+	 * invalid. */
+	schema_json = g_string_new ("{\"type\": \"object\", \"properties\": {");
+
+	for (i = 0; i < n_properties; i++) {
+		g_string_append_printf (schema_json,
+		                        "%s\"p%u\": {\"type\": \"integer\"}",
+		                        (i > 0) ? "," : "", i);
+	}
+
+	g_string_append (schema_json, "}, \"additionalProperties\": false}");
+
+	schema = wbl_schema_new ();
+	wbl_schema_load_from_data (schema, schema_json->str, -1, &error);
+	g_assert_no_error (error);
+
+	present_sets = g_array_new (FALSE, FALSE, sizeof (guint64));
+	n_pairwise = count_valid_object_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_PAIRWISE_PROPERTIES,
+	                                           present_sets);
+
+	for (i = 0; i < n_properties; i++) {
+		for (j = i + 1; j < n_properties; j++) {
+			guint combinations = 0;
+
+			for (k = 0; k < present_sets->len; k++) {
+				guint64 present = g_array_index (present_sets,
+				                                 guint64, k);
+
+				combinations |= 1 << (((present >> i) & 1) << 1 |
+				                      ((present >> j) & 1));
+			}
+
+			g_assert_cmpuint (combinations, ==, 0xf);
+		}
+	}
+
+	/* Changing the flags should invalidate the instance cache. */
+	n_singletons = count_valid_object_instances (schema,
+	                                             WBL_GENERATE_INSTANCE_NONE,
+	                                             NULL);
+	g_assert_cmpuint (n_pairwise, <, n_singletons);
+
+	g_array_unref (present_sets);
+	g_string_free (schema_json, TRUE);
+	g_object_unref (schema);
+}
+
+/* Test that %WBL_GENERATE_INSTANCE_MINIMISE outputs a smaller subset of the
+ * instances, which still includes valid and invalid ones, and which is split
+ * between shards in the same way as the full set. */
+static void
+test_schema_instance_generation_minimise (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GHashTable/*<owned utf8, unowned utf8>*/ *full = NULL;  /* owned */
+	GHashTable/*<owned utf8, unowned utf8>*/ *minimised = NULL;  /* owned */
+	guint i, j, n_valid = 0, n_invalid = 0, n_sharded = 0;
+	const guint n_shards = 2;
+	GError *error = NULL;
+
+	schema = wbl_schema_new ();
+
+	wbl_schema_load_from_data (schema,
+		"{"
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"name\": {\"type\": \"string\", \"maxLength\": 5},"
+				"\"age\": {"
+					"\"type\": \"integer\","
+					"\"minimum\": 0,"
+					"\"maximum\": 150"
+				"}"
+			"},"
+			"\"required\": [\"name\"]"
+		"}", -1, &error);
+	g_assert_no_error (error);
+
+	/* Key each instance on its validity and JSON. */
+	full = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+
+	for (i = 0; i < instances->len; i++) {
+		WblGeneratedInstance *instance = instances->pdata[i];
+
+		g_hash_table_add (full,
+		                  g_strdup_printf ("%u%s",
+		                                   wbl_generated_instance_is_valid (instance),
+		                                   wbl_generated_instance_get_json (instance)));
+	}
+
+	g_ptr_array_unref (instances);
+
+	minimised = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+	                                   NULL);
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_MINIMISE);
+
+	for (i = 0; i < instances->len; i++) {
+		WblGeneratedInstance *instance = instances->pdata[i];
+		gchar *key = NULL;
+
+		key = g_strdup_printf ("%u%s",
+		                       wbl_generated_instance_is_valid (instance),
+		                       wbl_generated_instance_get_json (instance));
+		g_assert (g_hash_table_contains (full, key));
+		g_hash_table_add (minimised, key);  /* transfer */
+
+		if (wbl_generated_instance_is_valid (instance)) {
+			n_valid++;
+		} else {
+			n_invalid++;
+		}
+	}
+
+	g_ptr_array_unref (instances);
+
+	g_assert_cmpuint (g_hash_table_size (minimised), <,
+	                  g_hash_table_size (full));
+	g_assert_cmpuint (n_valid, >, 0);
+	g_assert_cmpuint (n_invalid, >, 0);
+
+	/* The shards partition the minimised instances. */
+	for (j = 0; j < n_shards; j++) {
+		instances = wbl_schema_generate_instances_sharded (schema,
+		                                                   WBL_GENERATE_INSTANCE_MINIMISE,
+		                                                   j, n_shards);
+
+		for (i = 0; i < instances->len; i++) {
+			WblGeneratedInstance *instance = instances->pdata[i];
+			gchar *key = NULL;
+
+			key = g_strdup_printf ("%u%s",
+			                       wbl_generated_instance_is_valid (instance),
+			                       wbl_generated_instance_get_json (instance));
+			g_assert (g_hash_table_contains (minimised, key));
+			g_free (key);
+		}
+
+		n_sharded += instances->len;
+		g_ptr_array_unref (instances);
+	}
+
+	g_assert_cmpuint (n_sharded, ==, g_hash_table_size (minimised));
+
+	g_hash_table_unref (minimised);
+	g_hash_table_unref (full);
+	g_object_unref (schema);
+}
+
+/* Get the nesting depth of arrays and objects in @node. */
+static guint
+node_get_depth (JsonNode *node)
+{
+	guint depth = 0, i;
+
+	if (JSON_NODE_HOLDS_ARRAY (node)) {
+		JsonArray *array = json_node_get_array (node);
+
+		for (i = 0; i < json_array_get_length (array); i++) {
+			depth = MAX (depth,
+			             node_get_depth (json_array_get_element (array, i)));
+		}
+
+		return depth + 1;
+	} else if (JSON_NODE_HOLDS_OBJECT (node)) {
+		GList/*<unowned JsonNode>*/ *values = NULL, *l;
+
+		values = json_object_get_values (json_node_get_object (node));
+
+		for (l = values; l != NULL; l = l->next) {
+			depth = MAX (depth, node_get_depth (l->data));
+		}
+
+		g_list_free (values);
+
+		return depth + 1;
+	}
+
+	return 0;
+}
+
+/* Test that wbl_schema_set_generation_limits() limits the depth and size of
+ * generated instances. */
+static void
+test_schema_instance_generation_limits (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	guint i, max_depth, unlimited_depth = 0;
+	gsize max_instance_size, max_total_size, total_size;
+	gsize unlimited_size = 0;
+	WblSchema *other_schema = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *other_instances = NULL;  /* owned */
+	GHashTable/*<unowned utf8>*/ *kept = NULL;  /* owned */
+	GError *error = NULL;
+	const gchar *schema_json =
+		"{"
+			"\"type\": \"array\","
+			"\"items\": {"
+				"\"type\": \"object\","
+				"\"properties\": {"
+					"\"a\": {"
+						"\"type\": \"array\","
+						"\"items\": {\"type\": \"string\"},"
+						"\"maxItems\": 3"
+					"}"
+				"}"
+			"},"
+			"\"maxItems\": 2"
+		"}";
+
 	schema = wbl_schema_new ();
 	parser = json_parser_new ();
 
-	wbl_schema_load_from_data (schema,
-		"{"
-			"\"items\": [ {}, {}, {} ],"
-			"\"additionalItems\": false"
-		"}", -1, &error);
+	wbl_schema_load_from_data (schema, schema_json, -1, &error);
 	g_assert_no_error (error);
 
-	/* Valid cases. */
-	for (i = 0; i < G_N_ELEMENTS (valid_cases); i++) {
-		json_parser_load_from_data (parser, valid_cases[i], -1, &error);
-		g_assert_no_error (error);
+	/* No limits by default. */
+	wbl_schema_get_generation_limits (schema, &max_depth,
+	                                  &max_instance_size, &max_total_size);
+	g_assert_cmpuint (max_depth, ==, 0);
+	g_assert_cmpuint (max_instance_size, ==, 0);
+	g_assert_cmpuint (max_total_size, ==, 0);
 
-		wbl_schema_apply (schema,
-		                  json_parser_get_root (parser), &error);
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+
+	for (i = 0; i < instances->len; i++) {
+		const gchar *json;
+
+		json = wbl_generated_instance_get_json (instances->pdata[i]);
+		json_parser_load_from_data (parser, json, -1, &error);
 		g_assert_no_error (error);
+
+		unlimited_depth = MAX (unlimited_depth,
+		                       node_get_depth (json_parser_get_root (parser)));
+		unlimited_size = MAX (unlimited_size, strlen (json));
 	}
 
-	/* Invalid cases. */
-	for (i = 0; i < G_N_ELEMENTS (invalid_cases); i++) {
-		json_parser_load_from_data (parser,
-		                            invalid_cases[i], -1, &error);
+	g_assert_cmpuint (unlimited_depth, >=, 3);
+	g_ptr_array_unref (instances);
+
+	/* Limit the depth and instance size. */
+	wbl_schema_set_generation_limits (schema, 2, unlimited_size / 2, 0);
+	wbl_schema_get_generation_limits (schema, &max_depth,
+	                                  &max_instance_size, &max_total_size);
+	g_assert_cmpuint (max_depth, ==, 2);
+	g_assert_cmpuint (max_instance_size, ==, unlimited_size / 2);
+	g_assert_cmpuint (max_total_size, ==, 0);
+
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	g_assert_cmpuint (instances->len, >, 0);
+
+	for (i = 0; i < instances->len; i++) {
+		const gchar *json;
+
+		json = wbl_generated_instance_get_json (instances->pdata[i]);
+		json_parser_load_from_data (parser, json, -1, &error);
 		g_assert_no_error (error);
 
-		wbl_schema_apply (schema,
-		                  json_parser_get_root (parser), &error);
-		g_assert_error (error,
-		                WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
-		g_clear_error (&error);
+		g_assert_cmpuint (node_get_depth (json_parser_get_root (parser)),
+		                  <=, 2);
+		g_assert_cmpuint (strlen (json), <=, unlimited_size / 2);
+	}
+
+	g_ptr_array_unref (instances);
+
+	/* Limit the total size. */
+	wbl_schema_set_generation_limits (schema, 0, 0, 100);
+	instances = wbl_schema_generate_instances (schema,
+	                                           WBL_GENERATE_INSTANCE_NONE);
+	g_assert_cmpuint (instances->len, >, 0);
+
+	for (i = 0, total_size = 0; i < instances->len; i++) {
+		total_size += strlen (wbl_generated_instance_get_json (instances->pdata[i]));
+	}
+
+	g_assert_cmpuint (total_size, <=, 100);
+
+	/* The same instances should be cut when generating again from a
+	 * separately loaded copy of the schema. */
+	kept = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; i < instances->len; i++) {
+		g_hash_table_add (kept,
+		                  (gpointer) wbl_generated_instance_get_json (instances->pdata[i]));
+	}
+
+	other_schema = wbl_schema_new ();
+	wbl_schema_load_from_data (other_schema, schema_json, -1, &error);
+	g_assert_no_error (error);
+	wbl_schema_set_generation_limits (other_schema, 0, 0, 100);
+
+	other_instances = wbl_schema_generate_instances (other_schema,
+	                                                 WBL_GENERATE_INSTANCE_NONE);
+	g_assert_cmpuint (other_instances->len, ==, instances->len);
+
+	for (i = 0; i < other_instances->len; i++) {
+		g_assert (g_hash_table_contains (kept,
+		                                 wbl_generated_instance_get_json (other_instances->pdata[i])));
 	}
 
+	g_ptr_array_unref (other_instances);
+	g_object_unref (other_schema);
+	g_hash_table_unref (kept);
+	g_ptr_array_unref (instances);
+
 	g_object_unref (parser);
 	g_object_unref (schema);
 }
 
-/* Test generating instances for a simple schema. */
+/* Add a key for each of @instances, made of its validity and JSON, to a new
+ * set. */
+static GHashTable/*<owned utf8, owned utf8>*/ *
+instances_to_set (GPtrArray/*<owned WblGeneratedInstance>*/ *instances)
+{
+	GHashTable/*<owned utf8, owned utf8>*/ *set = NULL;  /* owned */
+	guint i;
+
+	set = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	for (i = 0; i < instances->len; i++) {
+		WblGeneratedInstance *instance = instances->pdata[i];
+
+		g_hash_table_add (set,
+		                  g_strdup_printf ("%u%s",
+		                                   wbl_generated_instance_is_valid (instance),
+		                                   wbl_generated_instance_get_json (instance)));
+	}
+
+	return set;
+}
+
+/* Test that spilling cached instances to files with
+ * wbl_schema_set_spill_threshold() does not change the generated instances,
+ * including when they are generated again from the spilled cache, when they
+ * also come out in the same order. */
 static void
-test_schema_instance_generation_simple (void)
+test_schema_instance_generation_spill (void)
 {
-	WblSchema *schema = NULL;  /* owned */
+	WblSchema *schema = NULL, *spill_schema = NULL;  /* owned */
 	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GPtrArray/*<owned WblGeneratedInstace>*/ *first_instances = NULL;  /* owned */
+	GHashTable/*<owned utf8, owned utf8>*/ *expected = NULL;  /* owned */
+	GHashTable/*<owned utf8, owned utf8>*/ *actual = NULL;  /* owned */
+	GHashTableIter iter;
+	gpointer key;
+	guint i;
 	GError *error = NULL;
-
-	schema = wbl_schema_new ();
-
-	wbl_schema_load_from_data (schema,
+	const gchar *data =
 		"{"
-			"\"title\": \"Example Schema\","
-			"\"type\": \"object\","
-			"\"properties\": {"
-				"\"firstName\": {"
-					"\"type\": \"string\""
-				"},"
-				"\"lastName\": {"
-					"\"type\": \"string\""
-				"},"
-				"\"age\": {"
-					"\"description\": \"Age in years\","
-					"\"type\": \"integer\","
-					"\"minimum\": 0"
+			"\"type\": \"array\","
+			"\"items\": {"
+				"\"type\": \"object\","
+				"\"properties\": {"
+					"\"a\": {\"type\": \"string\", \"maxLength\": 5},"
+					"\"b\": {\"type\": \"boolean\"}"
 				"}"
 			"},"
-			"\"required\": [\"firstName\", \"lastName\"]"
-		"}", -1, &error);
+			"\"maxItems\": 2"
+		"}";
+
+	schema = wbl_schema_new ();
+	wbl_schema_load_from_data (schema, data, -1, &error);
 	g_assert_no_error (error);
 
 	instances = wbl_schema_generate_instances (schema,
 	                                           WBL_GENERATE_INSTANCE_NONE);
-	wbl_test_assert_generated_instances_match_file (instances,
-	                                                "schema-instance-generation-simple.json");
+	expected = instances_to_set (instances);
 	g_ptr_array_unref (instances);
 
+	spill_schema = wbl_schema_new ();
+	wbl_schema_load_from_data (spill_schema, data, -1, &error);
+	g_assert_no_error (error);
+
+	g_assert_cmpuint (wbl_schema_get_spill_threshold (spill_schema), ==, 0);
+	wbl_schema_set_spill_threshold (spill_schema, 1);
+	g_assert_cmpuint (wbl_schema_get_spill_threshold (spill_schema), ==, 1);
+
+	/* Generate twice, so the second time uses the spilled cache. */
+	for (i = 0; i < 2; i++) {
+		guint j;
+
+		instances = wbl_schema_generate_instances (spill_schema,
+		                                           WBL_GENERATE_INSTANCE_NONE);
+		actual = instances_to_set (instances);
+
+		if (first_instances == NULL) {
+			first_instances = g_ptr_array_ref (instances);
+		} else {
+			g_assert_cmpuint (instances->len, ==,
+			                  first_instances->len);
+
+			for (j = 0; j < instances->len; j++) {
+				g_assert_cmpstr (wbl_generated_instance_get_json (instances->pdata[j]),
+				                 ==,
+				                 wbl_generated_instance_get_json (first_instances->pdata[j]));
+			}
+		}
+
+		g_ptr_array_unref (instances);
+
+		g_assert_cmpuint (g_hash_table_size (actual), ==,
+		                  g_hash_table_size (expected));
+
+		g_hash_table_iter_init (&iter, expected);
+
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			g_assert (g_hash_table_contains (actual, key));
+		}
+
+		g_hash_table_unref (actual);
+	}
+
+	g_ptr_array_unref (first_instances);
+	g_hash_table_unref (expected);
+	g_object_unref (spill_schema);
 	g_object_unref (schema);
 }
 
-/* Test generating instances for a complex schema. */
+/* An extension keyword, `x-even`, which requires integer instances to be even
+ * if its value is true. */
+static gboolean
+validate_x_even (WblSchema   *schema,
+                 JsonObject  *root,
+                 JsonNode    *schema_node,
+                 GError     **error,
+                 gpointer     user_data)
+{
+	if (!JSON_NODE_HOLDS_VALUE (schema_node) ||
+	    json_node_get_value_type (schema_node) != G_TYPE_BOOLEAN) {
+		g_set_error_literal (error, WBL_SCHEMA_ERROR,
+		                     WBL_SCHEMA_ERROR_MALFORMED,
+		                     "x-even must be a boolean.");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static void
-test_schema_instance_generation_complex (void)
+apply_x_even (WblSchema   *schema,
+              JsonObject  *root,
+              JsonNode    *schema_node,
+              JsonNode    *instance_node,
+              GError     **error,
+              gpointer     user_data)
+{
+	if (json_node_get_boolean (schema_node) &&
+	    JSON_NODE_HOLDS_VALUE (instance_node) &&
+	    json_node_get_value_type (instance_node) == G_TYPE_INT64 &&
+	    json_node_get_int (instance_node) % 2 != 0) {
+		g_set_error_literal (error, WBL_SCHEMA_ERROR,
+		                     WBL_SCHEMA_ERROR_INVALID,
+		                     "Instance is not even.");
+	}
+}
+
+static void
+generate_x_even (WblSchema  *schema,
+                 JsonObject *root,
+                 JsonNode   *schema_node,
+                 GPtrArray  *instances,
+                 gpointer    user_data)
+{
+	JsonNode *node = NULL;  /* owned */
+
+	node = json_node_new (JSON_NODE_VALUE);
+	json_node_set_int (node, 1001);
+	g_ptr_array_add (instances, node);  /* transfer */
+
+	node = json_node_new (JSON_NODE_VALUE);
+	json_node_set_int (node, 1002);
+	g_ptr_array_add (instances, node);  /* transfer */
+}
+
+static void
+x_even_user_data_free (gpointer user_data)
+{
+	gboolean *freed = user_data;
+
+	*freed = TRUE;
+}
+
+/* Test that keywords added with wbl_schema_add_keyword() are validated,
+ * applied and generated for alongside the standard keywords, including in
+ * subschemas. */
+static void
+test_schema_extension_keyword (void)
 {
 	WblSchema *schema = NULL;  /* owned */
 	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	GPtrArray/*<owned GError>*/ *verdicts = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	JsonNode *nodes[2];
+	gboolean freed = FALSE;
+	gboolean found_odd = FALSE, found_even = FALSE;
+	guint i;
 	GError *error = NULL;
 
 	schema = wbl_schema_new ();
+	wbl_schema_add_keyword (schema, "x-even", validate_x_even,
+	                        apply_x_even, generate_x_even, &freed,
+	                        x_even_user_data_free);
 
+	/* An invalid value for the keyword. */
+	wbl_schema_load_from_data (schema, "{\"x-even\": 5}", -1, &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+
+	/* A valid schema, with the keyword in a subschema. */
 	wbl_schema_load_from_data (schema,
 		"{"
-			"\"$schema\": \"http://json-schema.org/draft-04/schema#\","
-			"\"title\": \"Product set\","
-			"\"type\": \"array\","
-			"\"items\": {"
-				"\"title\": \"Product\","
-				"\"type\": \"object\","
-				"\"properties\": {"
-					"\"id\": {"
-						"\"description\": \"The unique identifier for a product\","
-						"\"type\": \"number\""
-					"},"
-					"\"name\": {"
-						"\"type\": \"string\""
-					"},"
-					"\"price\": {"
-						"\"type\": \"number\","
-						"\"minimum\": 0,"
-						"\"exclusiveMinimum\": true"
-					"},"
-					"\"tags\": {"
-						"\"type\": \"array\","
-						"\"items\": {"
-							"\"type\": \"string\""
-						"},"
-						"\"minItems\": 1,"
-						"\"uniqueItems\": true"
-					"},"
-					"\"dimensions\": {"
-						"\"type\": \"object\","
-						"\"properties\": {"
-							"\"length\": {\"type\": \"number\"},"
-							"\"width\": {\"type\": \"number\"},"
-							"\"height\": {\"type\": \"number\"}"
-						"},"
-						"\"required\": [\"length\", \"width\", \"height\"]"
-					"},"
-					"\"warehouseLocation\": {"
-						"\"description\": \"Coordinates of the warehouse with the product\","
-						"\"$ref\": \"http://json-schema.org/geo\""
-					"}"
-				"},"
-				"\"required\": [\"id\", \"name\", \"price\"]"
+			"\"type\": \"object\","
+			"\"properties\": {"
+				"\"a\": {\"type\": \"integer\", \"x-even\": true}"
 			"}"
 		"}", -1, &error);
 	g_assert_no_error (error);
 
-	instances = wbl_schema_generate_instances (schema,
-	                                           WBL_GENERATE_INSTANCE_NONE);
-	wbl_test_assert_generated_instances_match_file (instances,
-	                                                "schema-instance-generation-complex.json");
-	g_ptr_array_unref (instances);
+	parser = json_parser_new ();
 
-	g_object_unref (schema);
-}
+	json_parser_load_from_data (parser, "{\"a\": 4}", -1, &error);
+	g_assert_no_error (error);
+	nodes[0] = json_node_copy (json_parser_get_root (parser));
 
-/* Test generating instances for the JSON Schema meta-schema.
- * http://json-schema.org/schema */
-static void
-test_schema_instance_generation_schema (void)
-{
-	WblSchema *schema = NULL;  /* owned */
-	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
-	GError *error = NULL;
+	json_parser_load_from_data (parser, "{\"a\": 3}", -1, &error);
+	g_assert_no_error (error);
+	nodes[1] = json_node_copy (json_parser_get_root (parser));
 
-	/* FIXME: This needs a lot of mollycoddling to get it doing the right
-	 * thing. */
-	schema = wbl_meta_schema_load_schema (WBL_META_SCHEMA_META_SCHEMA,
-	                                      &error);
+	g_object_unref (parser);
+
+	wbl_schema_apply (schema, nodes[0], &error);
 	g_assert_no_error (error);
+	wbl_schema_apply (schema, nodes[1], &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_clear_error (&error);
+
+	verdicts = wbl_schema_apply_batch (schema, nodes, G_N_ELEMENTS (nodes));
+	g_assert_no_error (verdicts->pdata[0]);
+	g_assert_error (verdicts->pdata[1], WBL_SCHEMA_ERROR,
+	                WBL_SCHEMA_ERROR_INVALID);
+	g_ptr_array_unref (verdicts);
 
+	json_node_free (nodes[1]);
+	json_node_free (nodes[0]);
+
+	/* The generated instances are used for the property. */
 	instances = wbl_schema_generate_instances (schema,
 	                                           WBL_GENERATE_INSTANCE_NONE);
-	wbl_test_assert_generated_instances_match_file (instances,
-	                                                "schema-instance-generation-schema.json");
+
+	for (i = 0; i < instances->len; i++) {
+		WblGeneratedInstance *instance = instances->pdata[i];
+		const gchar *json;
+
+		json = wbl_generated_instance_get_json (instance);
+
+		if (strstr (json, "\"a\":1001") != NULL) {
+			g_assert (!wbl_generated_instance_is_valid (instance));
+			found_odd = TRUE;
+		} else if (strstr (json, "\"a\":1002") != NULL &&
+		           wbl_generated_instance_is_valid (instance)) {
+			found_even = TRUE;
+		}
+	}
+
+	g_assert (found_odd);
+	g_assert (found_even);
 	g_ptr_array_unref (instances);
 
+	g_assert (!freed);
 	g_object_unref (schema);
+	g_assert (freed);
 }
 
-/* Test generating instances for the JSON Hyper Schema meta-schema.
- * http://json-schema.org/hyper-schema */
+/* Test that the format keyword is only checked once enabled, and then
+ * validates and generates strings for the format. */
 static void
-test_schema_instance_generation_hyper_schema (void)
+test_schema_format (void)
 {
 	WblSchema *schema = NULL;  /* owned */
 	GPtrArray/*<owned WblGeneratedInstace>*/ *instances = NULL;  /* owned */
+	JsonParser *parser = NULL;  /* owned */
+	JsonNode *nodes[2];
+	gboolean found_invalid = FALSE, found_valid = FALSE;
+	guint i;
 	GError *error = NULL;
 
-	/* FIXME: This needs a lot of mollycoddling to get it doing the right
-	 * thing. */
-	schema = wbl_meta_schema_load_schema (WBL_META_SCHEMA_HYPER_META_SCHEMA,
-	                                      &error);
+	schema = wbl_schema_new ();
+	g_assert (!wbl_schema_get_check_formats (schema));
+
+	/* The keyword value must be a string. */
+	wbl_schema_load_from_data (schema, "{\"format\": 5}", -1, &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_MALFORMED);
+	g_clear_error (&error);
+
+	wbl_schema_load_from_data (schema,
+		"{\"type\": \"string\", \"format\": \"ipv4\"}", -1,
+		&error);
+	g_assert_no_error (error);
+
+	parser = json_parser_new ();
+
+	json_parser_load_from_data (parser, "\"x\"", -1, &error);
+	g_assert_no_error (error);
+	nodes[0] = json_node_copy (json_parser_get_root (parser));
+
+	json_parser_load_from_data (parser, "\"192.0.2.1\"", -1, &error);
+	g_assert_no_error (error);
+	nodes[1] = json_node_copy (json_parser_get_root (parser));
+
+	g_object_unref (parser);
+
+	/* Formats are not checked by default. */
+	wbl_schema_apply (schema, nodes[0], &error);
+	g_assert_no_error (error);
+
+	wbl_schema_set_check_formats (schema, TRUE);
+	g_assert (wbl_schema_get_check_formats (schema));
+
+	wbl_schema_apply (schema, nodes[0], &error);
+	g_assert_error (error, WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID);
+	g_clear_error (&error);
+
+	wbl_schema_apply (schema, nodes[1], &error);
 	g_assert_no_error (error);
 
+	json_node_free (nodes[1]);
+	json_node_free (nodes[0]);
+
+	/* Strings either side of the format boundary are generated. */
 	instances = wbl_schema_generate_instances (schema,
 	                                           WBL_GENERATE_INSTANCE_NONE);
-	wbl_test_assert_generated_instances_match_file (instances,
-	                                                "schema-instance-generation-hyper-schema.json");
+
+	for (i = 0; i < instances->len; i++) {
+		WblGeneratedInstance *instance = instances->pdata[i];
+		const gchar *json;
+
+		json = wbl_generated_instance_get_json (instance);
+
+		if (g_str_equal (json, "\"256.0.0.0\"")) {
+			g_assert (!wbl_generated_instance_is_valid (instance));
+			found_invalid = TRUE;
+		} else if (g_str_equal (json, "\"255.255.255.255\"")) {
+			g_assert (wbl_generated_instance_is_valid (instance));
+			found_valid = TRUE;
+		}
+	}
+
+	g_assert (found_invalid);
+	g_assert (found_valid);
 	g_ptr_array_unref (instances);
 
 	g_object_unref (schema);
@@ -889,6 +3457,12 @@ main (int argc, char *argv[])
 	g_test_add_func ("/schema/parsing/schema", test_schema_parsing_schema);
 	g_test_add_func ("/schema/parsing/hyper-schema",
 	                 test_schema_parsing_hyper_schema);
+	g_test_add_func ("/schema/parsing/memory", test_schema_parsing_memory);
+	g_test_add_func ("/schema/parsing/files", test_schema_parsing_files);
+	g_test_add_func ("/schema/parsing/load-modes",
+	                 test_schema_parsing_load_modes);
+	g_test_add_func ("/schema/parsing/snapshot",
+	                 test_schema_parsing_snapshot);
 
 	for (i = 0; i < G_N_ELEMENTS (google_schemas); i++) {
 		gchar *test_name = NULL;
@@ -910,6 +3484,34 @@ main (int argc, char *argv[])
 	}
 
 	g_test_add_func ("/schema/application", test_schema_application);
+	g_test_add_func ("/schema/application/batch",
+	                 test_schema_application_batch);
+	g_test_add_func ("/schema/application/data",
+	                 test_schema_application_data);
+	g_test_add_func ("/schema/application/async",
+	                 test_schema_application_async);
+	g_test_add_func ("/schema/application/async/reload",
+	                 test_schema_application_async_reload);
+	g_test_add_func ("/schema/application/verdict-cache",
+	                 test_schema_application_verdict_cache);
+	g_test_add_func ("/schema/application/repeated-subtrees",
+	                 test_schema_application_repeated_subtrees);
+	g_test_add_func ("/schema/application/repeated-subtrees/memoised",
+	                 test_schema_application_repeated_subtrees_memoised);
+
+	if (g_test_perf ()) {
+		g_test_add_func ("/schema/application/repeated-subtrees/perf",
+		                 test_schema_application_repeated_subtrees_perf);
+	}
+
+	g_test_add_func ("/schema/application/data/filtered",
+	                 test_schema_application_data_filtered);
+
+	if (g_test_perf ()) {
+		g_test_add_func ("/schema/application/data/perf",
+		                 test_schema_application_data_perf);
+	}
+
 	g_test_add_func ("/schema/instance-generation/simple",
 	                 test_schema_instance_generation_simple);
 	g_test_add_func ("/schema/instance-generation/complex",
@@ -918,6 +3520,23 @@ main (int argc, char *argv[])
 	                 test_schema_instance_generation_schema);
 	g_test_add_func ("/schema/instance-generation/hyper-schema",
 	                 test_schema_instance_generation_hyper_schema);
+	g_test_add_func ("/schema/instance-generation/allocations",
+	                 test_schema_instance_generation_allocations);
+	g_test_add_func ("/schema/instance-generation/estimate",
+	                 test_schema_instance_generation_estimate);
+	g_test_add_func ("/schema/instance-generation/sharded",
+	                 test_schema_instance_generation_sharded);
+	g_test_add_func ("/schema/instance-generation/pairwise",
+	                 test_schema_instance_generation_pairwise);
+	g_test_add_func ("/schema/instance-generation/minimise",
+	                 test_schema_instance_generation_minimise);
+	g_test_add_func ("/schema/instance-generation/limits",
+	                 test_schema_instance_generation_limits);
+	g_test_add_func ("/schema/instance-generation/spill",
+	                 test_schema_instance_generation_spill);
+	g_test_add_func ("/schema/extension-keyword",
+	                 test_schema_extension_keyword);
+	g_test_add_func ("/schema/format", test_schema_format);
 	g_test_add_func ("/schema/node/refs", test_schema_node_refs);
 	g_test_add_func ("/schema/node/title", test_schema_node_title);
 	g_test_add_func ("/schema/node/description",
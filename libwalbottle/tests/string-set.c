@@ -18,6 +18,7 @@
  */
 
 #include <glib.h>
+#include <json-glib/json-glib.h>
 #include <locale.h>
 #include <string.h>
 
@@ -27,26 +28,312 @@
 static void
 test_empty_set (void)
 {
+	WblStringPool *pool = NULL;
 	WblStringSet *set = NULL;
 
-	set = wbl_string_set_new_empty ();
+	pool = wbl_string_pool_new ();
+	set = wbl_string_set_new_empty (pool);
 	g_assert_cmpuint (wbl_string_set_get_size (set), ==, 0);
 
 	wbl_string_set_unref (set);
+	wbl_string_pool_unref (pool);
 }
 
 /* Test uniqueness of members. */
 static void
 test_set_uniqueness (void)
 {
+	WblStringPool *pool = NULL;
 	WblStringSet *set = NULL;
 
-	set = wbl_string_set_union (wbl_string_set_new_singleton ("a"),
-	                            wbl_string_set_new_singleton ("a"));
+	pool = wbl_string_pool_new ();
+	set = wbl_string_set_union (wbl_string_set_new_singleton (pool, "a"),
+	                            wbl_string_set_new_singleton (pool, "a"));
 	g_assert_cmpuint (wbl_string_set_get_size (set), ==, 1);
 	g_assert (wbl_string_set_contains (set, "a"));
 
 	wbl_string_set_unref (set);
+	wbl_string_pool_unref (pool);
+}
+
+/* Test that members are stored once in the pool, can be looked up using
+ * strings which are not from it, and that looking them up does not add to
+ * it. */
+static void
+test_set_pool (void)
+{
+	WblStringPool *pool = NULL, *other_pool = NULL;
+	WblStringSet *a = NULL, *b = NULL, *c = NULL;
+	WblStringSetIter iter;
+	const gchar *member_a, *member_b, *member_c;
+	gchar *copy = NULL;
+
+	pool = wbl_string_pool_new ();
+	other_pool = wbl_string_pool_new ();
+
+	copy = g_strdup ("pool-test-member");
+	a = wbl_string_set_ref_sink (wbl_string_set_new_singleton (pool, copy));
+	b = wbl_string_set_ref_sink (wbl_string_set_union (wbl_string_set_new_singleton (pool, "x"),
+	                                                   wbl_string_set_new_singleton (pool, copy)));
+	c = wbl_string_set_ref_sink (wbl_string_set_new_singleton (other_pool,
+	                                                           copy));
+
+	g_assert_cmpuint (wbl_string_pool_get_size (pool), ==, 2);
+	g_assert_cmpuint (wbl_string_pool_get_size (other_pool), ==, 1);
+
+	wbl_string_set_iter_init (&iter, a);
+	g_assert (wbl_string_set_iter_next (&iter, &member_a));
+	g_assert (member_a != copy);
+	g_assert_cmpstr (member_a, ==, copy);
+
+	wbl_string_set_iter_init (&iter, b);
+
+	while (wbl_string_set_iter_next (&iter, &member_b)) {
+		if (g_str_equal (member_b, copy)) {
+			break;
+		}
+	}
+
+	g_assert (member_b == member_a);
+
+	/* Each pool has its own copy. */
+	wbl_string_set_iter_init (&iter, c);
+	g_assert (wbl_string_set_iter_next (&iter, &member_c));
+	g_assert (member_c != member_a);
+	g_assert_cmpstr (member_c, ==, copy);
+
+	g_assert (wbl_string_set_contains (b, copy));
+	g_assert (!wbl_string_set_contains (b, "pool-test-never-added"));
+	g_assert_cmpuint (wbl_string_pool_get_size (pool), ==, 2);
+
+	/* Members stay valid while the pool is alive. */
+	wbl_string_set_unref (a);
+	wbl_string_set_unref (b);
+	g_assert_cmpstr (member_a, ==, copy);
+
+	g_free (copy);
+	wbl_string_set_unref (c);
+	wbl_string_pool_unref (other_pool);
+	wbl_string_pool_unref (pool);
+}
+
+/* Test sets with members spread over several words of the underlying bitset,
+ * built in different orders. */
+static void
+test_set_bitset (void)
+{
+	WblStringPool *pool = NULL;
+	WblStringSet *a = NULL, *b = NULL, *c = NULL;
+	WblStringSetIter iter;
+	const gchar *member;
+	GHashTable/*<unowned utf8>*/ *seen = NULL;
+	guint i;
+
+	pool = wbl_string_pool_new ();
+	a = wbl_string_set_new_empty (pool);
+	b = wbl_string_set_new_empty (pool);
+
+	for (i = 0; i < 200; i++) {
+		gchar *name = NULL;
+
+		name = g_strdup_printf ("bitset-test-%u", i);
+		a = wbl_string_set_union (a, wbl_string_set_new_singleton (pool, name));
+		g_free (name);
+
+		name = g_strdup_printf ("bitset-test-%u", 199 - i);
+		b = wbl_string_set_union (wbl_string_set_new_singleton (pool, name), b);
+		g_free (name);
+	}
+
+	wbl_string_set_ref_sink (a);
+	wbl_string_set_ref_sink (b);
+
+	g_assert_cmpuint (wbl_string_set_get_size (a), ==, 200);
+	g_assert (wbl_string_set_equal (a, b));
+	g_assert_cmpuint (wbl_string_set_hash (a), ==, wbl_string_set_hash (b));
+	g_assert (wbl_string_set_contains (a, "bitset-test-0"));
+	g_assert (wbl_string_set_contains (a, "bitset-test-199"));
+	g_assert (!wbl_string_set_contains (a, "bitset-test-200"));
+
+	/* Iteration covers every member exactly once. */
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+	wbl_string_set_iter_init (&iter, a);
+
+	while (wbl_string_set_iter_next (&iter, &member)) {
+		g_assert (g_hash_table_add (seen, (gpointer) member));
+	}
+
+	g_assert_cmpuint (g_hash_table_size (seen), ==, 200);
+	g_hash_table_unref (seen);
+
+	/* Adding a member changes the hash and equality. */
+	c = wbl_string_set_ref_sink (wbl_string_set_union (a,
+	                                                   wbl_string_set_new_singleton (pool, "a")));
+	g_assert_cmpuint (wbl_string_set_get_size (c), ==, 201);
+	g_assert (!wbl_string_set_equal (a, c));
+	g_assert_cmpuint (wbl_string_set_hash (a), !=, wbl_string_set_hash (c));
+
+	/* Union with a subset changes nothing. */
+	wbl_string_set_unref (c);
+	c = wbl_string_set_ref_sink (wbl_string_set_union (a,
+	                                                   wbl_string_set_new_singleton (pool, "bitset-test-100")));
+	g_assert (wbl_string_set_equal (a, c));
+	g_assert_cmpuint (wbl_string_set_hash (a), ==, wbl_string_set_hash (c));
+
+	wbl_string_set_unref (c);
+	wbl_string_set_unref (b);
+	wbl_string_set_unref (a);
+	wbl_string_pool_unref (pool);
+}
+
+/* Check that iterating over @set gives the same order as iterating over
+ * @expected, a #GHashTable built using the same sequence of additions. */
+static void
+assert_set_order (WblStringSet  *set,
+                  GHashTable    *expected)
+{
+	WblStringSetIter iter;
+	GHashTableIter expected_iter;
+	const gchar *member;
+	gpointer expected_member;
+
+	wbl_string_set_iter_init (&iter, set);
+	g_hash_table_iter_init (&expected_iter, expected);
+
+	while (wbl_string_set_iter_next (&iter, &member)) {
+		g_assert (g_hash_table_iter_next (&expected_iter,
+		                                  &expected_member, NULL));
+		g_assert_cmpstr (member, ==, expected_member);
+	}
+
+	g_assert (!g_hash_table_iter_next (&expected_iter, NULL, NULL));
+}
+
+/* Test that sets iterate in the same order as a #GHashTable built using the
+ * same sequence of operations, as generated instances depend on it. */
+static void
+test_set_order (void)
+{
+	WblStringPool *pool = NULL;
+	WblStringSet *a = NULL, *b = NULL, *c = NULL;
+	GHashTable/*<unowned utf8>*/ *expected_a = NULL, *expected_c = NULL;
+	GHashTableIter iter;
+	gpointer member;
+	const gchar *a_members[] = {
+		"order-e", "order-a", "order-d", "order-b", "order-c", NULL
+	};
+	const gchar *b_members[] = {
+		"order-z", "order-b", "order-y", "order-x", NULL
+	};
+	guint i;
+
+	pool = wbl_string_pool_new ();
+
+	a = wbl_string_set_ref_sink (wbl_string_set_new_from_strv (pool,
+	                                                           a_members));
+	b = wbl_string_set_ref_sink (wbl_string_set_new_from_strv (pool,
+	                                                           b_members));
+	c = wbl_string_set_ref_sink (wbl_string_set_union (b, a));
+
+	expected_a = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; a_members[i] != NULL; i++) {
+		g_hash_table_add (expected_a, (gpointer) a_members[i]);
+	}
+
+	assert_set_order (a, expected_a);
+
+	/* A union adds all of its first operand, then all of its second. */
+	expected_c = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; b_members[i] != NULL; i++) {
+		g_hash_table_add (expected_c, (gpointer) b_members[i]);
+	}
+
+	g_hash_table_iter_init (&iter, expected_a);
+
+	while (g_hash_table_iter_next (&iter, &member, NULL)) {
+		g_hash_table_add (expected_c, member);
+	}
+
+	assert_set_order (c, expected_c);
+
+	g_hash_table_unref (expected_c);
+	g_hash_table_unref (expected_a);
+	wbl_string_set_unref (c);
+	wbl_string_set_unref (b);
+	wbl_string_set_unref (a);
+	wbl_string_pool_unref (pool);
+}
+
+/* Test that dependencies are followed transitively, including through
+ * cycles, and that schema dependencies are ignored. */
+static void
+test_set_dependencies (void)
+{
+	WblStringPool *pool = NULL;
+	JsonObject *dependencies = NULL;
+	JsonArray *array = NULL;
+	WblDependencyClosure *closure = NULL;
+	WblStringSet *set = NULL, *expected = NULL;
+
+	pool = wbl_string_pool_new ();
+
+	/* a → b → c → a; d → e; f is a schema dependency on g. */
+	dependencies = json_object_new ();
+
+	array = json_array_new ();
+	json_array_add_string_element (array, "b");
+	json_object_set_array_member (dependencies, "a", array);
+
+	array = json_array_new ();
+	json_array_add_string_element (array, "c");
+	json_object_set_array_member (dependencies, "b", array);
+
+	array = json_array_new ();
+	json_array_add_string_element (array, "a");
+	json_object_set_array_member (dependencies, "c", array);
+
+	array = json_array_new ();
+	json_array_add_string_element (array, "e");
+	json_object_set_array_member (dependencies, "d", array);
+
+	json_object_set_object_member (dependencies, "f", json_object_new ());
+
+	closure = wbl_dependency_closure_new (pool, dependencies);
+
+	set = wbl_string_set_ref_sink (wbl_string_set_union_dependency_closure (wbl_string_set_new_singleton (pool, "c"),
+	                                                                        closure));
+	g_assert_cmpuint (wbl_string_set_get_size (set), ==, 3);
+	g_assert (wbl_string_set_contains (set, "a"));
+	g_assert (wbl_string_set_contains (set, "b"));
+	g_assert (wbl_string_set_contains (set, "c"));
+	wbl_string_set_unref (set);
+
+	set = wbl_string_set_union (wbl_string_set_new_singleton (pool, "d"),
+	                            wbl_string_set_new_singleton (pool, "f"));
+	set = wbl_string_set_ref_sink (wbl_string_set_union_dependency_closure (set,
+	                                                                        closure));
+	expected = wbl_string_set_union (wbl_string_set_new_singleton (pool, "d"),
+	                                 wbl_string_set_new_singleton (pool, "e"));
+	expected = wbl_string_set_ref_sink (wbl_string_set_union (expected,
+	                                                          wbl_string_set_new_singleton (pool, "f")));
+	g_assert (wbl_string_set_equal (set, expected));
+	g_assert_cmpuint (wbl_string_set_hash (set), ==,
+	                  wbl_string_set_hash (expected));
+	wbl_string_set_unref (expected);
+	wbl_string_set_unref (set);
+
+	/* The uncached version gives the same result. */
+	set = wbl_string_set_ref_sink (wbl_string_set_union_dependencies (wbl_string_set_new_singleton (pool, "b"),
+	                                                                  dependencies));
+	g_assert_cmpuint (wbl_string_set_get_size (set), ==, 3);
+	g_assert (wbl_string_set_contains (set, "a"));
+	wbl_string_set_unref (set);
+
+	wbl_dependency_closure_unref (closure);
+	json_object_unref (dependencies);
+	wbl_string_pool_unref (pool);
 }
 
 int
@@ -64,6 +351,10 @@ main (int argc, char *argv[])
 	/* #WblStringSet tests. */
 	g_test_add_func ("/string-set/empty", test_empty_set);
 	g_test_add_func ("/string-set/uniqueness", test_set_uniqueness);
+	g_test_add_func ("/string-set/pool", test_set_pool);
+	g_test_add_func ("/string-set/bitset", test_set_bitset);
+	g_test_add_func ("/string-set/order", test_set_order);
+	g_test_add_func ("/string-set/dependencies", test_set_dependencies);
 
 	return g_test_run ();
 }
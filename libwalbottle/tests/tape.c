@@ -0,0 +1,441 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include "wbl-json-node.h"
+#include "wbl-tape.h"
+
+static gchar *
+node_to_string (JsonNode *node)
+{
+	JsonGenerator *generator = NULL;  /* owned */
+	gchar *str = NULL;  /* owned */
+
+	generator = json_generator_new ();
+	json_generator_set_root (generator, node);
+	str = json_generator_to_data (generator, NULL);
+	g_object_unref (generator);
+
+	return str;
+}
+
+/* Test that values come back out of a tape equal to, and serialising
+ * identically to, how they went in. */
+static void
+test_tape_round_trip (void)
+{
+	JsonParser *parser = NULL;  /* owned */
+	GPtrArray/*<owned JsonNode>*/ *nodes = NULL;  /* owned */
+	WblTape *tape = NULL;  /* owned */
+	guint i;
+
+	const gchar *documents[] = {
+		"null",
+		"true",
+		"false",
+		"0",
+		"-9223372036854775808",
+		"9223372036854775807",
+		"1.5",
+		"-2.25e-3",
+		"\"\"",
+		"\"abc\"",
+		"\"é€😀 \\\" \\\\ \\n\"",
+		"[]",
+		"{}",
+		"[1, \"a\", [], {}, null]",
+		"{\"z\": 1, \"a\": [true, false, null], \"m\": {\"d\": \"e\"}}",
+		"{\"a\": \"a\", \"b\": {\"a\": \"b\"}}",
+		"[[[[[[[[[[1]]]]]]]]]]",
+	};
+
+	parser = json_parser_new ();
+	nodes = g_ptr_array_new_with_free_func ((GDestroyNotify) json_node_free);
+
+	for (i = 0; i < G_N_ELEMENTS (documents); i++) {
+		GError *error = NULL;
+
+		json_parser_load_from_data (parser, documents[i], -1, &error);
+		g_assert_no_error (error);
+
+		g_ptr_array_add (nodes,
+		                 json_node_copy (json_parser_get_root (parser)));
+	}
+
+	tape = wbl_tape_new_from_nodes ((JsonNode * const *) nodes->pdata,
+	                                nodes->len);
+	g_assert_cmpuint (wbl_tape_get_n_values (tape), ==, nodes->len);
+
+	for (i = 0; i < nodes->len; i++) {
+		JsonNode *node = NULL;  /* owned */
+		gchar *expected = NULL, *actual = NULL;  /* owned */
+		guint j;
+
+		g_test_message ("Document: %s", documents[i]);
+
+		node = wbl_tape_dup_node (tape, i);
+		g_assert (wbl_json_node_equal (node, nodes->pdata[i]));
+		g_assert_cmpuint (wbl_json_node_hash_strict (node), ==,
+		                  wbl_json_node_hash_strict (nodes->pdata[i]));
+
+		/* The documents are all distinct. */
+		for (j = 0; j < nodes->len; j++) {
+			g_assert (wbl_tape_equal_node (tape, i, nodes->pdata[j]) ==
+			          (i == j));
+		}
+
+		expected = node_to_string (nodes->pdata[i]);
+		actual = node_to_string (node);
+		g_assert_cmpstr (actual, ==, expected);
+
+		g_free (actual);
+		g_free (expected);
+		json_node_free (node);
+	}
+
+	wbl_tape_unref (tape);
+
+	/* An empty tape. */
+	tape = wbl_tape_new_from_nodes (NULL, 0);
+	g_assert_cmpuint (wbl_tape_get_n_values (tape), ==, 0);
+	wbl_tape_unref (tape);
+
+	g_ptr_array_unref (nodes);
+	g_object_unref (parser);
+}
+
+/* Test that repeated strings are only stored once, so a tape of many similar
+ * instances is smaller than their serialisations. */
+static void
+test_tape_interning (void)
+{
+	JsonParser *parser = NULL;  /* owned */
+	GPtrArray/*<owned JsonNode>*/ *nodes = NULL;  /* owned */
+	WblTape *tape = NULL;  /* owned */
+	gsize serialised_size = 0;
+	guint i;
+	GError *error = NULL;
+
+	parser = json_parser_new ();
+	nodes = g_ptr_array_new_with_free_func ((GDestroyNotify) json_node_free);
+
+	for (i = 0; i < 100; i++) {
+		gchar *document = NULL;  /* owned */
+
+		document = g_strdup_printf ("{"
+		                            "\"a-long-property-name\": %u,"
+		                            "\"another-long-property-name\": "
+		                            "\"a long string value\""
+		                            "}", i);
+		json_parser_load_from_data (parser, document, -1, &error);
+		g_assert_no_error (error);
+
+		g_ptr_array_add (nodes,
+		                 json_node_copy (json_parser_get_root (parser)));
+		serialised_size += strlen (document);
+		g_free (document);
+	}
+
+	tape = wbl_tape_new_from_nodes ((JsonNode * const *) nodes->pdata,
+	                                nodes->len);
+	g_assert_cmpuint (wbl_tape_get_n_bytes (tape), <, serialised_size / 2);
+
+	wbl_tape_unref (tape);
+	g_ptr_array_unref (nodes);
+	g_object_unref (parser);
+}
+
+/* Test that a tape spilled to a file still returns the same values. */
+static void
+test_tape_spill (void)
+{
+	JsonParser *parser = NULL;  /* owned */
+	GPtrArray/*<owned JsonNode>*/ *nodes = NULL;  /* owned */
+	WblTape *tape = NULL;  /* owned */
+	gsize n_bytes;
+	guint i;
+	GError *error = NULL;
+
+	parser = json_parser_new ();
+	nodes = g_ptr_array_new_with_free_func ((GDestroyNotify) json_node_free);
+
+	for (i = 0; i < 50; i++) {
+		gchar *document = NULL;  /* owned */
+
+		document = g_strdup_printf ("{\"a\": [%u, %u.5, \"b%u\"], "
+		                            "\"c\": {\"d\": null, \"e\": true}}",
+		                            i, i, i % 7);
+		json_parser_load_from_data (parser, document, -1, &error);
+		g_assert_no_error (error);
+
+		g_ptr_array_add (nodes,
+		                 json_node_copy (json_parser_get_root (parser)));
+		g_free (document);
+	}
+
+	tape = wbl_tape_new_from_nodes ((JsonNode * const *) nodes->pdata,
+	                                nodes->len);
+	n_bytes = wbl_tape_get_n_bytes (tape);
+	g_assert (!wbl_tape_is_spilled (tape));
+
+	wbl_tape_spill (tape, &error);
+	g_assert_no_error (error);
+	g_assert (wbl_tape_is_spilled (tape));
+	g_assert_cmpuint (wbl_tape_get_n_values (tape), ==, nodes->len);
+	g_assert_cmpuint (wbl_tape_get_n_bytes (tape), ==, n_bytes);
+
+	/* Spilling again does nothing. */
+	wbl_tape_spill (tape, &error);
+	g_assert_no_error (error);
+
+	for (i = 0; i < nodes->len; i++) {
+		JsonNode *node = NULL;  /* owned */
+
+		node = wbl_tape_dup_node (tape, i);
+		g_assert (wbl_json_node_equal (node, nodes->pdata[i]));
+		json_node_free (node);
+	}
+
+	wbl_tape_unref (tape);
+	g_ptr_array_unref (nodes);
+	g_object_unref (parser);
+}
+
+/* Test that values which are equal in the JSON Schema sense, but would
+ * serialise differently, are not identical, either in a tape or as nodes. */
+static void
+test_tape_equal_node (void)
+{
+	JsonParser *parser = NULL;  /* owned */
+	GHashTable/*<unowned JsonNode, guint>*/ *hashes = NULL;  /* owned */
+	guint i;
+
+	const struct {
+		const gchar *stored;
+		const gchar *compared;
+	} vectors[] = {
+		{ "1", "1.0" },
+		{ "0.0", "-0.0" },
+		{ "{\"a\": 1, \"b\": 2}", "{\"b\": 2, \"a\": 1}" },
+		{ "{\"a\": 1}", "{\"a\": 1, \"b\": 2}" },
+		{ "[1, 2]", "[1, 2, 3]" },
+		{ "\"a\"", "\"A\"" },
+		{ "[]", "{}" },
+		{ "null", "false" },
+	};
+
+	parser = json_parser_new ();
+	hashes = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (i = 0; i < G_N_ELEMENTS (vectors); i++) {
+		JsonNode *stored = NULL, *compared = NULL, *copy = NULL;  /* owned */
+		WblTape *tape = NULL;  /* owned */
+		GError *error = NULL;
+
+		g_test_message ("Vector %u: %s, %s", i, vectors[i].stored,
+		                vectors[i].compared);
+
+		json_parser_load_from_data (parser, vectors[i].stored, -1,
+		                            &error);
+		g_assert_no_error (error);
+		stored = json_node_copy (json_parser_get_root (parser));
+
+		json_parser_load_from_data (parser, vectors[i].compared, -1,
+		                            &error);
+		g_assert_no_error (error);
+		compared = json_node_copy (json_parser_get_root (parser));
+
+		tape = wbl_tape_new_from_nodes (&stored, 1);
+		g_assert (wbl_tape_equal_node (tape, 0, stored));
+		g_assert (!wbl_tape_equal_node (tape, 0, compared));
+
+		/* The same goes for nodes. */
+		copy = wbl_tape_dup_node (tape, 0);
+		g_assert (wbl_json_node_equal_strict (copy, stored));
+		g_assert (!wbl_json_node_equal_strict (copy, compared));
+		g_assert_cmpuint (wbl_json_node_hash_strict (copy), ==,
+		                  wbl_json_node_hash_strict (stored));
+		g_assert_cmpuint (wbl_json_node_hash_strict_cached (copy, hashes),
+		                  ==, wbl_json_node_hash_strict (stored));
+		g_hash_table_remove_all (hashes);
+		json_node_free (copy);
+
+		wbl_tape_unref (tape);
+
+		json_node_free (compared);
+		json_node_free (stored);
+	}
+
+	g_hash_table_unref (hashes);
+	g_object_unref (parser);
+}
+
+/* Test that a serialised tape loads again with the same values, and that
+ * truncated or corrupted serialisations are rejected or, if they are still
+ * well formed, can be read safely. */
+static void
+test_tape_serialise (void)
+{
+	JsonParser *parser = NULL;  /* owned */
+	GPtrArray/*<owned JsonNode>*/ *nodes = NULL;  /* owned */
+	WblTape *tape = NULL, *loaded = NULL;  /* owned */
+	GBytes *serialised = NULL, *bytes = NULL;  /* owned */
+	const guint8 *data;
+	guint8 *copy = NULL;  /* owned */
+	gsize length, i;
+	GRand *prng = NULL;  /* owned */
+	GError *error = NULL;
+
+	const gchar *documents[] = {
+		"{\"type\": \"object\", \"properties\": "
+		"{\"a\": {\"type\": \"integer\", \"minimum\": -1.5}}}",
+		"[1, \"é\", [[]], {}, null, true, false]",
+		"\"a\"",
+	};
+
+	parser = json_parser_new ();
+	nodes = g_ptr_array_new_with_free_func ((GDestroyNotify) json_node_free);
+
+	for (i = 0; i < G_N_ELEMENTS (documents); i++) {
+		json_parser_load_from_data (parser, documents[i], -1, &error);
+		g_assert_no_error (error);
+
+		g_ptr_array_add (nodes,
+		                 json_node_copy (json_parser_get_root (parser)));
+	}
+
+	tape = wbl_tape_new_from_nodes ((JsonNode * const *) nodes->pdata,
+	                                nodes->len);
+	serialised = wbl_tape_serialise (tape);
+	wbl_tape_unref (tape);
+
+	data = g_bytes_get_data (serialised, &length);
+
+	/* Load it normally, and from an unaligned copy. */
+	copy = g_malloc (length + 1);
+	memcpy (copy + 1, data, length);
+
+	for (i = 0; i < 2; i++) {
+		guint j;
+
+		if (i == 0) {
+			bytes = g_bytes_ref (serialised);
+		} else {
+			bytes = g_bytes_new_static (copy + 1, length);
+		}
+
+		loaded = wbl_tape_new_from_bytes (bytes, &error);
+		g_assert_no_error (error);
+		g_bytes_unref (bytes);
+
+		g_assert_cmpuint (wbl_tape_get_n_values (loaded), ==,
+		                  nodes->len);
+
+		/* Tapes loaded from bytes cannot be spilled. */
+		wbl_tape_spill (loaded, &error);
+		g_assert_no_error (error);
+		g_assert (!wbl_tape_is_spilled (loaded));
+
+		for (j = 0; j < nodes->len; j++) {
+			JsonNode *node = NULL;  /* owned */
+
+			node = wbl_tape_dup_node (loaded, j);
+			g_assert (wbl_json_node_equal (node, nodes->pdata[j]));
+			json_node_free (node);
+		}
+
+		wbl_tape_unref (loaded);
+	}
+
+	/* Every truncation is rejected. */
+	for (i = 0; i < length; i++) {
+		bytes = g_bytes_new_static (data, i);
+		g_assert (wbl_tape_new_from_bytes (bytes, NULL) == NULL);
+		g_bytes_unref (bytes);
+	}
+
+	/* Corrupt random bytes. */
+	prng = g_rand_new_with_seed (42);
+
+	for (i = 0; i < 10000; i++) {
+		guint j, n_corruptions;
+
+		memcpy (copy, data, length);
+		n_corruptions = g_rand_int_range (prng, 1, 4);
+
+		for (j = 0; j < n_corruptions; j++) {
+			copy[g_rand_int_range (prng, 0, length)] =
+				g_rand_int_range (prng, 0, 256);
+		}
+
+		bytes = g_bytes_new_static (copy, length);
+		loaded = wbl_tape_new_from_bytes (bytes, NULL);
+		g_bytes_unref (bytes);
+
+		if (loaded != NULL) {
+			for (j = 0; j < wbl_tape_get_n_values (loaded); j++) {
+				json_node_free (wbl_tape_dup_node (loaded, j));
+			}
+
+			wbl_tape_unref (loaded);
+		}
+	}
+
+	g_rand_free (prng);
+	g_free (copy);
+	g_bytes_unref (serialised);
+
+	/* An empty tape. */
+	tape = wbl_tape_new_from_nodes (NULL, 0);
+	serialised = wbl_tape_serialise (tape);
+	wbl_tape_unref (tape);
+
+	loaded = wbl_tape_new_from_bytes (serialised, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (wbl_tape_get_n_values (loaded), ==, 0);
+	wbl_tape_unref (loaded);
+	g_bytes_unref (serialised);
+
+	g_ptr_array_unref (nodes);
+	g_object_unref (parser);
+}
+
+int
+main (int argc, char *argv[])
+{
+#if !GLIB_CHECK_VERSION (2, 35, 0)
+	g_type_init ();
+#endif
+
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/tape/round-trip", test_tape_round_trip);
+	g_test_add_func ("/tape/interning", test_tape_interning);
+	g_test_add_func ("/tape/spill", test_tape_spill);
+	g_test_add_func ("/tape/serialise", test_tape_serialise);
+	g_test_add_func ("/tape/equal-node", test_tape_equal_node);
+
+	return g_test_run ();
+}
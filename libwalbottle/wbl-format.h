@@ -0,0 +1,79 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WBL_FORMAT_H
+#define WBL_FORMAT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * WblFormat:
+ * @WBL_FORMAT_UNKNOWN: A format which is not defined by
+ *    draft-fge-json-schema-validation-00, and is not checked.
+ * @WBL_FORMAT_DATE_TIME: `date-time`: an RFC 3339 date and time.
+ * @WBL_FORMAT_EMAIL: `email`: an RFC 5322 e-mail address.
+ * @WBL_FORMAT_HOSTNAME: `hostname`: an RFC 1034 host name.
+ * @WBL_FORMAT_IPV4: `ipv4`: an RFC 2673 dotted-quad IPv4 address.
+ * @WBL_FORMAT_IPV6: `ipv6`: an RFC 2373 IPv6 address.
+ * @WBL_FORMAT_URI: `uri`: an RFC 3986 URI.
+ *
+ * The string formats defined for the `format` keyword in
+ * draft-fge-json-schema-validation-00§7.3.
+ *
+ * Since: UNRELEASED
+ */
+typedef enum {
+	WBL_FORMAT_UNKNOWN = 0,
+	WBL_FORMAT_DATE_TIME,
+	WBL_FORMAT_EMAIL,
+	WBL_FORMAT_HOSTNAME,
+	WBL_FORMAT_IPV4,
+	WBL_FORMAT_IPV6,
+	WBL_FORMAT_URI,
+} WblFormat;
+
+/**
+ * WblFormatExample:
+ * @value: example string
+ * @valid: %TRUE if @value is valid for the format, %FALSE otherwise
+ *
+ * An example string for a #WblFormat, used for generating instances.
+ *
+ * Since: UNRELEASED
+ */
+typedef struct {
+	const gchar *value;
+	gboolean valid;
+} WblFormatExample;
+
+WblFormat                wbl_format_from_string  (const gchar *name);
+const gchar             *wbl_format_get_section  (WblFormat    format);
+
+gboolean                 wbl_format_validate     (WblFormat    format,
+                                                  const gchar *str,
+                                                  gsize        length);
+
+const WblFormatExample  *wbl_format_get_examples (WblFormat    format,
+                                                  gsize       *n_examples);
+
+G_END_DECLS
+
+#endif /* !WBL_FORMAT_H */
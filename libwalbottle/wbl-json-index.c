@@ -0,0 +1,1245 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SECTION:wbl-json-index
+ * @short_description: Structural index and parser for raw JSON data
+ * @stability: Private
+ * @include: libwalbottle/wbl-json-index.h
+ *
+ * A two-stage parser for serialised JSON, following the approach of
+ * simdjson (Langdale and Lemire, ‘Parsing Gigabytes of JSON per Second’,
+ * https://arxiv.org/abs/1902.08318).
+ *
+ * The first stage builds a #WblJsonIndex: the offsets of all the structural
+ * characters in the data, found 64 bytes at a time using bitmasks computed
+ * with SSE2 or AVX2 instructions where available. String boundaries are found
+ * from the bitmasks, without examining the string contents byte by byte. If
+ * SIMD instructions are not available, the index is built one byte at a time
+ * instead.
+ *
+ * The second stage walks the index to build a #JsonNode tree, checking the
+ * grammar and decoding strings and numbers as it goes. It accepts strict
+ * JSON (RFC 7159), with any value allowed at the top level. A filter can be
+ * given to skip decoding values which the caller will not look at, such as
+ * the members of an instance which no schema keyword examines; they are still
+ * checked, by walking their part of the index without allocating anything.
+ *
+ * Since: UNRELEASED
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "wbl-json-index.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* Maximum nesting depth of arrays and objects, to bound the recursion in
+ * parse_value(). */
+#define MAX_DEPTH 1024
+
+/* Ensure @self has space for @n_extra more positions. */
+static void
+ensure_capacity (WblJsonIndex *self,
+                 gsize        *n_allocated,
+                 gsize         n_extra)
+{
+	if (self->n_positions + n_extra > *n_allocated) {
+		*n_allocated = MAX (*n_allocated * 2,
+		                    self->n_positions + n_extra);
+		self->positions = g_renew (guint32, self->positions,
+		                           *n_allocated);
+	}
+}
+
+static void
+set_unterminated_string_error (GError **error)
+{
+	g_set_error_literal (error, JSON_PARSER_ERROR,
+	                     JSON_PARSER_ERROR_PARSE,
+	                     _("Unterminated string in JSON document."));
+}
+
+/* Build the index one byte at a time. As in build_simd(), a backslash escapes
+ * the following byte even outside a string; that is never valid JSON, but it
+ * keeps the two indexes identical.
+ *
+ * Complexity: O(N) in @length */
+static gboolean
+build_scalar (WblJsonIndex  *self,
+              const gchar   *data,
+              gsize          length,
+              GError       **error)
+{
+	gsize i, n_allocated = 0;
+	gboolean in_string = FALSE, escaped = FALSE, in_scalar = FALSE;
+
+	for (i = 0; i < length; i++) {
+		gboolean is_structural = FALSE, is_escaped = escaped;
+
+		escaped = (data[i] == '\\' && !is_escaped);
+
+		if (in_string) {
+			if (data[i] == '"' && !is_escaped) {
+				in_string = FALSE;
+				is_structural = TRUE;
+			}
+		} else {
+			switch (data[i]) {
+			case '{':
+			case '}':
+			case '[':
+			case ']':
+			case ':':
+			case ',':
+				in_scalar = FALSE;
+				is_structural = TRUE;
+				break;
+			case ' ':
+			case '\t':
+			case '\n':
+			case '\r':
+				in_scalar = FALSE;
+				break;
+			case '"':
+				if (!is_escaped) {
+					in_string = TRUE;
+					in_scalar = FALSE;
+					is_structural = TRUE;
+					break;
+				}
+				/* Fall through. */
+			default:
+				is_structural = !in_scalar;
+				in_scalar = TRUE;
+				break;
+			}
+		}
+
+		if (is_structural) {
+			ensure_capacity (self, &n_allocated, 1);
+			self->positions[self->n_positions++] = i;
+		}
+	}
+
+	if (in_string) {
+		set_unterminated_string_error (error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+#ifdef HAVE_X86_SIMD
+/* Bitmasks over a 64-byte block, with bit i set if byte i is in each class.
+ * Operators are the structural characters other than quotes. */
+typedef struct {
+	guint64 backslash;
+	guint64 quote;
+	guint64 operator;
+	guint64 whitespace;
+} BlockMasks;
+
+/* State carried from one block to the next. */
+typedef struct {
+	/* Bit 0 is set if the first byte of the block is escaped. */
+	guint64 prev_escaped;
+	/* All bits are set if the block starts inside a string. */
+	guint64 prev_in_string;
+	/* Bit 0 is set if the last byte of the previous block was part of a
+	 * number or literal. */
+	guint64 prev_scalar;
+} BlockState;
+
+#define EVEN_BITS G_GUINT64_CONSTANT (0x5555555555555555)
+
+static void
+classify_block_sse2 (const guchar *block,
+                     BlockMasks   *masks)
+{
+	guint i;
+
+	memset (masks, 0, sizeof (*masks));
+
+	for (i = 0; i < 4; i++) {
+		__m128i v, operator, whitespace;
+		guint shift = 16 * i;
+
+		v = _mm_loadu_si128 ((const __m128i *) (block + shift));
+
+		operator = _mm_or_si128 (
+			_mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('{')),
+			              _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('}'))),
+			_mm_or_si128 (
+				_mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('[')),
+				              _mm_cmpeq_epi8 (v, _mm_set1_epi8 (']'))),
+				_mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 (':')),
+				              _mm_cmpeq_epi8 (v, _mm_set1_epi8 (',')))));
+		whitespace = _mm_or_si128 (
+			_mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 (' ')),
+			              _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\t'))),
+			_mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\n')),
+			              _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\r'))));
+
+		masks->backslash |= (guint64) (guint16) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\\'))) << shift;
+		masks->quote |= (guint64) (guint16) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('"'))) << shift;
+		masks->operator |= (guint64) (guint16) _mm_movemask_epi8 (operator) << shift;
+		masks->whitespace |= (guint64) (guint16) _mm_movemask_epi8 (whitespace) << shift;
+	}
+}
+
+__attribute__ ((target ("avx2")))
+static void
+classify_block_avx2 (const guchar *block,
+                     BlockMasks   *masks)
+{
+	guint i;
+
+	memset (masks, 0, sizeof (*masks));
+
+	for (i = 0; i < 2; i++) {
+		__m256i v, operator, whitespace;
+		guint shift = 32 * i;
+
+		v = _mm256_loadu_si256 ((const __m256i *) (block + shift));
+
+		operator = _mm256_or_si256 (
+			_mm256_or_si256 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('{')),
+			                 _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('}'))),
+			_mm256_or_si256 (
+				_mm256_or_si256 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('[')),
+				                 _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 (']'))),
+				_mm256_or_si256 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 (':')),
+				                 _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 (',')))));
+		whitespace = _mm256_or_si256 (
+			_mm256_or_si256 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 (' ')),
+			                 _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('\t'))),
+			_mm256_or_si256 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('\n')),
+			                 _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('\r'))));
+
+		masks->backslash |= (guint64) (guint32) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('\\'))) << shift;
+		masks->quote |= (guint64) (guint32) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('"'))) << shift;
+		masks->operator |= (guint64) (guint32) _mm256_movemask_epi8 (operator) << shift;
+		masks->whitespace |= (guint64) (guint32) _mm256_movemask_epi8 (whitespace) << shift;
+	}
+}
+
+static gboolean
+cpu_supports_avx2 (void)
+{
+	static gsize supported = 0;  /* 1 if unsupported, 2 if supported */
+
+	if (g_once_init_enter (&supported)) {
+		__builtin_cpu_init ();
+		g_once_init_leave (&supported,
+		                   __builtin_cpu_supports ("avx2") ? 2 : 1);
+	}
+
+	return (supported == 2);
+}
+
+/* Find the bytes in a block which are escaped: those following an odd-length
+ * run of backslashes. Runs may continue from the previous block.
+ *
+ * Adding the bits for the runs which start on odd bits to the backslash bits
+ * carries each of those runs through to the byte following it, which flips
+ * the parity of the alternating mask of escaped bytes for those runs. */
+static guint64
+find_escaped (guint64  backslash,
+              guint64 *prev_escaped)
+{
+	guint64 follows_escape, odd_sequence_starts;
+	guint64 sequences_starting_on_even_bits;
+
+	if (backslash == 0) {
+		guint64 escaped = *prev_escaped;
+
+		*prev_escaped = 0;
+
+		return escaped;
+	}
+
+	/* An escaped backslash does not start a run. */
+	backslash &= ~*prev_escaped;
+	follows_escape = (backslash << 1) | *prev_escaped;
+
+	odd_sequence_starts = backslash & ~EVEN_BITS & ~follows_escape;
+	sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+	*prev_escaped = (sequences_starting_on_even_bits < odd_sequence_starts) ? 1 : 0;
+
+	return (EVEN_BITS ^ (sequences_starting_on_even_bits << 1)) &
+	       follows_escape;
+}
+
+/* Bit i of the result is the XOR of bits 0 to i of @bits. Applied to the
+ * unescaped quotes, this gives the bytes inside strings, including the
+ * opening quote but not the closing one. */
+static guint64
+prefix_xor (guint64 bits)
+{
+	bits ^= bits << 1;
+	bits ^= bits << 2;
+	bits ^= bits << 4;
+	bits ^= bits << 8;
+	bits ^= bits << 16;
+	bits ^= bits << 32;
+
+	return bits;
+}
+
+/* Add the positions of the structural characters in a block to @self, which
+ * must have space for at least 64 more positions.
+ *
+ * Complexity: O(S) in the number of structural characters in the block */
+static void
+index_block (WblJsonIndex     *self,
+             const BlockMasks *masks,
+             BlockState       *state,
+             guint32           offset)
+{
+	guint64 escaped, quote, in_string, scalar, scalar_starts, structural;
+
+	escaped = find_escaped (masks->backslash, &state->prev_escaped);
+	quote = masks->quote & ~escaped;
+
+	in_string = prefix_xor (quote) ^ state->prev_in_string;
+	state->prev_in_string = 0 - (in_string >> 63);
+
+	/* Numbers and literals are everything else outside strings; only the
+	 * first byte of each is indexed. */
+	scalar = ~(masks->operator | masks->whitespace | quote) & ~in_string;
+	scalar_starts = scalar & ~((scalar << 1) | state->prev_scalar);
+	state->prev_scalar = scalar >> 63;
+
+	structural = (masks->operator & ~in_string) | quote | scalar_starts;
+
+	while (structural != 0) {
+		self->positions[self->n_positions++] =
+			offset + (guint32) __builtin_ctzll (structural);
+		structural &= structural - 1;
+	}
+}
+
+/* Build the index 64 bytes at a time. The final partial block is padded with
+ * whitespace.
+ *
+ * Complexity: O(N) in @length */
+static gboolean
+build_simd (WblJsonIndex  *self,
+            const gchar   *data,
+            gsize          length,
+            GError       **error)
+{
+	BlockState state = { 0, 0, 0 };
+	BlockMasks masks;
+	guchar padded[64];
+	gsize offset, n_allocated = 0;
+	gboolean use_avx2;
+
+	use_avx2 = cpu_supports_avx2 ();
+
+	for (offset = 0; offset < length; offset += 64) {
+		const guchar *block;
+
+		if (length - offset >= 64) {
+			block = (const guchar *) data + offset;
+		} else {
+			memset (padded, ' ', sizeof (padded));
+			memcpy (padded, data + offset, length - offset);
+			block = padded;
+		}
+
+		if (use_avx2) {
+			classify_block_avx2 (block, &masks);
+		} else {
+			classify_block_sse2 (block, &masks);
+		}
+
+		ensure_capacity (self, &n_allocated, 64);
+		index_block (self, &masks, &state, offset);
+	}
+
+	if (state.prev_in_string != 0) {
+		set_unterminated_string_error (error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+#endif /* HAVE_X86_SIMD */
+
+/**
+ * wbl_json_index_init:
+ * @self: an uninitialised #WblJsonIndex
+ * @data: (array length=length): serialised JSON data to index
+ * @length: length of @data, in bytes
+ * @flags: flags affecting how the index is built
+ * @error: return location for a #GError, or %NULL
+ *
+ * Build a structural index over @data. This only checks that all strings in
+ * @data are terminated; the rest of the JSON grammar is checked by
+ * wbl_json_index_parse().
+ *
+ * On success, @self must be cleared using wbl_json_index_clear() when it is
+ * no longer needed. On failure, @self is left cleared.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ *
+ * Since: UNRELEASED
+ */
+gboolean
+wbl_json_index_init (WblJsonIndex       *self,
+                     const gchar        *data,
+                     gsize               length,
+                     WblJsonIndexFlags   flags,
+                     GError            **error)
+{
+	gboolean success;
+
+	g_return_val_if_fail (self != NULL, FALSE);
+	g_return_val_if_fail (data != NULL || length == 0, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	self->positions = NULL;
+	self->n_positions = 0;
+
+	if (length > G_MAXUINT32) {
+		g_set_error_literal (error, JSON_PARSER_ERROR,
+		                     JSON_PARSER_ERROR_INVALID_DATA,
+		                     _("JSON document is too large."));
+		return FALSE;
+	}
+
+#ifdef HAVE_X86_SIMD
+	if (!(flags & WBL_JSON_INDEX_SCALAR)) {
+		success = build_simd (self, data, length, error);
+	} else
+#endif
+	{
+		success = build_scalar (self, data, length, error);
+	}
+
+	if (!success) {
+		wbl_json_index_clear (self);
+	}
+
+	return success;
+}
+
+/**
+ * wbl_json_index_clear:
+ * @self: a #WblJsonIndex
+ *
+ * Free the contents of @self. It may be initialised again afterwards.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_json_index_clear (WblJsonIndex *self)
+{
+	g_return_if_fail (self != NULL);
+
+	g_free (self->positions);
+	self->positions = NULL;
+	self->n_positions = 0;
+}
+
+/* State for walking an index to build a #JsonNode tree. */
+typedef struct {
+	const gchar *data;  /* unowned */
+	gsize length;
+	const WblJsonIndex *index;  /* unowned */
+	gsize next;  /* index into index->positions */
+	guint depth;
+	GString *buffer;  /* owned; scratch space for decoding strings */
+	WblJsonIndexFilterFunc filter;  /* nullable */
+	gpointer user_data;
+} Parser;
+
+static void
+set_parse_error (GError          **error,
+                 JsonParserError   code,
+                 gsize             offset,
+                 const gchar      *message)
+{
+	g_set_error (error, JSON_PARSER_ERROR, code,
+	             _("Parse error at byte %u: %s"), (guint) offset, message);
+}
+
+/* Get the next structural character without consuming it, or nul if the end
+ * of the data has been reached. */
+static gchar
+peek (Parser *parser,
+      gsize  *offset_out)
+{
+	if (parser->next >= parser->index->n_positions) {
+		*offset_out = parser->length;
+		return '\0';
+	}
+
+	*offset_out = parser->index->positions[parser->next];
+
+	return parser->data[*offset_out];
+}
+
+static gboolean
+is_whitespace (gchar c)
+{
+	return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+}
+
+static gboolean
+read_hex4 (const gchar *p,
+           const gchar *end,
+           gunichar    *out)
+{
+	gunichar value = 0;
+	guint i;
+
+	if (end - p < 4) {
+		return FALSE;
+	}
+
+	for (i = 0; i < 4; i++) {
+		gint digit = g_ascii_xdigit_value (p[i]);
+
+		if (digit < 0) {
+			return FALSE;
+		}
+
+		value = value * 16 + (gunichar) digit;
+	}
+
+	*out = value;
+
+	return TRUE;
+}
+
+/* Check the string whose opening quote is at the next position in the index,
+ * and consume it. If @decode is %TRUE, also decode it into parser->buffer.
+ * Runs of printable ASCII are copied as they are; only escapes and non-ASCII
+ * characters are handled individually. `\u0000` is rejected: #JsonNode and
+ * #JsonObject store nul-terminated strings, so it would silently truncate the
+ * string.
+ *
+ * Returns: the decoded string, owned by parser->buffer (or an empty string if
+ *    @decode is %FALSE), or %NULL on error
+ *
+ * Complexity: O(N) in the length of the string */
+static const gchar *
+parse_string (Parser    *parser,
+              gboolean   decode,
+              GError   **error)
+{
+	gsize open, close;
+	const gchar *p, *end;
+
+	/* No structural characters are indexed inside strings, so the closing
+	 * quote is the next position. wbl_json_index_init() guarantees it
+	 * exists. */
+	open = parser->index->positions[parser->next];
+	close = parser->index->positions[parser->next + 1];
+	parser->next += 2;
+
+	if (decode) {
+		g_string_truncate (parser->buffer, 0);
+	}
+
+	p = parser->data + open + 1;
+	end = parser->data + close;
+
+	while (p < end) {
+		const gchar *run = p;
+		gunichar c;
+
+		while (p < end && (guchar) *p >= 0x20 && (guchar) *p < 0x80 &&
+		       *p != '\\') {
+			p++;
+		}
+
+		if (decode) {
+			g_string_append_len (parser->buffer, run, p - run);
+		}
+
+		if (p == end) {
+			break;
+		} else if ((guchar) *p < 0x20) {
+			set_parse_error (error, JSON_PARSER_ERROR_PARSE,
+			                 p - parser->data,
+			                 _("Control character in string."));
+			return NULL;
+		} else if ((guchar) *p >= 0x80) {
+			const gchar *next_char;
+
+			c = g_utf8_get_char_validated (p, end - p);
+
+			if (c == (gunichar) -1 || c == (gunichar) -2) {
+				set_parse_error (error,
+				                 JSON_PARSER_ERROR_INVALID_DATA,
+				                 p - parser->data,
+				                 _("Invalid UTF-8 in string."));
+				return NULL;
+			}
+
+			next_char = g_utf8_next_char (p);
+
+			if (decode) {
+				g_string_append_len (parser->buffer, p,
+				                     next_char - p);
+			}
+
+			p = next_char;
+
+			continue;
+		}
+
+		/* Escape sequence. The closing quote cannot be escaped, so
+		 * there is always at least one more byte. */
+		p++;
+
+		switch (*p) {
+		case '"':
+		case '\\':
+		case '/':
+			c = *p;
+			p++;
+			break;
+		case 'b':
+			c = '\b';
+			p++;
+			break;
+		case 'f':
+			c = '\f';
+			p++;
+			break;
+		case 'n':
+			c = '\n';
+			p++;
+			break;
+		case 'r':
+			c = '\r';
+			p++;
+			break;
+		case 't':
+			c = '\t';
+			p++;
+			break;
+		case 'u': {
+			gunichar low;
+
+			if (!read_hex4 (p + 1, end, &c)) {
+				goto invalid_escape;
+			}
+
+			p += 5;
+
+			/* Combine surrogate pairs. Unpaired surrogates are
+			 * not valid Unicode characters. */
+			if (c >= 0xd800 && c < 0xdc00) {
+				if (end - p < 6 || p[0] != '\\' || p[1] != 'u' ||
+				    !read_hex4 (p + 2, end, &low) ||
+				    low < 0xdc00 || low >= 0xe000) {
+					goto invalid_escape;
+				}
+
+				c = 0x10000 + ((c - 0xd800) << 10) +
+				    (low - 0xdc00);
+				p += 6;
+			} else if (c >= 0xdc00 && c < 0xe000) {
+				goto invalid_escape;
+			} else if (c == 0) {
+				set_parse_error (error,
+				                 JSON_PARSER_ERROR_INVALID_DATA,
+				                 p - 6 - parser->data,
+				                 _("Nul character in string."));
+				return NULL;
+			}
+
+			break;
+		}
+		default:
+			goto invalid_escape;
+		}
+
+		if (decode) {
+			g_string_append_unichar (parser->buffer, c);
+		}
+	}
+
+	return decode ? parser->buffer->str : "";
+
+invalid_escape:
+	set_parse_error (error, JSON_PARSER_ERROR_PARSE, p - parser->data,
+	                 _("Invalid escape sequence in string."));
+
+	return NULL;
+}
+
+/* Parse a number, following the grammar from RFC 7159§6. Numbers without a
+ * fraction or exponent are integers, unless they overflow a #gint64. If
+ * @node_out is %NULL, the number is only checked, not converted.
+ *
+ * Complexity: O(N) in @length */
+static gboolean
+parse_number (Parser       *parser,
+              const gchar  *start,
+              gsize         length,
+              JsonNode    **node_out,
+              GError      **error)
+{
+	const gchar *p = start, *end = start + length;
+	gboolean is_integer = TRUE;
+	gchar buf[64];
+	gchar *str = NULL;  /* owned */
+	JsonNode *node = NULL;  /* owned */
+
+	if (p < end && *p == '-') {
+		p++;
+	}
+
+	if (p < end && *p == '0') {
+		p++;
+	} else if (p < end && *p >= '1' && *p <= '9') {
+		while (p < end && g_ascii_isdigit (*p)) {
+			p++;
+		}
+	} else {
+		goto invalid;
+	}
+
+	if (p < end && *p == '.') {
+		p++;
+		is_integer = FALSE;
+
+		if (p == end || !g_ascii_isdigit (*p)) {
+			goto invalid;
+		}
+
+		while (p < end && g_ascii_isdigit (*p)) {
+			p++;
+		}
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		is_integer = FALSE;
+
+		if (p < end && (*p == '+' || *p == '-')) {
+			p++;
+		}
+
+		if (p == end || !g_ascii_isdigit (*p)) {
+			goto invalid;
+		}
+
+		while (p < end && g_ascii_isdigit (*p)) {
+			p++;
+		}
+	}
+
+	if (p != end) {
+		goto invalid;
+	}
+
+	if (node_out == NULL) {
+		return TRUE;
+	}
+
+	/* The conversion functions need a nul-terminated string. */
+	if (length < sizeof (buf)) {
+		memcpy (buf, start, length);
+		buf[length] = '\0';
+	} else {
+		str = g_strndup (start, length);
+	}
+
+	node = json_node_new (JSON_NODE_VALUE);
+
+	if (is_integer) {
+		gint64 value;
+
+		errno = 0;
+		value = g_ascii_strtoll ((str != NULL) ? str : buf, NULL, 10);
+
+		if (errno == 0) {
+			json_node_set_int (node, value);
+			g_free (str);
+			*node_out = node;
+
+			return TRUE;
+		}
+	}
+
+	json_node_set_double (node, g_ascii_strtod ((str != NULL) ? str : buf,
+	                                            NULL));
+	g_free (str);
+	*node_out = node;
+
+	return TRUE;
+
+invalid:
+	set_parse_error (error, JSON_PARSER_ERROR_INVALID_BAREWORD,
+	                 start - parser->data, _("Invalid bare word."));
+
+	return FALSE;
+}
+
+/* Parse a number or literal, which extends up to the next structural
+ * character, less any trailing whitespace. If @node_out is %NULL, the token is
+ * only checked.
+ *
+ * Complexity: O(N) in the length of the token */
+static gboolean
+parse_scalar (Parser    *parser,
+              JsonNode **node_out,
+              GError   **error)
+{
+	gsize start, end;
+	JsonNode *node = NULL;  /* owned */
+
+	start = parser->index->positions[parser->next];
+	parser->next++;
+
+	if (parser->next < parser->index->n_positions) {
+		end = parser->index->positions[parser->next];
+	} else {
+		end = parser->length;
+	}
+
+	while (end > start && is_whitespace (parser->data[end - 1])) {
+		end--;
+	}
+
+	if (end - start == 4 &&
+	    memcmp (parser->data + start, "true", 4) == 0) {
+		if (node_out != NULL) {
+			node = json_node_new (JSON_NODE_VALUE);
+			json_node_set_boolean (node, TRUE);
+		}
+	} else if (end - start == 5 &&
+	           memcmp (parser->data + start, "false", 5) == 0) {
+		if (node_out != NULL) {
+			node = json_node_new (JSON_NODE_VALUE);
+			json_node_set_boolean (node, FALSE);
+		}
+	} else if (end - start == 4 &&
+	           memcmp (parser->data + start, "null", 4) == 0) {
+		if (node_out != NULL) {
+			node = json_node_new (JSON_NODE_NULL);
+		}
+	} else {
+		return parse_number (parser, parser->data + start, end - start,
+		                     node_out, error);
+	}
+
+	if (node_out != NULL) {
+		*node_out = node;
+	}
+
+	return TRUE;
+}
+
+static gboolean parse_value (Parser    *parser,
+                             gpointer   context,
+                             JsonNode **node_out,
+                             GError   **error);
+
+/* Parse the member or element of a container being decoded with @context.
+ * If the filter says its value is not needed, it is only checked, and a null
+ * placeholder is returned instead.
+ *
+ * Complexity: O(parse_value) */
+static gboolean
+parse_child (Parser       *parser,
+             gpointer      context,
+             const gchar  *member_name,
+             guint         element_index,
+             JsonNode    **node_out,
+             GError      **error)
+{
+	gpointer child_context = NULL;
+
+	if (parser->filter != NULL) {
+		child_context = parser->filter (context, member_name,
+		                                element_index,
+		                                parser->user_data);
+
+		if (child_context == NULL) {
+			if (!parse_value (parser, NULL, NULL, error)) {
+				return FALSE;
+			}
+
+			*node_out = json_node_new (JSON_NODE_NULL);
+
+			return TRUE;
+		}
+	}
+
+	return parse_value (parser, child_context, node_out, error);
+}
+
+/* Parse an object. If @node_out is %NULL, the object is only checked, and
+ * none of its members are decoded.
+ *
+ * Complexity: O(N) in the number of members, plus parse_value() for each */
+static gboolean
+parse_object (Parser    *parser,
+              gpointer   context,
+              JsonNode **node_out,
+              GError   **error)
+{
+	JsonObject *object = NULL;  /* owned */
+	gboolean decode = (node_out != NULL);
+	gsize offset;
+	gchar c;
+
+	parser->next++;
+
+	if (decode) {
+		object = json_object_new ();
+	}
+
+	if (peek (parser, &offset) == '}') {
+		parser->next++;
+		goto done;
+	}
+
+	while (TRUE) {
+		gchar *member_name = NULL;  /* owned */
+		JsonNode *member_node = NULL;  /* owned */
+
+		c = peek (parser, &offset);
+
+		if (c != '"') {
+			set_parse_error (error,
+			                 (c == '}') ? JSON_PARSER_ERROR_TRAILING_COMMA :
+			                              JSON_PARSER_ERROR_PARSE,
+			                 offset, _("Expected a member name."));
+			goto error;
+		}
+
+		if (parse_string (parser, decode, error) == NULL) {
+			goto error;
+		}
+
+		if (decode) {
+			member_name = g_strdup (parser->buffer->str);
+		}
+
+		if (peek (parser, &offset) != ':') {
+			set_parse_error (error, JSON_PARSER_ERROR_MISSING_COLON,
+			                 offset, _("Expected ‘:’."));
+			g_free (member_name);
+			goto error;
+		}
+
+		parser->next++;
+
+		if (!(decode ?
+		      parse_child (parser, context, member_name, 0,
+		                   &member_node, error) :
+		      parse_value (parser, NULL, NULL, error))) {
+			g_free (member_name);
+			goto error;
+		}
+
+		/* As with #JsonParser, later duplicate members replace
+		 * earlier ones. */
+		if (decode) {
+			json_object_set_member (object, member_name,
+			                        member_node);  /* transfer */
+			g_free (member_name);
+		}
+
+		c = peek (parser, &offset);
+
+		if (c == ',') {
+			parser->next++;
+		} else if (c == '}') {
+			parser->next++;
+			break;
+		} else {
+			set_parse_error (error, JSON_PARSER_ERROR_MISSING_COMMA,
+			                 offset, _("Expected ‘,’ or ‘}’."));
+			goto error;
+		}
+	}
+
+done:
+	if (decode) {
+		*node_out = json_node_new (JSON_NODE_OBJECT);
+		json_node_take_object (*node_out, object);
+	}
+
+	return TRUE;
+
+error:
+	g_clear_pointer (&object, json_object_unref);
+
+	return FALSE;
+}
+
+/* Parse an array. If @node_out is %NULL, the array is only checked, and none
+ * of its elements are decoded.
+ *
+ * Complexity: O(N) in the number of elements, plus parse_value() for each */
+static gboolean
+parse_array (Parser    *parser,
+             gpointer   context,
+             JsonNode **node_out,
+             GError   **error)
+{
+	JsonArray *array = NULL;  /* owned */
+	gboolean decode = (node_out != NULL);
+	guint n_elements = 0;
+	gsize offset;
+	gchar c;
+
+	parser->next++;
+
+	if (decode) {
+		array = json_array_new ();
+	}
+
+	if (peek (parser, &offset) == ']') {
+		parser->next++;
+		goto done;
+	}
+
+	while (TRUE) {
+		JsonNode *element = NULL;  /* owned */
+
+		if (peek (parser, &offset) == ']') {
+			set_parse_error (error, JSON_PARSER_ERROR_TRAILING_COMMA,
+			                 offset, _("Expected a value."));
+			goto error;
+		}
+
+		if (!(decode ?
+		      parse_child (parser, context, NULL, n_elements,
+		                   &element, error) :
+		      parse_value (parser, NULL, NULL, error))) {
+			goto error;
+		}
+
+		if (decode) {
+			json_array_add_element (array, element);  /* transfer */
+		}
+
+		n_elements++;
+		c = peek (parser, &offset);
+
+		if (c == ',') {
+			parser->next++;
+		} else if (c == ']') {
+			parser->next++;
+			break;
+		} else {
+			set_parse_error (error, JSON_PARSER_ERROR_MISSING_COMMA,
+			                 offset, _("Expected ‘,’ or ‘]’."));
+			goto error;
+		}
+	}
+
+done:
+	if (decode) {
+		*node_out = json_node_new (JSON_NODE_ARRAY);
+		json_node_take_array (*node_out, array);
+	}
+
+	return TRUE;
+
+error:
+	g_clear_pointer (&array, json_array_unref);
+
+	return FALSE;
+}
+
+/* Parse a value, decoding it into @node_out with filter context @context, or
+ * only checking it if @node_out is %NULL.
+ *
+ * Complexity: O(N) in the size of the value */
+static gboolean
+parse_value (Parser    *parser,
+             gpointer   context,
+             JsonNode **node_out,
+             GError   **error)
+{
+	gboolean success;
+	const gchar *str;
+	gsize offset;
+
+	switch (peek (parser, &offset)) {
+	case '{':
+	case '[':
+		if (parser->depth >= MAX_DEPTH) {
+			set_parse_error (error, JSON_PARSER_ERROR_INVALID_DATA,
+			                 offset, _("Too deeply nested."));
+			return FALSE;
+		}
+
+		parser->depth++;
+
+		if (parser->data[offset] == '{') {
+			success = parse_object (parser, context, node_out, error);
+		} else {
+			success = parse_array (parser, context, node_out, error);
+		}
+
+		parser->depth--;
+
+		return success;
+	case '"':
+		str = parse_string (parser, node_out != NULL, error);
+
+		if (str == NULL) {
+			return FALSE;
+		}
+
+		if (node_out != NULL) {
+			*node_out = json_node_new (JSON_NODE_VALUE);
+			json_node_set_string (*node_out, str);
+		}
+
+		return TRUE;
+	case '\0':
+		set_parse_error (error, JSON_PARSER_ERROR_PARSE, offset,
+		                 _("Unexpected end of document."));
+		return FALSE;
+	case '}':
+	case ']':
+	case ':':
+	case ',':
+		set_parse_error (error, JSON_PARSER_ERROR_PARSE, offset,
+		                 _("Unexpected character."));
+		return FALSE;
+	default:
+		return parse_scalar (parser, node_out, error);
+	}
+}
+
+/**
+ * wbl_json_index_parse:
+ * @data: (array length=length): serialised JSON data to parse
+ * @length: length of @data, in bytes
+ * @error: return location for a #GError, or %NULL
+ *
+ * Parse @data as a single JSON value, by building a #WblJsonIndex over it and
+ * then walking the index. Errors are reported in the #JSON_PARSER_ERROR
+ * domain. Unlike #JsonParser, an empty document is an error, as is a string
+ * containing `\u0000`, which #JsonNode cannot represent.
+ *
+ * Returns: (transfer full): the root node of the parsed data, or %NULL on
+ *    error
+ *
+ * Since: UNRELEASED
+ */
+JsonNode *
+wbl_json_index_parse (const gchar  *data,
+                      gsize         length,
+                      GError      **error)
+{
+	g_return_val_if_fail (data != NULL || length == 0, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	return wbl_json_index_parse_filtered (data, length, NULL, NULL, NULL,
+	                                      error);
+}
+
+/**
+ * wbl_json_index_parse_filtered:
+ * @data: (array length=length): serialised JSON data to parse
+ * @length: length of @data, in bytes
+ * @filter: (nullable): function to choose which values to decode, or %NULL
+ *    to decode all of them
+ * @context: filter context for the root value
+ * @user_data: user data to pass to @filter
+ * @error: return location for a #GError, or %NULL
+ *
+ * Parse @data as wbl_json_index_parse() does, but only decode the values
+ * which @filter says are needed. @filter is called for each member of a
+ * decoded object and each element of a decoded array, with the context of
+ * the object or array. If it returns %NULL, the value is checked for errors
+ * but not decoded, and a null #JsonNode is put in its place; otherwise, the
+ * value is decoded, and the returned pointer is used as its context in
+ * turn. The whole of @data is always checked, so the same errors are reported
+ * whatever @filter returns.
+ *
+ * Skipping a value is much cheaper than decoding it, as skipped strings are
+ * not copied, skipped numbers are not converted, and no #JsonNodes are
+ * allocated for the contents of skipped arrays and objects.
+ *
+ * Returns: (transfer full): the root node of the parsed data, or %NULL on
+ *    error
+ *
+ * Since: UNRELEASED
+ */
+JsonNode *
+wbl_json_index_parse_filtered (const gchar             *data,
+                               gsize                    length,
+                               WblJsonIndexFilterFunc   filter,
+                               gpointer                 context,
+                               gpointer                 user_data,
+                               GError                 **error)
+{
+	WblJsonIndex json_index;
+	Parser parser;
+	JsonNode *root = NULL;  /* owned */
+
+	g_return_val_if_fail (data != NULL || length == 0, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	if (!wbl_json_index_init (&json_index, data, length,
+	                          WBL_JSON_INDEX_NONE, error)) {
+		return NULL;
+	}
+
+	parser.data = data;
+	parser.length = length;
+	parser.index = &json_index;
+	parser.next = 0;
+	parser.depth = 0;
+	parser.buffer = g_string_new ("");
+	parser.filter = filter;
+	parser.user_data = user_data;
+
+	if (parse_value (&parser, context, &root, error) &&
+	    parser.next < json_index.n_positions) {
+		set_parse_error (error, JSON_PARSER_ERROR_PARSE,
+		                 json_index.positions[parser.next],
+		                 _("Unexpected data after the end of the "
+		                   "document."));
+		g_clear_pointer (&root, json_node_free);
+	}
+
+	g_string_free (parser.buffer, TRUE);
+	wbl_json_index_clear (&json_index);
+
+	return root;
+}
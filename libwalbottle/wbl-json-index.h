@@ -0,0 +1,102 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WBL_JSON_INDEX_H
+#define WBL_JSON_INDEX_H
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * WblJsonIndexFlags:
+ * @WBL_JSON_INDEX_NONE: No flags set.
+ * @WBL_JSON_INDEX_SCALAR: Build the index one byte at a time, even if SIMD
+ *    instructions are available. This is intended for testing.
+ *
+ * Flags affecting how a #WblJsonIndex is built.
+ *
+ * Since: UNRELEASED
+ */
+typedef enum {
+	WBL_JSON_INDEX_NONE = 0,
+	WBL_JSON_INDEX_SCALAR = (1 << 0),
+} WblJsonIndexFlags;
+
+/**
+ * WblJsonIndex:
+ * @positions: (array length=n_positions): byte offsets of the structural
+ *    characters in the JSON data, in increasing order
+ * @n_positions: number of elements in @positions
+ *
+ * A structural index over serialised JSON data: the offset of every
+ * `{`, `}`, `[`, `]`, `:` and `,` outside a string, of every unescaped `"`,
+ * and of the first byte of every other token (numbers, `true`, `false` and
+ * `null`). This must be allocated on the stack, initialised using
+ * wbl_json_index_init() and cleared using wbl_json_index_clear().
+ *
+ * Since: UNRELEASED
+ */
+typedef struct {
+	guint32 *positions;  /* owned */
+	gsize n_positions;
+} WblJsonIndex;
+
+/**
+ * WblJsonIndexFilterFunc:
+ * @context: filter context of the object or array being decoded
+ * @member_name: (nullable): name of the object member whose value is to be
+ *    parsed, or %NULL for an array element
+ * @element_index: index of the array element to be parsed, or 0 for an object
+ *    member
+ * @user_data: user data passed to wbl_json_index_parse_filtered()
+ *
+ * Choose whether to decode the value of an object member or array element in
+ * wbl_json_index_parse_filtered().
+ *
+ * Returns: (nullable): filter context for the value, or %NULL to skip it
+ *
+ * Since: UNRELEASED
+ */
+typedef gpointer (*WblJsonIndexFilterFunc) (gpointer      context,
+                                            const gchar  *member_name,
+                                            guint         element_index,
+                                            gpointer      user_data);
+
+gboolean  wbl_json_index_init  (WblJsonIndex       *self,
+                                const gchar        *data,
+                                gsize               length,
+                                WblJsonIndexFlags   flags,
+                                GError            **error);
+void      wbl_json_index_clear (WblJsonIndex       *self);
+
+JsonNode *wbl_json_index_parse (const gchar        *data,
+                                gsize               length,
+                                GError            **error);
+JsonNode *wbl_json_index_parse_filtered (const gchar             *data,
+                                         gsize                    length,
+                                         WblJsonIndexFilterFunc   filter,
+                                         gpointer                 context,
+                                         gpointer                 user_data,
+                                         GError                 **error);
+
+G_END_DECLS
+
+#endif /* !WBL_JSON_INDEX_H */
@@ -38,6 +38,10 @@
 #include <json-glib/json-glib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "wbl-json-node.h"
 
 /* Indexed by #WblPrimitiveType. */
@@ -333,6 +337,61 @@ wbl_json_string_compare (gconstpointer a,
 	return g_strcmp0 (a, b);
 }
 
+/**
+ * wbl_json_string_get_length:
+ * @str: (array length=n_bytes): a valid UTF-8 string
+ * @n_bytes: length of @str, in bytes
+ *
+ * Count the Unicode characters in @str, as g_utf8_strlen() does. This is the
+ * length used by the maxLength and minLength keywords.
+ *
+ * Every byte of valid UTF-8 which is not a continuation byte (0x80–0xbf)
+ * starts a character, so this counts those bytes 16 at a time using SSE2
+ * where it is available, accumulating per-byte counts in a vector register
+ * and summing them every 255 vectors, before they can overflow.
+ *
+ * Returns: number of Unicode characters in @str
+ * Since: UNRELEASED
+ */
+gsize
+wbl_json_string_get_length (const gchar *str,
+                            gsize        n_bytes)
+{
+	gsize i = 0, n_chars = 0;
+
+#ifdef __SSE2__
+	while (n_bytes - i >= 16) {
+		__m128i counts = _mm_setzero_si128 ();
+		gsize j, n_vectors;
+
+		n_vectors = MIN ((n_bytes - i) / 16, 255);
+
+		for (j = 0; j < n_vectors; j++, i += 16) {
+			__m128i v;
+
+			/* Continuation bytes are the signed values below -64;
+			 * the comparison gives -1 for all other bytes. */
+			v = _mm_loadu_si128 ((const __m128i *) (str + i));
+			counts = _mm_sub_epi8 (counts,
+			                       _mm_cmpgt_epi8 (v, _mm_set1_epi8 (-65)));
+		}
+
+		/* Sum the bytes into the low 16 bits of each 64-bit lane. */
+		counts = _mm_sad_epu8 (counts, _mm_setzero_si128 ());
+		n_chars += (gsize) _mm_cvtsi128_si32 (counts) +
+		           (gsize) _mm_extract_epi16 (counts, 4);
+	}
+#endif
+
+	for (; i < n_bytes; i++) {
+		if (((guchar) str[i] & 0xc0) != 0x80) {
+			n_chars++;
+		}
+	}
+
+	return n_chars;
+}
+
 /**
  * wbl_json_node_hash:
  * @key: (type JsonNode): a #JsonNode to hash
@@ -584,3 +643,274 @@ wbl_json_node_equal (gconstpointer a,
 		g_assert_not_reached ();
 	}
 }
+
+/* Complexity: O(N) in the size of @node, or O(1) if @hashes already contains
+ * it */
+static guint
+node_hash_strict (JsonNode   *node,
+                  GHashTable *hashes)
+{
+	gpointer cached_hash;
+	guint hash;
+
+	/* Arbitrary magic values, as in wbl_json_node_hash(). */
+	const guint true_hash = 175;
+	const guint false_hash = 8823;
+	const guint null_hash = 33866;
+	const guint array_hash = 7735;
+	const guint object_hash = 23545;
+	const guint double_hash = 51407;
+
+	switch (json_node_get_node_type (node)) {
+	case JSON_NODE_NULL:
+		return null_hash;
+	case JSON_NODE_VALUE:
+		switch (json_node_get_value_type (node)) {
+		case G_TYPE_BOOLEAN:
+			return json_node_get_boolean (node) ? true_hash : false_hash;
+		case G_TYPE_STRING:
+			return g_str_hash (json_node_get_string (node));
+		case G_TYPE_INT64: {
+			gint64 v = json_node_get_int (node);
+			return g_int64_hash (&v);
+		}
+		case G_TYPE_DOUBLE: {
+			gdouble v = json_node_get_double (node);
+			gint64 bits;
+
+			/* Hash the bits so that 0.0 and -0.0 differ. */
+			memcpy (&bits, &v, sizeof (bits));
+			return g_int64_hash (&bits) ^ double_hash;
+		}
+		default:
+			g_assert_not_reached ();
+		}
+	case JSON_NODE_ARRAY:
+	case JSON_NODE_OBJECT:
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	if (hashes != NULL &&
+	    g_hash_table_lookup_extended (hashes, node, NULL, &cached_hash)) {
+		return GPOINTER_TO_UINT (cached_hash);
+	}
+
+	if (JSON_NODE_HOLDS_ARRAY (node)) {
+		JsonArray *array;  /* unowned */
+		guint i, length;
+
+		array = json_node_get_array (node);
+		length = json_array_get_length (array);
+		hash = array_hash + length;
+
+		for (i = 0; i < length; i++) {
+			hash = hash * 31 +
+			       node_hash_strict (json_array_get_element (array,
+			                                                 i),
+			                         hashes);
+		}
+	} else {
+		JsonObject *object;  /* unowned */
+		JsonObjectIter iter;
+		const gchar *member_name;
+		JsonNode *member;  /* unowned */
+
+		object = json_node_get_object (node);
+		hash = object_hash + json_object_get_size (object);
+
+		/* The iteration order is arbitrary, so combine the members
+		 * commutatively. */
+		json_object_iter_init (&iter, object);
+
+		while (json_object_iter_next (&iter, &member_name, &member)) {
+			hash += (g_str_hash (member_name) * 31) ^
+			        node_hash_strict (member, hashes);
+		}
+	}
+
+	if (hashes != NULL) {
+		g_hash_table_insert (hashes, node, GUINT_TO_POINTER (hash));
+	}
+
+	return hash;
+}
+
+/**
+ * wbl_json_node_hash_strict:
+ * @key: (type JsonNode): a #JsonNode to hash
+ *
+ * Calculate a hash value for the given @key (a #JsonNode) from its entire
+ * structure. Unlike wbl_json_node_hash(), which only looks at the sizes of
+ * objects and the first elements of arrays, this visits every value in @key,
+ * so it distributes whole documents well. It is consistent with
+ * wbl_json_node_equal_strict() rather than wbl_json_node_equal().
+ *
+ * Complexity: O(N) in the size of @key
+ * Returns: hash value for @key
+ * Since: UNRELEASED
+ */
+guint
+wbl_json_node_hash_strict (gconstpointer key)
+{
+	return node_hash_strict ((JsonNode *) key, NULL);
+}
+
+/**
+ * wbl_json_node_hash_strict_cached:
+ * @node: a #JsonNode to hash
+ * @hashes: (element-type JsonNode guint): cache of hashes of array and object
+ *    nodes
+ *
+ * Calculate the same hash value as wbl_json_node_hash_strict(), caching the
+ * hashes of @node and every array and object inside it in @hashes, which must
+ * use g_direct_hash(). Hashing every subtree of a document therefore takes
+ * O(N) in the size of the document overall, rather than O(N) for each
+ * subtree. The cached nodes must not be modified or freed while @hashes is in
+ * use.
+ *
+ * Complexity: O(N) in the size of @node, less any subtrees already in @hashes
+ * Returns: hash value for @node
+ * Since: UNRELEASED
+ */
+guint
+wbl_json_node_hash_strict_cached (JsonNode   *node,
+                                  GHashTable *hashes)
+{
+	g_return_val_if_fail (node != NULL, 0);
+	g_return_val_if_fail (hashes != NULL, 0);
+
+	return node_hash_strict (node, hashes);
+}
+
+/**
+ * wbl_json_node_equal_strict:
+ * @a: (type JsonNode): a #JsonNode
+ * @b: (type JsonNode): another #JsonNode
+ *
+ * Check whether @a and @b are identical #JsonNodes: that is, whether they
+ * serialise identically. Unlike wbl_json_node_equal(), integers and doubles are
+ * never equal to each other, and object members must be in the same order.
+ * Applying a schema to identical nodes always gives the same verdict.
+ *
+ * Complexity: O(N) in the size of @a
+ * Returns: %TRUE if @a and @b are identical; %FALSE otherwise
+ * Since: UNRELEASED
+ */
+gboolean
+wbl_json_node_equal_strict (gconstpointer a,
+                            gconstpointer b)
+{
+	JsonNode *node_a, *node_b;  /* unowned */
+	JsonNodeType type;
+
+	node_a = (JsonNode *) a;
+	node_b = (JsonNode *) b;
+
+	/* Identity comparison. */
+	if (node_a == node_b) {
+		return TRUE;
+	}
+
+	type = json_node_get_node_type (node_a);
+
+	if (type != json_node_get_node_type (node_b)) {
+		return FALSE;
+	}
+
+	switch (type) {
+	case JSON_NODE_NULL:
+		return TRUE;
+	case JSON_NODE_VALUE: {
+		GType value_type;
+
+		value_type = json_node_get_value_type (node_a);
+
+		if (value_type != json_node_get_value_type (node_b)) {
+			return FALSE;
+		}
+
+		switch (value_type) {
+		case G_TYPE_BOOLEAN:
+			return (!json_node_get_boolean (node_a) ==
+			        !json_node_get_boolean (node_b));
+		case G_TYPE_STRING:
+			return g_str_equal (json_node_get_string (node_a),
+			                    json_node_get_string (node_b));
+		case G_TYPE_INT64:
+			return (json_node_get_int (node_a) ==
+			        json_node_get_int (node_b));
+		case G_TYPE_DOUBLE: {
+			gdouble val_a, val_b;
+
+			val_a = json_node_get_double (node_a);
+			val_b = json_node_get_double (node_b);
+
+			return (memcmp (&val_a, &val_b, sizeof (val_a)) == 0);
+		}
+		default:
+			g_assert_not_reached ();
+		}
+	}
+	case JSON_NODE_ARRAY: {
+		JsonArray *array_a, *array_b;  /* unowned */
+		guint length, i;
+
+		array_a = json_node_get_array (node_a);
+		array_b = json_node_get_array (node_b);
+		length = json_array_get_length (array_a);
+
+		if (array_a == array_b) {
+			return TRUE;
+		} else if (length != json_array_get_length (array_b)) {
+			return FALSE;
+		}
+
+		for (i = 0; i < length; i++) {
+			if (!wbl_json_node_equal_strict (json_array_get_element (array_a, i),
+			                                 json_array_get_element (array_b, i))) {
+				return FALSE;
+			}
+		}
+
+		return TRUE;
+	}
+	case JSON_NODE_OBJECT: {
+		JsonObject *object_a, *object_b;  /* unowned */
+		GList/*<unowned utf8>*/ *members_a = NULL, *members_b = NULL;  /* owned */
+		GList *l_a, *l_b;  /* unowned */
+		gboolean equal = TRUE;
+
+		object_a = json_node_get_object (node_a);
+		object_b = json_node_get_object (node_b);
+
+		if (object_a == object_b) {
+			return TRUE;
+		} else if (json_object_get_size (object_a) !=
+		           json_object_get_size (object_b)) {
+			return FALSE;
+		}
+
+		/* Insertion order, which is the order members are serialised
+		 * in. */
+		members_a = json_object_get_members (object_a);
+		members_b = json_object_get_members (object_b);
+
+		for (l_a = members_a, l_b = members_b;
+		     l_a != NULL && l_b != NULL && equal;
+		     l_a = l_a->next, l_b = l_b->next) {
+			equal = (g_str_equal (l_a->data, l_b->data) &&
+			         wbl_json_node_equal_strict (json_object_get_member (object_a, l_a->data),
+			                                     json_object_get_member (object_b, l_b->data)));
+		}
+
+		g_list_free (members_b);
+		g_list_free (members_a);
+
+		return equal;
+	}
+	default:
+		g_assert_not_reached ();
+	}
+}
@@ -76,12 +76,23 @@ wbl_json_string_equal             (gconstpointer      a,
 gint
 wbl_json_string_compare           (gconstpointer      a,
                                    gconstpointer      b);
+gsize
+wbl_json_string_get_length        (const gchar       *str,
+                                   gsize              n_bytes);
 
 guint
 wbl_json_node_hash                (gconstpointer      key);
 gboolean
 wbl_json_node_equal               (gconstpointer      a,
                                    gconstpointer      b);
+guint
+wbl_json_node_hash_strict         (gconstpointer      key);
+guint
+wbl_json_node_hash_strict_cached  (JsonNode          *node,
+                                   GHashTable        *hashes);
+gboolean
+wbl_json_node_equal_strict        (gconstpointer      a,
+                                   gconstpointer      b);
 
 G_END_DECLS
 
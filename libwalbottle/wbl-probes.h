@@ -0,0 +1,67 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WBL_PROBES_H
+#define WBL_PROBES_H
+
+#include "config.h"
+
+#include <glib.h>
+
+/*
+ * Static probe points, for use with SystemTap, bpftrace, perf, etc. These are
+ * only compiled in if Walbottle is configured with `-Ddtrace=true`; otherwise
+ * they expand to nothing. When compiled in, each probe is a single no-op
+ * instruction until a tracer attaches to it.
+ *
+ * All probes are in the ‘walbottle’ provider. Probe names use double
+ * underscores, which tracers display as hyphens:
+ *  • subschema-apply-entry (subschema, instance)
+ *  • subschema-apply-return (subschema, instance, is_valid)
+ *  • subschema-generate-entry (subschema)
+ *  • subschema-generate-return (subschema, n_instances)
+ *  • instance-cache-hit (subschema, n_instances)
+ *  • instance-cache-miss (subschema)
+ *  • regex-compile-entry (pattern)
+ *  • regex-compile-return (pattern, success)
+ *
+ * For example, to print a latency histogram for apply:
+ * |[
+ * bpftrace -e '
+ *   usdt:libwalbottle-0.so:walbottle:subschema__apply__entry { @start[tid] = nsecs; }
+ *   usdt:libwalbottle-0.so:walbottle:subschema__apply__return /@start[tid]/ {
+ *     @ns = hist(nsecs - @start[tid]); delete(@start[tid]); }'
+ * ]|
+ */
+
+#ifdef HAVE_DTRACE
+#include <sys/sdt.h>
+
+#define WBL_PROBE(name) DTRACE_PROBE (walbottle, name)
+#define WBL_PROBE1(name, a) DTRACE_PROBE1 (walbottle, name, a)
+#define WBL_PROBE2(name, a, b) DTRACE_PROBE2 (walbottle, name, a, b)
+#define WBL_PROBE3(name, a, b, c) DTRACE_PROBE3 (walbottle, name, a, b, c)
+#else /* if !HAVE_DTRACE */
+#define WBL_PROBE(name) G_STMT_START { } G_STMT_END
+#define WBL_PROBE1(name, a) G_STMT_START { } G_STMT_END
+#define WBL_PROBE2(name, a, b) G_STMT_START { } G_STMT_END
+#define WBL_PROBE3(name, a, b, c) G_STMT_START { } G_STMT_END
+#endif /* !HAVE_DTRACE */
+
+#endif /* !WBL_PROBES_H */
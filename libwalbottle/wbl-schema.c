@@ -31,7 +31,9 @@
  *
  * When loading a schema, it is validated for well-formedness and adherence to
  * the JSON meta-schema (which defines the format used for schemas). Invalid
- * schemas will fail to load.
+ * schemas will fail to load. Schemas which are known to be valid, or of which
+ * only a few subschemas are used, can be loaded faster by skipping or
+ * deferring this validation; see wbl_schema_set_load_mode().
  *
  * Two main operations may be performed on a loaded schema: application of the
  * schema to a JSON instance, and generation of instances from the schema.
@@ -163,9 +165,13 @@
 #include <math.h>
 #include <string.h>
 
+#include "wbl-format.h"
+#include "wbl-json-index.h"
 #include "wbl-json-node.h"
+#include "wbl-probes.h"
 #include "wbl-schema.h"
 #include "wbl-string-set.h"
+#include "wbl-tape.h"
 
 GQuark
 wbl_schema_error_quark (void)
@@ -177,6 +183,16 @@ wbl_schema_error_quark (void)
 struct _WblSchemaNode {
 	gint ref_count;  /* atomic */
 	JsonObject *node;  /* owned */
+
+	/* Only used for the root node of a loaded schema: whether each
+	 * subschema reached so far is valid, if the schema was loaded with
+	 * %WBL_SCHEMA_LOAD_MODE_LAZY. These live on the node rather than the
+	 * #WblSchema so that apply calls which hold a reference to the node
+	 * keep using them after the schema is reloaded. Apply calls may run
+	 * in worker threads, so the table is protected by
+	 * @lazy_verdicts_lock. */
+	GHashTable/*<unowned JsonObject, gboolean>*/ *lazy_verdicts;  /* owned; NULL unless lazy */
+	GMutex lazy_verdicts_lock;
 };
 
 G_DEFINE_BOXED_TYPE (WblSchemaNode, wbl_schema_node,
@@ -218,6 +234,8 @@ wbl_schema_node_unref (WblSchemaNode *self)
 	g_return_if_fail (self->ref_count > 0);
 
 	if (g_atomic_int_dec_and_test (&self->ref_count)) {
+		g_clear_pointer (&self->lazy_verdicts, g_hash_table_unref);
+		g_mutex_clear (&self->lazy_verdicts_lock);
 		json_object_unref (self->node);
 		g_slice_free (WblSchemaNode, self);
 	}
@@ -789,6 +807,11 @@ wbl_generated_instance_is_valid (WblGeneratedInstance *self)
 	return self->valid;
 }
 
+/* Set on the current thread while subschema_validate_lazily() validates the
+ * keywords of a single subschema, so that its child subschemas are left to be
+ * validated when they are reached. */
+static GPrivate validate_shallow_private = G_PRIVATE_INIT (NULL);
+
 /* Helper functions to validate, apply and generate subschemas. */
 static GPtrArray/*<owned WblValidateMessage>*/ *
 subschema_validate (WblSchema *self,
@@ -800,8 +823,12 @@ subschema_validate (WblSchema *self,
 
 	klass = WBL_SCHEMA_GET_CLASS (self);
 
+	if (g_private_get (&validate_shallow_private) != NULL) {
+		return NULL;
+	}
+
 	if (klass->validate_schema != NULL) {
-		WblSchemaNode node;
+		WblSchemaNode node = { 0, };
 
 		node.ref_count = 1;
 		node.node = json_node_dup_object (subschema_node);
@@ -822,6 +849,57 @@ subschema_validate (WblSchema *self,
 	return messages;
 }
 
+/* A subschema applied to an instance subtree. */
+typedef struct {
+	JsonObject *subschema;  /* unowned */
+	JsonNode *instance;  /* unowned */
+	guint hash;  /* of @instance, from wbl_json_node_hash_strict() */
+	/* Whether the apply call had already reached an invalid subschema
+	 * before @instance was applied; not part of the key. */
+	gboolean was_malformed;
+} SubtreeKey;
+
+/* The result of applying a #SubtreeKey: the error, if any, and whether it
+ * reached a subschema which was invalid when validated lazily. */
+typedef struct {
+	GError *error;  /* owned; nullable */
+	gboolean malformed;
+} SubtreeVerdict;
+
+static guint
+subtree_key_hash (gconstpointer key)
+{
+	const SubtreeKey *subtree_key = key;
+
+	return (g_direct_hash (subtree_key->subschema) ^ subtree_key->hash);
+}
+
+/* Complexity: O(N) in the size of the instance subtrees */
+static gboolean
+subtree_key_equal (gconstpointer a,
+                   gconstpointer b)
+{
+	const SubtreeKey *key_a = a, *key_b = b;
+
+	return (key_a->subschema == key_b->subschema &&
+	        key_a->hash == key_b->hash &&
+	        wbl_json_node_equal_strict (key_a->instance, key_b->instance));
+}
+
+static void
+subtree_verdict_free (SubtreeVerdict *verdict)
+{
+	g_clear_error (&verdict->error);
+	g_slice_free (SubtreeVerdict, verdict);
+}
+
+static gboolean apply_state_lookup_subtree_verdict (JsonObject  *subschema,
+                                                    JsonNode    *instance,
+                                                    SubtreeKey  *key,
+                                                    GError     **error);
+static void apply_state_add_subtree_verdict (const SubtreeKey *key,
+                                             const GError     *error);
+
 static void
 subschema_apply (WblSchema *self,
                  JsonObject *subschema_object,
@@ -829,15 +907,37 @@ subschema_apply (WblSchema *self,
                  GError **error)
 {
 	WblSchemaClass *klass;
+	GError *child_error = NULL;
 
 	klass = WBL_SCHEMA_GET_CLASS (self);
 
+	WBL_PROBE2 (subschema__apply__entry, subschema_object, instance_node);
+
 	if (klass->apply_schema != NULL) {
-		WblSchemaNode node;
+		WblSchemaNode node = { 0, };
+		SubtreeKey key;
+
+		/* Documents often repeat identical subtrees, such as the items
+		 * of an array, so if memoising is enabled, only apply the
+		 * subschema to each distinct one once per apply call. */
+		if (!apply_state_lookup_subtree_verdict (subschema_object,
+		                                         instance_node, &key,
+		                                         &child_error)) {
+			node.ref_count = 1;
+			node.node = subschema_object;
+			klass->apply_schema (self, &node, instance_node,
+			                     &child_error);
+
+			apply_state_add_subtree_verdict (&key, child_error);
+		}
+	}
 
-		node.ref_count = 1;
-		node.node = subschema_object;
-		klass->apply_schema (self, &node, instance_node, error);
+	/* Derive the verdict from @child_error, as @error may be %NULL. */
+	WBL_PROBE3 (subschema__apply__return, subschema_object, instance_node,
+	            (child_error == NULL) ? 1 : 0);
+
+	if (child_error != NULL) {
+		g_propagate_error (error, child_error);
 	}
 }
 
@@ -853,8 +953,10 @@ subschema_generate_instances (WblSchema   *self,
 
 	klass = WBL_SCHEMA_GET_CLASS (self);
 
+	WBL_PROBE1 (subschema__generate__entry, subschema_object);
+
 	if (klass->generate_instance_nodes != NULL) {
-		WblSchemaNode node;
+		WblSchemaNode node = { 0, };
 
 		node.ref_count = 1;
 		node.node = subschema_object;
@@ -878,6 +980,9 @@ subschema_generate_instances (WblSchema   *self,
 		                                NULL);
 	}
 
+	WBL_PROBE2 (subschema__generate__return, subschema_object,
+	            g_hash_table_size (output));
+
 	return output;
 }
 
@@ -955,25 +1060,227 @@ subschema_generate_instances_split (WblSchema                       *self,
 	}
 }
 
-/* Schema instance cache entries. */
+/* Static generation cost estimates; see wbl_schema_estimate_generation(). The
+ * estimate_*() functions mirror the heuristics used by the matching
+ * generate_*() functions, but work in closed form without building any
+ * instances, so they stay cheap for schemas which would be infeasible to
+ * generate. Arithmetic is done in doubles so that huge `maxItems` or
+ * `maxLength` values saturate rather than overflow.
+ *
+ * Costs are unitless, and roughly count the JSON nodes and string characters
+ * built by generation. */
+struct _WblSchemaEstimate {
+	JsonObject *schema;  /* owned */
+	gchar *path;  /* owned */
+	guint depth;  /* allOf, anyOf, oneOf and not nesting */
+	gdouble n_instances;
+	gdouble cost;  /* excluding subschemas */
+	gdouble total_cost;  /* including subschemas */
+	const gchar *keyword;  /* unowned; most expensive keyword; nullable */
+	gdouble keyword_cost;
+	WblSchemaEstimateFlags flags;
+};
+
+/* Thresholds for the #WblSchemaEstimateFlags. */
+#define ESTIMATE_LARGE_ARRAYS 32  /* distinct array lengths generated */
+#define ESTIMATE_LARGE_STRINGS 4096  /* characters */
+#define ESTIMATE_MANY_PROPERTIES 32  /* optional property names */
+#define ESTIMATE_DEEP_NESTING 3  /* allOf, anyOf, oneOf and not */
+#define ESTIMATE_DOMINANT_SHARE 0.25  /* of the total cost */
+
+static gdouble
+subschema_estimate (WblSchema *self,
+                    GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                    WblSchemaEstimate *parent,
+                    JsonNode *subschema_node,
+                    gboolean nested);
+
+/* Allocation estimates, enabled by %WBL_GENERATE_INSTANCE_ESTIMATE_ALLOCATIONS.
+ * json-glib does not allow hooking its allocator, so these are not measured:
+ * they are derived by walking the instances each generator produces, and the
+ * intermediate sets of instances which the items and properties generators
+ * combine them from. Its structures are opaque, so byte counts are based on
+ * their layout on LP64 platforms. They are meant for comparing subschemas
+ * against each other, rather than as absolute figures.
+ *
+ * @n_peak_bytes is the most bytes held at once, rather than a total, so it is
+ * not summed by allocation_stats_add(). */
+typedef struct {
+	guint64 n_nodes;
+	guint64 n_objects;
+	guint64 n_arrays;
+	guint64 n_hash_tables;
+	guint64 n_bytes;  /* approximate */
+	guint64 n_peak_bytes;  /* approximate */
+} WblAllocationStats;
+
+#define ALLOCATION_SIZE_NODE 48  /* JsonNode */
+#define ALLOCATION_SIZE_VALUE 40  /* JsonValue, for scalar nodes */
+#define ALLOCATION_SIZE_OBJECT 136  /* JsonObject, its GHashTable and GQueue */
+#define ALLOCATION_SIZE_OBJECT_MEMBER 56  /* hash table slot and GList link */
+#define ALLOCATION_SIZE_ARRAY 48  /* JsonArray and its GPtrArray */
+#define ALLOCATION_SIZE_ARRAY_ELEMENT 8
+
+/* Complexity: O(N) in the number of nodes in @node */
+static void
+allocation_stats_add_node (WblAllocationStats  *stats,
+                           JsonNode            *node)
+{
+	stats->n_nodes++;
+	stats->n_bytes += ALLOCATION_SIZE_NODE;
+
+	switch (json_node_get_node_type (node)) {
+	case JSON_NODE_OBJECT: {
+		JsonObjectIter iter;
+		const gchar *member_name;
+		JsonNode *member_node;
+
+		stats->n_objects++;
+		stats->n_hash_tables++;
+		stats->n_bytes += ALLOCATION_SIZE_OBJECT;
+
+		json_object_iter_init (&iter, json_node_get_object (node));
+
+		while (json_object_iter_next (&iter, &member_name, &member_node)) {
+			stats->n_bytes += ALLOCATION_SIZE_OBJECT_MEMBER +
+			                  strlen (member_name) + 1;
+			allocation_stats_add_node (stats, member_node);
+		}
+
+		break;
+	}
+	case JSON_NODE_ARRAY: {
+		JsonArray *array;
+		guint i, len;
+
+		stats->n_arrays++;
+		stats->n_bytes += ALLOCATION_SIZE_ARRAY;
+
+		array = json_node_get_array (node);
+
+		for (i = 0, len = json_array_get_length (array); i < len; i++) {
+			stats->n_bytes += ALLOCATION_SIZE_ARRAY_ELEMENT;
+			allocation_stats_add_node (stats,
+			                           json_array_get_element (array, i));
+		}
+
+		break;
+	}
+	case JSON_NODE_VALUE:
+		stats->n_bytes += ALLOCATION_SIZE_VALUE;
+
+		if (json_node_get_value_type (node) == G_TYPE_STRING) {
+			stats->n_bytes += strlen (json_node_get_string (node)) + 1;
+		}
+
+		break;
+	case JSON_NODE_NULL:
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/* Complexity: O(1) */
+static void
+allocation_stats_add (WblAllocationStats        *stats,
+                      const WblAllocationStats  *other)
+{
+	stats->n_nodes += other->n_nodes;
+	stats->n_objects += other->n_objects;
+	stats->n_arrays += other->n_arrays;
+	stats->n_hash_tables += other->n_hash_tables;
+	stats->n_bytes += other->n_bytes;
+}
+
+/* Estimate the bytes held by @set, and add its allocations to @stats if that
+ * is non-%NULL.
+ *
+ * Complexity: O(N) in the number of nodes in @set */
+static guint64
+allocation_stats_add_set (WblAllocationStats              *stats,
+                          GHashTable/*<owned JsonNode>*/  *set)
+{
+	WblAllocationStats set_stats = { 0, };
+	GHashTableIter iter;
+	gpointer key;
+
+	set_stats.n_hash_tables = 1;
+	g_hash_table_iter_init (&iter, set);
+
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		allocation_stats_add_node (&set_stats, key);
+	}
+
+	if (stats != NULL) {
+		allocation_stats_add (stats, &set_stats);
+	}
+
+	return set_stats.n_bytes;
+}
+
+/* Variant of allocation_stats_add_set() for each of the sets in @set_map.
+ *
+ * Complexity: O(N) in the number of nodes in all the sets in @set_map */
+static guint64
+allocation_stats_add_set_map (WblAllocationStats                             *stats,
+                              GHashTable/*<gpointer, GHashTable<JsonNode>>*/ *set_map)
+{
+	GHashTableIter iter;
+	gpointer value;
+	guint64 n_bytes = 0;
+
+	g_hash_table_iter_init (&iter, set_map);
+
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		n_bytes += allocation_stats_add_set (stats, value);
+	}
+
+	return n_bytes;
+}
+
+/* Flags which change the instances cached for each subschema, or the
+ * allocation estimates cached with them. The other flags only filter or
+ * post-process the instances for the whole schema. */
+#define INSTANCE_CACHE_FLAGS (WBL_GENERATE_INSTANCE_ESTIMATE_ALLOCATIONS | \
+                              WBL_GENERATE_INSTANCE_PAIRWISE_PROPERTIES)
+
+/* Schema instance cache entries. The instances are held as a set of
+ * #JsonNodes, which the generate functions for parent subschemas use directly.
+ * With a spill threshold set, each set is also stored in a #WblTape as soon as
+ * it is generated, large tapes are spilled to a file, and at the end of each
+ * wbl_schema_generate_instances() call the #JsonNodes are freed; they are
+ * expanded from the tape again when they are next needed. See
+ * instance_cache_compact(). */
 typedef struct {
-	GHashTable/*<owned JsonNode>*/ *instances;
+	GHashTable/*<owned JsonNode>*/ *instances;  /* owned; NULL when compacted */
+	WblTape *tape;  /* owned; NULL until compacted */
+	guint n_instances;
 	guint n_times_generated;
 	gint64 generation_time;  /* in microseconds */
 	JsonObject *schema;  /* owned */
+
+	/* Only set if generated with allocation accounting enabled. */
+	WblAllocationStats *allocations;  /* owned; nullable */
+	GHashTable/*<unowned utf8, owned WblAllocationStats>*/ *keyword_allocations;  /* owned; nullable */
 } WblSchemaInstanceCacheEntry;
 
 static void
 wbl_schema_instance_cache_entry_free (WblSchemaInstanceCacheEntry *self)
 {
 	json_object_unref (self->schema);
-	g_hash_table_unref (self->instances);
+	g_clear_pointer (&self->instances, g_hash_table_unref);
+	g_clear_pointer (&self->tape, wbl_tape_unref);
+	g_clear_pointer (&self->keyword_allocations, g_hash_table_unref);
+	g_free (self->allocations);
 	g_slice_free (WblSchemaInstanceCacheEntry, self);
 }
 
 /* Schemas. */
 static void
 wbl_schema_dispose (GObject *object);
+static void
+wbl_schema_finalize (GObject *object);
 
 static GPtrArray/*<owned WblValidateMessage> */ *
 real_validate_schema (WblSchema *self,
@@ -988,24 +1295,290 @@ static GHashTable/*<owned JsonNode>*/ *
 real_generate_instance_nodes (WblSchema      *self,
                               WblSchemaNode  *schema);
 
+/* Information about a keyword added with wbl_schema_add_keyword(). This is
+ * handled in the same way as a #KeywordData entry. */
+typedef struct {
+	gchar *name;  /* owned */
+	WblKeywordValidateFunc validate;  /* NULL if validation always succeeds */
+	WblKeywordApplyFunc apply;  /* NULL if application always succeeds */
+	WblKeywordGenerateFunc generate;  /* NULL if generation produces nothing */
+	gpointer user_data;
+	GDestroyNotify user_data_free;  /* nullable */
+} ExtensionKeywordData;
+
+static void
+extension_keyword_data_clear (ExtensionKeywordData *self)
+{
+	g_free (self->name);
+
+	if (self->user_data_free != NULL) {
+		self->user_data_free (self->user_data);
+	}
+}
+
+/* Mix @value into the running @hash. This is a 32-bit FNV-1a step over the
+ * bytes of @value, so the result does not depend on the host. */
+static guint32
+shard_hash_mix (guint32  hash,
+                guint64  value)
+{
+	guint i;
+
+	for (i = 0; i < 8; i++) {
+		hash ^= (value >> (i * 8)) & 0xff;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+/* Deterministic hash of @node, used to assign generated instances to shards
+ * in wbl_schema_generate_instances_sharded(). Unlike
+ * wbl_json_node_hash(), this looks at the whole of @node, so that instances
+ * which differ only in their nested values are spread evenly between shards.
+ * Object members are combined commutatively, so member order does not matter.
+ *
+ * Complexity: O(size of @node) */
+static guint32
+shard_hash_node (JsonNode  *node)
+{
+	const guint32 seed = 2166136261;
+
+	switch (wbl_primitive_type_from_json_node (node)) {
+	case WBL_PRIMITIVE_TYPE_BOOLEAN:
+		return shard_hash_mix (seed, json_node_get_boolean (node) ? 1 : 2);
+	case WBL_PRIMITIVE_TYPE_NULL:
+		return shard_hash_mix (seed, 3);
+	case WBL_PRIMITIVE_TYPE_STRING:
+		return shard_hash_mix (seed,
+		                       g_str_hash (json_node_get_string (node)));
+	case WBL_PRIMITIVE_TYPE_INTEGER:
+		return shard_hash_mix (seed, json_node_get_int (node));
+	case WBL_PRIMITIVE_TYPE_NUMBER: {
+		gdouble v = json_node_get_double (node);
+		guint64 bits;
+
+		memcpy (&bits, &v, sizeof (bits));
+
+		return shard_hash_mix (seed, bits);
+	}
+	case WBL_PRIMITIVE_TYPE_ARRAY: {
+		JsonArray *array;  /* unowned */
+		guint i, len;
+		guint32 hash;
+
+		array = json_node_get_array (node);
+		len = json_array_get_length (array);
+		hash = shard_hash_mix (seed, len);
+
+		for (i = 0; i < len; i++) {
+			hash = shard_hash_mix (hash,
+			                       shard_hash_node (json_array_get_element (array, i)));
+		}
+
+		return hash;
+	}
+	case WBL_PRIMITIVE_TYPE_OBJECT: {
+		JsonObject *object;  /* unowned */
+		JsonObjectIter iter;
+		const gchar *member_name;
+		JsonNode *member_node;
+		guint32 sum = 0;
+
+		object = json_node_get_object (node);
+		json_object_iter_init (&iter, object);
+
+		while (json_object_iter_next (&iter, &member_name,
+		                              &member_node)) {
+			guint32 member_hash;
+
+			member_hash = shard_hash_mix (seed, g_str_hash (member_name));
+			member_hash = shard_hash_mix (member_hash,
+			                              shard_hash_node (member_node));
+			sum += member_hash;
+		}
+
+		return shard_hash_mix (shard_hash_mix (seed,
+		                                       json_object_get_size (object)),
+		                       sum);
+	}
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/* Deterministic hash of the strings in @set, used to divide property sets
+ * between shards. Like the object members in shard_hash_node(), they are
+ * combined commutatively, so the order of @set does not matter.
+ *
+ * Complexity: O(N) in the size of @set */
+static guint32
+shard_hash_string_set (WblStringSet  *set)
+{
+	const guint32 seed = 2166136261;
+	WblStringSetIter iter;
+	const gchar *str;
+	guint32 sum = 0;
+
+	wbl_string_set_iter_init (&iter, set);
+
+	while (wbl_string_set_iter_next (&iter, &str)) {
+		sum += shard_hash_mix (seed, g_str_hash (str));
+	}
+
+	return shard_hash_mix (shard_hash_mix (seed,
+	                                       wbl_string_set_get_size (set)),
+	                       sum);
+}
+
 struct _WblSchemaPrivate {
 	JsonParser *parser;  /* owned */
 	WblSchemaNode *schema;  /* owned; NULL when not loading */
 	GPtrArray/*<owned WblValidateMessage>*/ *messages;  /* owned; NULL on no validate messages */
 	gboolean debug;
 
-	/* Cached data used during generation. */
+	/* Flags for the current wbl_schema_generate_instances() call. */
+	WblGenerateInstanceFlags generate_flags;
+
+	/* Shard of the root schema to generate in the current
+	 * wbl_schema_generate_instances_sharded() call. @generate_n_shards is
+	 * 1 if generation is not divided between shards. See
+	 * generate_is_sharded_root(). */
+	guint generate_shard_index;
+	guint generate_n_shards;
+
+	/* Shard which the cached instances of the root schema were generated
+	 * for, in the same form. */
+	guint schema_instances_cache_shard_index;
+	guint schema_instances_cache_n_shards;
+
+	/* Limits set by wbl_schema_set_generation_limits(); 0 means no
+	 * limit. */
+	guint max_depth;
+	gsize max_instance_size;
+	gsize max_total_size;
+
+	/* Number of arrays and objects the subschema currently being
+	 * generated for is nested inside. */
+	guint generate_depth;
+
+	/* Allocation estimates for the keyword currently being generated for,
+	 * so that its generator can add the intermediate sets it builds. See
+	 * accounting_begin(). */
+	WblAllocationStats *accounting_stats;  /* unowned; NULL unless estimating */
+
+	/* Set by wbl_schema_set_spill_threshold(); 0 means never spill. */
+	gsize spill_threshold;
+
+	/* Set by wbl_schema_set_check_formats(). */
+	gboolean check_formats;
+
+	/* Set by wbl_schema_set_load_mode(), and used by the next load. */
+	WblSchemaLoadMode load_mode;
+
+	/* Whether @messages holds the result of validating the whole of the
+	 * loaded schema; %FALSE until needed if it was loaded without
+	 * validation. */
+	gboolean validated;
+
+	/* Verdicts from wbl_schema_apply() and wbl_schema_apply_data(), keyed
+	 * by the instance, with the most recently used first in
+	 * @verdict_cache_lru. Set up by wbl_schema_set_verdict_cache_size().
+	 * Apply calls may run in any thread, so all of these are protected by
+	 * @verdict_cache_lock. */
+	guint verdict_cache_size;
+	GHashTable/*<owned VerdictCacheEntry, unowned VerdictCacheEntry>*/ *verdict_cache;  /* owned; NULL when disabled */
+	GQueue/*<unowned VerdictCacheEntry>*/ verdict_cache_lru;
+	GMutex verdict_cache_lock;
+
+	/* Set by wbl_schema_set_memoise_subtrees(). */
+	gboolean memoise_subtrees;
+
+	/* Compiled regular expressions from the `pattern` and
+	 * `patternProperties` keywords, keyed by pattern, so that applying the
+	 * schema compiles each of them once rather than on every call. This
+	 * is cleared when a new schema is loaded. Apply calls may run in any
+	 * thread, so this is protected by @regex_cache_lock. */
+	GHashTable/*<owned utf8, owned GRegex>*/ *regex_cache;  /* owned */
+	GMutex regex_cache_lock;
+
+	/* Property names used in the #WblStringSets built during generation.
+	 * This is replaced when a new schema is loaded. */
+	WblStringPool *string_pool;  /* owned */
+
+	/* Cached data used during generation, and the #INSTANCE_CACHE_FLAGS
+	 * it was generated with. */
 	GHashTable/*<owned JsonObject, owned WblSchemaInstanceCacheEntry>*/ *schema_instances_cache;  /* owned */
+	WblGenerateInstanceFlags schema_instances_cache_flags;
+
+	/* Keywords added with wbl_schema_add_keyword(), in the order they were
+	 * added. */
+	GArray/*<owned ExtensionKeywordData>*/ *extension_keywords;  /* owned */
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (WblSchema, wbl_schema, G_TYPE_OBJECT)
 
+/* Get the allocation estimates for the keyword currently being generated for,
+ * so its generator can add the intermediate sets it builds, and the most bytes
+ * it holds at once; or %NULL if estimation is disabled.
+ *
+ * Complexity: O(1) */
+static WblAllocationStats *
+accounting_get_stats (WblSchema *self)
+{
+	WblSchemaPrivate *priv;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	return priv->accounting_stats;
+}
+
+/* Check whether generation for @root is being divided between shards: that
+ * is, whether @root is the root schema and the current generation depth is
+ * @root_depth. Only the root schema is divided, as dividing the instances of
+ * a subschema would change the instances its parents combine them into.
+ *
+ * Complexity: O(1) */
+static gboolean
+generate_is_sharded_root (WblSchema   *self,
+                          JsonObject  *root,
+                          guint        root_depth)
+{
+	WblSchemaPrivate *priv;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	return (priv->generate_n_shards > 1 &&
+	        priv->schema != NULL &&
+	        root == priv->schema->node &&
+	        priv->generate_depth == root_depth);
+}
+
+/* Check whether the generated @node belongs to the shard being generated.
+ * This is used for the instances which are not divided between shards
+ * before being generated, so every shard generates them.
+ *
+ * Complexity: O(shard_hash_node) */
+static gboolean
+generate_shard_owns_node (WblSchema  *self,
+                          JsonNode   *node)
+{
+	WblSchemaPrivate *priv;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	return (priv->generate_n_shards <= 1 ||
+	        shard_hash_node (node) % priv->generate_n_shards ==
+	        priv->generate_shard_index);
+}
+
 static void
 wbl_schema_class_init (WblSchemaClass *klass)
 {
 	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
 	gobject_class->dispose = wbl_schema_dispose;
+	gobject_class->finalize = wbl_schema_finalize;
 
 	klass->validate_schema = real_validate_schema;
 	klass->apply_schema = real_apply_schema;
@@ -1021,6 +1594,20 @@ wbl_schema_init (WblSchema *self)
 	priv = wbl_schema_get_instance_private (self);
 
 	priv->parser = json_parser_new ();
+	priv->string_pool = wbl_string_pool_new ();
+	g_mutex_init (&priv->verdict_cache_lock);
+	priv->regex_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                           g_free,
+	                                           (GDestroyNotify) g_regex_unref);
+	g_mutex_init (&priv->regex_cache_lock);
+
+	priv->generate_n_shards = 1;
+	priv->schema_instances_cache_n_shards = 1;
+
+	priv->extension_keywords = g_array_new (FALSE, FALSE,
+	                                        sizeof (ExtensionKeywordData));
+	g_array_set_clear_func (priv->extension_keywords,
+	                        (GDestroyNotify) extension_keyword_data_clear);
 
 	/* Check whether to enable debug output. */
 	messages_debug = g_getenv ("G_MESSAGES_DEBUG");
@@ -1059,91 +1646,357 @@ wbl_schema_dispose (GObject *object)
 
 	g_clear_pointer (&priv->messages, g_ptr_array_unref);
 	g_clear_pointer (&priv->schema_instances_cache, g_hash_table_unref);
+	g_clear_pointer (&priv->regex_cache, g_hash_table_unref);
+
+	g_queue_init (&priv->verdict_cache_lru);
+	g_clear_pointer (&priv->verdict_cache, g_hash_table_unref);
+
+	/* The cache refers to the extension keyword names, so must be cleared
+	 * first. */
+	g_clear_pointer (&priv->extension_keywords, g_array_unref);
 
 	/* Chain up to the parent class */
 	G_OBJECT_CLASS (wbl_schema_parent_class)->dispose (object);
 }
 
-/* A couple of utility functions for validation. */
+static void
+wbl_schema_finalize (GObject *object)
+{
+	WblSchema *self = WBL_SCHEMA (object);
+	WblSchemaPrivate *priv = wbl_schema_get_instance_private (self);
 
-/* Complexity: O(1) */
+	g_mutex_clear (&priv->verdict_cache_lock);
+	g_mutex_clear (&priv->regex_cache_lock);
+	wbl_string_pool_unref (priv->string_pool);
+
+	/* Chain up to the parent class */
+	G_OBJECT_CLASS (wbl_schema_parent_class)->finalize (object);
+}
+
+/* An entry in the verdict cache. Entries are keyed by either the serialised
+ * instance passed to wbl_schema_apply_data() (@data), or a compact copy of the
+ * instance passed to wbl_schema_apply() (@instance). Keys used for lookups
+ * and insertions point to the instance itself (@node) rather than a copy. */
+typedef struct {
+	guint hash;
+	GBytes *data;  /* owned; nullable */
+	WblTape *instance;  /* owned; nullable */
+	JsonNode *node;  /* unowned; NULL except in keys */
+	GError *verdict;  /* owned; NULL if the instance is valid */
+	GList link;  /* in WblSchemaPrivate.verdict_cache_lru */
+} VerdictCacheEntry;
+
+static void
+verdict_cache_entry_free (VerdictCacheEntry *entry)
+{
+	g_clear_pointer (&entry->data, g_bytes_unref);
+	g_clear_pointer (&entry->instance, wbl_tape_unref);
+	g_clear_error (&entry->verdict);
+	g_slice_free (VerdictCacheEntry, entry);
+}
+
+static guint
+verdict_cache_entry_hash (gconstpointer key)
+{
+	const VerdictCacheEntry *entry = key;
+
+	return entry->hash;
+}
+
+/* Complexity: O(N) in the size of the instance */
 static gboolean
-validate_regex (const gchar *regex)
+verdict_cache_entry_equal (gconstpointer a,
+                           gconstpointer b)
 {
-	GRegex *r = NULL;  /* owned */
-	GError *error = NULL;
+	const VerdictCacheEntry *entry_a = a, *entry_b = b;
+	const VerdictCacheEntry *entry, *key;
 
-	r = g_regex_new (regex, 0, 0, &error);
-	if (error != NULL) {
-		g_error_free (error);
-		return FALSE;
-	} else {
-		g_regex_unref (r);
+	if (entry_a == entry_b) {
 		return TRUE;
+	} else if (entry_a->data != NULL || entry_b->data != NULL) {
+		return (entry_a->data != NULL && entry_b->data != NULL &&
+		        g_bytes_equal (entry_a->data, entry_b->data));
+	}
+
+	/* Two distinct cached entries never have the same instance. */
+	if (entry_b->node != NULL) {
+		entry = entry_a;
+		key = entry_b;
+	} else if (entry_a->node != NULL) {
+		entry = entry_b;
+		key = entry_a;
+	} else {
+		return FALSE;
 	}
+
+	return (entry->instance != NULL &&
+	        wbl_tape_equal_node (entry->instance, 0, key->node));
 }
 
-/* Complexity: O(1) */
+/* Whether the verdict cache is enabled; if not, there is no need to build a
+ * key for it. */
 static gboolean
-validate_value_type (JsonNode *node, GType value_type)
+verdict_cache_is_enabled (WblSchemaPrivate *priv)
 {
-	return (JSON_NODE_HOLDS_VALUE (node) &&
-	        json_node_get_value_type (node) == value_type);
+	gboolean enabled;
+
+	g_mutex_lock (&priv->verdict_cache_lock);
+	enabled = (priv->verdict_cache != NULL);
+	g_mutex_unlock (&priv->verdict_cache_lock);
+
+	return enabled;
 }
 
-/* Validate a node is a non-empty array of unique strings.
+/* Evict the least recently used verdicts until there are at most
+ * @verdict_cache_size. Must be called with @verdict_cache_lock held.
  *
- * Complexity: O(N) in the length of the array */
-static gboolean
-validate_non_empty_unique_string_array (JsonNode *schema_node)
+ * Complexity: O(1) amortised */
+static void
+verdict_cache_trim (WblSchemaPrivate *priv)
 {
-	JsonArray *schema_array;  /* unowned */
-	guint i;
-	GHashTable/*<unowned utf8, unowned utf8>*/ *set = NULL;  /* owned */
-	gboolean valid = TRUE;
+	while (priv->verdict_cache_lru.length > priv->verdict_cache_size) {
+		GList *link;  /* unowned */
 
-	if (!JSON_NODE_HOLDS_ARRAY (schema_node)) {
-		return FALSE;
+		link = g_queue_pop_tail_link (&priv->verdict_cache_lru);
+		g_hash_table_remove (priv->verdict_cache, link->data);
 	}
+}
 
-	schema_array = json_node_get_array (schema_node);
+/* Drop all cached verdicts, for example because a new schema has been
+ * loaded. */
+static void
+verdict_cache_clear (WblSchemaPrivate *priv)
+{
+	g_mutex_lock (&priv->verdict_cache_lock);
 
-	if (json_array_get_length (schema_array) == 0) {
-		return FALSE;
+	if (priv->verdict_cache != NULL) {
+		g_queue_init (&priv->verdict_cache_lru);
+		g_hash_table_remove_all (priv->verdict_cache);
 	}
 
-	set = g_hash_table_new (wbl_json_string_hash, wbl_json_string_equal);
+	g_mutex_unlock (&priv->verdict_cache_lock);
+}
 
-	for (i = 0; i < json_array_get_length (schema_array); i++) {
-		JsonNode *child_node;  /* unowned */
-		const gchar *child_str;
+/* Look up the verdict for @key. If it is cached, set @verdict to a copy of
+ * it (leaving it unset if the instance was valid) and return %TRUE.
+ *
+ * Complexity: O(N) in the size of the instance, to compare it with the cached
+ * one */
+static gboolean
+verdict_cache_lookup (WblSchemaPrivate         *priv,
+                      const VerdictCacheEntry  *key,
+                      GError                  **verdict)
+{
+	VerdictCacheEntry *entry = NULL;  /* unowned */
 
-		child_node = json_array_get_element (schema_array, i);
+	g_mutex_lock (&priv->verdict_cache_lock);
 
-		/* Check it’s a string. */
-		if (!validate_value_type (child_node, G_TYPE_STRING)) {
-			valid = FALSE;
-			break;
-		}
+	if (priv->verdict_cache != NULL) {
+		entry = g_hash_table_lookup (priv->verdict_cache, key);
+	}
 
-		/* Check for uniqueness. */
-		child_str = json_node_get_string (child_node);
+	if (entry != NULL) {
+		g_queue_unlink (&priv->verdict_cache_lru, &entry->link);
+		g_queue_push_head_link (&priv->verdict_cache_lru, &entry->link);
 
-		if (g_hash_table_contains (set, child_str)) {
-			valid = FALSE;
-			break;
+		if (entry->verdict != NULL) {
+			g_propagate_error (verdict, g_error_copy (entry->verdict));
 		}
-
-		g_hash_table_add (set, (gpointer) child_str);
 	}
 
-	g_hash_table_unref (set);
+	g_mutex_unlock (&priv->verdict_cache_lock);
 
-	return valid;
+	return (entry != NULL);
 }
 
-/* Validate a node is a non-empty array of valid JSON schemas.
- * If any of the schemas is invalid, return all of the validation errors in
+/* Cache @verdict (which is %NULL if the instance is valid) for @key, evicting
+ * the least recently used verdict if the cache is full.
+ *
+ * Complexity: O(N) in the size of the instance, to copy it */
+static void
+verdict_cache_insert (WblSchemaPrivate        *priv,
+                      const VerdictCacheEntry *key,
+                      const GError            *verdict)
+{
+	VerdictCacheEntry *entry = NULL;  /* owned */
+
+	/* Copy the key outside the lock, as it may be large. */
+	entry = g_slice_new0 (VerdictCacheEntry);
+	entry->hash = key->hash;
+	entry->link.data = entry;
+
+	if (key->data != NULL) {
+		entry->data = g_bytes_new (g_bytes_get_data (key->data, NULL),
+		                           g_bytes_get_size (key->data));
+	} else {
+		entry->instance = wbl_tape_new_from_nodes (&key->node, 1);
+		entry->node = key->node;
+	}
+
+	if (verdict != NULL) {
+		entry->verdict = g_error_copy (verdict);
+	}
+
+	g_mutex_lock (&priv->verdict_cache_lock);
+
+	/* Another thread may have cached the same instance meanwhile, or the
+	 * cache may have been disabled. */
+	if (priv->verdict_cache != NULL &&
+	    !g_hash_table_contains (priv->verdict_cache, key)) {
+		g_hash_table_add (priv->verdict_cache, entry);
+		g_queue_push_head_link (&priv->verdict_cache_lru, &entry->link);
+		entry->node = NULL;
+		entry = NULL;  /* transferred */
+
+		verdict_cache_trim (priv);
+	}
+
+	g_mutex_unlock (&priv->verdict_cache_lock);
+
+	g_clear_pointer (&entry, verdict_cache_entry_free);
+}
+
+/* A couple of utility functions for validation. */
+
+/* Compile a regular expression from a schema. All regex compilation goes
+ * through here so that it can be traced.
+ *
+ * Complexity: O(g_regex_new) */
+static GRegex *
+regex_new (const gchar  *pattern,
+           GError      **error)
+{
+	GRegex *regex = NULL;  /* owned */
+
+	WBL_PROBE1 (regex__compile__entry, pattern);
+	regex = g_regex_new (pattern, 0, 0, error);
+	WBL_PROBE2 (regex__compile__return, pattern, (regex != NULL) ? 1 : 0);
+
+	return regex;
+}
+
+/* Get the compiled form of @pattern from the schema’s regex cache, compiling
+ * it the first time it is needed. Patterns which fail to compile are not
+ * cached.
+ *
+ * Complexity: O(1) once @pattern has been compiled; otherwise
+ *    O(g_regex_new)
+ * Returns: (transfer full): the compiled regex, or %NULL on error */
+static GRegex *
+schema_get_regex (WblSchema    *self,
+                  const gchar  *pattern,
+                  GError      **error)
+{
+	WblSchemaPrivate *priv;
+	GRegex *regex = NULL;  /* owned */
+
+	priv = wbl_schema_get_instance_private (self);
+
+	g_mutex_lock (&priv->regex_cache_lock);
+	regex = g_hash_table_lookup (priv->regex_cache, pattern);
+
+	if (regex != NULL) {
+		g_regex_ref (regex);
+	}
+
+	g_mutex_unlock (&priv->regex_cache_lock);
+
+	if (regex != NULL) {
+		return regex;
+	}
+
+	/* Compile outside the lock. If another thread compiles the same
+	 * pattern meanwhile, the later insertion replaces the earlier. */
+	regex = regex_new (pattern, error);
+
+	if (regex != NULL) {
+		g_mutex_lock (&priv->regex_cache_lock);
+		g_hash_table_insert (priv->regex_cache, g_strdup (pattern),
+		                     g_regex_ref (regex));
+		g_mutex_unlock (&priv->regex_cache_lock);
+	}
+
+	return regex;
+}
+
+/* Complexity: O(1) */
+static gboolean
+validate_regex (const gchar *regex)
+{
+	GRegex *r = NULL;  /* owned */
+	GError *error = NULL;
+
+	r = regex_new (regex, &error);
+	if (error != NULL) {
+		g_error_free (error);
+		return FALSE;
+	} else {
+		g_regex_unref (r);
+		return TRUE;
+	}
+}
+
+/* Complexity: O(1) */
+static gboolean
+validate_value_type (JsonNode *node, GType value_type)
+{
+	return (JSON_NODE_HOLDS_VALUE (node) &&
+	        json_node_get_value_type (node) == value_type);
+}
+
+/* Validate a node is a non-empty array of unique strings.
+ *
+ * Complexity: O(N) in the length of the array */
+static gboolean
+validate_non_empty_unique_string_array (JsonNode *schema_node)
+{
+	JsonArray *schema_array;  /* unowned */
+	guint i;
+	GHashTable/*<unowned utf8, unowned utf8>*/ *set = NULL;  /* owned */
+	gboolean valid = TRUE;
+
+	if (!JSON_NODE_HOLDS_ARRAY (schema_node)) {
+		return FALSE;
+	}
+
+	schema_array = json_node_get_array (schema_node);
+
+	if (json_array_get_length (schema_array) == 0) {
+		return FALSE;
+	}
+
+	set = g_hash_table_new (wbl_json_string_hash, wbl_json_string_equal);
+
+	for (i = 0; i < json_array_get_length (schema_array); i++) {
+		JsonNode *child_node;  /* unowned */
+		const gchar *child_str;
+
+		child_node = json_array_get_element (schema_array, i);
+
+		/* Check it’s a string. */
+		if (!validate_value_type (child_node, G_TYPE_STRING)) {
+			valid = FALSE;
+			break;
+		}
+
+		/* Check for uniqueness. */
+		child_str = json_node_get_string (child_node);
+
+		if (g_hash_table_contains (set, child_str)) {
+			valid = FALSE;
+			break;
+		}
+
+		g_hash_table_add (set, (gpointer) child_str);
+	}
+
+	g_hash_table_unref (set);
+
+	return valid;
+}
+
+/* Validate a node is a non-empty array of valid JSON schemas.
+ * If any of the schemas is invalid, return all of the validation errors in
  * @messages.
  *
  * Complexity: O(N * subschema_validate) in the length of the array */
@@ -1304,6 +2157,31 @@ generate_schema_array (WblSchema *self,
 	}
 }
 
+/* Estimate the instances generated by generate_schema_array().
+ *
+ * Complexity: O(N * subschema_estimate) in the number of schemas */
+static void
+estimate_schema_array (WblSchema *self,
+                       JsonArray *schema_array,
+                       GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                       WblSchemaEstimate *estimate,
+                       gdouble *n_instances,
+                       gdouble *cost)
+{
+	guint i, n_schemas;
+
+	n_schemas = json_array_get_length (schema_array);
+
+	for (i = 0; i < n_schemas; i++) {
+		*n_instances += subschema_estimate (self, estimates, estimate,
+		                                    json_array_get_element (schema_array, i),
+		                                    TRUE);
+	}
+
+	/* Each child instance is copied into the output. */
+	*cost = *n_instances;
+}
+
 /* A couple of utility functions for building #JsonNodes. */
 static JsonNode *
 node_new_int (gint64   value)
@@ -1352,6 +2230,114 @@ node_to_string (JsonNode  *node)
 	return output;
 }
 
+/* Get the serialised size of @str, including quotes and escapes, as output by
+ * #JsonGenerator.
+ *
+ * Complexity: O(N) in the length of @str */
+static gsize
+string_get_serialised_size (const gchar *str)
+{
+	gsize size = 2;
+
+	for (; *str != '\0'; str++) {
+		switch (*str) {
+		case '"':
+		case '\\':
+		case '\b':
+		case '\f':
+		case '\n':
+		case '\r':
+		case '\t':
+			size += 2;
+			break;
+		default:
+			size += ((guchar) *str < 0x20) ? 6 : 1;
+			break;
+		}
+	}
+
+	return size;
+}
+
+/* Get the size in bytes of @node when serialised by node_to_string(), or any
+ * value greater than @limit if it is bigger than that. This stops early on
+ * nodes which are much bigger than @limit. The sizes of doubles are
+ * approximate.
+ *
+ * Complexity: O(min(N, @limit)) in the serialised size N of @node */
+static gsize
+node_get_serialised_size (JsonNode  *node,
+                          gsize      limit)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+	gsize size = 0;
+
+	switch (json_node_get_node_type (node)) {
+	case JSON_NODE_OBJECT: {
+		JsonObjectIter iter;
+		const gchar *member_name;
+		JsonNode *member_node;
+
+		size = 2;
+		json_object_iter_init (&iter, json_node_get_object (node));
+
+		while (size <= limit &&
+		       json_object_iter_next (&iter, &member_name,
+		                              &member_node)) {
+			size += ((size > 2) ? 1 : 0) +
+			        string_get_serialised_size (member_name) + 1;
+			size += node_get_serialised_size (member_node, limit);
+		}
+
+		break;
+	}
+	case JSON_NODE_ARRAY: {
+		JsonArray *array;
+		guint i, len;
+
+		size = 2;
+		array = json_node_get_array (node);
+
+		for (i = 0, len = json_array_get_length (array);
+		     i < len && size <= limit; i++) {
+			size += ((i > 0) ? 1 : 0) +
+			        node_get_serialised_size (json_array_get_element (array, i),
+			                                  limit);
+		}
+
+		break;
+	}
+	case JSON_NODE_VALUE:
+		switch (json_node_get_value_type (node)) {
+		case G_TYPE_INT64:
+			size = g_snprintf (buf, sizeof (buf), "%" G_GINT64_FORMAT,
+			                   json_node_get_int (node));
+			break;
+		case G_TYPE_DOUBLE:
+			size = strlen (g_ascii_dtostr (buf, sizeof (buf),
+			                               json_node_get_double (node)));
+			break;
+		case G_TYPE_BOOLEAN:
+			size = json_node_get_boolean (node) ? 4 : 5;
+			break;
+		case G_TYPE_STRING:
+			size = string_get_serialised_size (json_node_get_string (node));
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+
+		break;
+	case JSON_NODE_NULL:
+		size = 4;
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	return size;
+}
+
 /* A couple of utility functions for generation. */
 
 /* Complexity: O(1) */
@@ -1363,6 +2349,83 @@ generate_take_node (GHashTable/*<owned JsonNode>*/  *output,
 	g_hash_table_add (output, node);  /* transfer */
 }
 
+/* Limits on the serialised sizes of the instances built by one combination
+ * loop, as set with wbl_schema_set_generation_limits(). The loop admits each
+ * instance as it is built, in generation order, so it never holds more than
+ * the total limit in instances, however many combinations there are. */
+typedef struct {
+	gsize instance_limit;  /* G_MAXSIZE for no limit */
+	gsize total_limit;  /* G_MAXSIZE for no limit */
+	gsize total_size;
+} GenerateSizeBudget;
+
+/* Complexity: O(1) */
+static void
+generate_size_budget_init (GenerateSizeBudget *budget,
+                           gsize               max_instance_size,
+                           gsize               max_total_size)
+{
+	budget->instance_limit = (max_instance_size > 0) ? max_instance_size :
+	                                                   G_MAXSIZE;
+	budget->total_limit = (max_total_size > 0) ? max_total_size : G_MAXSIZE;
+	budget->total_size = 0;
+}
+
+/* Whether no more instances can be admitted to @budget, as even the smallest
+ * array or object (`[]` or `{}`) would not fit.
+ *
+ * Complexity: O(1) */
+static gboolean
+generate_size_budget_is_exhausted (const GenerateSizeBudget *budget)
+{
+	return (budget->total_limit - budget->total_size < 2);
+}
+
+/* Check whether @node fits in what is left of @budget, and account for it if
+ * so. If not, the caller should drop it.
+ *
+ * Complexity: O(min(S, instance_limit)) in the serialised size S of @node */
+static gboolean
+generate_size_budget_admit (GenerateSizeBudget *budget,
+                            JsonNode           *node)
+{
+	gsize size, limit;
+
+	if (budget->instance_limit == G_MAXSIZE &&
+	    budget->total_limit == G_MAXSIZE) {
+		return TRUE;
+	}
+
+	limit = MIN (budget->instance_limit,
+	             budget->total_limit - budget->total_size);
+	size = node_get_serialised_size (node, limit);
+
+	if (size > limit) {
+		return FALSE;
+	}
+
+	budget->total_size += size;
+
+	return TRUE;
+}
+
+/* Add @node to @output if it is not already there and it fits in @budget.
+ * Otherwise free it.
+ *
+ * Complexity: O(generate_size_budget_admit) */
+static void
+generate_take_node_within_budget (GHashTable/*<owned JsonNode>*/  *output,
+                                  JsonNode                        *node,  /* transfer full */
+                                  GenerateSizeBudget              *budget)
+{
+	if (!g_hash_table_contains (output, node) &&
+	    generate_size_budget_admit (budget, node)) {
+		generate_take_node (output, node);
+	} else {
+		json_node_free (node);
+	}
+}
+
 /* Complexity: O(1) */
 static void
 generate_filled_string (GHashTable/*<owned JsonNode>*/ *output,
@@ -1603,6 +2666,20 @@ generate_multiple_of (WblSchema *self,
 	}
 }
 
+/* Complexity: O(1) */
+static void
+estimate_multiple_of (WblSchema *self,
+                      JsonObject *root,
+                      JsonNode *schema_node,
+                      GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                      WblSchemaEstimate *estimate,
+                      gdouble *n_instances,
+                      gdouble *cost)
+{
+	*n_instances = 4.0;
+	*cost = *n_instances;
+}
+
 /* maximum and exclusiveMaximum. draft-fge-json-schema-validation-00§5.1.2.
  *
  * Complexity: O(1) */
@@ -1718,6 +2795,111 @@ apply_maximum (WblSchema *self,
 	g_free (maximum_str);
 }
 
+/* Column-wise application of maximum or minimum to @instances; see
+ * KeywordApplyBatchFunc. The instance values are extracted into columns, then
+ * compared against the limit in a tight loop, following the semantics of
+ * wbl_json_number_node_comparison(). Only the instances which fail are passed
+ * to @apply, to build their error messages.
+ *
+ * Complexity: O(N) in the number of @instances */
+static void
+apply_batch_number_limit (WblSchema         *self,
+                          JsonObject        *root,
+                          JsonNode          *schema_node,
+                          JsonNode * const  *instances,
+                          GError           **errors,
+                          guint              n_instances,
+                          const gchar       *exclusive_keyword,
+                          gint               sign,
+                          void             (*apply) (WblSchema  *self,
+                                                     JsonObject *root,
+                                                     JsonNode   *schema_node,
+                                                     JsonNode   *instance_node,
+                                                     GError    **error))
+{
+	enum { SKIP, INTEGER, DOUBLE };
+	guint8 *kinds = NULL;  /* owned */
+	gint64 *ints = NULL;  /* owned */
+	gdouble *doubles = NULL;  /* owned */
+	gboolean limit_is_int, exclusive = FALSE;
+	gint64 limit_int = 0;
+	gdouble limit_double;
+	JsonNode *node;  /* unowned */
+	guint i;
+
+	node = json_object_get_member (root, exclusive_keyword);
+	if (node != NULL) {
+		exclusive = json_node_get_boolean (node);
+	}
+
+	limit_is_int = (json_node_get_value_type (schema_node) == G_TYPE_INT64);
+	if (limit_is_int) {
+		limit_int = json_node_get_int (schema_node);
+	}
+	limit_double = json_node_get_double (schema_node);
+
+	kinds = g_new (guint8, n_instances);
+	ints = g_new0 (gint64, n_instances);
+	doubles = g_new0 (gdouble, n_instances);
+
+	/* Extract the values. */
+	for (i = 0; i < n_instances; i++) {
+		if (errors[i] != NULL) {
+			kinds[i] = SKIP;
+		} else if (validate_value_type (instances[i], G_TYPE_INT64)) {
+			kinds[i] = INTEGER;
+			ints[i] = json_node_get_int (instances[i]);
+			doubles[i] = (gdouble) ints[i];
+		} else if (validate_value_type (instances[i], G_TYPE_DOUBLE)) {
+			kinds[i] = DOUBLE;
+			doubles[i] = json_node_get_double (instances[i]);
+		} else {
+			kinds[i] = SKIP;
+		}
+	}
+
+	/* Compare them. @sign is 1 for maximum and -1 for minimum, so the
+	 * comparison is inverted for minimum. */
+	for (i = 0; i < n_instances; i++) {
+		gint comparison;
+
+		if (kinds[i] == SKIP) {
+			continue;
+		}
+
+		if (limit_is_int && kinds[i] == INTEGER) {
+			comparison = (ints[i] > limit_int) - (ints[i] < limit_int);
+		} else {
+			comparison = (doubles[i] > limit_double) -
+			             (doubles[i] < limit_double);
+		}
+
+		comparison *= sign;
+
+		if (comparison > 0 || (exclusive && comparison == 0)) {
+			apply (self, root, schema_node, instances[i], &errors[i]);
+		}
+	}
+
+	g_free (doubles);
+	g_free (ints);
+	g_free (kinds);
+}
+
+/* Complexity: O(N) in the number of @instances */
+static void
+apply_batch_maximum (WblSchema         *self,
+                     JsonObject        *root,
+                     JsonNode          *schema_node,
+                     JsonNode * const  *instances,
+                     GError           **errors,
+                     guint              n_instances)
+{
+	apply_batch_number_limit (self, root, schema_node, instances, errors,
+	                          n_instances, "exclusiveMaximum", 1,
+	                          apply_maximum);
+}
+
 /* Complexity: O(1) */
 static void
 generate_maximum (WblSchema *self,
@@ -1772,6 +2954,20 @@ generate_maximum (WblSchema *self,
 	}
 }
 
+/* Complexity: O(1) */
+static void
+estimate_maximum (WblSchema *self,
+                  JsonObject *root,
+                  JsonNode *schema_node,
+                  GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                  WblSchemaEstimate *estimate,
+                  gdouble *n_instances,
+                  gdouble *cost)
+{
+	*n_instances = 4.0;
+	*cost = *n_instances;
+}
+
 /* minimum and exclusiveMinimum. draft-fge-json-schema-validation-00§5.1.3.
  *
  * Complexity: O(1) */
@@ -1887,6 +3083,20 @@ apply_minimum (WblSchema *self,
 	g_free (minimum_str);
 }
 
+/* Complexity: O(N) in the number of @instances */
+static void
+apply_batch_minimum (WblSchema         *self,
+                     JsonObject        *root,
+                     JsonNode          *schema_node,
+                     JsonNode * const  *instances,
+                     GError           **errors,
+                     guint              n_instances)
+{
+	apply_batch_number_limit (self, root, schema_node, instances, errors,
+	                          n_instances, "exclusiveMinimum", -1,
+	                          apply_minimum);
+}
+
 /* Complexity: O(1) */
 static void
 generate_minimum (WblSchema *self,
@@ -1942,8 +3152,433 @@ generate_minimum (WblSchema *self,
 	}
 }
 
-/* maxLength. draft-fge-json-schema-validation-00§5.2.1.
- *
+/* Complexity: O(1) */
+static void
+estimate_minimum (WblSchema *self,
+                  JsonObject *root,
+                  JsonNode *schema_node,
+                  GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                  WblSchemaEstimate *estimate,
+                  gdouble *n_instances,
+                  gdouble *cost)
+{
+	*n_instances = 4.0;
+	*cost = *n_instances;
+}
+
+/* A single keyword check made while applying a schema: the keyword (or
+ * keyword group) @keyword in the subschema @schema, and whether the instance
+ * passed it. A @schema and @keyword of %NULL record the validity of the
+ * instance as a whole. */
+typedef struct {
+	JsonObject *schema;  /* unowned */
+	const gchar *keyword;  /* unowned; static */
+	gboolean passed;
+} CoveragePoint;
+
+static guint
+coverage_point_hash (gconstpointer key)
+{
+	const CoveragePoint *point = key;
+
+	return (g_direct_hash (point->schema) ^
+	        g_direct_hash (point->keyword) ^
+	        (guint) point->passed);
+}
+
+static gboolean
+coverage_point_equal (gconstpointer a,
+                      gconstpointer b)
+{
+	const CoveragePoint *point_a = a, *point_b = b;
+
+	return (point_a->schema == point_b->schema &&
+	        point_a->keyword == point_b->keyword &&
+	        point_a->passed == point_b->passed);
+}
+
+/* Records the keyword checks exercised by instances while applying a schema.
+ * Each distinct #CoveragePoint is numbered in @point_indices, so that the
+ * points exercised by one instance can be stored compactly in @points. */
+typedef struct {
+	GHashTable/*<owned CoveragePoint, guint>*/ *point_indices;  /* owned */
+	GArray/*<guint>*/ *points;  /* owned; may contain duplicates */
+} CoverageRecorder;
+
+/* State shared by all the keyword checks made by an apply call, from the
+ * outermost apply_state_enter() to the matching apply_state_leave(). Calls
+ * may run concurrently in worker threads (see wbl_schema_apply_async()), so
+ * the state is per-thread. It holds:
+ *  - the root of the schema being applied, and whether to memoise subtree
+ *    verdicts, which are set by each call which gives a root and restored
+ *    from an #ApplyStateFrame when it returns;
+ *  - the recorder for keyword checks, set only for the duration of
+ *    apply_with_coverage();
+ *  - whether an invalid subschema was reached, which is taken by the call
+ *    which checks for it;
+ *  - the lengths of long strings for maxLength and minLength (a string may be
+ *    checked by both keywords, and by several subschemas through allOf, for
+ *    example), and the memoised subtree verdicts and hashes, which are
+ *    emptied when the outermost call returns, as the instance may then be
+ *    freed or modified. The tables themselves are kept for the lifetime of
+ *    the thread to avoid reallocating them. */
+typedef struct {
+	/* Nesting depth of apply_state_enter() calls. */
+	guint depth;
+	/* Root node of the schema being applied by the innermost call which
+	 * gave one, so lazy verdicts are looked up on the schema the call
+	 * started with, even if it has since been reloaded. See
+	 * subschema_validate_lazily(). */
+	WblSchemaNode *root;  /* unowned; nullable */
+	/* Cached lengths, in Unicode characters, of long string nodes. Kept
+	 * between calls to avoid reallocating it. */
+	GHashTable/*<unowned JsonNode, gsize>*/ *string_lengths;  /* owned; NULL until needed */
+	/* Keyword checks made by the current call, if they are being
+	 * recorded by apply_with_coverage(). */
+	CoverageRecorder *coverage;  /* unowned; NULL unless recording */
+	/* Set if the current call reached a subschema which was found to be
+	 * invalid when validated lazily. See subschema_validate_lazily(). */
+	gboolean malformed;
+	/* Whether to memoise @subtree_verdicts in the current call. This is
+	 * only worthwhile if instances repeat subtrees, so it is set from the
+	 * schema being applied; see wbl_schema_set_memoise_subtrees(). */
+	gboolean memoise_subtrees;
+	/* Verdicts of subschemas applied to array and object nodes in the
+	 * current call, so that each subschema is only applied once to
+	 * identical subtrees, plus the hashes of those subtrees. Kept between
+	 * calls to avoid reallocating them. See subschema_apply(). */
+	GHashTable/*<owned SubtreeKey, owned SubtreeVerdict>*/ *subtree_verdicts;  /* owned; NULL until needed */
+	GHashTable/*<unowned JsonNode, guint>*/ *subtree_hashes;  /* owned; NULL until needed */
+} ApplyState;
+
+/* The parts of #ApplyState which an inner apply call may change, saved by
+ * apply_state_enter() and restored by apply_state_leave(). */
+typedef struct {
+	WblSchemaNode *root;  /* unowned; nullable */
+	gboolean memoise_subtrees;
+} ApplyStateFrame;
+
+/* Strings shorter than this many bytes are cheaper to count than to look up
+ * in the cache. */
+#define STRING_LENGTH_CACHE_MIN_BYTES 64
+
+static void
+apply_state_free (ApplyState *state)
+{
+	if (state->string_lengths != NULL) {
+		g_hash_table_unref (state->string_lengths);
+	}
+
+	g_clear_pointer (&state->subtree_verdicts, g_hash_table_unref);
+	g_clear_pointer (&state->subtree_hashes, g_hash_table_unref);
+
+	g_free (state);
+}
+
+static GPrivate apply_state_private =
+	G_PRIVATE_INIT ((GDestroyNotify) apply_state_free);
+
+/* Mark the start of an apply call on the current thread, enabling the string
+ * length cache until the matching apply_state_leave(). If @root is
+ * non-%NULL, it is the root node of the schema being applied until then, and
+ * @memoise_subtrees says whether to memoise subtree verdicts; otherwise both
+ * are kept from any outer call. The previous values are saved in @previous,
+ * to be passed to apply_state_leave().
+ *
+ * Complexity: O(1) */
+static void
+apply_state_enter (WblSchemaNode   *root,
+                   gboolean         memoise_subtrees,
+                   ApplyStateFrame *previous)
+{
+	ApplyState *state;  /* unowned */
+
+	state = g_private_get (&apply_state_private);
+
+	if (state == NULL) {
+		state = g_new0 (ApplyState, 1);
+		g_private_set (&apply_state_private, state);
+	}
+
+	state->depth++;
+
+	previous->root = state->root;
+	previous->memoise_subtrees = state->memoise_subtrees;
+
+	if (root != NULL) {
+		state->root = root;
+		state->memoise_subtrees = memoise_subtrees;
+	}
+}
+
+/* Complexity: O(N) in the number of cached string lengths */
+static void
+apply_state_leave (const ApplyStateFrame *previous)
+{
+	ApplyState *state;  /* unowned */
+
+	state = g_private_get (&apply_state_private);
+	g_assert (state != NULL && state->depth > 0);
+
+	state->depth--;
+	state->root = previous->root;
+	state->memoise_subtrees = previous->memoise_subtrees;
+
+	/* Nodes may be freed or modified after the outermost call returns. */
+	if (state->depth == 0 && state->string_lengths != NULL) {
+		g_hash_table_remove_all (state->string_lengths);
+	}
+
+	if (state->depth == 0 && state->subtree_verdicts != NULL) {
+		g_hash_table_remove_all (state->subtree_verdicts);
+		g_hash_table_remove_all (state->subtree_hashes);
+	}
+}
+
+/* Get the recorder for keyword checks made on the current thread, or %NULL if
+ * they are not being recorded.
+ *
+ * Complexity: O(1) */
+static CoverageRecorder *
+apply_state_get_coverage (void)
+{
+	ApplyState *state;  /* unowned */
+
+	state = g_private_get (&apply_state_private);
+
+	return (state != NULL) ? state->coverage : NULL;
+}
+
+/* Get the root node of the schema being applied on the current thread, or
+ * %NULL if no apply call is running.
+ *
+ * Complexity: O(1) */
+static WblSchemaNode *
+apply_state_get_root (void)
+{
+	ApplyState *state;  /* unowned */
+
+	state = g_private_get (&apply_state_private);
+
+	return (state != NULL && state->depth > 0) ? state->root : NULL;
+}
+
+/* Record that the current apply call reached an invalid subschema, if there
+ * is one on this thread.
+ *
+ * Complexity: O(1) */
+static void
+apply_state_mark_malformed (void)
+{
+	ApplyState *state;  /* unowned */
+
+	state = g_private_get (&apply_state_private);
+
+	if (state != NULL && state->depth > 0) {
+		state->malformed = TRUE;
+	}
+}
+
+/* Get whether the current apply call has reached an invalid subschema since
+ * this was last called, and reset it.
+ *
+ * Complexity: O(1) */
+static gboolean
+apply_state_take_malformed (void)
+{
+	ApplyState *state;  /* unowned */
+	gboolean malformed;
+
+	state = g_private_get (&apply_state_private);
+
+	if (state == NULL) {
+		return FALSE;
+	}
+
+	malformed = state->malformed;
+	state->malformed = FALSE;
+
+	return malformed;
+}
+
+/* Look up the verdict from applying @subschema to an instance subtree
+ * identical to @instance earlier in the current apply call. If there is one,
+ * set @error to a copy of it and return %TRUE. Otherwise, set up @key for
+ * apply_state_add_subtree_verdict() and return %FALSE; @key->instance is left
+ * %NULL if the verdict should not be memoised.
+ *
+ * Nothing is memoised unless enabled for the schema being applied (see
+ * wbl_schema_set_memoise_subtrees()), as hashing and copying verdicts only
+ * pays off if instances repeat subtrees. Only arrays and objects are memoised, as other values are cheaper
+ * to check than to look up. Nothing is memoised while recording coverage, as
+ * every keyword check must be recorded.
+ *
+ * Complexity: O(N) in the size of @instance */
+static gboolean
+apply_state_lookup_subtree_verdict (JsonObject  *subschema,
+                                    JsonNode    *instance,
+                                    SubtreeKey  *key,
+                                    GError     **error)
+{
+	ApplyState *state;  /* unowned */
+	SubtreeVerdict *verdict;  /* unowned */
+
+	key->subschema = subschema;
+	key->instance = NULL;
+	key->hash = 0;
+	key->was_malformed = FALSE;
+
+	state = g_private_get (&apply_state_private);
+
+	if (state == NULL || state->depth == 0 || !state->memoise_subtrees ||
+	    state->coverage != NULL ||
+	    (!JSON_NODE_HOLDS_ARRAY (instance) &&
+	     !JSON_NODE_HOLDS_OBJECT (instance))) {
+		return FALSE;
+	}
+
+	if (state->subtree_verdicts == NULL) {
+		state->subtree_verdicts = g_hash_table_new_full (subtree_key_hash,
+		                                                 subtree_key_equal,
+		                                                 g_free,
+		                                                 (GDestroyNotify) subtree_verdict_free);
+		state->subtree_hashes = g_hash_table_new (g_direct_hash,
+		                                          g_direct_equal);
+	}
+
+	key->instance = instance;
+	key->hash = wbl_json_node_hash_strict_cached (instance,
+	                                              state->subtree_hashes);
+
+	verdict = g_hash_table_lookup (state->subtree_verdicts, key);
+
+	if (verdict == NULL) {
+		/* Any lazily found invalid subschema is recorded separately
+		 * for this subtree; see apply_state_add_subtree_verdict(). */
+		key->was_malformed = state->malformed;
+		state->malformed = FALSE;
+
+		return FALSE;
+	}
+
+	if (verdict->error != NULL) {
+		g_propagate_error (error, g_error_copy (verdict->error));
+	}
+
+	if (verdict->malformed) {
+		state->malformed = TRUE;
+	}
+
+	return TRUE;
+}
+
+/* Memoise @error as the verdict for @key, which was set up by
+ * apply_state_lookup_subtree_verdict().
+ *
+ * Complexity: O(1) */
+static void
+apply_state_add_subtree_verdict (const SubtreeKey *key,
+                                 const GError     *error)
+{
+	ApplyState *state;  /* unowned */
+	SubtreeKey *stored_key = NULL;  /* owned */
+	SubtreeVerdict *verdict = NULL;  /* owned */
+
+	if (key->instance == NULL) {
+		return;
+	}
+
+	state = g_private_get (&apply_state_private);
+
+	verdict = g_slice_new0 (SubtreeVerdict);
+	verdict->error = (error != NULL) ? g_error_copy (error) : NULL;
+	verdict->malformed = state->malformed;
+
+	stored_key = g_new (SubtreeKey, 1);
+	*stored_key = *key;
+	g_hash_table_insert (state->subtree_verdicts, stored_key, verdict);
+
+	state->malformed = (key->was_malformed || verdict->malformed);
+}
+
+/* Record that the @keyword check in @schema was made, and whether it
+ * @passed.
+ *
+ * Complexity: O(1) */
+static void
+coverage_recorder_add (CoverageRecorder *coverage,
+                       JsonObject       *schema,
+                       const gchar      *keyword,
+                       gboolean          passed)
+{
+	CoveragePoint lookup_point = { schema, keyword, passed };
+	gpointer index;
+	guint point_index;
+
+	if (!g_hash_table_lookup_extended (coverage->point_indices,
+	                                   &lookup_point, NULL, &index)) {
+		CoveragePoint *point = NULL;  /* owned */
+
+		point = g_new (CoveragePoint, 1);
+		*point = lookup_point;
+		index = GUINT_TO_POINTER (g_hash_table_size (coverage->point_indices));
+		g_hash_table_insert (coverage->point_indices, point, index);
+	}
+
+	point_index = GPOINTER_TO_UINT (index);
+	g_array_append_val (coverage->points, point_index);
+}
+
+/* Get the length of the string held by @instance_node in Unicode characters,
+ * using the cache if within an apply call.
+ *
+ * Complexity: O(N) in the length of the string on the first call; O(1) on
+ * subsequent calls within an apply call */
+static gsize
+get_string_length (JsonNode *instance_node)
+{
+	const gchar *str;
+	ApplyState *state;  /* unowned */
+	gpointer cached_length;
+	gsize n_bytes, n_chars;
+
+	str = json_node_get_string (instance_node);
+
+	/* Count short strings directly. */
+	n_bytes = 0;
+
+	while (n_bytes < STRING_LENGTH_CACHE_MIN_BYTES && str[n_bytes] != '\0') {
+		n_bytes++;
+	}
+
+	if (n_bytes < STRING_LENGTH_CACHE_MIN_BYTES) {
+		return wbl_json_string_get_length (str, n_bytes);
+	}
+
+	state = g_private_get (&apply_state_private);
+
+	if (state == NULL || state->depth == 0) {
+		return wbl_json_string_get_length (str, strlen (str));
+	}
+
+	if (state->string_lengths == NULL) {
+		state->string_lengths = g_hash_table_new (g_direct_hash,
+		                                          g_direct_equal);
+	} else if (g_hash_table_lookup_extended (state->string_lengths,
+	                                         instance_node, NULL,
+	                                         &cached_length)) {
+		return GPOINTER_TO_SIZE (cached_length);
+	}
+
+	n_chars = wbl_json_string_get_length (str, strlen (str));
+	g_hash_table_insert (state->string_lengths, instance_node,
+	                     GSIZE_TO_POINTER (n_chars));
+
+	return n_chars;
+}
+
+/* maxLength. draft-fge-json-schema-validation-00§5.2.1.
+ *
  * Complexity: O(1) */
 static gboolean
 validate_max_length (WblSchema *self,
@@ -1978,7 +3613,7 @@ apply_max_length (WblSchema *self,
 {
 	if (JSON_NODE_HOLDS_VALUE (instance_node) &&
 	    json_node_get_value_type (instance_node) == G_TYPE_STRING &&
-	    g_utf8_strlen (json_node_get_string (instance_node), -1) >
+	    (gint64) get_string_length (instance_node) >
 	    json_node_get_int (schema_node)) {
 		g_set_error (error,
 		             WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID,
@@ -1989,6 +3624,69 @@ apply_max_length (WblSchema *self,
 	}
 }
 
+/* Column-wise application of maxLength or minLength to @instances; see
+ * KeywordApplyBatchFunc. The string lengths are extracted into a column
+ * (with -1 for instances which are not strings), then compared against the
+ * limit in a tight loop. Only the instances which fail are passed to @apply,
+ * to build their error messages.
+ *
+ * Complexity: O(N) in the total length of the string @instances */
+static void
+apply_batch_length_limit (WblSchema         *self,
+                          JsonObject        *root,
+                          JsonNode          *schema_node,
+                          JsonNode * const  *instances,
+                          GError           **errors,
+                          guint              n_instances,
+                          gboolean           is_maximum,
+                          void             (*apply) (WblSchema  *self,
+                                                     JsonObject *root,
+                                                     JsonNode   *schema_node,
+                                                     JsonNode   *instance_node,
+                                                     GError    **error))
+{
+	gint64 *lengths = NULL;  /* owned */
+	gint64 limit;
+	guint i;
+
+	limit = json_node_get_int (schema_node);
+	lengths = g_new (gint64, n_instances);
+
+	/* Extract the lengths. */
+	for (i = 0; i < n_instances; i++) {
+		if (errors[i] == NULL &&
+		    JSON_NODE_HOLDS_VALUE (instances[i]) &&
+		    json_node_get_value_type (instances[i]) == G_TYPE_STRING) {
+			lengths[i] = get_string_length (instances[i]);
+		} else {
+			lengths[i] = -1;
+		}
+	}
+
+	/* Compare them. */
+	for (i = 0; i < n_instances; i++) {
+		if (lengths[i] >= 0 &&
+		    (is_maximum ? lengths[i] > limit : lengths[i] < limit)) {
+			apply (self, root, schema_node, instances[i], &errors[i]);
+		}
+	}
+
+	g_free (lengths);
+}
+
+/* Complexity: O(N) in the total length of the string @instances */
+static void
+apply_batch_max_length (WblSchema         *self,
+                        JsonObject        *root,
+                        JsonNode          *schema_node,
+                        JsonNode * const  *instances,
+                        GError           **errors,
+                        guint              n_instances)
+{
+	apply_batch_length_limit (self, root, schema_node, instances, errors,
+	                          n_instances, TRUE, apply_max_length);
+}
+
 /* Complexity: O(1) */
 static void
 generate_max_length (WblSchema *self,
@@ -2018,6 +3716,30 @@ generate_max_length (WblSchema *self,
 	}
 }
 
+/* Complexity: O(1) */
+static void
+estimate_max_length (WblSchema *self,
+                     JsonObject *root,
+                     JsonNode *schema_node,
+                     GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                     WblSchemaEstimate *estimate,
+                     gdouble *n_instances,
+                     gdouble *cost)
+{
+	gint64 max_length;
+
+	max_length = json_node_get_int (schema_node);
+
+	/* Two strings of @max_length characters, and two of
+	 * (@max_length + 1). */
+	*n_instances = (max_length < G_MAXINT64) ? 4.0 : 2.0;
+	*cost = *n_instances * ((gdouble) max_length + 1.0);
+
+	if (max_length > ESTIMATE_LARGE_STRINGS) {
+		estimate->flags |= WBL_SCHEMA_ESTIMATE_LARGE_STRINGS;
+	}
+}
+
 /* minLength. draft-fge-json-schema-validation-00§5.2.2.
  *
  * Complexity: O(1) */
@@ -2054,7 +3776,7 @@ apply_min_length (WblSchema *self,
 {
 	if (JSON_NODE_HOLDS_VALUE (instance_node) &&
 	    json_node_get_value_type (instance_node) == G_TYPE_STRING &&
-	    g_utf8_strlen (json_node_get_string (instance_node), -1) <
+	    (gint64) get_string_length (instance_node) <
 	    json_node_get_int (schema_node)) {
 		g_set_error (error,
 		             WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID,
@@ -2065,6 +3787,19 @@ apply_min_length (WblSchema *self,
 	}
 }
 
+/* Complexity: O(N) in the total length of the string @instances */
+static void
+apply_batch_min_length (WblSchema         *self,
+                        JsonObject        *root,
+                        JsonNode          *schema_node,
+                        JsonNode * const  *instances,
+                        GError           **errors,
+                        guint              n_instances)
+{
+	apply_batch_length_limit (self, root, schema_node, instances, errors,
+	                          n_instances, FALSE, apply_min_length);
+}
+
 /* Complexity: O(1) */
 static void
 generate_min_length (WblSchema *self,
@@ -2094,6 +3829,30 @@ generate_min_length (WblSchema *self,
 	}
 }
 
+/* Complexity: O(1) */
+static void
+estimate_min_length (WblSchema *self,
+                     JsonObject *root,
+                     JsonNode *schema_node,
+                     GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                     WblSchemaEstimate *estimate,
+                     gdouble *n_instances,
+                     gdouble *cost)
+{
+	gint64 min_length;
+
+	min_length = json_node_get_int (schema_node);
+
+	/* Two strings of @min_length characters, and two of
+	 * (@min_length - 1). The two empty strings are identical. */
+	*n_instances = (min_length > 0) ? 4.0 : 1.0;
+	*cost = *n_instances * ((gdouble) min_length + 1.0);
+
+	if (min_length > ESTIMATE_LARGE_STRINGS) {
+		estimate->flags |= WBL_SCHEMA_ESTIMATE_LARGE_STRINGS;
+	}
+}
+
 /* pattern. draft-fge-json-schema-validation-00§5.2.3.
  *
  * Complexity: O(1) */
@@ -2143,7 +3902,7 @@ apply_pattern (WblSchema *self,
 	/* Any errors in the regex should have been caught in
 	 * validate_pattern() */
 	regex_str = json_node_get_string (schema_node);
-	regex = g_regex_new (regex_str, 0, 0, &child_error);
+	regex = schema_get_regex (self, regex_str, &child_error);
 	g_assert_no_error (child_error);
 
 	if (!g_regex_match (regex, instance_str, 0, NULL)) {
@@ -2175,6 +3934,20 @@ generate_pattern (WblSchema *self,
 	generate_take_node (output, node_new_string ("non-empty"));
 }
 
+/* Complexity: O(1) */
+static void
+estimate_pattern (WblSchema *self,
+                  JsonObject *root,
+                  JsonNode *schema_node,
+                  GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                  WblSchemaEstimate *estimate,
+                  gdouble *n_instances,
+                  gdouble *cost)
+{
+	*n_instances = 2.0;
+	*cost = *n_instances;
+}
+
 /**
  * array_copy_n:
  * @items: a JSON array instance
@@ -2677,6 +4450,14 @@ validity_array_to_string (GArray/*<boolean>*/  *arr)
  *    keyword.
  *  # Add all the mutated and non-mutated array instances to @output.
  *
+ * Array and mutated instances which exceed the size limits from
+ * wbl_schema_set_generation_limits() are dropped as they are built, and
+ * building stops once the total size limit is reached.
+ *
+ * If @divide_between_shards is %TRUE, only the subschema arrays belonging to
+ * the shard being generated are built and mutated. They are assigned by index,
+ * so the shard’s arrays are the same on every host.
+ *
  * Complexity: O(generate_subschema_arrays +
  *               M * subschema_generate_instances +
  *               M * N * subschema_apply +
@@ -2695,6 +4476,7 @@ generate_all_items (WblSchema                       *self,
                     gint64                           min_items,
                     gint64                           max_items,
                     gboolean                         unique_items,
+                    gboolean                         divide_between_shards,
                     GHashTable/*<owned JsonNode>*/  *output)
 {
 	WblSchemaPrivate *priv;
@@ -2711,8 +4493,13 @@ generate_all_items (WblSchema                       *self,
 	             owned GHashTable<owned JsonNode>>*/ *valid_instances_map = NULL;
 	GHashTable/*<unowned JsonObject,
 	             owned GHashTable<owned JsonNode>>*/ *invalid_instances_map = NULL;
+	GenerateSizeBudget budget;
+	WblAllocationStats *stats;  /* unowned; NULL unless estimating */
 
 	priv = wbl_schema_get_instance_private (self);
+	stats = accounting_get_stats (self);
+	generate_size_budget_init (&budget, priv->max_instance_size,
+	                           priv->max_total_size);
 
 	/* Massage the input to remove some irregularities. */
 	if (validate_value_type (additional_items_node, G_TYPE_BOOLEAN)) {
@@ -2778,7 +4565,10 @@ generate_all_items (WblSchema                       *self,
          *               P * M +
          *               P * (M + N) * N) in the number P of
          *    subschema arrays, N of valid instances and M of subschemas */
-	for (i = 0; i < subschema_arrays->len; i++) {
+	for (i = 0;
+	     i < subschema_arrays->len &&
+	     !generate_size_budget_is_exhausted (&budget);
+	     i++) {
 		JsonArray *subschema_array;
 		GPtrArray/*<owned GArray<boolean>>*/ *validity_arrays = NULL;
 		GPtrArray/*<owned GHashTable<owned JsonNode>>*/ *valid_instances_array;
@@ -2786,6 +4576,12 @@ generate_all_items (WblSchema                       *self,
 		GHashTableIter *valid_iters = NULL, *invalid_iters = NULL;
 		guint max_n_valid_instances, max_n_invalid_instances;
 
+		/* Leave other shards’ arrays for them to generate. */
+		if (divide_between_shards &&
+		    i % priv->generate_n_shards != priv->generate_shard_index) {
+			continue;
+		}
+
 		subschema_array = subschema_arrays->pdata[i];
 		valid_instances_array = g_ptr_array_new_full (json_array_get_length (subschema_array),
 		                                              (GDestroyNotify) g_hash_table_unref);
@@ -2900,7 +4696,10 @@ generate_all_items (WblSchema                       *self,
 		}
 
                 /* Complexity: O((M + N) * N) */
-		for (j = 0; j < validity_arrays->len; j++) {
+		for (j = 0;
+		     j < validity_arrays->len &&
+		     !generate_size_budget_is_exhausted (&budget);
+		     j++) {
 			GArray/*<boolean>*/ *validity_array;
 			JsonNode *instance = NULL;
 			gchar *debug_output = NULL;
@@ -2955,7 +4754,6 @@ generate_all_items (WblSchema                       *self,
 			json_builder_end_array (builder);
 
 			instance = json_builder_get_root (builder);
-			g_hash_table_add (instance_set, instance);  /* transfer */
 
 			/* Debug output. */
 			if (priv->debug) {
@@ -2964,6 +4762,8 @@ generate_all_items (WblSchema                       *self,
 				g_free (debug_output);
 			}
 
+			generate_take_node_within_budget (instance_set, instance,
+			                                  &budget);  /* transfer */
 			json_builder_reset (builder);
 		}
 
@@ -2974,6 +4774,19 @@ generate_all_items (WblSchema                       *self,
 		g_ptr_array_unref (validity_arrays);
 	}
 
+	/* Account the child instance sets combined above to this keyword.
+	 * They are held at the same time as all the combinations. */
+	if (stats != NULL) {
+		guint64 n_held_bytes;
+
+		n_held_bytes = allocation_stats_add_set_map (stats,
+		                                             valid_instances_map) +
+		               allocation_stats_add_set_map (stats,
+		                                             invalid_instances_map) +
+		               allocation_stats_add_set (NULL, instance_set);
+		stats->n_peak_bytes = MAX (stats->n_peak_bytes, n_held_bytes);
+	}
+
 	g_hash_table_unref (invalid_instances_map);
 	g_hash_table_unref (valid_instances_map);
 
@@ -2989,7 +4802,8 @@ generate_all_items (WblSchema                       *self,
 	g_hash_table_iter_init (&iter, instance_set);
 
         /* Complexity: O((M + N) * N) */
-	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+	while (!generate_size_budget_is_exhausted (&budget) &&
+	       g_hash_table_iter_next (&iter, &key, NULL)) {
 		JsonNode *node = key;
 		JsonNode *mutated_instance = NULL;
 		JsonArray *array;
@@ -3002,7 +4816,9 @@ generate_all_items (WblSchema                       *self,
 
 			mutated_instance = instance_drop_n_elements (array,
 			                                             json_array_get_length (array) - min_items + 1);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		}
 
 		/* maxItems. */
@@ -3013,7 +4829,9 @@ generate_all_items (WblSchema                       *self,
 			                                            max_items - json_array_get_length (array) + 1,
 			                                            items_node,
 			                                            additional_items_node);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		}
 
 		/* items and additionalItems. Add an extra element to the array
@@ -3023,13 +4841,17 @@ generate_all_items (WblSchema                       *self,
 		    (JSON_NODE_HOLDS_OBJECT (items_node) ||
 		     json_array_get_length (array) == json_array_get_length (json_node_get_array (items_node)))) {
 			mutated_instance = instance_add_null_element (array);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		}
 
 		/* TODO: How to do uniqueItems? */
 		if (unique_items && json_array_get_length (array) > 0) {
 			mutated_instance = instance_clone_final_element (array);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		} else if (unique_items) {
 			JsonArray *new_array = NULL;
 
@@ -3039,7 +4861,9 @@ generate_all_items (WblSchema                       *self,
 			json_array_add_null_element (new_array);
 
 			json_node_take_array (mutated_instance, new_array);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		}
 	}
 
@@ -3058,6 +4882,17 @@ generate_all_items (WblSchema                       *self,
 		generate_take_node (output, json_node_copy (node));
 	}
 
+	/* The output is accounted by accounting_end(); the sets it was
+	 * copied from are accounted here. */
+	if (stats != NULL) {
+		guint64 n_held_bytes;
+
+		n_held_bytes = allocation_stats_add_set (stats, instance_set) +
+		               allocation_stats_add_set (stats, mutation_set) +
+		               allocation_stats_add_set (NULL, output);
+		stats->n_peak_bytes = MAX (stats->n_peak_bytes, n_held_bytes);
+	}
+
 	g_hash_table_unref (mutation_set);
 	g_hash_table_unref (instance_set);
 	g_ptr_array_unref (subschema_arrays);
@@ -3171,33 +5006,209 @@ generate_all_items_wrapper (WblSchema                       *self,
 		unique_items = FALSE;
 	}
 
+	/* Keyword groups are generated one level deeper than their schema. */
 	generate_all_items (self, items_node, additional_items_node, min_items,
-	                    max_items, unique_items, output);
+	                    max_items, unique_items,
+	                    generate_is_sharded_root (self, root, 1), output);
 
 	json_node_free (items_node);
 	json_node_free (additional_items_node);
 }
 
-/* Complexity: O(N * subschema_validate) in the length of the array;
- *    N=1 for objects */
-static gboolean
-validate_items (WblSchema *self,
-                JsonObject *root,
-                JsonNode *schema_node,
-                GPtrArray/*<owned WblValidateMessage>*/ *messages)
+/* Sum of (L + 1) for L in [@a, @b], as a double so it cannot overflow. */
+static gdouble
+sum_lengths (gdouble a,
+             gdouble b)
 {
-	if (JSON_NODE_HOLDS_OBJECT (schema_node)) {
-		GPtrArray/*<owned WblValidateMessage>*/ *sub_messages = NULL;
-		GError *child_error = NULL;
+	if (b < a) {
+		return 0.0;
+	}
 
-		/* Validate the schema. */
-		sub_messages = subschema_validate (self, schema_node, &child_error);
+	return (b - a + 1.0) * (a + b + 2.0) / 2.0;
+}
 
-		if (child_error == NULL) {
-			/* Valid. */
-			g_clear_pointer (&sub_messages,
-			                 g_ptr_array_unref);
-			return TRUE;
+/* Estimate the instances generated by generate_all_items_wrapper(), without
+ * building any subschema arrays. This follows generate_subschema_arrays(),
+ * generate_validity_arrays() and the mutation step of generate_all_items(),
+ * summing over the array lengths in closed form where the number of lengths
+ * is unbounded by the size of the schema. The valid and invalid instances of
+ * each item subschema are assumed to split its instances between them.
+ *
+ * Complexity: O(N * subschema_estimate) in the number N of item subschemas */
+static void
+estimate_all_items_wrapper (WblSchema *self,
+                            JsonObject *root,
+                            GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                            WblSchemaEstimate *estimate,
+                            gdouble *n_instances,
+                            gdouble *cost)
+{
+	JsonNode *items_node, *additional_items_node;
+	gint64 min_items, max_items;
+	gboolean unique_items, additional_items_allowed;
+	gdouble n_lengths, n_base, base_cost, n_mutations, apply_cost;
+
+	items_node = json_object_get_member (root, "items");
+	additional_items_node = json_object_get_member (root,
+	                                                "additionalItems");
+	min_items = json_object_has_member (root, "minItems") ?
+	            json_object_get_int_member (root, "minItems") : 0;
+	max_items = json_object_has_member (root, "maxItems") ?
+	            json_object_get_int_member (root, "maxItems") : G_MAXINT64;
+	unique_items = json_object_has_member (root, "uniqueItems") &&
+	               json_object_get_boolean_member (root, "uniqueItems");
+
+	/* draft-fge-json-schema-validation-00§5.3.1.4. */
+	additional_items_allowed = (additional_items_node == NULL ||
+	                            !validate_value_type (additional_items_node,
+	                                                  G_TYPE_BOOLEAN) ||
+	                            json_node_get_boolean (additional_items_node));
+
+	if (items_node != NULL && JSON_NODE_HOLDS_ARRAY (items_node)) {
+		JsonArray *items_array;
+		guint64 i, n_items, limit;
+		gdouble items_n, max_n, additional_n, a, b;
+
+		items_array = json_node_get_array (items_node);
+		n_items = json_array_get_length (items_array);
+		n_base = 0.0;
+		base_cost = 0.0;
+		max_n = 0.0;
+		apply_cost = 0.0;
+
+		/* Sub-arrays of @items. Each has a step validity array per
+		 * index, and enough uniform ones to use every child
+		 * instance. */
+		limit = MIN (n_items, (guint64) max_items);
+		n_lengths = (limit >= (guint64) min_items) ?
+		            limit - min_items + 1 : 0;
+
+		for (i = 0; i <= limit; i++) {
+			gdouble n;
+
+			if (i > 0) {
+				items_n = subschema_estimate (self, estimates,
+				                              estimate,
+				                              json_array_get_element (items_array, i - 1),
+				                              FALSE);
+				max_n = MAX (max_n, items_n);
+				apply_cost += items_n;
+			}
+
+			if (i < (guint64) min_items) {
+				continue;
+			}
+
+			/* The empty array has a single validity array. */
+			n = ((i > 0) ? i - 1.0 : 1.0) + max_n;
+			n_base += n;
+			base_cost += n * (i + 1);
+		}
+
+		/* Arrays with additional items, up to @max_items, or one
+		 * extra if unbounded. */
+		a = n_items + 1.0;
+		b = (max_items == G_MAXINT64) ? a : (gdouble) max_items;
+
+		if (additional_items_allowed && b >= a) {
+			if (additional_items_node != NULL &&
+			    JSON_NODE_HOLDS_OBJECT (additional_items_node)) {
+				additional_n = subschema_estimate (self,
+				                                   estimates,
+				                                   estimate,
+				                                   additional_items_node,
+				                                   FALSE);
+			} else {
+				additional_n = 1.0;
+			}
+
+			max_n = MAX (max_n, additional_n);
+			apply_cost += additional_n;
+
+			/* Sum of (L - 1 + max_n), and of its product with
+			 * (L + 1), for L in [a, b]. */
+			n_lengths += b - a + 1.0;
+			n_base += sum_lengths (a, b) +
+			          (max_n - 2.0) * (b - a + 1.0);
+			base_cost += (b * (b + 1.0) * (2.0 * b + 1.0) -
+			              (a - 1.0) * a * (2.0 * a - 1.0)) / 6.0 -
+			             (b - a + 1.0) +
+			             max_n * sum_lengths (a, b);
+		}
+	} else {
+		gdouble items_n, first, limit;
+
+		if (items_node != NULL) {
+			items_n = subschema_estimate (self, estimates, estimate,
+			                              items_node, FALSE);
+		} else {
+			items_n = 1.0;
+		}
+
+		apply_cost = items_n;
+
+		/* Repetitions of @items_node, as in
+		 * generate_subschema_arrays(). Arrays of each non-zero length
+		 * have enough uniform validity arrays to use every child
+		 * instance. */
+		if (max_items != G_MAXINT64) {
+			limit = max_items;
+		} else if (additional_items_allowed) {
+			limit = MAX (min_items, 1) + 1;
+		} else {
+			limit = min_items;
+		}
+
+		n_lengths = (limit >= min_items) ? limit - min_items + 1.0 : 0.0;
+		first = MAX (min_items, 1);
+		n_base = (limit >= first) ? (limit - first + 1.0) * items_n : 0.0;
+		base_cost = items_n * sum_lengths (first, limit);
+
+		if (min_items == 0) {
+			n_base += 1.0;
+			base_cost += 1.0;
+		}
+	}
+
+	/* Mutations of every instance. The maxItems mutation pads the instance
+	 * out to (@max_items + 1) elements. */
+	n_mutations = ((min_items > 0) ? 1.0 : 0.0) +
+	              (!additional_items_allowed ? 1.0 : 0.0) +
+	              (unique_items ? 1.0 : 0.0);
+	*cost = base_cost * (1.0 + n_mutations) + apply_cost;
+
+	if (max_items < G_MAXINT64) {
+		n_mutations += 1.0;
+		*cost += n_base * ((gdouble) max_items + 2.0);
+	}
+
+	*n_instances = n_base * (1.0 + n_mutations);
+
+	if (n_lengths > ESTIMATE_LARGE_ARRAYS) {
+		estimate->flags |= WBL_SCHEMA_ESTIMATE_LARGE_ARRAYS;
+	}
+}
+
+/* Complexity: O(N * subschema_validate) in the length of the array;
+ *    N=1 for objects */
+static gboolean
+validate_items (WblSchema *self,
+                JsonObject *root,
+                JsonNode *schema_node,
+                GPtrArray/*<owned WblValidateMessage>*/ *messages)
+{
+	if (JSON_NODE_HOLDS_OBJECT (schema_node)) {
+		GPtrArray/*<owned WblValidateMessage>*/ *sub_messages = NULL;
+		GError *child_error = NULL;
+
+		/* Validate the schema. */
+		sub_messages = subschema_validate (self, schema_node, &child_error);
+
+		if (child_error == NULL) {
+			/* Valid. */
+			g_clear_pointer (&sub_messages,
+			                 g_ptr_array_unref);
+			return TRUE;
 		}
 
 		_wbl_validate_message_output (messages,
@@ -4146,7 +6157,7 @@ apply_properties_parent_schema (WblSchema *self,
 
 		/* Construct the regex. Should never fail due to being validated
 		 * in validate_pattern_properties(). */
-		regex = g_regex_new (regex_str, 0, 0, &child_error);
+		regex = schema_get_regex (self, regex_str, &child_error);
 		g_assert_no_error (child_error);
 
 		for (k = set_s; k != NULL;) {
@@ -4256,7 +6267,7 @@ apply_properties_child_schema (WblSchema *self,
 
 			/* Construct the regex. Should never fail due to being
 			 * validated in validate_pattern_properties(). */
-			regex = g_regex_new (regex_str, 0, 0, &child_error);
+			regex = schema_get_regex (self, regex_str, &child_error);
 			g_assert_no_error (child_error);
 
 			if (g_regex_match (regex, member_name, 0, NULL)) {
@@ -4395,7 +6406,7 @@ pattern_properties_find_match (JsonObject   *pattern_properties,
 	       json_object_iter_next (&iter, &member_name, &child_node)) {
 		GRegex *regex = NULL;
 
-		regex = g_regex_new (member_name, 0, 0, NULL);
+		regex = regex_new (member_name, NULL);
 		g_assert (regex != NULL);
 
 		if (g_regex_match (regex, property, 0, NULL)) {
@@ -4410,6 +6421,7 @@ pattern_properties_find_match (JsonObject   *pattern_properties,
 
 /**
  * generate_n_additional_properties:
+ * @pool: string pool for the output set
  * @num_additional_properties: minimum number of additional properties to
  *    generate
  * @known_properties: set of existing property names which must not be in the
@@ -4436,9 +6448,10 @@ pattern_properties_find_match (JsonObject   *pattern_properties,
  * Since: 0.2.0
  */
 static WblStringSet *
-generate_n_additional_properties (gint64         num_additional_properties,
-                                  WblStringSet  *known_properties,
-                                  JsonObject    *pattern_properties)
+generate_n_additional_properties (WblStringPool  *pool,
+                                  gint64          num_additional_properties,
+                                  WblStringSet   *known_properties,
+                                  JsonObject     *pattern_properties)
 {
 	WblStringSet *output = NULL;
 	gint64 i;
@@ -4447,7 +6460,7 @@ generate_n_additional_properties (gint64         num_additional_properties,
 	         G_STRFUNC, num_additional_properties,
 	         json_object_get_size (pattern_properties));
 
-	output = wbl_string_set_new_empty ();
+	output = wbl_string_set_new_empty (pool);
 
 	/* FIXME: Reverse-engineer the regexes. */
 	for (i = 0; num_additional_properties > 0; i++) {
@@ -4459,7 +6472,8 @@ generate_n_additional_properties (gint64         num_additional_properties,
 		    pattern_properties_find_match (pattern_properties,
 		                                   new_property) == NULL) {
 			output = wbl_string_set_union (output,
-			                               wbl_string_set_new_singleton (new_property));
+			                               wbl_string_set_new_singleton (pool,
+			                                                             new_property));
 			num_additional_properties--;
 		}
 
@@ -4471,6 +6485,7 @@ generate_n_additional_properties (gint64         num_additional_properties,
 
 /**
  * pattern_properties_generate_instances:
+ * @pool: string pool for the output set
  * @pattern_properties: set of existing property name patterns to generate
  *    instances of
  * @properties: set of existing property names which must not be in the
@@ -4488,14 +6503,15 @@ generate_n_additional_properties (gint64         num_additional_properties,
  * Since: 0.2.0
  */
 static WblStringSet *
-pattern_properties_generate_instances (JsonObject    *pattern_properties,
-                                       WblStringSet  *properties)
+pattern_properties_generate_instances (WblStringPool  *pool,
+                                       JsonObject     *pattern_properties,
+                                       WblStringSet   *properties)
 {
 	WblStringSet *output = NULL;
 	JsonObjectIter iter;
 	const gchar *member_name;
 
-	output = wbl_string_set_new_empty ();
+	output = wbl_string_set_new_empty (pool);
 	json_object_iter_init (&iter, pattern_properties);
 
 	while (json_object_iter_next (&iter, &member_name, NULL)) {
@@ -4513,7 +6529,7 @@ pattern_properties_generate_instances (JsonObject    *pattern_properties,
 
 		/* FIXME: This is a horrendous hack and should instead be
 		 * handled by exploring the regex’s FSM. */
-		regex = g_regex_new (member_name, 0, 0, NULL);
+		regex = regex_new (member_name, NULL);
 		g_assert (regex != NULL);
 
 		for (i = 0; i < G_N_ELEMENTS (candidate_properties); i++) {
@@ -4533,7 +6549,8 @@ pattern_properties_generate_instances (JsonObject    *pattern_properties,
 		}
 
 		output = wbl_string_set_union (output,
-		                               wbl_string_set_new_singleton (candidate_properties[i]));
+		                               wbl_string_set_new_singleton (pool,
+		                                                             candidate_properties[i]));
 
 		g_regex_unref (regex);
 	}
@@ -4541,8 +6558,126 @@ pattern_properties_generate_instances (JsonObject    *pattern_properties,
 	return output;
 }
 
+/* Calculate the binomial coefficient C(@n, @k), or @limit if it is bigger. */
+static guint64
+binomial_capped (guint    n,
+                 guint    k,
+                 guint64  limit)
+{
+	guint64 result = 1;
+	guint i;
+
+	if (k > n) {
+		return 0;
+	}
+
+	k = MIN (k, n - k);
+
+	/* Each intermediate result is C(n - k + i, i), so the division is
+	 * exact. */
+	for (i = 1; i <= k; i++) {
+		result = result * (n - k + i) / i;
+
+		if (result >= limit) {
+			return limit;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * generate_pairwise_property_sets:
+ * @pool: string pool for the output sets
+ * @property_names: (element-type utf8): property names to cover
+ *
+ * Generate a family of subsets of @property_names such that, for every pair of
+ * distinct properties p and q, the family contains a subset with both of them,
+ * one with neither, one with only p and one with only q. This is a binary
+ * covering array of strength 2, with one subset per row.
+ *
+ * The array has the smallest number of rows N for which there are at least
+ * |@property_names| distinct N-bit columns with a zero in the first row and
+ * exactly ⌈N/2⌉ ones in the others; each property is assigned one of these
+ * columns. Any two such columns have a common zero in the first row; have a
+ * common one, as 2⌈N/2⌉ > N - 1; and neither is a subset of the other, as they
+ * are distinct and have the same number of ones. This is the smallest possible
+ * covering array (Kleitman and Spencer, 1973), and N is O(log P).
+ *
+ * Complexity: O(P log P) in the number P of @property_names
+ * Returns: (transfer full) (element-type WblStringSet): family of property sets
+ * Since: UNRELEASED
+ */
+static GPtrArray/*<owned WblStringSet>*/ *
+generate_pairwise_property_sets (WblStringPool                *pool,
+                                 GPtrArray/*<unowned utf8>*/  *property_names)
+{
+	GPtrArray/*<owned WblStringSet>*/ *output = NULL;
+	GPtrArray/*<unowned utf8>*/ **rows = NULL;
+	guint n_rows, n_ones, i, row;
+	guint64 column;
+
+	output = g_ptr_array_new_with_free_func ((GDestroyNotify) wbl_string_set_unref);
+
+	if (property_names->len == 0) {
+		g_ptr_array_add (output,
+		                 wbl_string_set_ref_sink (wbl_string_set_new_empty (pool)));
+		return output;
+	}
+
+	/* Find the number of rows. There are at most 64 of them, which is
+	 * enough for over 10^17 properties. */
+	for (n_rows = 2; n_rows < 64; n_rows++) {
+		if (binomial_capped (n_rows - 1, (n_rows + 1) / 2,
+		                     property_names->len) >= property_names->len) {
+			break;
+		}
+	}
+
+	n_ones = (n_rows + 1) / 2;
+
+	rows = g_new0 (GPtrArray *, n_rows);
+
+	for (row = 0; row < n_rows; row++) {
+		rows[row] = g_ptr_array_new ();
+	}
+
+	/* Assign the columns in increasing numerical order. Bit r of @column
+	 * is row r + 1; row 0 is always zero. */
+	column = (G_GUINT64_CONSTANT (1) << n_ones) - 1;
+
+	for (i = 0; i < property_names->len; i++) {
+		guint64 lowest, ripple;
+
+		for (row = 1; row < n_rows; row++) {
+			if (column & (G_GUINT64_CONSTANT (1) << (row - 1))) {
+				g_ptr_array_add (rows[row],
+				                 property_names->pdata[i]);
+			}
+		}
+
+		/* Next column with the same number of ones (Gosper’s hack). */
+		lowest = column & -column;
+		ripple = column + lowest;
+		column = (((ripple ^ column) >> 2) / lowest) | ripple;
+	}
+
+	for (row = 0; row < n_rows; row++) {
+		g_ptr_array_add (rows[row], NULL);
+		g_ptr_array_add (output,
+		                 wbl_string_set_ref_sink (wbl_string_set_new_from_strv (pool,
+		                                                                        (const gchar * const *) rows[row]->pdata)));
+		g_ptr_array_unref (rows[row]);
+	}
+
+	g_free (rows);
+
+	return output;
+}
+
 /**
  * generate_valid_property_sets:
+ * @pool: string pool for the property sets, which @required must come from
  * @required: set of required property names
  * @min_properties: minimum number of properties required (inclusive)
  * @max_properties: maximum number of properties allowed (inclusive)
@@ -4553,6 +6688,9 @@ pattern_properties_generate_instances (JsonObject    *pattern_properties,
  *    or @pattern_properties are allowed, %FALSE otherwise
  * @dependencies: object mapping property names to arrays of property names
  *    they depend on
+ * @pairwise: %TRUE to cover all pairs of properties using
+ *    generate_pairwise_property_sets(), rather than using singleton sets
+ * @debug: %TRUE to output debug messages
  *
  * Generate a family of valid property sets which satisfy all the schema
  * keywords taken as input. This family is not necessarily complete; it is
@@ -4563,25 +6701,28 @@ pattern_properties_generate_instances (JsonObject    *pattern_properties,
  *
  * See the inline comments for a formal specification.
  *
- * Complexity: O(D + P + A + max_properties * A +
- *               (D + P + A + max_properties) * D) in the number D
- *    of @dependencies, P of @properties and A of @pattern_properties
+ * Complexity: O(D^2 + P + A + max_properties * A) in the number D
+ *    of @dependencies, P of @properties and A of @pattern_properties, treating
+ *    operations on the words of a #WblStringSet as constant time
  * Returns: (transfer full): a family of property sets, which may be empty
  * Since: 0.2.0
  */
 static GHashTable/*<floating WblStringSet>*/ *
-generate_valid_property_sets (WblStringSet  *required,
-                              gint64         min_properties,
-                              gint64         max_properties,
-                              JsonObject    *properties,
-                              JsonObject    *pattern_properties,
-                              gboolean       additional_properties_allowed,
-                              JsonObject    *dependencies,
-                              gboolean       debug)
+generate_valid_property_sets (WblStringPool  *pool,
+                              WblStringSet   *required,
+                              gint64          min_properties,
+                              gint64          max_properties,
+                              JsonObject     *properties,
+                              JsonObject     *pattern_properties,
+                              gboolean        additional_properties_allowed,
+                              JsonObject     *dependencies,
+                              gboolean        pairwise,
+                              gboolean        debug)
 {
 	WblStringSet *initial = NULL;
 	WblStringSet *known_properties = NULL;
 	WblStringSet *additional_properties = NULL;
+	WblDependencyClosure *dependency_closure = NULL;
 	GHashTable/*<owned WblStringSet>*/ *set_family = NULL;
 	GHashTable/*<floating WblStringSet>*/ *property_sets = NULL;
 	WblStringSetIter iter;
@@ -4589,19 +6730,24 @@ generate_valid_property_sets (WblStringSet  *required,
 	GHashTableIter hash_iter;
 	gpointer key;
 
-	g_debug ("%s: O((%u + %u + %u + %" G_GINT64_FORMAT ") * %u)",
+	g_debug ("%s: O(%u^2 + %u + %u + %" G_GINT64_FORMAT " * %u)",
 	         G_STRFUNC, json_object_get_size (dependencies),
 	         json_object_get_size (properties),
 	         json_object_get_size (pattern_properties), max_properties,
-	         json_object_get_size (dependencies));
+	         json_object_get_size (pattern_properties));
 
 	/* Add all properties from @required and transitively satisfy
 	 * dependencies.
 	 *
 	 * Formally:
 	 *    @initial = dependency_closure(@required ∪ domain(@dependencies))
+	 *
+	 * The transitive closure of @dependencies is computed once here, as
+	 * it is needed again for every set in @set_family below.
 	 */
-	initial = wbl_string_set_union_dependencies (required, dependencies);
+	dependency_closure = wbl_dependency_closure_new (pool, dependencies);
+	initial = wbl_string_set_union_dependency_closure (required,
+	                                                   dependency_closure);
 	wbl_string_set_ref_sink (initial);
 
 	/* Debug. */
@@ -4623,12 +6769,15 @@ generate_valid_property_sets (WblStringSet  *required,
 	 *    generate: regex set ↦ property name set
 	 * is a function to generate matching instances of a regex.
 	 */
-	known_properties = wbl_string_set_new_from_object_members (properties);
+	known_properties = wbl_string_set_new_from_object_members (pool,
+	                                                           properties);
 	known_properties = wbl_string_set_union (known_properties,
-	                                         pattern_properties_generate_instances (pattern_properties,
+	                                         pattern_properties_generate_instances (pool,
+	                                                                                pattern_properties,
 	                                                                                known_properties));
 	known_properties = wbl_string_set_union (known_properties,
-	                                         wbl_string_set_new_from_object_members (dependencies));
+	                                         wbl_string_set_new_from_object_members (pool,
+	                                                                                 dependencies));
 
 	wbl_string_set_ref_sink (known_properties);
 
@@ -4652,11 +6801,12 @@ generate_valid_property_sets (WblStringSet  *required,
 			                                 max_properties - wbl_string_set_get_size (initial));
 		}
 
-		additional_properties = generate_n_additional_properties (num_additional_properties,
+		additional_properties = generate_n_additional_properties (pool,
+		                                                          num_additional_properties,
 		                                                          known_properties,
 		                                                          pattern_properties);
 	} else {
-		additional_properties = wbl_string_set_new_empty ();
+		additional_properties = wbl_string_set_new_empty (pool);
 	}
 
 	wbl_string_set_ref_sink (additional_properties);
@@ -4693,6 +6843,16 @@ generate_valid_property_sets (WblStringSet  *required,
 	 *    } ∪
 	 *    { {k} | k ∈ @known_properties } ∪
 	 *    { {a} | a ∈ @additional_properties }
+	 *
+	 * If @pairwise is set, the singleton sets are replaced with a covering
+	 * array, so that interactions between pairs of properties are tested.
+	 * Properties in @initial are always present, so are left out of it:
+	 *    @set_family = {
+	 *       ∅,
+	 *       @known_properties,
+	 *       @known_properties ∪ @additional_properties,
+	 *    } ∪
+	 *    pairwise((@known_properties ∪ @additional_properties) ∖ @initial)
 	 */
 	set_family = g_hash_table_new_full ((GHashFunc) wbl_string_set_hash,
 	                                    (GEqualFunc) wbl_string_set_equal,
@@ -4704,26 +6864,58 @@ generate_valid_property_sets (WblStringSet  *required,
 	                                       NULL);
 
 	g_hash_table_add (set_family,
-	                  wbl_string_set_ref_sink (wbl_string_set_new_empty ()));
+	                  wbl_string_set_ref_sink (wbl_string_set_new_empty (pool)));
 	g_hash_table_add (set_family, wbl_string_set_ref (known_properties));
 	g_hash_table_add (set_family,
 	                  wbl_string_set_ref_sink (wbl_string_set_union (known_properties,
 	                                                                 additional_properties)));
 
-	wbl_string_set_iter_init (&iter, known_properties);
-	while (wbl_string_set_iter_next (&iter, &element)) {
-		WblStringSet *singleton = NULL;
+	if (pairwise) {
+		GPtrArray/*<unowned utf8>*/ *free_properties = NULL;
+		GPtrArray/*<owned WblStringSet>*/ *rows = NULL;
+		guint i;
 
-		singleton = wbl_string_set_new_singleton (element);
-		g_hash_table_add (set_family, wbl_string_set_ref_sink (singleton));
-	}
+		free_properties = g_ptr_array_new ();
+
+		wbl_string_set_iter_init (&iter, known_properties);
+		while (wbl_string_set_iter_next (&iter, &element)) {
+			if (!wbl_string_set_contains (initial, element)) {
+				g_ptr_array_add (free_properties, (gpointer) element);
+			}
+		}
+
+		wbl_string_set_iter_init (&iter, additional_properties);
+		while (wbl_string_set_iter_next (&iter, &element)) {
+			if (!wbl_string_set_contains (initial, element)) {
+				g_ptr_array_add (free_properties, (gpointer) element);
+			}
+		}
+
+		rows = generate_pairwise_property_sets (pool, free_properties);
+
+		for (i = 0; i < rows->len; i++) {
+			g_hash_table_add (set_family,
+			                  wbl_string_set_ref (rows->pdata[i]));
+		}
+
+		g_ptr_array_unref (rows);
+		g_ptr_array_unref (free_properties);
+	} else {
+		wbl_string_set_iter_init (&iter, known_properties);
+		while (wbl_string_set_iter_next (&iter, &element)) {
+			WblStringSet *singleton = NULL;
+
+			singleton = wbl_string_set_new_singleton (pool, element);
+			g_hash_table_add (set_family, wbl_string_set_ref_sink (singleton));
+		}
 
-	wbl_string_set_iter_init (&iter, additional_properties);
-	while (wbl_string_set_iter_next (&iter, &element)) {
-		WblStringSet *singleton = NULL;
+		wbl_string_set_iter_init (&iter, additional_properties);
+		while (wbl_string_set_iter_next (&iter, &element)) {
+			WblStringSet *singleton = NULL;
 
-		singleton = wbl_string_set_new_singleton (element);
-		g_hash_table_add (set_family, wbl_string_set_ref_sink (singleton));
+			singleton = wbl_string_set_new_singleton (pool, element);
+			g_hash_table_add (set_family, wbl_string_set_ref_sink (singleton));
+		}
 	}
 
 	/* Add in the initial set and calculate the transitive dependency set
@@ -4735,15 +6927,15 @@ generate_valid_property_sets (WblStringSet  *required,
 	 */
 	g_hash_table_iter_init (&hash_iter, set_family);
 
-        /* Complexity: O((D + P + A + max_properties) * D) */
+        /* Complexity: O(D + P + A + max_properties) */
 	while (g_hash_table_iter_next (&hash_iter, &key, NULL)) {
 		WblStringSet *property_set = key;
 		WblStringSet *candidate = NULL;
 		guint candidate_size;
 
 		candidate = wbl_string_set_union (initial,
-		                                  wbl_string_set_union_dependencies (property_set,
-		                                                                     dependencies));
+		                                  wbl_string_set_union_dependency_closure (property_set,
+		                                                                           dependency_closure));
 		candidate_size = wbl_string_set_get_size (candidate);
 
 		/* Debug output. */
@@ -4768,6 +6960,7 @@ generate_valid_property_sets (WblStringSet  *required,
 	wbl_string_set_unref (additional_properties);
 	wbl_string_set_unref (known_properties);
 	wbl_string_set_unref (initial);
+	wbl_dependency_closure_unref (dependency_closure);
 
 	return property_sets;
 }
@@ -4824,7 +7017,7 @@ get_subschemas_for_property (JsonObject   *properties,
 	while (json_object_iter_next (&iter, &member_name, &child_node)) {
 		GRegex *regex = NULL;
 
-		regex = g_regex_new (member_name, 0, 0, NULL);
+		regex = regex_new (member_name, NULL);
 		g_assert (regex != NULL);
 
 		if (g_regex_match (regex, property, 0, NULL)) {
@@ -5112,11 +7305,23 @@ instance_add_non_matching_property (JsonObject  *instance,
 	return output;
 }
 
+/* Create a table keyed by property names from the schema’s #WblStringPool.
+ * Names are compared by pointer, but hashed by content so that the order in
+ * which validity objects are iterated (and hence the order of members in the
+ * generated instances) does not vary from run to run.
+ *
+ * Complexity: O(1) */
+static GHashTable/*<unowned pooled utf8, gpointer>*/ *
+new_property_name_table (void)
+{
+	return g_hash_table_new (g_str_hash, g_direct_equal);
+}
+
 /**
  * generate_boolean_object:
  * @property_names: set of property names to use for the object
  * @invalid_property_name: (nullable): name of the single property to mark as
- *    invalid
+ *    invalid, which must be a member of @property_names or %NULL
  *
  * Generate a JSON object containing exactly the given @property_names, mapping
  * them all to a boolean value representing whether the subinstance assigned to
@@ -5130,22 +7335,23 @@ instance_add_non_matching_property (JsonObject  *instance,
  * Returns: (transfer full): validity object for @property_names
  * Since: 0.3.0
  */
-static GHashTable/*<owned utf8, boolean>*/ *
+static GHashTable/*<unowned pooled utf8, boolean>*/ *
 generate_boolean_object (WblStringSet  *property_names,
                          const gchar   *invalid_property_name)
 {
 	WblStringSetIter iter;
 	const gchar *property_name;
-	GHashTable/*<owned utf8, boolean>*/ *output = NULL;
+	GHashTable/*<unowned pooled utf8, boolean>*/ *output = NULL;
 
-	output = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	output = new_property_name_table ();
 	wbl_string_set_iter_init (&iter, property_names);
 
 	while (wbl_string_set_iter_next (&iter, &property_name)) {
 		gboolean valid;
 
-		valid = (g_strcmp0 (property_name, invalid_property_name) != 0);
-		g_hash_table_insert (output, g_strdup (property_name),
+		/* Both come from the schema’s string pool. */
+		valid = (property_name != invalid_property_name);
+		g_hash_table_insert (output, (gpointer) property_name,
 		                     GUINT_TO_POINTER (valid));
 	}
 
@@ -5167,19 +7373,19 @@ generate_boolean_object (WblStringSet  *property_names,
  * Returns: (transfer full): validity object for @property_names
  * Since: 0.3.0
  */
-static GHashTable/*<owned utf8, boolean>*/ *
+static GHashTable/*<unowned pooled utf8, boolean>*/ *
 generate_boolean_object_uniform (WblStringSet  *property_names,
                                  gboolean       valid)
 {
 	WblStringSetIter iter;
 	const gchar *property_name;
-	GHashTable/*<owned utf8, boolean>*/ *output = NULL;
+	GHashTable/*<unowned pooled utf8, boolean>*/ *output = NULL;
 
-	output = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	output = new_property_name_table ();
 	wbl_string_set_iter_init (&iter, property_names);
 
 	while (wbl_string_set_iter_next (&iter, &property_name)) {
-		g_hash_table_insert (output, g_strdup (property_name),
+		g_hash_table_insert (output, (gpointer) property_name,
 		                     GUINT_TO_POINTER (valid));
 	}
 
@@ -5224,7 +7430,7 @@ generate_validity_objects (WblStringSet  *valid_property_set,
                            guint          max_n_valid_instances,
                            guint          max_n_invalid_instances)
 {
-	GPtrArray/*<owned GHashTable<owned utf8, boolean>>*/ *output = NULL;
+	GPtrArray/*<owned GHashTable<unowned pooled utf8, boolean>>*/ *output = NULL;
 	WblStringSetIter iter;
 	const gchar *property_name;
 	guint i;
@@ -5290,7 +7496,7 @@ generate_validity_objects (WblStringSet  *valid_property_set,
 }
 
 static gchar *
-validity_object_to_string (GHashTable/*<owned utf8, boolean>*/  *obj)
+validity_object_to_string (GHashTable/*<unowned pooled utf8, boolean>*/  *obj)
 {
 	GHashTableIter iter;
 	GString *out = NULL;
@@ -5349,6 +7555,15 @@ validity_object_to_string (GHashTable/*<owned utf8, boolean>*/  *obj)
  *    keyword.
  *  # Add all the mutated and non-mutated object instances to @output.
  *
+ * Object and mutated instances which exceed the size limits from
+ * wbl_schema_set_generation_limits() are dropped as they are built, and
+ * building stops once the total size limit is reached.
+ *
+ * If @divide_between_shards is %TRUE, only the property sets belonging to the
+ * shard being generated are built and mutated, and only their properties have
+ * instances generated. They are assigned by hashing their property names, as
+ * the order of @valid_property_sets differs between hosts.
+ *
  * Complexity: O(generate_valid_property_sets +
  *               P * (get_subschemas_for_property +
  *                    subschema_generate_instances_split) +
@@ -5370,6 +7585,7 @@ generate_all_properties (WblSchema                       *self,
                          JsonObject                      *pattern_properties,
                          JsonNode                        *additional_properties,
                          JsonObject                      *dependencies,
+                         gboolean                         divide_between_shards,
                          GHashTable/*<owned JsonNode>*/  *output)
 {
 	WblSchemaPrivate *priv;
@@ -5384,12 +7600,17 @@ generate_all_properties (WblSchema                       *self,
 	JsonNode *node;
 	guint i;
 	WblStringSet *required = NULL;
-	GHashTable/*<owned utf8, GHashTable<owned JsonNode>>*/ *valid_instance_map = NULL;
-	GHashTable/*<owned utf8, GHashTable<owned JsonNode>>*/ *invalid_instance_map = NULL;
+	GHashTable/*<unowned pooled utf8, GHashTable<owned JsonNode>>*/ *valid_instance_map = NULL;
+	GHashTable/*<unowned pooled utf8, GHashTable<owned JsonNode>>*/ *invalid_instance_map = NULL;
 	guint max_n_valid_instances, max_n_invalid_instances;
+	GenerateSizeBudget budget;
+	WblAllocationStats *stats;  /* unowned; NULL unless estimating */
 
 	priv = wbl_schema_get_instance_private (self);
+	stats = accounting_get_stats (self);
 	builder = json_builder_new ();
+	generate_size_budget_init (&budget, priv->max_instance_size,
+	                           priv->max_total_size);
 
 	g_debug ("%s: O(generate_valid_property_sets + "
 	         "P * (A + A * subschema_generate_instances) + "
@@ -5401,7 +7622,8 @@ generate_all_properties (WblSchema                       *self,
 	         json_object_get_size (dependencies), min_properties);
 
 	/* Copy @required so we can handle it as a set. */
-	required = wbl_string_set_new_from_array_elements (_required);
+	required = wbl_string_set_new_from_array_elements (priv->string_pool,
+	                                                   _required);
 	wbl_string_set_ref_sink (required);
 
 	/* Work out the type of @additional_properties. */
@@ -5409,22 +7631,28 @@ generate_all_properties (WblSchema                       *self,
 	                                 json_node_get_boolean (additional_properties));
 
 	/* Generate a set of all valid property sets, given the constraints. */
-	valid_property_sets = generate_valid_property_sets (required,
+	valid_property_sets = generate_valid_property_sets (priv->string_pool,
+	                                                    required,
 	                                                    min_properties,
 	                                                    max_properties,
 	                                                    properties,
 	                                                    pattern_properties,
 	                                                    additional_properties_allowed,
 	                                                    dependencies,
+	                                                    (priv->generate_flags &
+	                                                     WBL_GENERATE_INSTANCE_PAIRWISE_PROPERTIES) != 0,
 	                                                    priv->debug);
 
 	/* Map of property name to a set of possible valid subinstances for
-	 * it. The @instance_map is not unique to any @valid_property_set. */
-	valid_instance_map = g_hash_table_new_full (g_str_hash, g_str_equal,
-	                                            g_free,
+	 * it. The @instance_map is not unique to any @valid_property_set.
+	 * Property names from #WblStringSets all come from the schema’s string
+	 * pool, so these maps (which are never iterated) are keyed by
+	 * pointer. */
+	valid_instance_map = g_hash_table_new_full (g_direct_hash,
+	                                            g_direct_equal, NULL,
 	                                            (GDestroyNotify) g_hash_table_unref);
-	invalid_instance_map = g_hash_table_new_full (g_str_hash, g_str_equal,
-	                                              g_free,
+	invalid_instance_map = g_hash_table_new_full (g_direct_hash,
+	                                              g_direct_equal, NULL,
 	                                              (GDestroyNotify) g_hash_table_unref);
 
 	max_n_valid_instances = 0;
@@ -5443,13 +7671,21 @@ generate_all_properties (WblSchema                       *self,
 	 *               V * generate_validity_objects +
 	 *               V * P +
 	 *               V * X * P) */
-	while (g_hash_table_iter_next (&property_sets_iter, &key, NULL)) {
+	while (!generate_size_budget_is_exhausted (&budget) &&
+	       g_hash_table_iter_next (&property_sets_iter, &key, NULL)) {
 		WblStringSet *valid_property_set = key;
 		WblStringSetIter string_iter;
 		const gchar *property_name;
 		GPtrArray/*<owned GHashTable<boolean>>*/ *validity_objects = NULL;  /* owned */
-		GHashTable/*<owned utf8, owned GHashTableIter>*/ *valid_iters = NULL;
-		GHashTable/*<owned utf8, owned GHashTableIter>*/ *invalid_iters = NULL;
+		GHashTable/*<unowned pooled utf8, owned GHashTableIter>*/ *valid_iters = NULL;
+		GHashTable/*<unowned pooled utf8, owned GHashTableIter>*/ *invalid_iters = NULL;
+
+		/* Leave other shards’ property sets for them to generate. */
+		if (divide_between_shards &&
+		    shard_hash_string_set (valid_property_set) %
+		    priv->generate_n_shards != priv->generate_shard_index) {
+			continue;
+		}
 
 		wbl_string_set_iter_init (&string_iter, valid_property_set);
 
@@ -5492,10 +7728,10 @@ generate_all_properties (WblSchema                       *self,
 
 			/* Add to the instance map. Transfer ownership. */
 			g_hash_table_insert (valid_instance_map,
-			                     g_strdup (property_name),
+			                     (gpointer) property_name,
 			                     valid_instances);
 			g_hash_table_insert (invalid_instance_map,
-			                     g_strdup (property_name),
+			                     (gpointer) property_name,
 			                     invalid_instances);
 
 			max_n_valid_instances = MAX (max_n_valid_instances,
@@ -5547,10 +7783,11 @@ generate_all_properties (WblSchema                       *self,
 		 * iterating for each validity object in @validity_objects as a
 		 * template.
 		 */
-		valid_iters = g_hash_table_new_full (g_str_hash, g_str_equal,
-		                                     g_free, g_free);
-		invalid_iters = g_hash_table_new_full (g_str_hash, g_str_equal,
-		                                       g_free, g_free);
+		valid_iters = g_hash_table_new_full (g_direct_hash,
+		                                     g_direct_equal, NULL, g_free);
+		invalid_iters = g_hash_table_new_full (g_direct_hash,
+		                                       g_direct_equal, NULL,
+		                                       g_free);
 
 		for (i = 0, wbl_string_set_iter_init (&string_iter,
 		                                      valid_property_set);
@@ -5566,7 +7803,7 @@ generate_all_properties (WblSchema                       *self,
 			valid_iter = g_new0 (GHashTableIter, 1);
 			g_hash_table_iter_init (valid_iter, valid_instances);
 			g_hash_table_insert (valid_iters,
-			                     g_strdup (property_name),
+			                     (gpointer) property_name,
 			                     valid_iter);  /* transfer */
 
 			invalid_instances = g_hash_table_lookup (invalid_instance_map,
@@ -5576,12 +7813,15 @@ generate_all_properties (WblSchema                       *self,
 			g_hash_table_iter_init (invalid_iter,
 			                        invalid_instances);
 			g_hash_table_insert (invalid_iters,
-			                     g_strdup (property_name),
+			                     (gpointer) property_name,
 			                     invalid_iter);  /* transfer */
 		}
 
 		/* Complexity: O(X * P) */
-		for (i = 0; i < validity_objects->len; i++) {
+		for (i = 0;
+		     i < validity_objects->len &&
+		     !generate_size_budget_is_exhausted (&budget);
+		     i++) {
 			GHashTable/*<boolean>*/ *validity_object;
 			JsonNode *instance = NULL;
 			gchar *debug_output = NULL;
@@ -5646,7 +7886,6 @@ generate_all_properties (WblSchema                       *self,
 			json_builder_end_object (builder);
 
 			instance = json_builder_get_root (builder);
-			g_hash_table_add (instance_set, instance);  /* transfer */
 
 			/* Debug output. */
 			if (priv->debug) {
@@ -5655,6 +7894,8 @@ generate_all_properties (WblSchema                       *self,
 				g_free (debug_output);
 			}
 
+			generate_take_node_within_budget (instance_set, instance,
+			                                  &budget);  /* transfer */
 			json_builder_reset (builder);
 		}
 
@@ -5663,6 +7904,19 @@ generate_all_properties (WblSchema                       *self,
 		g_ptr_array_unref (validity_objects);
 	}
 
+	/* Account the child instance sets combined above to this keyword.
+	 * They are held at the same time as all the combinations. */
+	if (stats != NULL) {
+		guint64 n_held_bytes;
+
+		n_held_bytes = allocation_stats_add_set_map (stats,
+		                                             valid_instance_map) +
+		               allocation_stats_add_set_map (stats,
+		                                             invalid_instance_map) +
+		               allocation_stats_add_set (NULL, instance_set);
+		stats->n_peak_bytes = MAX (stats->n_peak_bytes, n_held_bytes);
+	}
+
 	g_hash_table_unref (valid_instance_map);
 	g_hash_table_unref (invalid_instance_map);
 
@@ -5677,7 +7931,8 @@ generate_all_properties (WblSchema                       *self,
 	 * patternProperties and properties. */
 	g_hash_table_iter_init (&instance_set_iter, instance_set);
 
-	while (g_hash_table_iter_next (&instance_set_iter, &key, NULL)) {
+	while (!generate_size_budget_is_exhausted (&budget) &&
+	       g_hash_table_iter_next (&instance_set_iter, &key, NULL)) {
 		JsonNode *mutated_instance = NULL;
 		JsonObject *obj;
 		JsonObjectIter dependencies_iter;
@@ -5694,7 +7949,9 @@ generate_all_properties (WblSchema                       *self,
 			mutated_instance = instance_drop_n_properties (obj,
 			                                               json_object_get_size (obj) - min_properties + 1,
 			                                               required);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		}
 
 		/* maxProperties. */
@@ -5706,7 +7963,9 @@ generate_all_properties (WblSchema                       *self,
 			                                              properties,
 			                                              pattern_properties,
 			                                              additional_properties);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		}
 
 		/* properties, patternProperties and additionalProperties. */
@@ -5718,7 +7977,9 @@ generate_all_properties (WblSchema                       *self,
 			                                                       properties,
 			                                                       pattern_properties,
 			                                                       additional_properties);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		}
 
 		/* required. */
@@ -5729,7 +7990,9 @@ generate_all_properties (WblSchema                       *self,
 
 			mutated_instance = instance_drop_property (obj,
 			                                           required_property);
-			g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+			generate_take_node_within_budget (mutation_set,
+			                                  mutated_instance,
+			                                  &budget);  /* transfer */
 		}
 
 		/* dependencies. */
@@ -5756,7 +8019,9 @@ generate_all_properties (WblSchema                       *self,
 
 				mutated_instance = instance_drop_property (obj,
 				                                           required_property);
-				g_hash_table_add (mutation_set, mutated_instance);  /* transfer */
+				generate_take_node_within_budget (mutation_set,
+				                                  mutated_instance,
+				                                  &budget);  /* transfer */
 			}
 		}
 	}
@@ -5776,6 +8041,17 @@ generate_all_properties (WblSchema                       *self,
 		generate_take_node (output, json_node_copy (node));
 	}
 
+	/* The output is accounted by accounting_end(); the sets it was
+	 * copied from are accounted here. */
+	if (stats != NULL) {
+		guint64 n_held_bytes;
+
+		n_held_bytes = allocation_stats_add_set (stats, instance_set) +
+		               allocation_stats_add_set (stats, mutation_set) +
+		               allocation_stats_add_set (NULL, output);
+		stats->n_peak_bytes = MAX (stats->n_peak_bytes, n_held_bytes);
+	}
+
 	g_hash_table_unref (mutation_set);
 	g_hash_table_unref (instance_set);
 	g_hash_table_unref (valid_property_sets);
@@ -5852,9 +8128,12 @@ generate_all_properties_wrapper (WblSchema                       *self,
 		dependencies = json_object_new ();
 	}
 
+	/* Keyword groups are generated one level deeper than their schema. */
 	generate_all_properties (self, required, min_properties, max_properties,
 	                         properties, pattern_properties,
-	                         additional_properties, dependencies, output);
+	                         additional_properties, dependencies,
+	                         generate_is_sharded_root (self, root, 1),
+	                         output);
 
 	json_object_unref (dependencies);
 	json_node_free (additional_properties);
@@ -5863,6 +8142,189 @@ generate_all_properties_wrapper (WblSchema                       *self,
 	json_array_unref (required);
 }
 
+/* Estimate the instances generated by generate_all_properties() for a property
+ * set of @size members, where each member has at most @max_n child instances.
+ * Sets which do not satisfy @min_properties and @max_properties are dropped by
+ * generate_valid_property_sets(). */
+static void
+estimate_property_set (gdouble   size,
+                       gdouble   max_n,
+                       gint64    min_properties,
+                       gint64    max_properties,
+                       gdouble   multiplicity,
+                       gdouble  *n_base,
+                       gdouble  *base_cost)
+{
+	gdouble n;
+
+	if (size < min_properties || size > max_properties) {
+		return;
+	}
+
+	/* See generate_validity_objects(). */
+	n = size + max_n + ((size == 0.0) ? 1.0 : 0.0);
+	*n_base += multiplicity * n;
+	*base_cost += multiplicity * n * (size + 1.0);
+}
+
+/* Estimate the instances generated by generate_all_properties_wrapper(),
+ * following the heuristic in generate_valid_property_sets() and the mutation
+ * step of generate_all_properties(). Overlaps between property names from
+ * different keywords, and the transitive closure of `dependencies`, are
+ * ignored, so this is an overestimate.
+ *
+ * Complexity: O(P * subschema_estimate + D) in the number P of property
+ *    subschemas and D of @dependencies */
+static void
+estimate_all_properties_wrapper (WblSchema *self,
+                                 JsonObject *root,
+                                 GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                                 WblSchemaEstimate *estimate,
+                                 gdouble *n_instances,
+                                 gdouble *cost)
+{
+	JsonNode *required_node, *properties_node, *pattern_properties_node;
+	JsonNode *additional_properties_node, *dependencies_node;
+	gint64 min_properties, max_properties;
+	gdouble n_required, n_known, n_additional, n_optional;
+	gdouble max_n, apply_cost, n_base, base_cost, n_mutations;
+	gboolean additional_properties_allowed, has_properties;
+	JsonObjectIter iter;
+	JsonNode *member_node;
+
+	required_node = json_object_get_member (root, "required");
+	properties_node = json_object_get_member (root, "properties");
+	pattern_properties_node = json_object_get_member (root,
+	                                                  "patternProperties");
+	additional_properties_node = json_object_get_member (root,
+	                                                     "additionalProperties");
+	dependencies_node = json_object_get_member (root, "dependencies");
+	min_properties = json_object_has_member (root, "minProperties") ?
+	                 json_object_get_int_member (root, "minProperties") : 0;
+	max_properties = json_object_has_member (root, "maxProperties") ?
+	                 json_object_get_int_member (root, "maxProperties") :
+	                 G_MAXINT64;
+
+	n_required = (required_node != NULL) ?
+	             json_array_get_length (json_node_get_array (required_node)) : 0;
+	n_known = 0.0;
+	max_n = 0.0;
+	apply_cost = 0.0;
+	n_mutations = 0.0;
+
+	/* Child instances for each property, pattern property and additional
+	 * property. */
+	if (properties_node != NULL) {
+		json_object_iter_init (&iter, json_node_get_object (properties_node));
+
+		while (json_object_iter_next (&iter, NULL, &member_node)) {
+			gdouble n;
+
+			n = subschema_estimate (self, estimates, estimate,
+			                        member_node, FALSE);
+			max_n = MAX (max_n, n);
+			apply_cost += n;
+			n_known++;
+		}
+	}
+
+	if (pattern_properties_node != NULL) {
+		json_object_iter_init (&iter,
+		                       json_node_get_object (pattern_properties_node));
+
+		while (json_object_iter_next (&iter, NULL, &member_node)) {
+			gdouble n;
+
+			n = subschema_estimate (self, estimates, estimate,
+			                        member_node, FALSE);
+			max_n = MAX (max_n, n);
+			apply_cost += n;
+			n_known++;
+		}
+	}
+
+	has_properties = (n_known > 0.0);
+
+	/* draft-fge-json-schema-validation-00§5.4.4.4. */
+	if (additional_properties_node == NULL) {
+		additional_properties_allowed = TRUE;
+		max_n = MAX (max_n, 1.0);
+	} else if (JSON_NODE_HOLDS_OBJECT (additional_properties_node)) {
+		gdouble n;
+
+		additional_properties_allowed = TRUE;
+		n = subschema_estimate (self, estimates, estimate,
+		                        additional_properties_node, FALSE);
+		max_n = MAX (max_n, n);
+		apply_cost += n;
+	} else {
+		additional_properties_allowed = json_node_get_boolean (additional_properties_node);
+	}
+
+	/* Property dependencies are known properties, and each one is dropped
+	 * as a mutation. */
+	if (dependencies_node != NULL) {
+		json_object_iter_init (&iter, json_node_get_object (dependencies_node));
+
+		while (json_object_iter_next (&iter, NULL, &member_node)) {
+			n_known++;
+
+			if (JSON_NODE_HOLDS_ARRAY (member_node)) {
+				n_mutations += json_array_get_length (json_node_get_array (member_node));
+			}
+		}
+	}
+
+	/* See generate_valid_property_sets(). */
+	if (additional_properties_allowed) {
+		n_additional = MAX (1.0, min_properties - n_required);
+
+		if (max_properties < G_MAXINT64) {
+			n_additional = MAX (n_additional,
+			                    max_properties - n_required);
+		}
+	} else {
+		n_additional = 0.0;
+	}
+
+	n_optional = n_known + n_additional - n_required;
+
+	if (n_optional > ESTIMATE_MANY_PROPERTIES) {
+		estimate->flags |= WBL_SCHEMA_ESTIMATE_MANY_PROPERTIES;
+	}
+
+	/* The empty set, the known properties, the known and additional
+	 * properties, and singletons of each; all with the required properties
+	 * added. */
+	n_base = 0.0;
+	base_cost = 0.0;
+
+	estimate_property_set (n_required, max_n, min_properties,
+	                       max_properties, 1.0, &n_base, &base_cost);
+	estimate_property_set (n_required + n_known, max_n, min_properties,
+	                       max_properties, 1.0, &n_base, &base_cost);
+	estimate_property_set (n_required + n_known + n_additional, max_n,
+	                       min_properties, max_properties, 1.0,
+	                       &n_base, &base_cost);
+	estimate_property_set (n_required + 1.0, max_n, min_properties,
+	                       max_properties, n_known + n_additional,
+	                       &n_base, &base_cost);
+
+	/* Mutations of every instance. The maxProperties mutation pads the
+	 * instance out to (@max_properties + 1) members. */
+	n_mutations += n_required +
+	               ((min_properties > 0) ? 1.0 : 0.0) +
+	               ((has_properties || !additional_properties_allowed) ? 1.0 : 0.0);
+	*cost = base_cost * (1.0 + n_mutations) + apply_cost;
+
+	if (max_properties < G_MAXINT64) {
+		n_mutations += 1.0;
+		*cost += n_base * ((gdouble) max_properties + 2.0);
+	}
+
+	*n_instances = n_base * (1.0 + n_mutations);
+}
+
 /* dependencies. draft-fge-json-schema-validation-00§5.4.5.
  *
  * Complexity: O(N * subschema_validate + N * D) in the number N of
@@ -6176,6 +8638,20 @@ generate_enum (WblSchema *self,
 	 * members? How would we generate one of those? */
 }
 
+/* Complexity: O(1) */
+static void
+estimate_enum (WblSchema *self,
+               JsonObject *root,
+               JsonNode *schema_node,
+               GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+               WblSchemaEstimate *estimate,
+               gdouble *n_instances,
+               gdouble *cost)
+{
+	*n_instances = json_array_get_length (json_node_get_array (schema_node));
+	*cost = *n_instances;
+}
+
 /* type. draft-fge-json-schema-validation-00§5.5.2.
  *
  * Complexity: O(N) in the number of array elements; N=1 for non-array nodes */
@@ -6330,6 +8806,61 @@ done:
 	g_array_unref (schema_types);
 }
 
+/* Column-wise application of type to @instances; see KeywordApplyBatchFunc.
+ * The schema types are parsed once into a mask of the instance types they
+ * accept, which is then checked against a column of the instance types. Only
+ * the instances which fail are passed to apply_type(), to build their error
+ * messages.
+ *
+ * Complexity: O(N) in the number of @instances */
+static void
+apply_batch_type (WblSchema         *self,
+                  JsonObject        *root,
+                  JsonNode          *schema_node,
+                  JsonNode * const  *instances,
+                  GError           **errors,
+                  guint              n_instances)
+{
+	GArray/*<WblPrimitiveType>*/ *schema_types = NULL;  /* owned */
+	guint8 *types = NULL;  /* owned */
+	guint accepted = 0;
+	guint i, j;
+
+	/* Work out which instance types are accepted. */
+	schema_types = type_node_to_array (schema_node);
+
+	for (i = WBL_PRIMITIVE_TYPE_ARRAY; i <= WBL_PRIMITIVE_TYPE_STRING; i++) {
+		for (j = 0; j < schema_types->len; j++) {
+			if (wbl_primitive_type_is_a (i,
+			                             g_array_index (schema_types,
+			                                            WblPrimitiveType,
+			                                            j))) {
+				accepted |= (1 << i);
+				break;
+			}
+		}
+	}
+
+	g_array_unref (schema_types);
+
+	/* Extract the instance types. */
+	types = g_new (guint8, n_instances);
+
+	for (i = 0; i < n_instances; i++) {
+		types[i] = wbl_primitive_type_from_json_node (instances[i]);
+	}
+
+	/* Check them. */
+	for (i = 0; i < n_instances; i++) {
+		if (errors[i] == NULL && !(accepted & (1 << types[i]))) {
+			apply_type (self, root, schema_node, instances[i],
+			            &errors[i]);
+		}
+	}
+
+	g_free (types);
+}
+
 /* Complexity: O(N) in the number of types in the @schema_node */
 static void
 generate_type (WblSchema *self,
@@ -6395,6 +8926,29 @@ generate_type (WblSchema *self,
 	g_array_unref (schema_types);
 }
 
+/* Complexity: O(1) */
+static void
+estimate_type (WblSchema *self,
+               JsonObject *root,
+               JsonNode *schema_node,
+               GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+               WblSchemaEstimate *estimate,
+               gdouble *n_instances,
+               gdouble *cost)
+{
+	guint n_types;
+
+	if (JSON_NODE_HOLDS_ARRAY (schema_node)) {
+		n_types = json_array_get_length (json_node_get_array (schema_node));
+	} else {
+		n_types = 1;
+	}
+
+	/* A valid and an invalid instance for each type. */
+	*n_instances = 2.0 * n_types;
+	*cost = *n_instances;
+}
+
 /* allOf. draft-fge-json-schema-validation-00§5.5.3.
  *
  * Complexity: O(validate_schema_array) */
@@ -6444,6 +8998,20 @@ generate_all_of (WblSchema *self,
 	generate_schema_array (self, schema_array, output);
 }
 
+/* Complexity: O(estimate_schema_array) */
+static void
+estimate_all_of (WblSchema *self,
+                 JsonObject *root,
+                 JsonNode *schema_node,
+                 GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                 WblSchemaEstimate *estimate,
+                 gdouble *n_instances,
+                 gdouble *cost)
+{
+	estimate_schema_array (self, json_node_get_array (schema_node),
+	                       estimates, estimate, n_instances, cost);
+}
+
 /* anyOf. draft-fge-json-schema-validation-00§5.5.4.
  *
  * Complexity: O(validate_schema_array) */
@@ -6493,6 +9061,20 @@ generate_any_of (WblSchema *self,
 	generate_schema_array (self, schema_array, output);
 }
 
+/* Complexity: O(estimate_schema_array) */
+static void
+estimate_any_of (WblSchema *self,
+                 JsonObject *root,
+                 JsonNode *schema_node,
+                 GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                 WblSchemaEstimate *estimate,
+                 gdouble *n_instances,
+                 gdouble *cost)
+{
+	estimate_schema_array (self, json_node_get_array (schema_node),
+	                       estimates, estimate, n_instances, cost);
+}
+
 /* oneOf. draft-fge-json-schema-validation-00§5.5.5.
  *
  * Complexity: O(validate_schema_array) */
@@ -6542,6 +9124,20 @@ generate_one_of (WblSchema *self,
 	generate_schema_array (self, schema_array, output);
 }
 
+/* Complexity: O(estimate_schema_array) */
+static void
+estimate_one_of (WblSchema *self,
+                 JsonObject *root,
+                 JsonNode *schema_node,
+                 GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                 WblSchemaEstimate *estimate,
+                 gdouble *n_instances,
+                 gdouble *cost)
+{
+	estimate_schema_array (self, json_node_get_array (schema_node),
+	                       estimates, estimate, n_instances, cost);
+}
+
 /* not. draft-fge-json-schema-validation-00§5.5.6.
  *
  * Complexity: O(subschema_validate) */
@@ -6640,11 +9236,26 @@ generate_not (WblSchema *self,
 	g_hash_table_unref (child_output);
 }
 
-/* title. draft-fge-json-schema-validation-00§6.1.
- *
- * Complexity: O(validate_value_type) */
-static gboolean
-validate_title (WblSchema *self,
+/* Complexity: O(subschema_estimate) */
+static void
+estimate_not (WblSchema *self,
+              JsonObject *root,
+              JsonNode *schema_node,
+              GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+              WblSchemaEstimate *estimate,
+              gdouble *n_instances,
+              gdouble *cost)
+{
+	*n_instances = subschema_estimate (self, estimates, estimate,
+	                                   schema_node, TRUE);
+	*cost = *n_instances;
+}
+
+/* title. draft-fge-json-schema-validation-00§6.1.
+ *
+ * Complexity: O(validate_value_type) */
+static gboolean
+validate_title (WblSchema *self,
                 JsonObject *root,
                 JsonNode *schema_node,
                 GPtrArray/*<owned WblValidateMessage>*/ *messages)
@@ -6703,6 +9314,136 @@ generate_default (WblSchema *self,
 	generate_take_node (output, json_node_copy (schema_node));
 }
 
+/* Complexity: O(1) */
+static void
+estimate_default (WblSchema *self,
+                  JsonObject *root,
+                  JsonNode *schema_node,
+                  GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                  WblSchemaEstimate *estimate,
+                  gdouble *n_instances,
+                  gdouble *cost)
+{
+	*n_instances = 1.0;
+	*cost = *n_instances;
+}
+
+/* format. draft-fge-json-schema-validation-00§7.
+ *
+ * Complexity: O(validate_value_type) */
+static gboolean
+validate_format (WblSchema *self,
+                 JsonObject *root,
+                 JsonNode *schema_node,
+                 GPtrArray/*<owned WblValidateMessage>*/ *messages)
+{
+	if (!validate_value_type (schema_node, G_TYPE_STRING)) {
+		_wbl_validate_message_output (messages,
+		                              WBL_VALIDATE_MESSAGE_ERROR,
+		                              schema_node,
+		                              WBL_SCHEMA_VALIDATION,
+		                              "7.1",
+		                              NULL,
+		                              _("format must be a string."));
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Complexity: O(N) in the length of the instance */
+static void
+apply_format (WblSchema *self,
+              JsonObject *root,
+              JsonNode *schema_node,
+              JsonNode *instance_node,
+              GError **error)
+{
+	WblSchemaPrivate *priv;
+	WblFormat format;
+	const gchar *instance_str;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	/* Validation succeeds if formats are not being checked, or the
+	 * instance is the wrong type. Unknown formats are always valid. */
+	if (!priv->check_formats ||
+	    !validate_value_type (instance_node, G_TYPE_STRING)) {
+		return;
+	}
+
+	format = wbl_format_from_string (json_node_get_string (schema_node));
+	instance_str = json_node_get_string (instance_node);
+
+	if (!wbl_format_validate (format, instance_str,
+	                          strlen (instance_str))) {
+		g_set_error (error,
+		             WBL_SCHEMA_ERROR, WBL_SCHEMA_ERROR_INVALID,
+		             /* Translators: The first parameter is the name
+		              * of a format, such as ‘date-time’, and the second
+		              * is a section number. */
+		             _("Value must be a valid ‘%s’ due to the format "
+		               "schema keyword. "
+		               "See draft-fge-json-schema-validation-00§%s."),
+		             json_node_get_string (schema_node),
+		             wbl_format_get_section (format));
+	}
+}
+
+/* Complexity: O(1) */
+static void
+generate_format (WblSchema *self,
+                 JsonObject *root,
+                 JsonNode *schema_node,
+                 GHashTable/*<owned JsonNode>*/ *output)
+{
+	WblSchemaPrivate *priv;
+	WblFormat format;
+	const WblFormatExample *examples;
+	gsize n_examples, i;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	if (!priv->check_formats) {
+		return;
+	}
+
+	/* Generate strings on either side of the boundary of the format. */
+	format = wbl_format_from_string (json_node_get_string (schema_node));
+	examples = wbl_format_get_examples (format, &n_examples);
+
+	for (i = 0; i < n_examples; i++) {
+		generate_take_node (output,
+		                    node_new_string (examples[i].value));
+	}
+}
+
+/* Complexity: O(1) */
+static void
+estimate_format (WblSchema *self,
+                 JsonObject *root,
+                 JsonNode *schema_node,
+                 GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                 WblSchemaEstimate *estimate,
+                 gdouble *n_instances,
+                 gdouble *cost)
+{
+	WblSchemaPrivate *priv;
+	WblFormat format;
+	gsize n_examples = 0;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	if (priv->check_formats) {
+		format = wbl_format_from_string (json_node_get_string (schema_node));
+		wbl_format_get_examples (format, &n_examples);
+	}
+
+	*n_instances = n_examples;
+	*cost = *n_instances;
+}
+
 typedef gboolean
 (*KeywordValidateFunc) (WblSchema *self,
                         JsonObject *root,
@@ -6715,10 +9456,25 @@ typedef void
                      JsonNode *instance_node,
                      GError **error);
 typedef void
+(*KeywordApplyBatchFunc) (WblSchema *self,
+                          JsonObject *root,
+                          JsonNode *schema_node,
+                          JsonNode * const *instances,
+                          GError **errors,
+                          guint n_instances);
+typedef void
 (*KeywordGenerateFunc) (WblSchema *self,
                         JsonObject *root,
                         JsonNode *schema_node,
                         GHashTable/*<owned JsonNode, unowned JsonNode>*/ *output);
+typedef void
+(*KeywordEstimateFunc) (WblSchema *self,
+                        JsonObject *root,
+                        JsonNode *schema_node,
+                        GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                        WblSchemaEstimate *estimate,
+                        gdouble *n_instances,
+                        gdouble *cost);
 
 typedef void
 (*KeywordGroupApplyFunc) (WblSchema   *self,
@@ -6729,6 +9485,13 @@ typedef void
 (*KeywordGroupGenerateFunc) (WblSchema   *self,
                              JsonObject  *root,
                              GHashTable/*<owned JsonNode, unowned JsonNode>*/ *output);
+typedef void
+(*KeywordGroupEstimateFunc) (WblSchema   *self,
+                             JsonObject  *root,
+                             GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                             WblSchemaEstimate *estimate,
+                             gdouble     *n_instances,
+                             gdouble     *cost);
 
 /* Structure holding information about a single JSON Schema keyword, as defined
  * in draft-zyp-json-schema-04§3.2. Default keywords are described in
@@ -6739,11 +9502,15 @@ typedef struct {
 	KeywordValidateFunc validate;  /* NULL if validation always succeeds */
 	KeywordApplyFunc apply;  /* NULL if application always succeeds */
 	KeywordGenerateFunc generate;  /* NULL if generation produces nothing */
+	KeywordEstimateFunc estimate;  /* NULL iff generate is NULL */
+	KeywordApplyBatchFunc apply_batch;  /* NULL to use apply on each instance */
 } KeywordData;
 
 typedef struct {
+	const gchar *name;  /* used for debugging output only */
 	KeywordGroupApplyFunc apply;  /* NULL if application always succeeds */
 	KeywordGroupGenerateFunc generate;  /* NULL if generation produces nothing */
+	KeywordGroupEstimateFunc estimate;  /* NULL iff generate is NULL */
 	const KeywordData *keywords;
 	gsize n_keywords;
 } KeywordGroupData;
@@ -6760,74 +9527,75 @@ typedef struct {
  */
 static const KeywordData json_schema_items_keywords[] = {
 	/* draft-fge-json-schema-validation-00§5.3.1 */
-	{ "additionalItems", "{}", validate_additional_items, NULL, NULL },
-	{ "items", "{}", validate_items, apply_items, NULL },
+	{ "additionalItems", "{}", validate_additional_items, NULL, NULL, NULL, NULL },
+	{ "items", "{}", validate_items, apply_items, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.3.2 */
-	{ "maxItems", NULL, validate_max_items, apply_max_items, NULL },
+	{ "maxItems", NULL, validate_max_items, apply_max_items, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.3.3 */
-	{ "minItems", "0", validate_min_items, apply_min_items, NULL },
+	{ "minItems", "0", validate_min_items, apply_min_items, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.3.3 */
-	{ "uniqueItems", "false", validate_unique_items, apply_unique_items, NULL },
+	{ "uniqueItems", "false", validate_unique_items, apply_unique_items, NULL, NULL, NULL },
 };
 
 static const KeywordData json_schema_properties_keywords[] = {
 	/* draft-fge-json-schema-validation-00§5.4.1 */
-	{ "maxProperties", NULL, validate_max_properties, apply_max_properties, NULL },
+	{ "maxProperties", NULL, validate_max_properties, apply_max_properties, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.4.2 */
-	{ "minProperties", "0", validate_min_properties, apply_min_properties, NULL },
+	{ "minProperties", "0", validate_min_properties, apply_min_properties, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.4.3 */
-	{ "required", NULL, validate_required, apply_required, NULL },
+	{ "required", NULL, validate_required, apply_required, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.4.4 */
-	{ "additionalProperties", "{}", validate_additional_properties, NULL, NULL },
-	{ "properties", "{}", validate_properties, NULL, NULL },
-	{ "patternProperties", "{}", validate_pattern_properties, NULL, NULL },
+	{ "additionalProperties", "{}", validate_additional_properties, NULL, NULL, NULL, NULL },
+	{ "properties", "{}", validate_properties, NULL, NULL, NULL, NULL },
+	{ "patternProperties", "{}", validate_pattern_properties, NULL, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.4.5 */
-	{ "dependencies", NULL, validate_dependencies, apply_dependencies, NULL },
+	{ "dependencies", NULL, validate_dependencies, apply_dependencies, NULL, NULL, NULL },
 };
 
 static const KeywordGroupData json_schema_group_keywords[] = {
 	/* draft-fge-json-schema-validation-00§5.3 */
-	{ NULL, generate_all_items_wrapper, json_schema_items_keywords, G_N_ELEMENTS (json_schema_items_keywords) },
+	{ "items", NULL, generate_all_items_wrapper, estimate_all_items_wrapper, json_schema_items_keywords, G_N_ELEMENTS (json_schema_items_keywords) },
 	/* draft-fge-json-schema-validation-00§5.4 */
-	{ apply_all_properties, generate_all_properties_wrapper, json_schema_properties_keywords, G_N_ELEMENTS (json_schema_properties_keywords) },
+	{ "properties", apply_all_properties, generate_all_properties_wrapper, estimate_all_properties_wrapper, json_schema_properties_keywords, G_N_ELEMENTS (json_schema_properties_keywords) },
 };
 
 static const KeywordData json_schema_keywords[] = {
 	/* draft-fge-json-schema-validation-00§5.1.1 */
-	{ "multipleOf", NULL, validate_multiple_of, apply_multiple_of, generate_multiple_of },
+	{ "multipleOf", NULL, validate_multiple_of, apply_multiple_of, generate_multiple_of, estimate_multiple_of, NULL },
 	/* draft-fge-json-schema-validation-00§5.1.2 */
-	{ "maximum", NULL, validate_maximum, apply_maximum, generate_maximum },
-	{ "exclusiveMaximum", NULL, validate_exclusive_maximum, NULL, NULL },
+	{ "maximum", NULL, validate_maximum, apply_maximum, generate_maximum, estimate_maximum, apply_batch_maximum },
+	{ "exclusiveMaximum", NULL, validate_exclusive_maximum, NULL, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.1.3. */
-	{ "minimum", NULL, validate_minimum, apply_minimum, generate_minimum },
-	{ "exclusiveMinimum", NULL, validate_exclusive_minimum, NULL, NULL },
+	{ "minimum", NULL, validate_minimum, apply_minimum, generate_minimum, estimate_minimum, apply_batch_minimum },
+	{ "exclusiveMinimum", NULL, validate_exclusive_minimum, NULL, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§5.2.1 */
-	{ "maxLength", NULL, validate_max_length, apply_max_length, generate_max_length },
+	{ "maxLength", NULL, validate_max_length, apply_max_length, generate_max_length, estimate_max_length, apply_batch_max_length },
 	/* draft-fge-json-schema-validation-00§5.2.2 */
-	{ "minLength", "0", validate_min_length, apply_min_length, generate_min_length },
+	{ "minLength", "0", validate_min_length, apply_min_length, generate_min_length, estimate_min_length, apply_batch_min_length },
 	/* draft-fge-json-schema-validation-00§5.2.3 */
-	{ "pattern", NULL, validate_pattern, apply_pattern, generate_pattern },
+	{ "pattern", NULL, validate_pattern, apply_pattern, generate_pattern, estimate_pattern, NULL },
 	/* draft-fge-json-schema-validation-00§5.5.1 */
-	{ "enum", NULL, validate_enum, apply_enum, generate_enum },
+	{ "enum", NULL, validate_enum, apply_enum, generate_enum, estimate_enum, NULL },
 	/* draft-fge-json-schema-validation-00§5.5.2 */
-	{ "type", NULL, validate_type, apply_type, generate_type },
+	{ "type", NULL, validate_type, apply_type, generate_type, estimate_type, apply_batch_type },
 	/* draft-fge-json-schema-validation-00§5.5.3 */
-	{ "allOf", NULL, validate_all_of, apply_all_of, generate_all_of },
+	{ "allOf", NULL, validate_all_of, apply_all_of, generate_all_of, estimate_all_of, NULL },
 	/* draft-fge-json-schema-validation-00§5.5.4 */
-	{ "anyOf", NULL, validate_any_of, apply_any_of, generate_any_of },
+	{ "anyOf", NULL, validate_any_of, apply_any_of, generate_any_of, estimate_any_of, NULL },
 	/* draft-fge-json-schema-validation-00§5.5.5 */
-	{ "oneOf", NULL, validate_one_of, apply_one_of, generate_one_of },
+	{ "oneOf", NULL, validate_one_of, apply_one_of, generate_one_of, estimate_one_of, NULL },
 	/* draft-fge-json-schema-validation-00§5.5.6 */
-	{ "not", NULL, validate_not, apply_not, generate_not },
+	{ "not", NULL, validate_not, apply_not, generate_not, estimate_not, NULL },
 	/* draft-fge-json-schema-validation-00§6.1 */
-	{ "title", NULL, validate_title, NULL, NULL },
-	{ "description", NULL, validate_description, NULL, NULL },
+	{ "title", NULL, validate_title, NULL, NULL, NULL, NULL },
+	{ "description", NULL, validate_description, NULL, NULL, NULL, NULL },
 	/* draft-fge-json-schema-validation-00§6.2 */
-	{ "default", NULL, NULL, NULL, generate_default },
+	{ "default", NULL, NULL, NULL, generate_default, estimate_default, NULL },
+	/* draft-fge-json-schema-validation-00§7 */
+	{ "format", NULL, validate_format, apply_format, generate_format, estimate_format, NULL },
 
 	/* TODO:
 	 *  • definitions (draft-fge-json-schema-validation-00§5.5.7)
-	 *  • format (draft-fge-json-schema-validation-00§7.1)
 	 *  • json-schema-core
 	 *  • json-schema-hypermedia
 	 */
@@ -6872,15 +9640,107 @@ parse_default_value (const gchar *json_string)
 	return output;
 }
 
+/* If the schema was loaded with %WBL_SCHEMA_LOAD_MODE_LAZY, validate the
+ * keywords of @subschema_object the first time it is reached, and remember the
+ * verdict. Its child subschemas are validated when they are reached in turn.
+ * Validation messages are not kept, as wbl_schema_get_validation_messages()
+ * validates the whole schema when they are needed.
+ *
+ * Parent keywords may hide or invert the error from an invalid child
+ * subschema (`not` and `anyOf`, for example), so it is also recorded in the
+ * #ApplyState, and the outermost apply call fails with
+ * %WBL_SCHEMA_ERROR_MALFORMED.
+ *
+ * Complexity: O(1) once @subschema_object has been validated; otherwise
+ * O(validate_schema) for its keywords alone */
+static gboolean
+subschema_validate_lazily (WblSchema   *self,
+                           JsonObject  *subschema_object,
+                           GError     **error)
+{
+	WblSchemaClass *klass;
+	WblSchemaPrivate *priv;
+	GPtrArray/*<owned WblValidateMessage>*/ *messages = NULL;  /* owned */
+	WblSchemaNode node = { 0, };
+	WblSchemaNode *root;  /* unowned */
+	gpointer verdict;
+	gboolean found;
+	GError *child_error = NULL;
+
+	klass = WBL_SCHEMA_GET_CLASS (self);
+	priv = wbl_schema_get_instance_private (self);
+
+	/* Use the verdicts for the schema the current apply call started
+	 * with, which may not be the loaded one if @self has been reloaded
+	 * since. Generation and validation run in the calling thread, so
+	 * always use the loaded one. The table is created when the node is
+	 * and lives as long as it does, so it can be checked without the
+	 * lock. */
+	root = apply_state_get_root ();
+
+	if (root == NULL) {
+		root = priv->schema;
+	}
+
+	/* Empty subschemas are always valid; and keyword validate functions
+	 * may apply subschemas (to check a default value, for example), which
+	 * must not recurse back into validation. */
+	if (root == NULL || root->lazy_verdicts == NULL ||
+	    klass->validate_schema == NULL ||
+	    json_object_get_size (subschema_object) == 0 ||
+	    g_private_get (&validate_shallow_private) != NULL) {
+		return TRUE;
+	}
+
+	g_mutex_lock (&root->lazy_verdicts_lock);
+	found = g_hash_table_lookup_extended (root->lazy_verdicts,
+	                                      subschema_object, NULL,
+	                                      &verdict);
+	g_mutex_unlock (&root->lazy_verdicts_lock);
+
+	if (!found) {
+		/* Validate outside the lock. If another thread reaches the same
+		 * subschema meanwhile, it will reach the same verdict. */
+		node.ref_count = 1;
+		node.node = subschema_object;
+
+		g_private_set (&validate_shallow_private, GINT_TO_POINTER (TRUE));
+		messages = klass->validate_schema (self, &node, &child_error);
+		g_private_set (&validate_shallow_private, NULL);
+
+		g_clear_pointer (&messages, g_ptr_array_unref);
+
+		verdict = GINT_TO_POINTER (child_error == NULL);
+		g_clear_error (&child_error);
+
+		g_mutex_lock (&root->lazy_verdicts_lock);
+		g_hash_table_insert (root->lazy_verdicts, subschema_object,
+		                     verdict);
+		g_mutex_unlock (&root->lazy_verdicts_lock);
+	}
+
+	if (!GPOINTER_TO_INT (verdict)) {
+		apply_state_mark_malformed ();
+		g_set_error_literal (error, WBL_SCHEMA_ERROR,
+		                     WBL_SCHEMA_ERROR_MALFORMED,
+		                     _("JSON Schema is invalid."));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static GPtrArray/*<owned WblValidateMessage>*/ *
 real_validate_schema (WblSchema *self,
                       WblSchemaNode *schema,
                       GError **error)
 {
+	WblSchemaPrivate *priv;
 	GPtrArray/*<owned WblValidateMessage>*/ *messages = NULL;
 	gboolean success = TRUE;
 	guint i;
 
+	priv = wbl_schema_get_instance_private (self);
 	messages = g_ptr_array_new_with_free_func ((GDestroyNotify) wbl_validate_message_free);
 
 	for (i = 0; i < G_N_ELEMENTS (json_schema_keywords); i++) {
@@ -6938,6 +9798,44 @@ real_validate_schema (WblSchema *self,
 		}
 	}
 
+	/* Extension keywords. These have no defaults, and report a single
+	 * error message each. */
+	for (i = 0; i < priv->extension_keywords->len; i++) {
+		const ExtensionKeywordData *keyword;
+		JsonNode *schema_node;
+		GError *child_error = NULL;
+
+		keyword = &g_array_index (priv->extension_keywords,
+		                          ExtensionKeywordData, i);
+		schema_node = json_object_get_member (schema->node,
+		                                      keyword->name);
+
+		if (schema_node == NULL || keyword->validate == NULL ||
+		    keyword->validate (self, schema->node, schema_node,
+		                       &child_error, keyword->user_data)) {
+			g_clear_error (&child_error);
+			continue;
+		}
+
+		if (child_error != NULL) {
+			_wbl_validate_message_output (messages,
+			                              WBL_VALIDATE_MESSAGE_ERROR,
+			                              schema_node, NULL, NULL,
+			                              NULL, "%s",
+			                              child_error->message);
+		} else {
+			_wbl_validate_message_output (messages,
+			                              WBL_VALIDATE_MESSAGE_ERROR,
+			                              schema_node, NULL, NULL,
+			                              NULL,
+			                              _("%s must be valid."),
+			                              keyword->name);
+		}
+
+		g_clear_error (&child_error);
+		success = FALSE;
+	}
+
 	if (!success) {
 		g_set_error_literal (error, WBL_SCHEMA_ERROR,
 		                     WBL_SCHEMA_ERROR_MALFORMED,
@@ -6953,8 +9851,17 @@ real_apply_schema (WblSchema *self,
                    JsonNode *instance,
                    GError **error)
 {
+	WblSchemaPrivate *priv;
+	CoverageRecorder *coverage;  /* unowned */
 	guint i;
 
+	priv = wbl_schema_get_instance_private (self);
+	coverage = apply_state_get_coverage ();
+
+	if (!subschema_validate_lazily (self, schema->node, error)) {
+		return;
+	}
+
 	for (i = 0; i < G_N_ELEMENTS (json_schema_keywords); i++) {
 		const KeywordData *keyword = &json_schema_keywords[i];
 		JsonNode *schema_node, *default_schema_node = NULL;
@@ -6972,6 +9879,12 @@ real_apply_schema (WblSchema *self,
 		if (schema_node != NULL && keyword->apply != NULL) {
 			keyword->apply (self, schema->node,
 			                schema_node, instance, &child_error);
+
+			if (coverage != NULL) {
+				coverage_recorder_add (coverage, schema->node,
+				                       keyword->name,
+				                       child_error == NULL);
+			}
 		}
 
 		g_clear_pointer (&default_schema_node, json_node_free);
@@ -6993,6 +9906,12 @@ real_apply_schema (WblSchema *self,
 		if (keyword_group->apply != NULL) {
 			keyword_group->apply (self, schema->node, instance,
 			                      &child_error);
+
+			if (coverage != NULL) {
+				coverage_recorder_add (coverage, schema->node,
+				                       keyword_group->name,
+				                       child_error == NULL);
+			}
 		}
 
 		if (child_error != NULL) {
@@ -7021,6 +9940,13 @@ real_apply_schema (WblSchema *self,
 				keyword->apply (self, schema->node,
 				                schema_node, instance,
 				                &child_error);
+
+				if (coverage != NULL) {
+					coverage_recorder_add (coverage,
+					                       schema->node,
+					                       keyword->name,
+					                       child_error == NULL);
+				}
 			}
 
 			g_clear_pointer (&default_schema_node, json_node_free);
@@ -7031,622 +9957,3702 @@ real_apply_schema (WblSchema *self,
 			}
 		}
 	}
-}
 
-static GHashTable/*<owned JsonNode>*/ *
-real_generate_instance_nodes (WblSchema      *self,
-                              WblSchemaNode  *schema)
-{
-	WblSchemaPrivate *priv;
-	guint i;
-	WblSchemaInstanceCacheEntry *entry = NULL;  /* owned */
-	GHashTable/*<owned JsonNode>*/ *instances = NULL;  /* owned */
+	/* Extension keywords, after all the standard ones. */
+	for (i = 0; i < priv->extension_keywords->len; i++) {
+		const ExtensionKeywordData *keyword;
+		JsonNode *schema_node;
+		GError *child_error = NULL;
 
-	priv = wbl_schema_get_instance_private (self);
+		keyword = &g_array_index (priv->extension_keywords,
+		                          ExtensionKeywordData, i);
+		schema_node = json_object_get_member (schema->node,
+		                                      keyword->name);
 
-	/* Set up and check the cache. */
-	if (priv->schema_instances_cache == NULL) {
-		priv->schema_instances_cache = g_hash_table_new_full (g_direct_hash,
-		                                                      g_direct_equal,
-		                                                      (GDestroyNotify) json_object_unref,
-		                                                      (GDestroyNotify) wbl_schema_instance_cache_entry_free);
+		if (schema_node != NULL && keyword->apply != NULL) {
+			keyword->apply (self, schema->node, schema_node,
+			                instance, &child_error,
+			                keyword->user_data);
+
+			if (coverage != NULL) {
+				coverage_recorder_add (coverage, schema->node,
+				                       keyword->name,
+				                       child_error == NULL);
+			}
+		}
+
+		if (child_error != NULL) {
+			g_propagate_error (error, child_error);
+			return;
+		}
 	}
+}
 
-	entry = g_hash_table_lookup (priv->schema_instances_cache,
-	                             schema->node);
+/* Apply a single keyword to each of @instances which has not already failed
+ * validation, column-wise if the keyword supports it. */
+static void
+apply_keyword_batch (WblSchema         *self,
+                     WblSchemaNode     *schema,
+                     const KeywordData *keyword,
+                     JsonNode * const  *instances,
+                     GError           **errors,
+                     guint              n_instances)
+{
+	JsonNode *schema_node, *default_schema_node = NULL;
+	guint i;
 
-	if (entry != NULL) {
-		instances = g_hash_table_ref (entry->instances);
-		entry->n_times_generated++;
-	} else {
-		gint64 start_time, end_time;
+	schema_node = json_object_get_member (schema->node, keyword->name);
 
-		instances = g_hash_table_new_full (wbl_json_node_hash,
-		                                   wbl_json_node_equal,
-		                                   (GDestroyNotify) json_node_free,
-		                                   NULL);
+	/* Default. This is only parsed once for the whole batch. */
+	if (schema_node == NULL && keyword->default_value != NULL) {
+		default_schema_node = parse_default_value (keyword->default_value);
+		schema_node = default_schema_node;
+	}
 
-		g_debug ("%s: Subschema instance cache miss for subschema %p",
-		         G_STRFUNC, schema->node);
-		start_time = g_get_monotonic_time ();
+	if (schema_node != NULL && keyword->apply_batch != NULL) {
+		keyword->apply_batch (self, schema->node, schema_node,
+		                      instances, errors, n_instances);
+	} else if (schema_node != NULL && keyword->apply != NULL) {
+		for (i = 0; i < n_instances; i++) {
+			if (errors[i] == NULL) {
+				keyword->apply (self, schema->node,
+				                schema_node, instances[i],
+				                &errors[i]);
+			}
+		}
+	}
 
-		/* Generate for each keyword in turn. Handle individual keywords
-		 * first. */
-		for (i = 0; i < G_N_ELEMENTS (json_schema_keywords); i++) {
-			const KeywordData *keyword = &json_schema_keywords[i];
-			JsonNode *schema_node, *default_schema_node = NULL;
+	g_clear_pointer (&default_schema_node, json_node_free);
+}
 
-			schema_node = json_object_get_member (schema->node,
-			                                      keyword->name);
+/* Column-wise variant of real_apply_schema(), which applies each keyword in
+ * turn to all of @instances, rather than each instance in turn to all of the
+ * keywords. The keywords are applied in the same order, and an instance is
+ * not checked against any more keywords once one fails, so each entry in
+ * @errors is set exactly as real_apply_schema() would set it.
+ *
+ * Subschemas (from properties, items, allOf, etc.) are applied to each
+ * instance in turn by the keyword’s apply function.
+ *
+ * Complexity: O(N * real_apply_schema) in the number of @instances */
+static void
+real_apply_schema_batch (WblSchema         *self,
+                         WblSchemaNode     *schema,
+                         JsonNode * const  *instances,
+                         GError           **errors,
+                         guint              n_instances)
+{
+	WblSchemaPrivate *priv;
+	GError *child_error = NULL;
+	guint i, j, k;
 
-			/* Default. */
-			if (schema_node == NULL &&
-			    keyword->default_value != NULL) {
-				default_schema_node = parse_default_value (keyword->default_value);
-				schema_node = default_schema_node;
-			}
+	priv = wbl_schema_get_instance_private (self);
 
-			if (schema_node != NULL && keyword->generate != NULL) {
-				keyword->generate (self, schema->node,
-				                   schema_node, instances);
+	if (!subschema_validate_lazily (self, schema->node, &child_error)) {
+		for (k = 0; k < n_instances; k++) {
+			if (errors[k] == NULL) {
+				errors[k] = g_error_copy (child_error);
 			}
-
-			g_clear_pointer (&default_schema_node, json_node_free);
 		}
 
-		for (i = 0; i < G_N_ELEMENTS (json_schema_group_keywords); i++) {
-			const KeywordGroupData *keyword_group;
+		g_error_free (child_error);
 
-			keyword_group = &json_schema_group_keywords[i];
+		return;
+	}
 
-			if (keyword_group->generate != NULL) {
-				keyword_group->generate (self, schema->node,
-				                         instances);
+	for (i = 0; i < G_N_ELEMENTS (json_schema_keywords); i++) {
+		apply_keyword_batch (self, schema, &json_schema_keywords[i],
+		                     instances, errors, n_instances);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (json_schema_group_keywords); i++) {
+		const KeywordGroupData *keyword_group;
+
+		keyword_group = &json_schema_group_keywords[i];
+
+		/* Run the apply() function for the group as a whole. */
+		if (keyword_group->apply != NULL) {
+			for (k = 0; k < n_instances; k++) {
+				if (errors[k] == NULL) {
+					keyword_group->apply (self,
+					                      schema->node,
+					                      instances[k],
+					                      &errors[k]);
+				}
 			}
 		}
 
-		end_time = g_get_monotonic_time ();
+		/* Then its individual keywords. */
+		for (j = 0; j < keyword_group->n_keywords; j++) {
+			apply_keyword_batch (self, schema,
+			                     &keyword_group->keywords[j],
+			                     instances, errors, n_instances);
+		}
+	}
+
+	/* Extension keywords have no batch variant. */
+	for (i = 0; i < priv->extension_keywords->len; i++) {
+		const ExtensionKeywordData *keyword;
+		JsonNode *schema_node;
+
+		keyword = &g_array_index (priv->extension_keywords,
+		                          ExtensionKeywordData, i);
+		schema_node = json_object_get_member (schema->node,
+		                                      keyword->name);
+
+		if (schema_node == NULL || keyword->apply == NULL) {
+			continue;
+		}
+
+		for (k = 0; k < n_instances; k++) {
+			if (errors[k] == NULL) {
+				keyword->apply (self, schema->node,
+				                schema_node, instances[k],
+				                &errors[k], keyword->user_data);
+			}
+		}
+	}
+}
+
+/* Apply @schema to each of @instances, setting the corresponding entry in
+ * @errors for each invalid instance. This uses the column-wise
+ * real_apply_schema_batch() unless a subclass has overridden
+ * #WblSchemaClass.apply_schema, in which case the override is called for each
+ * instance. */
+static void
+schema_apply_batch (WblSchema         *self,
+                    WblSchemaNode     *schema,
+                    JsonNode * const  *instances,
+                    GError           **errors,
+                    guint              n_instances)
+{
+	WblSchemaClass *klass;
+	WblSchemaPrivate *priv;
+	ApplyStateFrame previous;
+	guint i;
+
+	klass = WBL_SCHEMA_GET_CLASS (self);
+	priv = wbl_schema_get_instance_private (self);
+
+	apply_state_enter (schema, priv->memoise_subtrees, &previous);
+
+	if (klass->apply_schema == real_apply_schema) {
+		real_apply_schema_batch (self, schema, instances, errors,
+		                         n_instances);
+	} else if (klass->apply_schema != NULL) {
+		for (i = 0; i < n_instances; i++) {
+			klass->apply_schema (self, schema, instances[i],
+			                     &errors[i]);
+		}
+	}
+
+	/* An invalid subschema was reached while validating the schema
+	 * lazily; see wbl_schema_apply(). It is not known which instances
+	 * reached it, so apply them again one at a time. This only happens
+	 * for invalid schemas. */
+	if (apply_state_take_malformed () && klass->apply_schema != NULL) {
+		for (i = 0; i < n_instances; i++) {
+			g_clear_error (&errors[i]);
+			klass->apply_schema (self, schema, instances[i],
+			                     &errors[i]);
+
+			if (apply_state_take_malformed ()) {
+				g_clear_error (&errors[i]);
+				g_set_error_literal (&errors[i],
+				                     WBL_SCHEMA_ERROR,
+				                     WBL_SCHEMA_ERROR_MALFORMED,
+				                     _("JSON Schema is invalid."));
+			}
+		}
+	}
+
+	apply_state_leave (&previous);
+}
+
+/* Allocation estimates for a single real_generate_instance_nodes() call, if
+ * estimation is enabled. Each keyword generator is accounted in turn by
+ * accounting_begin() and accounting_end(). */
+typedef struct {
+	GHashTable/*<unowned utf8, owned WblAllocationStats>*/ *keyword_allocations;  /* owned; NULL unless estimating */
+	/* Estimated bytes in the instances generated so far. */
+	guint64 n_output_bytes;
+	/* Most estimated bytes held at once by the subschema’s instances and
+	 * the intermediate sets of the keyword being generated. */
+	guint64 n_peak_bytes;
+	/* #WblSchemaPrivate.accounting_stats from any outer call, restored by
+	 * accounting_end(). */
+	WblAllocationStats *previous_stats;  /* unowned */
+} GenerateAccounting;
+
+/* Helpers for estimating the allocations made by each keyword generator. If
+ * estimation is enabled (@accounting->keyword_allocations is non-%NULL), each
+ * generator writes to a fresh instance set, which is measured and then merged
+ * into @instances; and it can add the intermediate sets it builds using
+ * accounting_get_stats(). Otherwise, the generator writes to @instances
+ * directly.
+ *
+ * Complexity: O(1) */
+static GHashTable/*<owned JsonNode>*/ *
+accounting_begin (WblSchema                       *self,
+                  GenerateAccounting              *accounting,
+                  const gchar                     *keyword_name,
+                  GHashTable/*<owned JsonNode>*/  *instances)
+{
+	WblSchemaPrivate *priv;
+	WblAllocationStats *stats;  /* unowned */
+
+	if (accounting->keyword_allocations == NULL) {
+		return instances;
+	}
+
+	priv = wbl_schema_get_instance_private (self);
+
+	stats = g_hash_table_lookup (accounting->keyword_allocations,
+	                             keyword_name);
+
+	if (stats == NULL) {
+		stats = g_new0 (WblAllocationStats, 1);
+		g_hash_table_insert (accounting->keyword_allocations,
+		                     (gpointer) keyword_name, stats);
+	}
+
+	accounting->previous_stats = priv->accounting_stats;
+	priv->accounting_stats = stats;
+
+	return g_hash_table_new_full (wbl_json_node_hash,
+	                              wbl_json_node_equal,
+	                              (GDestroyNotify) json_node_free,
+	                              NULL);
+}
+
+/* Complexity: O(N) in the number of nodes in @keyword_instances */
+static void
+accounting_end (WblSchema                       *self,
+                GenerateAccounting              *accounting,
+                const gchar                     *keyword_name,
+                GHashTable/*<owned JsonNode>*/  *keyword_instances,  /* transfer full */
+                GHashTable/*<owned JsonNode>*/  *instances)
+{
+	WblSchemaPrivate *priv;
+	WblAllocationStats *stats;  /* unowned */
+	GHashTableIter iter;
+	gpointer key;
+	guint64 n_bytes;
+
+	if (accounting->keyword_allocations == NULL) {
+		return;
+	}
+
+	priv = wbl_schema_get_instance_private (self);
+	stats = priv->accounting_stats;
+	priv->accounting_stats = accounting->previous_stats;
+
+	g_assert (stats == g_hash_table_lookup (accounting->keyword_allocations,
+	                                        keyword_name));
+
+	/* The keyword’s output is held at least until it is merged. */
+	n_bytes = stats->n_bytes;
+	g_hash_table_iter_init (&iter, keyword_instances);
+
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		JsonNode *node = key;  /* owned after stealing */
+
+		allocation_stats_add_node (stats, node);
+		g_hash_table_iter_steal (&iter);
+		generate_take_node (instances, node);
+	}
+
+	n_bytes = stats->n_bytes - n_bytes;
+	stats->n_peak_bytes = MAX (stats->n_peak_bytes, n_bytes);
+
+	/* The instances from earlier keywords are held throughout. */
+	accounting->n_peak_bytes = MAX (accounting->n_peak_bytes,
+	                                accounting->n_output_bytes +
+	                                stats->n_peak_bytes);
+	accounting->n_output_bytes += n_bytes;
+
+	g_hash_table_unref (keyword_instances);
+}
+
+/* Get the nesting depth of the arrays and objects in @node: 0 for a scalar, 1
+ * for an array or object of scalars, and so on. Or any value greater than
+ * @limit if it is deeper than that.
+ *
+ * Complexity: O(N) in the number of nodes in @node above depth @limit */
+static guint
+node_get_depth (JsonNode  *node,
+                guint      limit)
+{
+	guint depth = 0;
+
+	switch (json_node_get_node_type (node)) {
+	case JSON_NODE_OBJECT: {
+		JsonObjectIter iter;
+		JsonNode *member_node;
+
+		depth = 1;
+
+		if (limit == 0) {
+			break;
+		}
+
+		json_object_iter_init (&iter, json_node_get_object (node));
+
+		while (depth <= limit &&
+		       json_object_iter_next (&iter, NULL, &member_node)) {
+			depth = MAX (depth,
+			             node_get_depth (member_node, limit - 1) + 1);
+		}
+
+		break;
+	}
+	case JSON_NODE_ARRAY: {
+		JsonArray *array;
+		guint i, len;
+
+		depth = 1;
+
+		if (limit == 0) {
+			break;
+		}
+
+		array = json_node_get_array (node);
+
+		for (i = 0, len = json_array_get_length (array);
+		     i < len && depth <= limit; i++) {
+			depth = MAX (depth,
+			             node_get_depth (json_array_get_element (array, i),
+			                             limit - 1) + 1);
+		}
+
+		break;
+	}
+	case JSON_NODE_VALUE:
+	case JSON_NODE_NULL:
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	return depth;
+}
+
+typedef struct {
+	JsonNode *node;  /* unowned */
+	gsize size;
+	guint hash;
+} LimitCandidate;
+
+/* Order candidates smallest first, then by content, so the order does not
+ * depend on the order of the #GHashTable they came from.
+ *
+ * Complexity: O(S) in the serialised size S of the candidates, but only when
+ *    they have the same size and hash */
+static gint
+limit_candidate_compare (gconstpointer a,
+                         gconstpointer b)
+{
+	const LimitCandidate *candidate_a = a, *candidate_b = b;
+	gchar *json_a = NULL, *json_b = NULL;  /* owned */
+	gint retval;
+
+	if (candidate_a->size != candidate_b->size) {
+		return (candidate_a->size < candidate_b->size) ? -1 : 1;
+	}
+
+	if (candidate_a->hash != candidate_b->hash) {
+		return (candidate_a->hash < candidate_b->hash) ? -1 : 1;
+	}
+
+	json_a = node_to_string (candidate_a->node);
+	json_b = node_to_string (candidate_b->node);
+	retval = strcmp (json_a, json_b);
+	g_free (json_b);
+	g_free (json_a);
+
+	return retval;
+}
+
+/* Drop instances from @instances which exceed the limits set with
+ * wbl_schema_set_generation_limits(), given that they will be nested inside
+ * priv->generate_depth arrays and objects. For the total size limit,
+ * instances are considered smallest first (with ties broken by content) and
+ * any which would take the total size of @instances over the limit are
+ * dropped. This keeps as many instances as possible, and the same ones on
+ * every run.
+ *
+ * This is done for the instances of each subschema as they are generated, so
+ * the instances of a parent subschema are only ever built from instances of
+ * its children which are within the limits. generate_all_items() and
+ * generate_all_properties() also apply the size limits while building their
+ * combinations, so they never build more than the limits allow.
+ *
+ * Complexity: O(N * min(S, max_instance_size) + N log N) in the number N of
+ *    @instances and their serialised size S */
+static void
+generate_apply_limits (WblSchema                      *self,
+                       GHashTable/*<owned JsonNode>*/ *instances)
+{
+	WblSchemaPrivate *priv;
+	GHashTableIter iter;
+	gpointer key;
+	GArray/*<LimitCandidate>*/ *candidates = NULL;  /* owned */
+	GenerateSizeBudget budget;
+	gsize size_limit;
+	guint depth_limit, i;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	if (priv->max_depth == 0 && priv->max_instance_size == 0 &&
+	    priv->max_total_size == 0) {
+		return;
+	}
+
+	if (priv->max_depth == 0) {
+		depth_limit = G_MAXUINT;
+	} else if (priv->generate_depth <= priv->max_depth) {
+		depth_limit = priv->max_depth - priv->generate_depth;
+	} else {
+		depth_limit = 0;
+	}
+
+	size_limit = (priv->max_instance_size > 0) ? priv->max_instance_size :
+	                                             G_MAXSIZE;
+	candidates = g_array_sized_new (FALSE, FALSE, sizeof (LimitCandidate),
+	                                g_hash_table_size (instances));
+
+	g_hash_table_iter_init (&iter, instances);
+
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		LimitCandidate candidate;
+
+		candidate.node = key;
+
+		if (priv->max_depth > 0 &&
+		    node_get_depth (candidate.node, depth_limit) > depth_limit) {
+			g_hash_table_iter_remove (&iter);
+			continue;
+		}
+
+		if (priv->max_instance_size == 0 && priv->max_total_size == 0) {
+			continue;
+		}
+
+		candidate.size = node_get_serialised_size (candidate.node,
+		                                           size_limit);
+
+		if (candidate.size > size_limit) {
+			g_hash_table_iter_remove (&iter);
+			continue;
+		}
+
+		candidate.hash = wbl_json_node_hash (candidate.node);
+		g_array_append_val (candidates, candidate);
+	}
+
+	/* Cut to the total size. */
+	if (priv->max_total_size > 0) {
+		g_array_sort (candidates, limit_candidate_compare);
+		generate_size_budget_init (&budget, 0, priv->max_total_size);
+
+		for (i = 0; i < candidates->len; i++) {
+			const LimitCandidate *candidate;
+
+			candidate = &g_array_index (candidates, LimitCandidate, i);
+
+			if (candidate->size >
+			    budget.total_limit - budget.total_size) {
+				g_hash_table_remove (instances, candidate->node);
+			} else {
+				budget.total_size += candidate->size;
+			}
+		}
+	}
+
+	g_array_unref (candidates);
+}
+
+/* Store the instances of @entry in a #WblTape, and rebuild its set of
+ * instances by adding them in tape order, as
+ * instance_cache_entry_dup_instances() does when expanding the tape. A set’s
+ * iteration order depends on the order its members were added in, so this
+ * means the set is iterated in the same order whether or not it has since
+ * been expanded from the tape. The #JsonNodes are moved to the new set, so any
+ * other references to the old set see it empty.
+ *
+ * Complexity: O(N) in the total size of the instances */
+static void
+instance_cache_entry_build_tape (WblSchemaInstanceCacheEntry *entry)
+{
+	GPtrArray/*<owned JsonNode>*/ *nodes = NULL;  /* owned */
+	GHashTable/*<owned JsonNode>*/ *instances = NULL;  /* owned */
+	GHashTableIter iter;
+	gpointer key;
+	guint i;
+
+	g_assert (entry->tape == NULL && entry->instances != NULL);
+
+	nodes = g_ptr_array_sized_new (entry->n_instances);
+	g_hash_table_iter_init (&iter, entry->instances);
+
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_ptr_array_add (nodes, key);
+	}
+
+	entry->tape = wbl_tape_new_from_nodes ((JsonNode * const *) nodes->pdata,
+	                                       nodes->len);
+
+	instances = g_hash_table_new_full (wbl_json_node_hash,
+	                                   wbl_json_node_equal,
+	                                   (GDestroyNotify) json_node_free,
+	                                   NULL);
+	g_hash_table_steal_all (entry->instances);
+
+	for (i = 0; i < nodes->len; i++) {
+		g_hash_table_add (instances, nodes->pdata[i]);  /* transfer */
+	}
+
+	g_hash_table_unref (entry->instances);
+	entry->instances = instances;  /* transfer */
+
+	g_ptr_array_unref (nodes);
+}
+
+/* Spill the tape of @entry to a file if it is at least as big as the spill
+ * threshold, and free its #JsonNodes if so. A spilled tape is expanded into
+ * #JsonNodes again in full whenever the entry is used.
+ *
+ * Complexity: O(N) in the total size of the instances */
+static void
+instance_cache_entry_spill (WblSchema                   *self,
+                            WblSchemaInstanceCacheEntry *entry)
+{
+	WblSchemaPrivate *priv;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	if (priv->spill_threshold > 0 &&
+	    !wbl_tape_is_spilled (entry->tape) &&
+	    wbl_tape_get_n_bytes (entry->tape) >= priv->spill_threshold) {
+		GError *error = NULL;
+
+		if (!wbl_tape_spill (entry->tape, &error)) {
+			g_debug ("%s: Failed to spill instances for subschema "
+			         "%p; keeping them in memory: %s", G_STRFUNC,
+			         entry->schema, error->message);
+			g_clear_error (&error);
+		}
+	}
+
+	if (wbl_tape_is_spilled (entry->tape)) {
+		g_clear_pointer (&entry->instances, g_hash_table_unref);
+	}
+}
+
+/* Get the set of instances of @entry, expanding them from its tape if they
+ * are not held as #JsonNodes. They are added to a new set in tape order, so it
+ * is iterated in the same order as the set rebuilt by
+ * instance_cache_entry_build_tape(). Unless the tape has been spilled, the
+ * expanded set is kept until the end of the generate call.
+ *
+ * Complexity: O(N) in the total size of the instances */
+static GHashTable/*<owned JsonNode>*/ *
+instance_cache_entry_dup_instances (WblSchemaInstanceCacheEntry *entry)
+{
+	GHashTable/*<owned JsonNode>*/ *instances = NULL;  /* owned */
+	guint i;
+
+	if (entry->instances != NULL) {
+		return g_hash_table_ref (entry->instances);
+	}
+
+	instances = g_hash_table_new_full (wbl_json_node_hash,
+	                                   wbl_json_node_equal,
+	                                   (GDestroyNotify) json_node_free,
+	                                   NULL);
+
+	for (i = 0; i < entry->n_instances; i++) {
+		g_hash_table_add (instances,
+		                  wbl_tape_dup_node (entry->tape, i));
+	}
+
+	if (!wbl_tape_is_spilled (entry->tape)) {
+		entry->instances = g_hash_table_ref (instances);
+	}
+
+	return instances;
+}
+
+static GHashTable/*<owned JsonNode>*/ *
+real_generate_instance_nodes (WblSchema      *self,
+                              WblSchemaNode  *schema)
+{
+	WblSchemaPrivate *priv;
+	guint i;
+	WblSchemaInstanceCacheEntry *entry = NULL;  /* owned */
+	GHashTable/*<owned JsonNode>*/ *instances = NULL;  /* owned */
+
+	priv = wbl_schema_get_instance_private (self);
+
+	/* Nothing can be generated for an invalid subschema. */
+	if (!subschema_validate_lazily (self, schema->node, NULL)) {
+		return g_hash_table_new_full (wbl_json_node_hash,
+		                              wbl_json_node_equal,
+		                              (GDestroyNotify) json_node_free,
+		                              NULL);
+	}
+
+	/* Set up and check the cache. */
+	if (priv->schema_instances_cache == NULL) {
+		priv->schema_instances_cache = g_hash_table_new_full (g_direct_hash,
+		                                                      g_direct_equal,
+		                                                      (GDestroyNotify) json_object_unref,
+		                                                      (GDestroyNotify) wbl_schema_instance_cache_entry_free);
+	}
+
+	entry = g_hash_table_lookup (priv->schema_instances_cache,
+	                             schema->node);
+
+	if (entry != NULL) {
+		WBL_PROBE2 (instance__cache__hit, schema->node,
+		            entry->n_instances);
+
+		instances = instance_cache_entry_dup_instances (entry);
+		entry->n_times_generated++;
+	} else {
+		gint64 start_time, end_time;
+		GenerateAccounting accounting = { NULL, };
+		gboolean sharded_root;
+
+		WBL_PROBE1 (instance__cache__miss, schema->node);
+
+		sharded_root = generate_is_sharded_root (self, schema->node, 0);
+
+		instances = g_hash_table_new_full (wbl_json_node_hash,
+		                                   wbl_json_node_equal,
+		                                   (GDestroyNotify) json_node_free,
+		                                   NULL);
+
+		if (priv->generate_flags &
+		    WBL_GENERATE_INSTANCE_ESTIMATE_ALLOCATIONS) {
+			accounting.keyword_allocations = g_hash_table_new_full (g_str_hash,
+			                                                        g_str_equal,
+			                                                        NULL,
+			                                                        g_free);
+		}
+
+		g_debug ("%s: Subschema instance cache miss for subschema %p",
+		         G_STRFUNC, schema->node);
+		start_time = g_get_monotonic_time ();
+
+		/* Generate for each keyword in turn. Handle individual keywords
+		 * first. */
+		for (i = 0; i < G_N_ELEMENTS (json_schema_keywords); i++) {
+			const KeywordData *keyword = &json_schema_keywords[i];
+			JsonNode *schema_node, *default_schema_node = NULL;
+
+			schema_node = json_object_get_member (schema->node,
+			                                      keyword->name);
+
+			/* Default. */
+			if (schema_node == NULL &&
+			    keyword->default_value != NULL) {
+				default_schema_node = parse_default_value (keyword->default_value);
+				schema_node = default_schema_node;
+			}
+
+			if (schema_node != NULL && keyword->generate != NULL) {
+				GHashTable/*<owned JsonNode>*/ *keyword_instances;
+
+				keyword_instances = accounting_begin (self,
+				                                      &accounting,
+				                                      keyword->name,
+				                                      instances);
+				keyword->generate (self, schema->node,
+				                   schema_node, keyword_instances);
+				accounting_end (self, &accounting,
+				                keyword->name, keyword_instances,
+				                instances);
+			}
+
+			g_clear_pointer (&default_schema_node, json_node_free);
+		}
+
+		/* When dividing the root schema between shards, every shard
+		 * generates the cheap instances from the individual keywords,
+		 * and keeps those which hash to it. The keyword groups divide
+		 * their combinations between shards before generating them. */
+		if (sharded_root) {
+			GHashTableIter iter;
+			gpointer key;
+
+			g_hash_table_iter_init (&iter, instances);
+
+			while (g_hash_table_iter_next (&iter, &key, NULL)) {
+				if (!generate_shard_owns_node (self, key)) {
+					g_hash_table_iter_remove (&iter);
+				}
+			}
+		}
+
+		/* The keyword groups generate arrays and objects, so the
+		 * subschemas they generate instances for are nested one level
+		 * deeper. Don’t bother generating them if that is too deep. */
+		priv->generate_depth++;
+
+		for (i = 0;
+		     i < G_N_ELEMENTS (json_schema_group_keywords) &&
+		     (priv->max_depth == 0 ||
+		      priv->generate_depth <= priv->max_depth);
+		     i++) {
+			const KeywordGroupData *keyword_group;
+
+			keyword_group = &json_schema_group_keywords[i];
+
+			if (keyword_group->generate != NULL) {
+				GHashTable/*<owned JsonNode>*/ *keyword_instances;
+
+				keyword_instances = accounting_begin (self,
+				                                      &accounting,
+				                                      keyword_group->name,
+				                                      instances);
+				keyword_group->generate (self, schema->node,
+				                         keyword_instances);
+				accounting_end (self, &accounting,
+				                keyword_group->name,
+				                keyword_instances, instances);
+			}
+		}
+
+		priv->generate_depth--;
+
+		/* Extension keywords. Their instances go into the same set
+		 * and cache entry as those from the standard keywords. */
+		for (i = 0; i < priv->extension_keywords->len; i++) {
+			const ExtensionKeywordData *keyword;
+			JsonNode *schema_node;
+			GHashTable/*<owned JsonNode>*/ *keyword_instances;
+			GPtrArray/*<owned JsonNode>*/ *keyword_output = NULL;  /* owned */
+			guint j;
+
+			keyword = &g_array_index (priv->extension_keywords,
+			                          ExtensionKeywordData, i);
+			schema_node = json_object_get_member (schema->node,
+			                                      keyword->name);
+
+			if (schema_node == NULL || keyword->generate == NULL) {
+				continue;
+			}
+
+			keyword_instances = accounting_begin (self, &accounting,
+			                                      keyword->name,
+			                                      instances);
+			keyword_output = g_ptr_array_new_with_free_func ((GDestroyNotify) json_node_free);
+
+			keyword->generate (self, schema->node, schema_node,
+			                   keyword_output, keyword->user_data);
+
+			for (j = 0; j < keyword_output->len; j++) {
+				if (sharded_root &&
+				    !generate_shard_owns_node (self,
+				                               keyword_output->pdata[j])) {
+					json_node_free (keyword_output->pdata[j]);
+					continue;
+				}
+
+				generate_take_node (keyword_instances,
+				                    keyword_output->pdata[j]);
+			}
+
+			g_ptr_array_set_free_func (keyword_output, NULL);
+			g_ptr_array_unref (keyword_output);
+
+			accounting_end (self, &accounting, keyword->name,
+			                keyword_instances, instances);
+		}
+
+		generate_apply_limits (self, instances);
+
+		end_time = g_get_monotonic_time ();
+
+		/* Add to the cache. */
+		entry = g_slice_new0 (WblSchemaInstanceCacheEntry);
+		entry->n_times_generated = 1;
+		entry->generation_time = end_time - start_time;
+		entry->instances = g_hash_table_ref (instances);
+		entry->n_instances = g_hash_table_size (instances);
+		entry->schema = json_object_ref (schema->node);
+
+		if (accounting.keyword_allocations != NULL) {
+			GHashTableIter iter;
+			gpointer value;
+
+			/* The total includes the instance set itself. */
+			entry->allocations = g_new0 (WblAllocationStats, 1);
+			entry->allocations->n_hash_tables = 1;
+			entry->allocations->n_peak_bytes = accounting.n_peak_bytes;
+
+			g_hash_table_iter_init (&iter, accounting.keyword_allocations);
+
+			while (g_hash_table_iter_next (&iter, NULL, &value)) {
+				allocation_stats_add (entry->allocations, value);
+			}
+
+			entry->keyword_allocations = accounting.keyword_allocations;  /* transfer */
+		}
+
+		g_hash_table_insert (priv->schema_instances_cache,
+		                     json_object_ref (schema->node), entry);
+
+		/* Don’t keep large instance sets in memory while the rest of
+		 * the schema is generated. The caller still gets the
+		 * #JsonNodes, but they are freed once it has used them. The
+		 * set is rebuilt in tape order, so hand back the rebuilt one. */
+		if (priv->spill_threshold > 0) {
+			g_hash_table_unref (instances);
+			instance_cache_entry_build_tape (entry);
+			instances = g_hash_table_ref (entry->instances);
+			instance_cache_entry_spill (self, entry);
+		}
+	}
+
+	return instances;
+}
+
+/* Add a keyword’s contribution to @estimate, tracking the most expensive
+ * keyword. */
+static void
+estimate_add_keyword (WblSchemaEstimate *estimate,
+                      const gchar *keyword,
+                      gdouble n_instances,
+                      gdouble cost)
+{
+	estimate->n_instances += n_instances;
+	estimate->cost += cost;
+
+	if (cost > estimate->keyword_cost) {
+		estimate->keyword = keyword;
+		estimate->keyword_cost = cost;
+	}
+}
+
+/* Estimate the cost of generating instances for @subschema_node and all its
+ * subschemas, adding a #WblSchemaEstimate for each of them to @estimates.
+ * This mirrors subschema_generate_instances() and
+ * real_generate_instance_nodes(), including their special handling of empty
+ * subschemas and the instance cache. @parent is %NULL for the top-level
+ * schema, and @nested is %TRUE if @subschema_node is an argument of `allOf`,
+ * `anyOf`, `oneOf` or `not`.
+ *
+ * Complexity: O(N) in the number of subschemas
+ * Returns: estimated number of instances generated for @subschema_node */
+static gdouble
+subschema_estimate (WblSchema *self,
+                    GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates,
+                    WblSchemaEstimate *parent,
+                    JsonNode *subschema_node,
+                    gboolean nested)
+{
+	JsonObject *subschema_object;  /* unowned */
+	WblSchemaEstimate *estimate = NULL;  /* unowned */
+	guint i;
+
+	subschema_object = json_node_get_object (subschema_node);
+
+	/* Empty subschemas generate a single null value. */
+	if (parent != NULL && json_object_get_size (subschema_object) == 0) {
+		return 1.0;
+	}
+
+	/* Each subschema is only generated once, then cached. */
+	estimate = g_hash_table_lookup (estimates, subschema_object);
+
+	if (estimate != NULL) {
+		return estimate->n_instances;
+	}
+
+	estimate = g_slice_new0 (WblSchemaEstimate);
+	estimate->schema = json_object_ref (subschema_object);
+	estimate->path = build_node_path (subschema_node);
+
+	if (parent != NULL) {
+		estimate->depth = parent->depth + (nested ? 1 : 0);
+	}
+
+	if (estimate->depth > ESTIMATE_DEEP_NESTING) {
+		estimate->flags |= WBL_SCHEMA_ESTIMATE_DEEP_NESTING;
+	}
+
+	g_hash_table_insert (estimates, subschema_object, estimate);
+
+	/* As in real_generate_instance_nodes(), nothing is generated for an
+	 * invalid subschema. */
+	if (!subschema_validate_lazily (self, subschema_object, NULL)) {
+		return estimate->n_instances;
+	}
+
+	/* Estimate for each keyword in turn, in the same way as
+	 * real_generate_instance_nodes(). */
+	for (i = 0; i < G_N_ELEMENTS (json_schema_keywords); i++) {
+		const KeywordData *keyword = &json_schema_keywords[i];
+		JsonNode *schema_node, *default_schema_node = NULL;
+
+		schema_node = json_object_get_member (subschema_object,
+		                                      keyword->name);
+
+		/* Default. */
+		if (schema_node == NULL && keyword->default_value != NULL) {
+			default_schema_node = parse_default_value (keyword->default_value);
+			schema_node = default_schema_node;
+		}
+
+		if (schema_node != NULL && keyword->estimate != NULL) {
+			gdouble n_instances = 0.0, cost = 0.0;
+
+			keyword->estimate (self, subschema_object, schema_node,
+			                   estimates, estimate, &n_instances,
+			                   &cost);
+			estimate_add_keyword (estimate, keyword->name,
+			                      n_instances, cost);
+		}
+
+		g_clear_pointer (&default_schema_node, json_node_free);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (json_schema_group_keywords); i++) {
+		const KeywordGroupData *keyword_group;
+
+		keyword_group = &json_schema_group_keywords[i];
+
+		if (keyword_group->estimate != NULL) {
+			gdouble n_instances = 0.0, cost = 0.0;
+
+			keyword_group->estimate (self, subschema_object,
+			                         estimates, estimate,
+			                         &n_instances, &cost);
+			estimate_add_keyword (estimate, keyword_group->name,
+			                      n_instances, cost);
+		}
+	}
+
+	/* Subschemas have already added their total costs. */
+	estimate->total_cost += estimate->cost;
+
+	if (parent != NULL) {
+		parent->total_cost += estimate->total_cost;
+	}
+
+	return estimate->n_instances;
+}
+
+/**
+ * wbl_schema_new:
+ *
+ * Creates a new #WblSchema with default properties.
+ *
+ * Return value: (transfer full): a new #WblSchema; unref with g_object_unref()
+ *
+ * Since: 0.1.0
+ */
+WblSchema *
+wbl_schema_new (void)
+{
+	return g_object_new (WBL_TYPE_SCHEMA, NULL);
+}
+
+/**
+ * wbl_schema_set_load_mode:
+ * @self: a #WblSchema
+ * @mode: how much of the schema to validate when loading it
+ *
+ * Set how much of each schema is validated when it is loaded. The default is
+ * %WBL_SCHEMA_LOAD_MODE_VALIDATE, which validates the whole schema. Skipping
+ * validation makes loading large schemas faster, especially if only a few of
+ * their subschemas are used; see #WblSchemaLoadMode.
+ *
+ * This affects subsequent loads, not the currently loaded schema.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_set_load_mode (WblSchema         *self,
+                          WblSchemaLoadMode  mode)
+{
+	WblSchemaPrivate *priv;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (mode == WBL_SCHEMA_LOAD_MODE_VALIDATE ||
+	                  mode == WBL_SCHEMA_LOAD_MODE_TRUSTED ||
+	                  mode == WBL_SCHEMA_LOAD_MODE_LAZY);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	priv->load_mode = mode;
+}
+
+/**
+ * wbl_schema_get_load_mode:
+ * @self: a #WblSchema
+ *
+ * Get how much of each schema is validated when it is loaded. See
+ * wbl_schema_set_load_mode().
+ *
+ * Returns: the load mode
+ * Since: UNRELEASED
+ */
+WblSchemaLoadMode
+wbl_schema_get_load_mode (WblSchema *self)
+{
+	WblSchemaPrivate *priv;
+
+	g_return_val_if_fail (WBL_IS_SCHEMA (self),
+	                      WBL_SCHEMA_LOAD_MODE_VALIDATE);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	return priv->load_mode;
+}
+
+/* Whether @name is handled by one of the standard keyword tables. */
+static gboolean
+is_standard_keyword (const gchar *name)
+{
+	guint i, j;
+
+	for (i = 0; i < G_N_ELEMENTS (json_schema_keywords); i++) {
+		if (g_str_equal (json_schema_keywords[i].name, name)) {
+			return TRUE;
+		}
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (json_schema_group_keywords); i++) {
+		const KeywordGroupData *keyword_group;
+
+		keyword_group = &json_schema_group_keywords[i];
+
+		for (j = 0; j < keyword_group->n_keywords; j++) {
+			if (g_str_equal (keyword_group->keywords[j].name,
+			                 name)) {
+				return TRUE;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * wbl_schema_add_keyword:
+ * @self: a #WblSchema
+ * @name: name of the keyword, as it appears in schemas
+ * @validate: (nullable): function to check the keyword’s value in a schema is
+ *    valid, or %NULL if any value is valid
+ * @apply: (nullable): function to check an instance against the keyword, or
+ *    %NULL if all instances are valid
+ * @generate: (nullable): function to generate instances for the keyword, or
+ *    %NULL to generate none
+ * @user_data: user data to pass to the functions
+ * @user_data_free: (nullable): function to free @user_data when @self is
+ *    finalised
+ *
+ * Add support for an extension keyword to @self, which is handled alongside
+ * the standard JSON Schema keywords. For every subschema which contains
+ * @name, @validate is called when the schema is loaded, @apply is called after
+ * the standard keywords when applying the schema to an instance, and
+ * @generate is called after the standard keywords when generating instances.
+ *
+ * This is an alternative to overriding the #WblSchemaClass virtual methods
+ * for extension keywords, which keeps the standard implementation’s batched
+ * application, instance cache and coverage tracking for the whole schema. The
+ * instances from @generate are cached with those from the standard keywords,
+ * and their validity is decided by applying the whole schema to them, so
+ * they do not need to be valid. Extension keywords are not included in
+ * wbl_schema_estimate_generation().
+ *
+ * Keywords must be added before loading a schema, and must not be added while
+ * applying or generating. Keywords are applied and generated in the order
+ * they were added. @name must not be a standard keyword, or an extension
+ * keyword which has already been added.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_add_keyword (WblSchema              *self,
+                        const gchar            *name,
+                        WblKeywordValidateFunc  validate,
+                        WblKeywordApplyFunc     apply,
+                        WblKeywordGenerateFunc  generate,
+                        gpointer                user_data,
+                        GDestroyNotify          user_data_free)
+{
+	WblSchemaPrivate *priv;
+	ExtensionKeywordData keyword;
+	guint i;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (name != NULL && *name != '\0');
+	g_return_if_fail (!is_standard_keyword (name));
+
+	priv = wbl_schema_get_instance_private (self);
+
+	for (i = 0; i < priv->extension_keywords->len; i++) {
+		g_return_if_fail (!g_str_equal (g_array_index (priv->extension_keywords,
+		                                               ExtensionKeywordData,
+		                                               i).name,
+		                                name));
+	}
+
+	keyword.name = g_strdup (name);
+	keyword.validate = validate;
+	keyword.apply = apply;
+	keyword.generate = generate;
+	keyword.user_data = user_data;
+	keyword.user_data_free = user_data_free;
+
+	g_array_append_val (priv->extension_keywords, keyword);
+
+	/* Any cached instances were generated without the keyword, and any
+	 * lazily validated subschemas and cached verdicts were validated
+	 * without it. */
+	g_clear_pointer (&priv->schema_instances_cache, g_hash_table_unref);
+	verdict_cache_clear (priv);
+
+	if (priv->schema != NULL && priv->schema->lazy_verdicts != NULL) {
+		g_mutex_lock (&priv->schema->lazy_verdicts_lock);
+		g_hash_table_remove_all (priv->schema->lazy_verdicts);
+		g_mutex_unlock (&priv->schema->lazy_verdicts_lock);
+	}
+}
+
+static void load_from_memory (WblSchema    *self,
+                              const gchar  *data,
+                              gsize         length,
+                              GError      **error);
+
+/**
+ * wbl_schema_load_from_data:
+ * @self: a #WblSchema
+ * @data: (array length=length): serialised JSON data to load
+ * @length: length of @data, or -1 if @data is nul-terminated
+ * @error: return location for a #GError, or %NULL
+ *
+ * Load and parse a JSON schema from the given serialised JSON @data. @data is
+ * parsed in place, without being copied.
+ *
+ * See wbl_schema_load_from_stream_async() for more details.
+ *
+ * Since: 0.1.0
+ */
+void
+wbl_schema_load_from_data (WblSchema *self,
+                           const gchar *data,
+                           gssize length,
+                           GError **error)
+{
+	gsize length_unsigned;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (data != NULL);
+	g_return_if_fail (length >= -1);
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	if (length < 0) {
+		length_unsigned = strlen (data);
+	} else {
+		length_unsigned = (gsize) length;
+	}
+
+	load_from_memory (self, data, length_unsigned, error);
+}
+
+/**
+ * wbl_schema_load_from_bytes:
+ * @self: a #WblSchema
+ * @bytes: serialised JSON data to load
+ * @error: return location for a #GError, or %NULL
+ *
+ * Load and parse a JSON schema from the given serialised JSON data in @bytes.
+ * The data is parsed in place, without being copied, and the loaded schema
+ * does not keep a reference to @bytes, so it may be freed as soon as this
+ * returns.
+ *
+ * See wbl_schema_load_from_stream_async() for more details.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_load_from_bytes (WblSchema  *self,
+                            GBytes     *bytes,
+                            GError    **error)
+{
+	gconstpointer data;
+	gsize length;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (bytes != NULL);
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	data = g_bytes_get_data (bytes, &length);
+	load_from_memory (self, (data != NULL) ? data : "", length, error);
+}
+
+/**
+ * wbl_schema_load_from_mapped_file:
+ * @self: a #WblSchema
+ * @mapped_file: mapped file containing serialised JSON data to load
+ * @error: return location for a #GError, or %NULL
+ *
+ * Load and parse a JSON schema from the given memory-mapped file containing
+ * serialised JSON data. The data is parsed in place, without being copied, and
+ * the loaded schema does not keep a reference to @mapped_file, so it may be
+ * unmapped as soon as this returns.
+ *
+ * See wbl_schema_load_from_stream_async() for more details.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_load_from_mapped_file (WblSchema    *self,
+                                  GMappedFile  *mapped_file,
+                                  GError      **error)
+{
+	const gchar *data;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (mapped_file != NULL);
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	/* Empty files have %NULL contents. */
+	data = g_mapped_file_get_contents (mapped_file);
+	load_from_memory (self, (data != NULL) ? data : "",
+	                  g_mapped_file_get_length (mapped_file), error);
+}
+
+/**
+ * wbl_schema_load_from_file:
+ * @self: a #WblSchema
+ * @filename: (type filename): path to a local JSON file to load
+ * @error: return location for a #GError, or %NULL
+ *
+ * Load and parse a JSON schema from the given local file containing serialised
+ * JSON data. To load a non-local file, or to use a URI, use
+ * wbl_schema_load_from_stream_async().
+ *
+ * The file is memory mapped and parsed in place where possible; otherwise (for
+ * example, if it is a pipe) it is read as a stream.
+ *
+ * See wbl_schema_load_from_stream_async() for more details.
+ *
+ * Since: 0.1.0
+ */
+void
+wbl_schema_load_from_file (WblSchema *self,
+                           const gchar *filename,
+                           GError **error)
+{
+	GMappedFile *mapped_file = NULL;  /* owned */
+	GError *child_error = NULL;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (filename != NULL);
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+
+	if (mapped_file != NULL) {
+		wbl_schema_load_from_mapped_file (self, mapped_file,
+		                                  &child_error);
+		g_mapped_file_unref (mapped_file);
+	} else {
+		GFile *file = NULL;  /* owned */
+		GFileInputStream *stream = NULL;  /* owned */
+
+		/* Fall back to reading it as a stream, which also gives a
+		 * more consistent error if it cannot be opened at all. */
+		file = g_file_new_for_path (filename);
+		stream = g_file_read (file, NULL, &child_error);
+		g_object_unref (file);
+
+		if (stream != NULL) {
+			wbl_schema_load_from_stream (self,
+			                             G_INPUT_STREAM (stream),
+			                             NULL, &child_error);
+			g_object_unref (stream);
+		}
+	}
+
+	if (child_error != NULL) {
+		g_propagate_prefixed_error (error, child_error,
+		                            _("Error loading schema from file "
+		                              "‘%s’: "), filename);
+	}
+}
+
+/* Closure for loading a single file in wbl_schema_load_from_files(). */
+typedef struct {
+	WblSchema *schema;  /* unowned */
+	const gchar *filename;  /* unowned */
+	GCancellable *cancellable;  /* unowned; nullable */
+	GError **error;  /* unowned */
+} LoadFileData;
+
+static void
+load_file_thread_cb (gpointer  data,
+                     gpointer  user_data)
+{
+	LoadFileData *load_data = data;
+
+	if (!g_cancellable_set_error_if_cancelled (load_data->cancellable,
+	                                           load_data->error)) {
+		wbl_schema_load_from_file (load_data->schema,
+		                           load_data->filename,
+		                           load_data->error);
+	}
+}
+
+/**
+ * wbl_schema_load_from_files:
+ * @schemas: (array length=n_files): #WblSchemas to load into
+ * @filenames: (array length=n_files) (element-type filename): paths to local
+ *    JSON files to load
+ * @n_files: number of elements in @schemas, @filenames and @errors
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @errors: (array length=n_files) (out caller-allocates): return locations for
+ *    a #GError for each file; each must be %NULL on entry
+ *
+ * Load and parse many JSON schemas at once, loading the file at
+ * `filenames[i]` into `schemas[i]` as wbl_schema_load_from_file() would,
+ * including validating it. The files are loaded concurrently in a pool of
+ * threads, and this returns once they have all finished loading. Loading each
+ * schema is independent, so @schemas must not contain the same #WblSchema
+ * twice, and must not be used by any other thread until this returns.
+ *
+ * If loading `filenames[i]` fails, `errors[i]` is set; otherwise it is left as
+ * %NULL. The results are therefore in the same order as @filenames, regardless
+ * of the order the files finish loading in. If @cancellable is cancelled,
+ * the files which have not started loading yet fail with
+ * %G_IO_ERROR_CANCELLED.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_load_from_files (WblSchema           **schemas,
+                            const gchar * const  *filenames,
+                            guint                 n_files,
+                            GCancellable         *cancellable,
+                            GError              **errors)
+{
+	LoadFileData *load_data = NULL;  /* owned */
+	GThreadPool *pool = NULL;  /* owned */
+	guint i, n_threads;
+
+	g_return_if_fail (n_files == 0 || schemas != NULL);
+	g_return_if_fail (n_files == 0 || filenames != NULL);
+	g_return_if_fail (n_files == 0 || errors != NULL);
+	g_return_if_fail (cancellable == NULL ||
+	                  G_IS_CANCELLABLE (cancellable));
+
+	for (i = 0; i < n_files; i++) {
+		g_return_if_fail (WBL_IS_SCHEMA (schemas[i]));
+		g_return_if_fail (filenames[i] != NULL);
+		g_return_if_fail (errors[i] == NULL);
+	}
+
+	load_data = g_new0 (LoadFileData, n_files);
+
+	for (i = 0; i < n_files; i++) {
+		load_data[i].schema = schemas[i];
+		load_data[i].filename = filenames[i];
+		load_data[i].cancellable = cancellable;
+		load_data[i].error = &errors[i];
+	}
+
+#if GLIB_CHECK_VERSION (2, 36, 0)
+	n_threads = g_get_num_processors ();
+#else
+	n_threads = 4;
+#endif
+	n_threads = CLAMP (n_threads, 1, MAX (n_files, 1));
+
+	/* Not worth the thread overhead for a single file. Otherwise, the pool
+	 * can only fail to be created if it is exclusive, which it is not. */
+	if (n_threads > 1) {
+		pool = g_thread_pool_new (load_file_thread_cb, NULL,
+		                          (gint) n_threads, FALSE, NULL);
+	}
+
+	for (i = 0; i < n_files; i++) {
+		if (pool != NULL) {
+			g_thread_pool_push (pool, &load_data[i], NULL);
+		} else {
+			load_file_thread_cb (&load_data[i], NULL);
+		}
+	}
+
+	/* Wait for all the queued loads to finish. */
+	if (pool != NULL) {
+		g_thread_pool_free (pool, FALSE, TRUE);
+	}
+
+	g_free (load_data);
+}
+
+static void
+start_loading (WblSchema *self)
+{
+	WblSchemaPrivate *priv;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	/* Clear the old wrapper node first. */
+	if (priv->schema != NULL) {
+		wbl_schema_node_unref (priv->schema);
+		priv->schema = NULL;
+	}
+
+	/* And its messages. Lazy verdicts go with the node, as apply calls
+	 * running in worker threads may still hold a reference to it. */
+	g_clear_pointer (&priv->messages, g_ptr_array_unref);
+	priv->validated = FALSE;
+
+	/* And clear any left-over generation caches and verdicts, and the
+	 * property names from the old schema. */
+	g_clear_pointer (&priv->schema_instances_cache, g_hash_table_unref);
+	verdict_cache_clear (priv);
+	wbl_string_pool_unref (priv->string_pool);
+	priv->string_pool = wbl_string_pool_new ();
+
+	g_mutex_lock (&priv->regex_cache_lock);
+	g_hash_table_remove_all (priv->regex_cache);
+	g_mutex_unlock (&priv->regex_cache_lock);
+}
+
+static void
+finish_loading_with_mode (WblSchema          *self,
+                          JsonNode           *root,
+                          WblSchemaLoadMode   load_mode,
+                          GError            **error)
+{
+	WblSchemaClass *klass;
+	WblSchemaPrivate *priv;
+	GError *child_error = NULL;
+
+	klass = WBL_SCHEMA_GET_CLASS (self);
+	priv = wbl_schema_get_instance_private (self);
+
+	/* A schema must be a JSON object. draft-zyp-json-schema-04§3.2. */
+	if (root == NULL || !JSON_NODE_HOLDS_OBJECT (root)) {
+		priv->messages = g_ptr_array_new_with_free_func ((GDestroyNotify) wbl_validate_message_free);
+
+		_wbl_validate_message_output (priv->messages,
+		                              WBL_VALIDATE_MESSAGE_ERROR,
+		                              root,
+		                              WBL_SCHEMA_VALIDATION,
+		                              "3.2",
+		                              NULL,
+		                              _("Root node of schema is not an "
+		                                "object."));
+
+		g_set_error_literal (error, WBL_SCHEMA_ERROR,
+		                     WBL_SCHEMA_ERROR_MALFORMED,
+		                     _("JSON Schema is invalid."));
+
+		return;
+	}
+
+	/* Schema. */
+	priv->schema = g_slice_new0 (WblSchemaNode);
+	priv->schema->ref_count = 1;
+	priv->schema->node = json_node_dup_object (root);
+	g_mutex_init (&priv->schema->lazy_verdicts_lock);
+
+	/* Validate the schema, unless that has been deferred until it is
+	 * needed. */
+	switch (load_mode) {
+	case WBL_SCHEMA_LOAD_MODE_VALIDATE:
+		if (klass->validate_schema != NULL) {
+			priv->messages = klass->validate_schema (self,
+			                                         priv->schema,
+			                                         &child_error);
+		}
+
+		priv->validated = TRUE;
+		break;
+	case WBL_SCHEMA_LOAD_MODE_LAZY:
+		priv->schema->lazy_verdicts = g_hash_table_new (g_direct_hash,
+		                                                g_direct_equal);
+		break;
+	case WBL_SCHEMA_LOAD_MODE_TRUSTED:
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	if (child_error != NULL) {
+		/* Clear out state. */
+		g_clear_pointer (&priv->schema, wbl_schema_node_unref);
+		g_clear_pointer (&priv->schema_instances_cache, g_hash_table_unref);
+
+		g_propagate_error (error, child_error);
+	}
+}
+
+static void
+finish_loading (WblSchema *self, JsonNode *root, GError **error)
+{
+	WblSchemaPrivate *priv;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	finish_loading_with_mode (self, root, priv->load_mode, error);
+}
+
+/* Snapshots start with a fixed header. The magic contains a nul byte, so can
+ * never be mistaken for the start of a JSON document. The rest of the snapshot
+ * is a serialised #WblTape holding the root schema object and the names of the
+ * extension keywords it was validated with, in host byte order. */
+#define SNAPSHOT_MAGIC "WBLSNAP"
+#define SNAPSHOT_VERSION 1
+
+typedef enum {
+	SNAPSHOT_FLAGS_NONE = 0,
+	/* The whole schema was validated without errors. */
+	SNAPSHOT_FLAGS_VALIDATED = 1 << 0,
+} SnapshotFlags;
+
+typedef struct {
+	gchar magic[8];
+	guint32 version;
+	guint32 flags;
+} SnapshotHeader;
+
+G_STATIC_ASSERT (sizeof (SnapshotHeader) == 16);
+G_STATIC_ASSERT (sizeof (SNAPSHOT_MAGIC) == 8);
+
+static gboolean
+is_snapshot (const gchar  *data,
+             gsize         length)
+{
+	return (length >= sizeof (SNAPSHOT_MAGIC) &&
+	        memcmp (data, SNAPSHOT_MAGIC, sizeof (SNAPSHOT_MAGIC)) == 0);
+}
+
+/* Parse @data directly, without copying it or wrapping it in a stream.
+ * json_parser_load_from_data() tokenises the buffer in place, and the
+ * resulting #JsonNodes own copies of everything they need, so @data is not
+ * referenced once this returns. */
+static void
+load_from_memory (WblSchema    *self,
+                  const gchar  *data,
+                  gsize         length,
+                  GError      **error)
+{
+	WblSchemaPrivate *priv;
+	GError *child_error = NULL;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	start_loading (self);
+
+	if (length > G_MAXSSIZE) {
+		g_set_error_literal (&child_error, JSON_PARSER_ERROR,
+		                     JSON_PARSER_ERROR_PARSE,
+		                     _("JSON document is too large."));
+		goto done;
+	}
+
+	json_parser_load_from_data (priv->parser, data, (gssize) length,
+	                            &child_error);
+
+	if (child_error != NULL) {
+		goto done;
+	}
+
+	finish_loading (self, json_parser_get_root (priv->parser),
+	                &child_error);
+
+done:
+	if (child_error != NULL) {
+		g_propagate_error (error, child_error);
+	}
+}
+
+/**
+ * wbl_schema_load_from_stream:
+ * @self: a #WblSchema
+ * @stream: stream of serialised JSON data to load
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Load and parse a JSON schema from an input stream providing serialised JSON
+ * data. This is the synchronous version of wbl_schema_load_from_stream_async(),
+ * which is preferred for production code.
+ *
+ * See wbl_schema_load_from_stream_async() for more details.
+ *
+ * Since: 0.1.0
+ */
+void
+wbl_schema_load_from_stream (WblSchema *self,
+                             GInputStream *stream,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+	GError *child_error = NULL;
+
+	WblSchemaPrivate *priv;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (G_IS_INPUT_STREAM (stream));
+	g_return_if_fail (cancellable == NULL ||
+	                  G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	start_loading (self);
+	json_parser_load_from_stream (priv->parser, stream,
+	                              cancellable, &child_error);
+
+	if (child_error != NULL) {
+		goto done;
+	}
+
+	finish_loading (self, json_parser_get_root (priv->parser),
+	                &child_error);
+
+done:
+	if (child_error != NULL) {
+		g_propagate_error (error, child_error);
+	}
+}
+
+static void
+load_from_stream_cb (GObject *source_object,
+                     GAsyncResult *result,
+                     gpointer user_data)
+{
+	WblSchema *self;
+	WblSchemaPrivate *priv;
+	GTask *task = NULL;  /* owned */
+	GError *child_error = NULL;
+
+	self = WBL_SCHEMA (source_object);
+	priv = wbl_schema_get_instance_private (self);
+	task = G_TASK (user_data);
+
+	/* Clear any previous loads. */
+	start_loading (self);
+
+	/* Finish loading from the stream. */
+	json_parser_load_from_stream_finish (priv->parser,
+	                                     result, &child_error);
+
+	if (child_error != NULL) {
+		goto done;
+	}
+
+	/* Finish loading and validate. */
+	finish_loading (self, json_parser_get_root (priv->parser),
+	                &child_error);
+
+done:
+	if (child_error != NULL) {
+		g_task_return_error (task, child_error);
+	} else {
+		g_task_return_boolean (task, TRUE);
+	}
+
+	g_object_unref (task);
+}
+
+/**
+ * wbl_schema_load_from_stream_async:
+ * @self: a #WblSchema
+ * @stream: stream of serialised JSON data to load
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: (scope async) (nullable): callback to invoke when parsing is
+ *   complete, or %NULL
+ * @user_data: (closure callback): user data to pass to @callback
+ *
+ * Load and parse a JSON schema from an input stream providing serialised JSON
+ * data. The loading and parsing is done asynchronously and, once complete,
+ * @callback is invoked in the main context which was thread default at the time
+ * of calling this method.
+ *
+ * Call wbl_schema_load_from_stream_finish() from @callback to retrieve
+ * information about any parsing errors.
+ *
+ * If a schema is loaded successfully, it is guaranteed to be valid, unless
+ * validation was skipped or deferred using wbl_schema_set_load_mode().
+ *
+ * Any previously loaded schemas will be unloaded when starting to load a new
+ * one, even if the new load operation fails (e.g. due to the new schema being
+ * invalid).
+ *
+ * This is the preferred method for loading a schema due to the potential
+ * blocking involved in the I/O.
+ *
+ * Since: 0.1.0
+ */
+void
+wbl_schema_load_from_stream_async (WblSchema *self,
+                                   GInputStream *stream,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data)
+{
+	WblSchemaPrivate *priv;
+	GTask *task = NULL;  /* owned */
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (G_IS_INPUT_STREAM (stream));
+	g_return_if_fail (cancellable == NULL ||
+	                  G_IS_CANCELLABLE (cancellable));
+
+	priv = wbl_schema_get_instance_private (self);
+
+	task = g_task_new (self, cancellable, callback, user_data);
+	json_parser_load_from_stream_async (priv->parser, stream, cancellable,
+	                                    load_from_stream_cb,
+	                                    g_object_ref (task));
+	g_object_unref (task);
+}
+
+/**
+ * wbl_schema_load_from_stream_finish:
+ * @self: a #WblSchema
+ * @result: result from the asynchronous operation
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finish an asynchronous schema loading operation started with
+ * wbl_schema_load_from_stream_async().
+ *
+ * Since: 0.1.0
+ */
+void
+wbl_schema_load_from_stream_finish (WblSchema *self,
+                                    GAsyncResult *result,
+                                    GError **error)
+{
+	GTask *task;  /* unowned */
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (g_task_is_valid (result, self));
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	task = G_TASK (result);
+
+	g_task_propagate_boolean (task, error);
+}
+
+/**
+ * wbl_schema_load_from_json:
+ * @self: a #WblSchema
+ * @root: root node of the parsed JSON data to load
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Load and parse a JSON schema from a pre-parsed JSON tree. To load from a
+ * non-pre-parsed JSON document, use wbl_schema_load_from_stream_async().
+ *
+ * See wbl_schema_load_from_stream_async() for more details.
+ *
+ * Since: 0.3.0
+ */
+void
+wbl_schema_load_from_json (WblSchema     *self,
+                           JsonNode      *root,
+                           GCancellable  *cancellable,
+                           GError       **error)
+{
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (root != NULL);
+	g_return_if_fail (cancellable == NULL ||
+	                  G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	start_loading (self);
+	finish_loading (self, root, error);
+}
+
+/* Whether @keywords, from a snapshot, names exactly the extension keywords
+ * currently added to the schema, in the same order. */
+static gboolean
+snapshot_keywords_match (WblSchema  *self,
+                         JsonNode   *keywords)
+{
+	WblSchemaPrivate *priv;
+	JsonArray *array;  /* unowned */
+	guint i;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	if (!JSON_NODE_HOLDS_ARRAY (keywords)) {
+		return FALSE;
+	}
+
+	array = json_node_get_array (keywords);
+
+	if (json_array_get_length (array) != priv->extension_keywords->len) {
+		return FALSE;
+	}
+
+	for (i = 0; i < priv->extension_keywords->len; i++) {
+		const ExtensionKeywordData *keyword;
+		JsonNode *name;  /* unowned */
+
+		keyword = &g_array_index (priv->extension_keywords,
+		                          ExtensionKeywordData, i);
+		name = json_array_get_element (array, i);
+
+		if (json_node_get_value_type (name) != G_TYPE_STRING ||
+		    !g_str_equal (json_node_get_string (name), keyword->name)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * wbl_schema_dup_snapshot:
+ * @self: a #WblSchema
+ *
+ * Serialise the loaded schema to a snapshot, which can be loaded again using
+ * wbl_schema_load_from_snapshot() without parsing the JSON again. The other
+ * wbl_schema_load_from_*() methods only load JSON, and fail on snapshots.
+ *
+ * If the schema has been validated without errors, the snapshot records that,
+ * so that a caller which trusts the snapshot can skip validating the schema
+ * again when loading it; see wbl_schema_load_from_snapshot(). This makes
+ * loading a trusted snapshot from a memory-mapped file (for example, using
+ * g_mapped_file_get_bytes()) much faster than loading the original JSON.
+ *
+ * Snapshots are only intended to be loaded by the same version of Walbottle on
+ * the same machine which created them: they are stored in host byte order, and
+ * snapshots created by a different version may fail to load with
+ * %G_IO_ERROR_NOT_SUPPORTED.
+ *
+ * Complexity: O(N) in the size of the schema
+ * Returns: (transfer full) (nullable): snapshot of the loaded schema, or %NULL
+ *    if no schema is loaded
+ *
+ * Since: UNRELEASED
+ */
+GBytes *
+wbl_schema_dup_snapshot (WblSchema *self)
+{
+	WblSchemaPrivate *priv;
+	SnapshotHeader header;
+	JsonNode *nodes[2] = { NULL, NULL };  /* owned */
+	JsonArray *keywords = NULL;  /* owned */
+	WblTape *tape = NULL;  /* owned */
+	GBytes *tape_bytes = NULL;  /* owned */
+	GByteArray *snapshot = NULL;  /* owned */
+	gconstpointer tape_data;
+	gsize tape_length;
+	guint i;
+
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	if (priv->schema == NULL) {
+		return NULL;
+	}
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.flags = SNAPSHOT_FLAGS_NONE;
+
+	if (priv->validated) {
+		gboolean has_errors = FALSE;
+
+		for (i = 0; priv->messages != NULL &&
+		            i < priv->messages->len; i++) {
+			if (wbl_validate_message_get_level (priv->messages->pdata[i]) ==
+			    WBL_VALIDATE_MESSAGE_ERROR) {
+				has_errors = TRUE;
+				break;
+			}
+		}
+
+		if (!has_errors) {
+			header.flags |= SNAPSHOT_FLAGS_VALIDATED;
+		}
+	}
+
+	keywords = json_array_sized_new (priv->extension_keywords->len);
+
+	for (i = 0; i < priv->extension_keywords->len; i++) {
+		json_array_add_string_element (keywords,
+		                               g_array_index (priv->extension_keywords,
+		                                              ExtensionKeywordData,
+		                                              i).name);
+	}
+
+	nodes[0] = json_node_alloc ();
+	json_node_init_object (nodes[0], priv->schema->node);
+	nodes[1] = json_node_alloc ();
+	json_node_init_array (nodes[1], keywords);
+	json_array_unref (keywords);
+
+	tape = wbl_tape_new_from_nodes (nodes, G_N_ELEMENTS (nodes));
+	tape_bytes = wbl_tape_serialise (tape);
+	tape_data = g_bytes_get_data (tape_bytes, &tape_length);
+
+	snapshot = g_byte_array_sized_new (sizeof (header) + tape_length);
+	g_byte_array_append (snapshot, (const guint8 *) &header,
+	                     sizeof (header));
+	g_byte_array_append (snapshot, tape_data, tape_length);
+
+	g_bytes_unref (tape_bytes);
+	wbl_tape_unref (tape);
+	json_node_free (nodes[1]);
+	json_node_free (nodes[0]);
+
+	return g_byte_array_free_to_bytes (snapshot);
+}
+
+/**
+ * wbl_schema_load_from_snapshot:
+ * @self: a #WblSchema
+ * @snapshot: a snapshot from wbl_schema_dup_snapshot()
+ * @error: return location for a #GError, or %NULL
+ *
+ * Load a schema from a snapshot created by wbl_schema_dup_snapshot(). The
+ * schema is rebuilt directly from @snapshot, without parsing any JSON, and the
+ * loaded schema does not keep a reference to @snapshot.
+ *
+ * The schema is validated according to the mode set with
+ * wbl_schema_set_load_mode(). A snapshot records whether its schema was
+ * validated without errors, but that record is only as trustworthy as the
+ * snapshot itself, so it is only used if the mode is
+ * %WBL_SCHEMA_LOAD_MODE_TRUSTED. In that mode, the schema is not validated
+ * again if the snapshot records that it was validated without errors, and the
+ * same extension keywords have been added to @self (see
+ * wbl_schema_add_keyword()) as had been added to the snapshotted schema;
+ * otherwise it is validated as with %WBL_SCHEMA_LOAD_MODE_VALIDATE. Only use
+ * %WBL_SCHEMA_LOAD_MODE_TRUSTED for snapshots from a trusted source, such as
+ * those written by the application itself.
+ *
+ * If @snapshot is not a valid snapshot, or is corrupt, %G_IO_ERROR_INVALID_DATA
+ * is returned. If it was created by an incompatible version of Walbottle,
+ * %G_IO_ERROR_NOT_SUPPORTED is returned.
+ *
+ * See wbl_schema_load_from_stream_async() for more details.
+ *
+ * Complexity: O(N) in the size of @snapshot
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_load_from_snapshot (WblSchema  *self,
+                               GBytes     *snapshot,
+                               GError    **error)
+{
+	WblSchemaPrivate *priv;
+	SnapshotHeader header;
+	const guint8 *data;
+	gsize length;
+	GBytes *tape_bytes = NULL;  /* owned */
+	WblTape *tape = NULL;  /* owned */
+	JsonNode *root = NULL, *keywords = NULL;  /* owned */
+	WblSchemaLoadMode load_mode;
+	GError *child_error = NULL;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (snapshot != NULL);
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	start_loading (self);
+
+	data = g_bytes_get_data (snapshot, &length);
+
+	if (length < sizeof (header) ||
+	    !is_snapshot ((const gchar *) data, length)) {
+		g_set_error_literal (&child_error, G_IO_ERROR,
+		                     G_IO_ERROR_INVALID_DATA,
+		                     _("Data is not a schema snapshot."));
+		goto done;
+	}
+
+	memcpy (&header, data, sizeof (header));
+
+	if (header.version == GUINT32_SWAP_LE_BE (SNAPSHOT_VERSION)) {
+		g_set_error_literal (&child_error, G_IO_ERROR,
+		                     G_IO_ERROR_INVALID_DATA,
+		                     _("Schema snapshot was created on a machine "
+		                       "with a different byte order."));
+		goto done;
+	} else if (header.version != SNAPSHOT_VERSION) {
+		g_set_error (&child_error, G_IO_ERROR,
+		             G_IO_ERROR_NOT_SUPPORTED,
+		             _("Schema snapshot version %u is not supported."),
+		             header.version);
+		goto done;
+	}
+
+	/* The header is a multiple of 4 bytes long, so the tape can be used in
+	 * place if the snapshot is aligned (for example, if it is mapped). */
+	tape_bytes = g_bytes_new_from_bytes (snapshot, sizeof (header),
+	                                     length - sizeof (header));
+	tape = wbl_tape_new_from_bytes (tape_bytes, &child_error);
+	g_bytes_unref (tape_bytes);
+
+	if (tape == NULL) {
+		goto done;
+	}
+
+	if (wbl_tape_get_n_values (tape) != 2) {
+		g_set_error_literal (&child_error, G_IO_ERROR,
+		                     G_IO_ERROR_INVALID_DATA,
+		                     _("Schema snapshot is corrupt."));
+		goto done;
+	}
+
+	root = wbl_tape_dup_node (tape, 0);
+	keywords = wbl_tape_dup_node (tape, 1);
+
+	/* Only skip validation if the caller trusts the snapshot, and the
+	 * snapshotted schema was validated with the same keywords as this one
+	 * would be. A trusted snapshot which cannot vouch for its schema is
+	 * validated in full. */
+	load_mode = priv->load_mode;
+
+	if (load_mode == WBL_SCHEMA_LOAD_MODE_TRUSTED &&
+	    (!(header.flags & SNAPSHOT_FLAGS_VALIDATED) ||
+	     !snapshot_keywords_match (self, keywords))) {
+		load_mode = WBL_SCHEMA_LOAD_MODE_VALIDATE;
+	}
+
+	finish_loading_with_mode (self, root, load_mode, &child_error);
+
+done:
+	g_clear_pointer (&keywords, json_node_free);
+	g_clear_pointer (&root, json_node_free);
+	g_clear_pointer (&tape, wbl_tape_unref);
+
+	if (child_error != NULL) {
+		g_propagate_error (error, child_error);
+	}
+}
+
+/**
+ * wbl_schema_get_root:
+ * @self: a #WblSchema
+ *
+ * Get the root schema from the parsed schema document. If no document has been
+ * parsed using wbl_schema_load_from_stream_async() yet, or if the parsed
+ * document was invalid, %NULL is returned.
+ *
+ * The returned object is valid as long as the #WblSchema is alive and has not
+ * started parsing another document.
+ *
+ * Returns: (transfer none) (nullable): a JSON schema root object, or %NULL
+ *
+ * Since: 0.1.0
+ */
+WblSchemaNode *
+wbl_schema_get_root (WblSchema *self)
+{
+	WblSchemaPrivate *priv;
+
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	return priv->schema;
+}
+
+/**
+ * wbl_schema_get_validation_messages:
+ * @self: a #WblSchema
+ *
+ * Get an array of messages from the validation process of the schema document.
+ * These may be informational messages as well as errors. If no document has
+ * been parsed using wbl_schema_load_from_stream_async() yet, or if there were
+ * no messages from the validation process, %NULL is returned.
+ *
+ * The returned messages are valid as long as the #WblSchema is alive and has
+ * not started parsing another document.
+ *
+ * If the schema was loaded without validating it (see
+ * wbl_schema_set_load_mode()), the whole schema is validated the first time
+ * this is called. Unlike loading, this does not fail if the schema is invalid;
+ * the errors are returned as messages.
+ *
+ * Returns: (transfer none) (nullable) (element-type WblValidateMessage): a
+ *    non-empty array of messages, or %NULL
+ *
+ * Since: 0.3.0
+ */
+GPtrArray *
+wbl_schema_get_validation_messages (WblSchema *self)
+{
+	WblSchemaClass *klass;
+	WblSchemaPrivate *priv;
+
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+
+	klass = WBL_SCHEMA_GET_CLASS (self);
+	priv = wbl_schema_get_instance_private (self);
+
+	if (priv->schema != NULL && !priv->validated) {
+		if (klass->validate_schema != NULL) {
+			priv->messages = klass->validate_schema (self,
+			                                         priv->schema,
+			                                         NULL);
+		}
+
+		priv->validated = TRUE;
+	}
+
+	if (priv->messages != NULL && priv->messages->len == 0)
+		return NULL;
+
+	return priv->messages;
+}
+
+/* Apply the schema to @instance without using the verdict cache. */
+static void
+schema_apply (WblSchema  *self,
+              JsonNode   *instance,
+              GError    **error)
+{
+	WblSchemaClass *klass;
+	WblSchemaPrivate *priv;
+	GError *child_error = NULL;
+
+	klass = WBL_SCHEMA_GET_CLASS (self);
+	priv = wbl_schema_get_instance_private (self);
+
+	/* Apply the schema to the instance. */
+	if (klass->apply_schema != NULL) {
+		ApplyStateFrame previous;
+
+		apply_state_enter (priv->schema, priv->memoise_subtrees,
+		                   &previous);
+		klass->apply_schema (self, priv->schema, instance,
+		                     &child_error);
+
+		if (apply_state_take_malformed ()) {
+			g_clear_error (&child_error);
+			g_set_error_literal (&child_error, WBL_SCHEMA_ERROR,
+			                     WBL_SCHEMA_ERROR_MALFORMED,
+			                     _("JSON Schema is invalid."));
+		}
+
+		apply_state_leave (&previous);
+	}
+
+	if (child_error != NULL) {
+		g_propagate_error (error, child_error);
+	}
+}
+
+/**
+ * wbl_schema_apply:
+ * @self: a #WblSchema
+ * @instance: the JSON instance to validate against the schema
+ * @error: return location for a #GError, or %NULL
+ *
+ * Apply a JSON Schema to a JSON instance, validating whether the instance
+ * conforms to the schema. The instance may be any kind of JSON node, and does
+ * not necessarily have to be a JSON object.
+ *
+ * If the verdict cache is enabled (see wbl_schema_set_verdict_cache_size())
+ * and an identical instance has been applied before, its verdict is returned
+ * without applying the schema again.
+ *
+ * Since: 0.1.0
+ */
+void
+wbl_schema_apply (WblSchema *self,
+                  JsonNode *instance,
+                  GError **error)
+{
+	WblSchemaPrivate *priv;
+	VerdictCacheEntry key = { 0, };
+	GError *child_error = NULL;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (instance != NULL);
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	/* A cached verdict would skip the keyword checks which coverage is
+	 * being recorded for. */
+	if (verdict_cache_is_enabled (priv) &&
+	    apply_state_get_coverage () == NULL) {
+		key.hash = wbl_json_node_hash_strict (instance);
+		key.node = instance;
+
+		if (verdict_cache_lookup (priv, &key, &child_error)) {
+			goto done;
+		}
+	}
+
+	schema_apply (self, instance, &child_error);
+
+	if (key.node != NULL) {
+		verdict_cache_insert (priv, &key, child_error);
+	}
+
+done:
+	if (child_error != NULL) {
+		g_propagate_error (error, child_error);
+	}
+}
+
+/* Filter context for apply_data_filter() meaning that the whole of a value must
+ * be decoded. */
+static const gchar apply_data_decode_all = 0;
+#define APPLY_DATA_DECODE_ALL ((gpointer) &apply_data_decode_all)
+
+/* Keywords which, applied to an array or object, look at no more than its
+ * size, its member names, and the values which `properties`,
+ * `additionalProperties`, `items` and `additionalItems` apply subschemas to.
+ * The rest only look at scalars, or are annotations. */
+static const gchar * const apply_data_shallow_keywords[] = {
+	"$schema", "id", "title", "description", "default", "definitions",
+	"type", "format", "multipleOf", "maximum", "exclusiveMaximum",
+	"minimum", "exclusiveMinimum", "maxLength", "minLength", "pattern",
+	"maxProperties", "minProperties", "required", "properties",
+	"additionalProperties", "dependencies", "items", "additionalItems",
+	"maxItems", "minItems", "uniqueItems",
+};
+
+/* Check whether applying @subschema_object to an array or object might look at
+ * any of its values other than those covered by apply_data_filter(). This is
+ * conservative: the schema may not have been validated yet, so anything
+ * unexpected counts.
+ *
+ * Complexity: O(N) in the number of keywords in @subschema_object */
+static gboolean
+apply_data_needs_all (JsonObject *subschema_object)
+{
+	JsonObjectIter iter;
+	const gchar *keyword;
+	JsonNode *value;
+
+	json_object_iter_init (&iter, subschema_object);
+
+	while (json_object_iter_next (&iter, &keyword, &value)) {
+		gsize i;
+
+		for (i = 0; i < G_N_ELEMENTS (apply_data_shallow_keywords); i++) {
+			if (g_str_equal (keyword, apply_data_shallow_keywords[i])) {
+				break;
+			}
+		}
+
+		if (i == G_N_ELEMENTS (apply_data_shallow_keywords)) {
+			return TRUE;
+		}
+
+		/* uniqueItems compares whole elements; and dependencies can
+		 * apply schemas to the whole object. */
+		if ((g_str_equal (keyword, "uniqueItems") &&
+		     (!validate_value_type (value, G_TYPE_BOOLEAN) ||
+		      json_node_get_boolean (value))) ||
+		    (g_str_equal (keyword, "properties") &&
+		     !JSON_NODE_HOLDS_OBJECT (value)) ||
+		    ((g_str_equal (keyword, "additionalProperties") ||
+		      g_str_equal (keyword, "additionalItems")) &&
+		     !JSON_NODE_HOLDS_OBJECT (value) &&
+		     !validate_value_type (value, G_TYPE_BOOLEAN)) ||
+		    (g_str_equal (keyword, "items") &&
+		     !JSON_NODE_HOLDS_OBJECT (value) &&
+		     !JSON_NODE_HOLDS_ARRAY (value))) {
+			return TRUE;
+		}
+
+		if (g_str_equal (keyword, "dependencies")) {
+			JsonObjectIter dependency_iter;
+			JsonNode *dependency;
+
+			if (!JSON_NODE_HOLDS_OBJECT (value)) {
+				return TRUE;
+			}
+
+			json_object_iter_init (&dependency_iter,
+			                       json_node_get_object (value));
+
+			while (json_object_iter_next (&dependency_iter, NULL,
+			                              &dependency)) {
+				if (!JSON_NODE_HOLDS_ARRAY (dependency)) {
+					return TRUE;
+				}
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+/* Get the filter context for a value which @subschema_object is applied to:
+ * %NULL if it is empty, as the empty schema never looks at the value;
+ * %APPLY_DATA_DECODE_ALL if all of the value might be looked at; or the
+ * subschema. Non-empty subschemas are never skipped, so that they are
+ * validated lazily exactly as if the whole instance had been decoded.
+ *
+ * Complexity: O(apply_data_needs_all) */
+static gpointer
+apply_data_get_context (JsonObject *subschema_object)
+{
+	if (json_object_get_size (subschema_object) == 0) {
+		return NULL;
+	} else if (apply_data_needs_all (subschema_object)) {
+		return APPLY_DATA_DECODE_ALL;
+	}
+
+	return subschema_object;
+}
+
+/* #WblJsonIndexFilterFunc for wbl_schema_apply_data(), which skips decoding
+ * the members and elements of the instance which no subschema is applied to.
+ * @context is the subschema applied to the array or object being decoded, as
+ * returned by apply_data_get_context().
+ *
+ * Complexity: O(apply_data_get_context) */
+static gpointer
+apply_data_filter (gpointer      context,
+                   const gchar  *member_name,
+                   guint         element_index,
+                   gpointer      user_data)
+{
+	JsonObject *subschema_object = context;
+	JsonNode *child_node, *additional_node;
+
+	if (context == NULL || context == APPLY_DATA_DECODE_ALL) {
+		return context;
+	}
+
+	if (member_name != NULL) {
+		child_node = json_object_get_member (subschema_object,
+		                                     "properties");
+
+		if (child_node != NULL) {
+			child_node = json_object_get_member (json_node_get_object (child_node),
+			                                     member_name);
+		}
+
+		additional_node = json_object_get_member (subschema_object,
+		                                          "additionalProperties");
+	} else {
+		child_node = json_object_get_member (subschema_object, "items");
+
+		if (child_node != NULL && JSON_NODE_HOLDS_ARRAY (child_node)) {
+			JsonArray *items = json_node_get_array (child_node);
+
+			child_node = (element_index < json_array_get_length (items)) ?
+			             json_array_get_element (items, element_index) :
+			             NULL;
+			additional_node = json_object_get_member (subschema_object,
+			                                          "additionalItems");
+		} else {
+			additional_node = NULL;
+		}
+	}
+
+	if (child_node == NULL && additional_node != NULL &&
+	    JSON_NODE_HOLDS_OBJECT (additional_node)) {
+		child_node = additional_node;
+	}
+
+	if (child_node == NULL) {
+		return NULL;
+	} else if (!JSON_NODE_HOLDS_OBJECT (child_node)) {
+		return APPLY_DATA_DECODE_ALL;
+	}
+
+	return apply_data_get_context (json_node_get_object (child_node));
+}
+
+/**
+ * wbl_schema_apply_data:
+ * @self: a #WblSchema
+ * @data: (array length=length): serialised JSON instance to validate against
+ *    the schema
+ * @length: length of @data in bytes, or -1 if it is nul-terminated
+ * @error: return location for a #GError, or %NULL
+ *
+ * Parse a serialised JSON instance and apply the JSON Schema to it, as
+ * wbl_schema_apply() does for a parsed instance.
+ *
+ * The instance is parsed by first finding the offsets of all its structural
+ * characters, using SIMD instructions where the CPU supports them, and then
+ * walking those offsets. Only the parts of the instance which the schema can
+ * look at are decoded into #JsonNodes: object members and array elements which
+ * no subschema applies to (through `properties`, `additionalProperties`,
+ * `items` or `additionalItems`) are checked for well-formedness and then
+ * skipped, without copying their strings or allocating anything for their
+ * contents. Whole values are decoded where keywords such as `enum`, `allOf`
+ * or `uniqueItems` could compare them, and everything is decoded if the
+ * schema has extension keywords or #WblSchemaClass.apply_schema is
+ * overridden. The verdict is the same as from wbl_schema_apply() on the fully
+ * parsed instance; this is fastest for large instances validated against
+ * schemas which only constrain a few of their members.
+ *
+ * If @data is not well-formed JSON, a #JSON_PARSER_ERROR is set. Unlike
+ * #JsonParser, an empty document is not accepted, and nor are strings
+ * containing `\u0000`, which a #JsonNode cannot hold. Otherwise, a
+ * #WBL_SCHEMA_ERROR may be set as by wbl_schema_apply().
+ *
+ * If the verdict cache is enabled (see wbl_schema_set_verdict_cache_size())
+ * and byte-identical data has been applied before, its verdict is returned
+ * without parsing @data or applying the schema again.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_apply_data (WblSchema    *self,
+                       const gchar  *data,
+                       gssize        length,
+                       GError      **error)
+{
+	WblSchemaClass *klass;
+	WblSchemaPrivate *priv;
+	JsonNode *instance = NULL;  /* owned */
+	VerdictCacheEntry key = { 0, };
+	GError *child_error = NULL;
+
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (data != NULL);
+	g_return_if_fail (length >= -1);
+	g_return_if_fail (error == NULL || *error == NULL);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	if (length < 0) {
+		length = strlen (data);
+	}
+
+	if (verdict_cache_is_enabled (priv)) {
+		key.data = g_bytes_new_static (data, length);
+		key.hash = g_bytes_hash (key.data);
+
+		if (verdict_cache_lookup (priv, &key, &child_error)) {
+			goto done;
+		}
+	}
+
+	/* Only decode what the schema can look at; see
+	 * apply_data_filter(). */
+	klass = WBL_SCHEMA_GET_CLASS (self);
+
+	if (priv->schema != NULL &&
+	    priv->extension_keywords->len == 0 &&
+	    klass->apply_schema == real_apply_schema) {
+		instance = wbl_json_index_parse_filtered (data, length,
+		                                          apply_data_filter,
+		                                          apply_data_get_context (priv->schema->node),
+		                                          NULL, &child_error);
+	} else {
+		instance = wbl_json_index_parse (data, length, &child_error);
+	}
+
+	if (instance != NULL) {
+		schema_apply (self, instance, &child_error);
+		json_node_free (instance);
+	}
+
+	if (key.data != NULL) {
+		verdict_cache_insert (priv, &key, child_error);
+	}
+
+done:
+	g_clear_pointer (&key.data, g_bytes_unref);
+
+	if (child_error != NULL) {
+		g_propagate_error (error, child_error);
+	}
+}
+
+/* Free function for arrays of verdicts, which contain %NULL for valid
+ * instances. */
+static void
+apply_error_free (GError *error)
+{
+	if (error != NULL) {
+		g_error_free (error);
+	}
+}
 
-		/* Add to the cache. */
-		entry = g_slice_new0 (WblSchemaInstanceCacheEntry);
-		entry->n_times_generated = 1;
-		entry->generation_time = end_time - start_time;
-		entry->instances = g_hash_table_ref (instances);
-		entry->schema = json_object_ref (schema->node);
+/**
+ * wbl_schema_apply_batch:
+ * @self: a #WblSchema
+ * @instances: (array length=n_instances): JSON instances to validate against
+ *    the schema
+ * @n_instances: number of elements in @instances
+ *
+ * Apply a JSON Schema to each of several JSON instances, as
+ * wbl_schema_apply() does for a single instance. This is intended for
+ * validating large numbers of similar instances, such as the records in a
+ * newline-delimited JSON stream.
+ *
+ * Rather than applying each instance in turn to all the keywords in the
+ * top-level schema, each keyword is applied in turn to all the instances, so
+ * the schema data for a keyword is only looked up once per batch. The numeric
+ * range, string length and type keywords are checked in tight loops over
+ * values extracted from the instances.
+ *
+ * The verdicts are returned in the same order as the instances were passed
+ * in: element `i` is %NULL if `instances[i]` conforms to the schema, and
+ * otherwise is the #GError which wbl_schema_apply() would have set for it.
+ *
+ * Returns: (transfer full) (element-type GError): a newly allocated array of
+ *    verdicts, one for each instance
+ *
+ * Since: UNRELEASED
+ */
+GPtrArray *
+wbl_schema_apply_batch (WblSchema         *self,
+                        JsonNode * const  *instances,
+                        guint              n_instances)
+{
+	WblSchemaPrivate *priv;
+	GPtrArray/*<owned nullable GError>*/ *verdicts = NULL;  /* owned */
+	guint i;
 
-		g_hash_table_insert (priv->schema_instances_cache,
-		                     json_object_ref (schema->node), entry);
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+	g_return_val_if_fail (n_instances == 0 || instances != NULL, NULL);
+
+	for (i = 0; i < n_instances; i++) {
+		g_return_val_if_fail (instances[i] != NULL, NULL);
 	}
 
-	return instances;
+	priv = wbl_schema_get_instance_private (self);
+
+	verdicts = g_ptr_array_new_full (n_instances,
+	                                 (GDestroyNotify) apply_error_free);
+	g_ptr_array_set_size (verdicts, n_instances);
+
+	schema_apply_batch (self, priv->schema, instances,
+	                    (GError **) verdicts->pdata, n_instances);
+
+	return verdicts;
+}
+
+/* Asynchronous application; see wbl_schema_apply_async(). */
+typedef struct {
+	WblSchemaNode *schema;  /* owned */
+	GPtrArray/*<owned JsonNode>*/ *instances;  /* owned */
+	gboolean is_batch;
+} ApplyData;
+
+static void
+apply_data_free (ApplyData *data)
+{
+	wbl_schema_node_unref (data->schema);
+	g_ptr_array_unref (data->instances);
+	g_slice_free (ApplyData, data);
+}
+
+/* Number of instances to validate between checks for cancellation in
+ * apply_thread_cb(). */
+#define APPLY_BATCH_CHUNK_SIZE 64
+
+/* Run in a worker thread from get_apply_pool(). Takes ownership of the
+ * #GTask passed as @data. Instances are validated column-wise in chunks, so
+ * that cancellation is still checked regularly for large batches. */
+static void
+apply_thread_cb (gpointer  data,
+                 gpointer  user_data)
+{
+	GTask *task = data;  /* owned */
+	WblSchema *self;  /* unowned */
+	ApplyData *apply_data;  /* unowned */
+	GPtrArray/*<owned nullable GError>*/ *verdicts = NULL;  /* owned */
+	guint i, n_instances;
+
+	self = g_task_get_source_object (task);
+	apply_data = g_task_get_task_data (task);
+	n_instances = apply_data->instances->len;
+
+	verdicts = g_ptr_array_new_full (n_instances,
+	                                 (GDestroyNotify) apply_error_free);
+	g_ptr_array_set_size (verdicts, n_instances);
+
+	for (i = 0; i < n_instances; i += APPLY_BATCH_CHUNK_SIZE) {
+		/* Check for cancellation between chunks. */
+		if (g_task_return_error_if_cancelled (task)) {
+			goto done;
+		}
+
+		schema_apply_batch (self, apply_data->schema,
+		                    (JsonNode * const *) apply_data->instances->pdata + i,
+		                    (GError **) verdicts->pdata + i,
+		                    MIN (APPLY_BATCH_CHUNK_SIZE, n_instances - i));
+	}
+
+	if (apply_data->is_batch) {
+		g_task_return_pointer (task, g_ptr_array_ref (verdicts),
+		                       (GDestroyNotify) g_ptr_array_unref);
+	} else if (verdicts->pdata[0] != NULL) {
+		g_task_return_error (task, verdicts->pdata[0]);
+		verdicts->pdata[0] = NULL;  /* transferred */
+	} else {
+		g_task_return_boolean (task, TRUE);
+	}
+
+done:
+	g_ptr_array_unref (verdicts);
+	g_object_unref (task);
+}
+
+/* Get the pool of worker threads shared by all asynchronous apply calls.
+ * It is bounded to one thread per processor, so that validating many large
+ * documents at once does not oversubscribe the machine; further calls are
+ * queued. */
+static GThreadPool *
+get_apply_pool (void)
+{
+	static gsize pool_initialised = 0;
+	static GThreadPool *pool = NULL;
+
+	if (g_once_init_enter (&pool_initialised)) {
+		guint n_threads;
+
+#if GLIB_CHECK_VERSION (2, 36, 0)
+		n_threads = g_get_num_processors ();
+#else
+		n_threads = 4;
+#endif
+
+		/* This can only fail for exclusive pools. */
+		pool = g_thread_pool_new (apply_thread_cb, NULL,
+		                          (gint) MAX (n_threads, 1), FALSE,
+		                          NULL);
+		g_once_init_leave (&pool_initialised, 1);
+	}
+
+	return pool;
+}
+
+static void
+apply_async_internal (WblSchema            *self,
+                      JsonNode * const     *instances,
+                      guint                 n_instances,
+                      gboolean              is_batch,
+                      GCancellable         *cancellable,
+                      GAsyncReadyCallback   callback,
+                      gpointer              user_data,
+                      gpointer              source_tag)
+{
+	WblSchemaPrivate *priv;
+	GTask *task = NULL;  /* owned */
+	ApplyData *data = NULL;  /* owned */
+	guint i;
+
+	priv = wbl_schema_get_instance_private (self);
+
+	task = g_task_new (self, cancellable, callback, user_data);
+	g_task_set_source_tag (task, source_tag);
+
+	if (priv->schema == NULL) {
+		g_task_return_new_error (task, WBL_SCHEMA_ERROR,
+		                         WBL_SCHEMA_ERROR_MALFORMED,
+		                         _("JSON Schema is invalid."));
+		g_object_unref (task);
+		return;
+	}
+
+	/* Keep the schema alive even if @self loads another one before the
+	 * worker gets to this task. */
+	data = g_slice_new0 (ApplyData);
+	data->schema = wbl_schema_node_ref (priv->schema);
+	data->instances = g_ptr_array_new_full (n_instances,
+	                                        (GDestroyNotify) json_node_unref);
+	data->is_batch = is_batch;
+
+	for (i = 0; i < n_instances; i++) {
+		g_ptr_array_add (data->instances, json_node_ref (instances[i]));
+	}
+
+	g_task_set_task_data (task, data, (GDestroyNotify) apply_data_free);
+
+	g_thread_pool_push (get_apply_pool (), task, NULL);  /* transfer */
 }
 
 /**
- * wbl_schema_new:
+ * wbl_schema_apply_async:
+ * @self: a #WblSchema
+ * @instance: the JSON instance to validate against the schema
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: (scope async) (nullable): callback to invoke when validation is
+ *   complete, or %NULL
+ * @user_data: (closure callback): user data to pass to @callback
  *
- * Creates a new #WblSchema with default properties.
+ * Apply a JSON Schema to a JSON instance asynchronously, as
+ * wbl_schema_apply() does. Validation is done in a worker thread from a pool
+ * which is shared between all #WblSchemas and has one thread per processor;
+ * once complete, @callback is invoked in the main context which was thread
+ * default at the time of calling this method.
  *
- * Return value: (transfer full): a new #WblSchema; unref with g_object_unref()
+ * Call wbl_schema_apply_finish() from @callback to retrieve the result.
  *
- * Since: 0.1.0
+ * A reference is taken on @instance, and it must not be modified until
+ * validation is complete. The currently loaded schema is used, even if @self
+ * loads another schema before validation is complete. If no schema is loaded,
+ * the operation fails with %WBL_SCHEMA_ERROR_MALFORMED.
+ *
+ * Since: UNRELEASED
  */
-WblSchema *
-wbl_schema_new (void)
+void
+wbl_schema_apply_async (WblSchema           *self,
+                        JsonNode            *instance,
+                        GCancellable        *cancellable,
+                        GAsyncReadyCallback  callback,
+                        gpointer             user_data)
 {
-	return g_object_new (WBL_TYPE_SCHEMA, NULL);
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+	g_return_if_fail (instance != NULL);
+	g_return_if_fail (cancellable == NULL ||
+	                  G_IS_CANCELLABLE (cancellable));
+
+	apply_async_internal (self, &instance, 1, FALSE, cancellable,
+	                      callback, user_data, wbl_schema_apply_async);
 }
 
 /**
- * wbl_schema_load_from_data:
+ * wbl_schema_apply_finish:
  * @self: a #WblSchema
- * @data: (array length=length): serialised JSON data to load
- * @length: length of @data, or -1 if @data is nul-terminated
+ * @result: result from the asynchronous operation
  * @error: return location for a #GError, or %NULL
  *
- * Load and parse a JSON schema from the given serialised JSON @data.
+ * Finish an asynchronous validation operation started with
+ * wbl_schema_apply_async(). If the instance does not conform to the schema,
+ * @error is set exactly as by wbl_schema_apply(); if the operation was
+ * cancelled, it is set to %G_IO_ERROR_CANCELLED.
  *
- * See wbl_schema_load_from_stream_async() for more details.
- *
- * Since: 0.1.0
+ * Since: UNRELEASED
  */
 void
-wbl_schema_load_from_data (WblSchema *self,
-                           const gchar *data,
-                           gssize length,
-                           GError **error)
+wbl_schema_apply_finish (WblSchema     *self,
+                         GAsyncResult  *result,
+                         GError       **error)
 {
-	GBytes *bytes = NULL;  /* owned */
-	GInputStream *stream = NULL;  /* owned */
-	gsize length_unsigned;
-
 	g_return_if_fail (WBL_IS_SCHEMA (self));
-	g_return_if_fail (data != NULL);
-	g_return_if_fail (length >= -1);
+	g_return_if_fail (g_task_is_valid (result, self));
+	g_return_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+	                  wbl_schema_apply_async);
 	g_return_if_fail (error == NULL || *error == NULL);
 
-	if (length < 0) {
-		length_unsigned = strlen (data);
-	} else {
-		length_unsigned = (gsize) length;
-	}
-
-	bytes = g_bytes_new (data, length_unsigned);
-	stream = g_memory_input_stream_new_from_bytes (bytes);
-	g_bytes_unref (bytes);
-	wbl_schema_load_from_stream (self, stream, NULL, error);
-	g_object_unref (stream);
+	g_task_propagate_boolean (G_TASK (result), error);
 }
 
 /**
- * wbl_schema_load_from_file:
+ * wbl_schema_apply_batch_async:
  * @self: a #WblSchema
- * @filename: (type filename): path to a local JSON file to load
- * @error: return location for a #GError, or %NULL
+ * @instances: (array length=n_instances): JSON instances to validate against
+ *    the schema
+ * @n_instances: number of elements in @instances
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: (scope async) (nullable): callback to invoke when validation is
+ *   complete, or %NULL
+ * @user_data: (closure callback): user data to pass to @callback
  *
- * Load and parse a JSON schema from the given local file containing serialised
- * JSON data. To load a non-local file, or to use a URI, use
- * wbl_schema_load_from_stream_async().
+ * Apply a JSON Schema to each of several JSON instances asynchronously. This
+ * is equivalent to calling wbl_schema_apply_async() for each of them, but
+ * they are validated together in a single task on the worker pool, as by
+ * wbl_schema_apply_batch(), and @callback is only invoked once, when all of
+ * them have been validated. This avoids the overhead of a task and a main
+ * context iteration per instance when validating many small instances.
  *
- * See wbl_schema_load_from_stream_async() for more details.
+ * Call wbl_schema_apply_batch_finish() from @callback to retrieve the
+ * results. See wbl_schema_apply_async() for more details.
  *
- * Since: 0.1.0
+ * Since: UNRELEASED
  */
 void
-wbl_schema_load_from_file (WblSchema *self,
-                           const gchar *filename,
-                           GError **error)
+wbl_schema_apply_batch_async (WblSchema           *self,
+                              JsonNode * const    *instances,
+                              guint                n_instances,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
 {
-	GFile *file = NULL;  /* owned */
-	GFileInputStream *stream = NULL;  /* owned */
-	GError *child_error = NULL;
+	guint i;
 
 	g_return_if_fail (WBL_IS_SCHEMA (self));
-	g_return_if_fail (filename != NULL);
-	g_return_if_fail (error == NULL || *error == NULL);
-
-	file = g_file_new_for_path (filename);
-	stream = g_file_read (file, NULL, &child_error);
-	g_object_unref (file);
+	g_return_if_fail (n_instances == 0 || instances != NULL);
+	g_return_if_fail (cancellable == NULL ||
+	                  G_IS_CANCELLABLE (cancellable));
 
-	if (stream != NULL) {
-		wbl_schema_load_from_stream (self, G_INPUT_STREAM (stream),
-		                             NULL, &child_error);
-		g_object_unref (stream);
+	for (i = 0; i < n_instances; i++) {
+		g_return_if_fail (instances[i] != NULL);
 	}
 
-	if (child_error != NULL) {
-		g_propagate_prefixed_error (error, child_error,
-		                            _("Error loading schema from file "
-		                              "‘%s’: "), filename);
-	}
+	apply_async_internal (self, instances, n_instances, TRUE, cancellable,
+	                      callback, user_data,
+	                      wbl_schema_apply_batch_async);
 }
 
-static void
-start_loading (WblSchema *self)
+/**
+ * wbl_schema_apply_batch_finish:
+ * @self: a #WblSchema
+ * @result: result from the asynchronous operation
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finish an asynchronous batch validation operation started with
+ * wbl_schema_apply_batch_async().
+ *
+ * The verdicts are returned in the same order as the instances were passed
+ * in: element `i` is %NULL if `instances[i]` conforms to the schema, and
+ * otherwise is the #GError which wbl_schema_apply() would have set for it.
+ * @error is only set if the whole operation failed, for example because it
+ * was cancelled or no schema was loaded.
+ *
+ * Returns: (transfer full) (element-type GError) (nullable): a newly
+ *    allocated array of verdicts, one for each instance, or %NULL on error
+ *
+ * Since: UNRELEASED
+ */
+GPtrArray *
+wbl_schema_apply_batch_finish (WblSchema     *self,
+                               GAsyncResult  *result,
+                               GError       **error)
 {
-	WblSchemaPrivate *priv;
-
-	priv = wbl_schema_get_instance_private (self);
-
-	/* Clear the old wrapper node first. */
-	if (priv->schema != NULL) {
-		wbl_schema_node_unref (priv->schema);
-		priv->schema = NULL;
-	}
-
-	/* And its messages. */
-	g_clear_pointer (&priv->messages, g_ptr_array_unref);
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+	g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+	g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+	                      wbl_schema_apply_batch_async, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
-	/* And clear any left-over generation caches. */
-	g_clear_pointer (&priv->schema_instances_cache, g_hash_table_unref);
+	return g_task_propagate_pointer (G_TASK (result), error);
 }
 
+/* If a spill threshold is set, store the instances in each entry in the
+ * instance cache in a #WblTape, and free their #JsonNodes, so the cache only
+ * holds tapes between calls to wbl_schema_generate_instances(). Otherwise,
+ * leave the cache as it is: compacting it costs a pass over every cached
+ * instance, which one-shot callers would get nothing back for.
+ *
+ * Complexity: O(N) in the total size of the cached instances */
 static void
-finish_loading (WblSchema *self, JsonNode *root, GError **error)
+instance_cache_compact (WblSchema *self)
 {
-	WblSchemaClass *klass;
 	WblSchemaPrivate *priv;
-	GError *child_error = NULL;
+	GHashTableIter iter;
+	gpointer value;
+	gsize n_bytes = 0;
 
-	klass = WBL_SCHEMA_GET_CLASS (self);
 	priv = wbl_schema_get_instance_private (self);
 
-	/* A schema must be a JSON object. draft-zyp-json-schema-04§3.2. */
-	if (root == NULL || !JSON_NODE_HOLDS_OBJECT (root)) {
-		priv->messages = g_ptr_array_new_with_free_func ((GDestroyNotify) wbl_validate_message_free);
-
-		_wbl_validate_message_output (priv->messages,
-		                              WBL_VALIDATE_MESSAGE_ERROR,
-		                              root,
-		                              WBL_SCHEMA_VALIDATION,
-		                              "3.2",
-		                              NULL,
-		                              _("Root node of schema is not an "
-		                                "object."));
-
-		g_set_error_literal (error, WBL_SCHEMA_ERROR,
-		                     WBL_SCHEMA_ERROR_MALFORMED,
-		                     _("JSON Schema is invalid."));
-
+	if (priv->schema_instances_cache == NULL ||
+	    priv->spill_threshold == 0) {
 		return;
 	}
 
-	/* Schema. */
-	priv->schema = g_slice_new0 (WblSchemaNode);
-	priv->schema->ref_count = 1;
-	priv->schema->node = json_node_dup_object (root);
+	g_hash_table_iter_init (&iter, priv->schema_instances_cache);
 
-	/* Validate the schema. */
-	if (klass->validate_schema != NULL) {
-		priv->messages = klass->validate_schema (self, priv->schema,
-		                                         &child_error);
-	}
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		WblSchemaInstanceCacheEntry *entry = value;
 
-	if (child_error != NULL) {
-		/* Clear out state. */
-		g_clear_pointer (&priv->schema, wbl_schema_node_unref);
-		g_clear_pointer (&priv->schema_instances_cache, g_hash_table_unref);
+		if (entry->tape == NULL) {
+			instance_cache_entry_build_tape (entry);
+		}
 
-		g_propagate_error (error, child_error);
+		instance_cache_entry_spill (self, entry);
+		g_clear_pointer (&entry->instances, g_hash_table_unref);
+		n_bytes += wbl_tape_get_n_bytes (entry->tape);
 	}
+
+	g_debug ("%s: Compacted %u cache entries into %" G_GSIZE_FORMAT
+	         " bytes", G_STRFUNC,
+	         g_hash_table_size (priv->schema_instances_cache), n_bytes);
 }
 
 /**
- * wbl_schema_load_from_stream:
+ * wbl_schema_set_generation_limits:
  * @self: a #WblSchema
- * @stream: stream of serialised JSON data to load
- * @cancellable: (nullable): a #GCancellable, or %NULL
- * @error: return location for a #GError, or %NULL
- *
- * Load and parse a JSON schema from an input stream providing serialised JSON
- * data. This is the synchronous version of wbl_schema_load_from_stream_async(),
- * which is preferred for production code.
- *
- * See wbl_schema_load_from_stream_async() for more details.
- *
- * Since: 0.1.0
+ * @max_depth: maximum nesting depth of arrays and objects in each generated
+ *    instance, or 0 for no limit
+ * @max_instance_size: maximum serialised size of each generated instance, in
+ *    bytes, or 0 for no limit
+ * @max_total_size: maximum total serialised size of the generated instances,
+ *    in bytes, or 0 for no limit
+ *
+ * Set limits on the instances generated by wbl_schema_generate_instances() and
+ * wbl_schema_generate_instances_sharded(). Nested array and object schemas can
+ * produce very large numbers of very large instances, and these limits keep
+ * the time and memory needed to generate them bounded.
+ *
+ * The nesting depth of a scalar instance is 0; of an array or object of
+ * scalars is 1; and so on. Sizes are of the compact serialisation of each
+ * instance, as returned by wbl_generated_instance_get_json().
+ *
+ * The limits are enforced as each subschema is generated, rather than by
+ * filtering the final instances: instances of a subschema which are too deep
+ * or too big are dropped before they are used to build the instances of its
+ * parent, and the instances of each subschema are limited to @max_total_size
+ * in total. Arrays and objects are not generated at all below the maximum
+ * depth, and array and object instances which are too big are dropped as
+ * their items and properties are combined, so building them stops once
+ * @max_total_size is reached. Where the instances of a subschema exceed
+ * @max_total_size, the smallest are kept, so the same instances are
+ * generated on every run. Some instances which test boundary conditions may
+ * therefore not be generated.
+ *
+ * Changing the limits invalidates any cached instances.
+ *
+ * Since: UNRELEASED
  */
 void
-wbl_schema_load_from_stream (WblSchema *self,
-                             GInputStream *stream,
-                             GCancellable *cancellable,
-                             GError **error)
+wbl_schema_set_generation_limits (WblSchema *self,
+                                  guint      max_depth,
+                                  gsize      max_instance_size,
+                                  gsize      max_total_size)
 {
-	GError *child_error = NULL;
-
 	WblSchemaPrivate *priv;
 
 	g_return_if_fail (WBL_IS_SCHEMA (self));
-	g_return_if_fail (G_IS_INPUT_STREAM (stream));
-	g_return_if_fail (cancellable == NULL ||
-	                  G_IS_CANCELLABLE (cancellable));
-	g_return_if_fail (error == NULL || *error == NULL);
 
 	priv = wbl_schema_get_instance_private (self);
 
-	start_loading (self);
-	json_parser_load_from_stream (priv->parser, stream,
-	                              cancellable, &child_error);
-
-	if (child_error != NULL) {
-		goto done;
+	if (priv->max_depth == max_depth &&
+	    priv->max_instance_size == max_instance_size &&
+	    priv->max_total_size == max_total_size) {
+		return;
 	}
 
-	finish_loading (self, json_parser_get_root (priv->parser),
-	                &child_error);
+	priv->max_depth = max_depth;
+	priv->max_instance_size = max_instance_size;
+	priv->max_total_size = max_total_size;
 
-done:
-	if (child_error != NULL) {
-		g_propagate_error (error, child_error);
-	}
+	g_clear_pointer (&priv->schema_instances_cache, g_hash_table_unref);
 }
 
-static void
-load_from_stream_cb (GObject *source_object,
-                     GAsyncResult *result,
-                     gpointer user_data)
+/**
+ * wbl_schema_get_generation_limits:
+ * @self: a #WblSchema
+ * @max_depth: (out) (optional): return location for the maximum nesting depth,
+ *    or %NULL
+ * @max_instance_size: (out) (optional): return location for the maximum size of
+ *    each instance, or %NULL
+ * @max_total_size: (out) (optional): return location for the maximum total
+ *    size of the instances, or %NULL
+ *
+ * Get the limits set with wbl_schema_set_generation_limits(). Each is 0 if
+ * there is no limit.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_get_generation_limits (WblSchema *self,
+                                  guint     *max_depth,
+                                  gsize     *max_instance_size,
+                                  gsize     *max_total_size)
 {
-	WblSchema *self;
 	WblSchemaPrivate *priv;
-	GTask *task = NULL;  /* owned */
-	GError *child_error = NULL;
 
-	self = WBL_SCHEMA (source_object);
+	g_return_if_fail (WBL_IS_SCHEMA (self));
+
 	priv = wbl_schema_get_instance_private (self);
-	task = G_TASK (user_data);
 
-	/* Clear any previous loads. */
-	start_loading (self);
+	if (max_depth != NULL) {
+		*max_depth = priv->max_depth;
+	}
 
-	/* Finish loading from the stream. */
-	json_parser_load_from_stream_finish (priv->parser,
-	                                     result, &child_error);
+	if (max_instance_size != NULL) {
+		*max_instance_size = priv->max_instance_size;
+	}
 
-	if (child_error != NULL) {
-		goto done;
+	if (max_total_size != NULL) {
+		*max_total_size = priv->max_total_size;
 	}
+}
 
-	/* Finish loading and validate. */
-	finish_loading (self, json_parser_get_root (priv->parser),
-	                &child_error);
+/**
+ * wbl_schema_set_spill_threshold:
+ * @self: a #WblSchema
+ * @n_bytes: minimum size of an instance set to spill to a file, in bytes, or 0
+ *    to never spill
+ *
+ * Set the threshold for storing intermediate instance sets in temporary
+ * files while generating instances, rather than in memory.
+ *
+ * The instances generated for each subschema are cached, as they are used to
+ * build the instances for its parents. For large schemas, the cache can
+ * become bigger than the available memory. With a spill threshold set, the
+ * instances for each subschema are stored in a compact form as soon as they
+ * have been generated, and any set which takes at least @n_bytes is moved out
+ * to a temporary file in g_get_tmp_dir() (which can be set using the `TMPDIR`
+ * environment variable). The file is mapped back into memory, so the kernel
+ * can page it out while it is not in use.
+ *
+ * Only the finished sets in the cache are spilled. Each time a spilled set is
+ * used to build the instances of a parent, it is expanded back into memory in
+ * full, and the combinations built from it are held in memory too. So this
+ * bounds the memory held by the cache between uses, but not the peak memory
+ * used while generating the instances of any one subschema; use
+ * wbl_schema_set_generation_limits() to bound that.
+ *
+ * Between generate calls, the cache then holds only the compact form of each
+ * set. Without a spill threshold, nothing is compacted, and the cache holds
+ * every set in full.
+ *
+ * This makes generation slower, but does not change the generated instances,
+ * or the order they are returned in. If a set cannot be written to a file, it
+ * is kept in memory.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_set_spill_threshold (WblSchema *self,
+                                gsize      n_bytes)
+{
+	WblSchemaPrivate *priv;
 
-done:
-	if (child_error != NULL) {
-		g_task_return_error (task, child_error);
-	} else {
-		g_task_return_boolean (task, TRUE);
-	}
+	g_return_if_fail (WBL_IS_SCHEMA (self));
 
-	g_object_unref (task);
+	priv = wbl_schema_get_instance_private (self);
+	priv->spill_threshold = n_bytes;
 }
 
 /**
- * wbl_schema_load_from_stream_async:
+ * wbl_schema_get_spill_threshold:
  * @self: a #WblSchema
- * @stream: stream of serialised JSON data to load
- * @cancellable: (nullable): a #GCancellable, or %NULL
- * @callback: (scope async) (nullable): callback to invoke when parsing is
- *   complete, or %NULL
- * @user_data: (closure callback): user data to pass to @callback
- *
- * Load and parse a JSON schema from an input stream providing serialised JSON
- * data. The loading and parsing is done asynchronously and, once complete,
- * @callback is invoked in the main context which was thread default at the time
- * of calling this method.
  *
- * Call wbl_schema_load_from_stream_finish() from @callback to retrieve
- * information about any parsing errors.
+ * Get the threshold set with wbl_schema_set_spill_threshold().
  *
- * If a schema is loaded successfully, it is guaranteed to be valid.
+ * Returns: minimum size of an instance set to spill to a file, in bytes, or 0
+ *    if instance sets are never spilled
+ * Since: UNRELEASED
+ */
+gsize
+wbl_schema_get_spill_threshold (WblSchema *self)
+{
+	WblSchemaPrivate *priv;
+
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), 0);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	return priv->spill_threshold;
+}
+
+/**
+ * wbl_schema_set_check_formats:
+ * @self: a #WblSchema
+ * @check_formats: %TRUE to check the `format` keyword, %FALSE to ignore it
  *
- * Any previously loaded schemas will be unloaded when starting to load a new
- * one, even if the new load operation fails (e.g. due to the new schema being
- * invalid).
+ * Set whether to check instances against the `format` keyword when applying
+ * the schema, and generate instances for it. This is disabled by default, as
+ * allowed by draft-fge-json-schema-validation-00§7.2.
  *
- * This is the preferred method for loading a schema due to the potential
- * blocking involved in the I/O.
+ * The formats defined in draft-fge-json-schema-validation-00§7.3 are
+ * supported: `date-time`, `email`, `hostname`, `ipv4`, `ipv6` and `uri`.
+ * Strings are always valid for any other format. The formats are checked
+ * directly, rather than with regular expressions, so using `format` is
+ * faster and more exact than using `pattern` for them.
  *
- * Since: 0.1.0
+ * Since: UNRELEASED
  */
 void
-wbl_schema_load_from_stream_async (WblSchema *self,
-                                   GInputStream *stream,
-                                   GCancellable *cancellable,
-                                   GAsyncReadyCallback callback,
-                                   gpointer user_data)
+wbl_schema_set_check_formats (WblSchema *self,
+                              gboolean   check_formats)
 {
 	WblSchemaPrivate *priv;
-	GTask *task = NULL;  /* owned */
 
 	g_return_if_fail (WBL_IS_SCHEMA (self));
-	g_return_if_fail (G_IS_INPUT_STREAM (stream));
-	g_return_if_fail (cancellable == NULL ||
-	                  G_IS_CANCELLABLE (cancellable));
 
 	priv = wbl_schema_get_instance_private (self);
+	check_formats = !!check_formats;
 
-	task = g_task_new (self, cancellable, callback, user_data);
-	json_parser_load_from_stream_async (priv->parser, stream, cancellable,
-	                                    load_from_stream_cb,
-	                                    g_object_ref (task));
-	g_object_unref (task);
+	if (priv->check_formats != check_formats) {
+		priv->check_formats = check_formats;
+		g_clear_pointer (&priv->schema_instances_cache,
+		                 g_hash_table_unref);
+		verdict_cache_clear (priv);
+	}
 }
 
 /**
- * wbl_schema_load_from_stream_finish:
+ * wbl_schema_get_check_formats:
  * @self: a #WblSchema
- * @result: result from the asynchronous operation
- * @error: return location for a #GError, or %NULL
  *
- * Finish an asynchronous schema loading operation started with
- * wbl_schema_load_from_stream_async().
+ * Get whether the `format` keyword is checked. See
+ * wbl_schema_set_check_formats().
  *
- * Since: 0.1.0
+ * Returns: %TRUE if the `format` keyword is checked, %FALSE otherwise
+ * Since: UNRELEASED
+ */
+gboolean
+wbl_schema_get_check_formats (WblSchema *self)
+{
+	WblSchemaPrivate *priv;
+
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), FALSE);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	return priv->check_formats;
+}
+
+/**
+ * wbl_schema_set_verdict_cache_size:
+ * @self: a #WblSchema
+ * @n_verdicts: maximum number of verdicts to cache, or 0 to disable the cache
+ *
+ * Set the maximum number of verdicts to cache from wbl_schema_apply() and
+ * wbl_schema_apply_data(). This is useful when many identical documents are
+ * validated, such as retried requests or fixed configuration blobs: applying
+ * the schema to an instance which is identical to one already in the cache
+ * returns the same verdict (and the same error) as before, without applying the
+ * schema again.
+ *
+ * Verdicts from wbl_schema_apply_data() are keyed by the serialised data, so
+ * only byte-identical documents match, but they do not need parsing again.
+ * Verdicts from wbl_schema_apply() are keyed by the #JsonNode tree, so only
+ * trees with the same values, value types and member order match. Either way,
+ * each key is compared in full against the cached instance, so the cost of a
+ * hit is proportional to the size of the instance, but much less than
+ * validating it. Verdicts from the other apply methods are not cached.
+ *
+ * This cache is separate from memoising verdicts for repeated subtrees within
+ * an instance; see wbl_schema_set_memoise_subtrees().
+ *
+ * The cache is cleared when a new schema is loaded, and when anything which
+ * affects verdicts is changed, such as with wbl_schema_add_keyword(). If the
+ * cache is full, the least recently used verdict is evicted. The cache is
+ * disabled by default; disabling it frees it.
+ *
+ * The cache must not be enabled for #WblSchema subclasses, or with extension
+ * keywords, whose verdicts depend on anything other than the instance.
+ *
+ * Since: UNRELEASED
  */
 void
-wbl_schema_load_from_stream_finish (WblSchema *self,
-                                    GAsyncResult *result,
-                                    GError **error)
+wbl_schema_set_verdict_cache_size (WblSchema *self,
+                                   guint      n_verdicts)
 {
-	GTask *task;  /* unowned */
+	WblSchemaPrivate *priv;
 
 	g_return_if_fail (WBL_IS_SCHEMA (self));
-	g_return_if_fail (g_task_is_valid (result, self));
-	g_return_if_fail (error == NULL || *error == NULL);
 
-	task = G_TASK (result);
+	priv = wbl_schema_get_instance_private (self);
 
-	g_task_propagate_boolean (task, error);
+	g_mutex_lock (&priv->verdict_cache_lock);
+
+	priv->verdict_cache_size = n_verdicts;
+
+	if (n_verdicts == 0) {
+		g_queue_init (&priv->verdict_cache_lru);
+		g_clear_pointer (&priv->verdict_cache, g_hash_table_unref);
+	} else if (priv->verdict_cache == NULL) {
+		priv->verdict_cache = g_hash_table_new_full (verdict_cache_entry_hash,
+		                                             verdict_cache_entry_equal,
+		                                             (GDestroyNotify) verdict_cache_entry_free,
+		                                             NULL);
+	} else {
+		verdict_cache_trim (priv);
+	}
+
+	g_mutex_unlock (&priv->verdict_cache_lock);
 }
 
 /**
- * wbl_schema_load_from_json:
+ * wbl_schema_get_verdict_cache_size:
  * @self: a #WblSchema
- * @root: root node of the parsed JSON data to load
- * @cancellable: (nullable): a #GCancellable, or %NULL
- * @error: return location for a #GError, or %NULL
- *
- * Load and parse a JSON schema from a pre-parsed JSON tree. To load from a
- * non-pre-parsed JSON document, use wbl_schema_load_from_stream_async().
  *
- * See wbl_schema_load_from_stream_async() for more details.
+ * Get the maximum number of verdicts to cache, set with
+ * wbl_schema_set_verdict_cache_size().
  *
- * Since: 0.3.0
+ * Returns: maximum number of verdicts to cache, or 0 if the cache is disabled
+ * Since: UNRELEASED
  */
-void
-wbl_schema_load_from_json (WblSchema     *self,
-                           JsonNode      *root,
-                           GCancellable  *cancellable,
-                           GError       **error)
+guint
+wbl_schema_get_verdict_cache_size (WblSchema *self)
 {
-	g_return_if_fail (WBL_IS_SCHEMA (self));
-	g_return_if_fail (root != NULL);
-	g_return_if_fail (cancellable == NULL ||
-	                  G_IS_CANCELLABLE (cancellable));
-	g_return_if_fail (error == NULL || *error == NULL);
+	WblSchemaPrivate *priv;
+	guint n_verdicts;
 
-	start_loading (self);
-	finish_loading (self, root, error);
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), 0);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	g_mutex_lock (&priv->verdict_cache_lock);
+	n_verdicts = priv->verdict_cache_size;
+	g_mutex_unlock (&priv->verdict_cache_lock);
+
+	return n_verdicts;
 }
 
 /**
- * wbl_schema_get_root:
+ * wbl_schema_set_memoise_subtrees:
  * @self: a #WblSchema
+ * @memoise_subtrees: %TRUE to memoise subtree verdicts, %FALSE otherwise
  *
- * Get the root schema from the parsed schema document. If no document has been
- * parsed using wbl_schema_load_from_stream_async() yet, or if the parsed
- * document was invalid, %NULL is returned.
+ * Set whether each apply call remembers the verdicts of subschemas applied to
+ * the array and object subtrees of the instance, so that identical subtrees,
+ * such as repeated items of an array, are only validated once per call. This
+ * applies to all the apply methods; for wbl_schema_apply_batch() and
+ * wbl_schema_apply_batch_async(), verdicts are also shared between the
+ * instances in the batch.
  *
- * The returned object is valid as long as the #WblSchema is alive and has not
- * started parsing another document.
+ * Memoising costs a hash of each array and object subtree, plus an allocation
+ * and a copy of the verdict for each subschema applied to one, so it only pays
+ * off if instances repeat subtrees. It is disabled by default. It does not
+ * change any verdicts, and is independent of the verdict cache for whole
+ * instances (see wbl_schema_set_verdict_cache_size()).
  *
- * Returns: (transfer none) (nullable): a JSON schema root object, or %NULL
+ * Memoising must not be enabled for #WblSchema subclasses, or with extension
+ * keywords, whose verdicts depend on anything other than the subtree.
  *
- * Since: 0.1.0
+ * Since: UNRELEASED
  */
-WblSchemaNode *
-wbl_schema_get_root (WblSchema *self)
+void
+wbl_schema_set_memoise_subtrees (WblSchema *self,
+                                 gboolean   memoise_subtrees)
 {
 	WblSchemaPrivate *priv;
 
-	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+	g_return_if_fail (WBL_IS_SCHEMA (self));
 
 	priv = wbl_schema_get_instance_private (self);
 
-	return priv->schema;
+	priv->memoise_subtrees = !!memoise_subtrees;
 }
 
 /**
- * wbl_schema_get_validation_messages:
+ * wbl_schema_get_memoise_subtrees:
  * @self: a #WblSchema
  *
- * Get an array of messages from the validation process of the schema document.
- * These may be informational messages as well as errors. If no document has
- * been parsed using wbl_schema_load_from_stream_async() yet, or if there were
- * no messages from the validation process, %NULL is returned.
- *
- * The returned messages are valid as long as the #WblSchema is alive and has
- * not started parsing another document.
- *
- * Returns: (transfer none) (nullable) (element-type WblValidateMessage): a
- *    non-empty array of messages, or %NULL
+ * Get whether subtree verdicts are memoised. See
+ * wbl_schema_set_memoise_subtrees().
  *
- * Since: 0.3.0
+ * Returns: %TRUE if subtree verdicts are memoised, %FALSE otherwise
+ * Since: UNRELEASED
  */
-GPtrArray *
-wbl_schema_get_validation_messages (WblSchema *self)
+gboolean
+wbl_schema_get_memoise_subtrees (WblSchema *self)
 {
 	WblSchemaPrivate *priv;
 
-	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), FALSE);
 
 	priv = wbl_schema_get_instance_private (self);
 
-	if (priv->messages != NULL && priv->messages->len == 0)
-		return NULL;
-
-	return priv->messages;
+	return priv->memoise_subtrees;
 }
 
 /**
- * wbl_schema_apply:
+ * wbl_schema_generate_instances:
  * @self: a #WblSchema
- * @instance: the JSON instance to validate against the schema
- * @error: return location for a #GError, or %NULL
+ * @flags: flags affecting how instances are generated
  *
- * Apply a JSON Schema to a JSON instance, validating whether the instance
- * conforms to the schema. The instance may be any kind of JSON node, and does
- * not necessarily have to be a JSON object.
+ * Generate JSON instances for the given JSON Schema. These instances are
+ * designed to be used as test vectors for code which parses and handles JSON
+ * following this schema. By default, instances which are both valid and invalid
+ * are generated, with the invalid schemas designed to test boundary conditions
+ * of validity, and common parsing problems.
+ *
+ * All generated instances are correctly formed JSON, and all will parse
+ * successfully. By design, however, some of the instances will not validate
+ * according to the given #WblSchema.
+ *
+ * This is equivalent to calling wbl_schema_generate_instances_sharded() with
+ * a single shard.
+ *
+ * Returns: (transfer container) (element-type WblGeneratedInstance): newly
+ *   allocated array of #WblGeneratedInstances
  *
  * Since: 0.1.0
  */
-void
-wbl_schema_apply (WblSchema *self,
-                  JsonNode *instance,
-                  GError **error)
+GPtrArray *
+wbl_schema_generate_instances (WblSchema *self,
+                               WblGenerateInstanceFlags flags)
 {
-	WblSchemaClass *klass;
-	WblSchemaPrivate *priv;
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+
+	return wbl_schema_generate_instances_sharded (self, flags, 0, 1);
+}
+
+/* Apply @self to @instance as wbl_schema_apply() does, adding the keyword
+ * checks made to @coverage.
+ *
+ * Complexity: O(wbl_schema_apply) */
+static void
+apply_with_coverage (WblSchema         *self,
+                     JsonNode          *instance,
+                     CoverageRecorder  *coverage,
+                     GError           **error)
+{
+	ApplyState *state;  /* unowned */
+	ApplyStateFrame previous;
+
+	apply_state_enter (NULL, FALSE, &previous);
+
+	state = g_private_get (&apply_state_private);
+	state->coverage = coverage;
+	wbl_schema_apply (self, instance, error);
+	state->coverage = NULL;
+
+	apply_state_leave (&previous);
+}
+
+static gint
+compare_uints (gconstpointer a,
+               gconstpointer b)
+{
+	guint uint_a = *((const guint *) a), uint_b = *((const guint *) b);
+
+	return (uint_a < uint_b) ? -1 : (uint_a > uint_b) ? 1 : 0;
+}
+
+/* Whether an instance with the given validity is output with @flags.
+ *
+ * Complexity: O(1) */
+static gboolean
+generate_flags_keep_instance (WblGenerateInstanceFlags  flags,
+                              gboolean                  valid)
+{
+	return ((!(flags & WBL_GENERATE_INSTANCE_IGNORE_VALID) || !valid) &&
+	        (!(flags & WBL_GENERATE_INSTANCE_IGNORE_INVALID) || valid));
+}
+
+/**
+ * minimise_instance_nodes:
+ * @self: a #WblSchema
+ * @nodes: (element-type JsonNode): candidate instances
+ * @flags: flags from the generate call, used to filter out valid or invalid
+ *    candidates before minimising
+ * @verdicts: (out) (element-type gboolean): return location for whether each
+ *    of the returned instances is valid
+ *
+ * Choose a subset of the candidates in @nodes which, between them, make every
+ * keyword check in @self with every outcome (pass or fail) that all the
+ * candidates do, and which includes valid and invalid instances if the
+ * candidates do. Candidates which %WBL_GENERATE_INSTANCE_IGNORE_VALID or
+ * %WBL_GENERATE_INSTANCE_IGNORE_INVALID in @flags would drop are not
+ * candidates, and the checks only they make do not need to be made. Keyword
+ * checks are distinguished by the subschema they are in, so a keyword in two
+ * subschemas is two checks.
+ *
+ * Each instance is applied once, recording both the checks it makes and its
+ * verdict, which is returned in @verdicts so the caller does not need to
+ * apply the kept instances again.
+ *
+ * Finding the smallest such subset is the set cover problem, which is NP-hard,
+ * so this uses the greedy approximation: repeatedly keep the instance which
+ * makes the most checks not made by the instances kept so far, preferring
+ * earlier instances in @nodes on ties. The result has at most H(K) ≈ ln K
+ * times as many instances as the smallest subset, where K is the most checks
+ * made by any one instance.
+ *
+ * Complexity: O(N * (wbl_schema_apply + C log C) + N * C * M) in the number N
+ *    of @nodes, the number C of checks made by each instance, and the number M
+ *    of instances kept
+ * Returns: (transfer container) (element-type JsonNode): subset of @nodes, in
+ *    the same order
+ * Since: UNRELEASED
+ */
+static GPtrArray/*<unowned JsonNode>*/ *
+minimise_instance_nodes (WblSchema                        *self,
+                         GPtrArray/*<unowned JsonNode>*/  *nodes,
+                         WblGenerateInstanceFlags          flags,
+                         GArray/*<gboolean>*/            **verdicts)
+{
+	GPtrArray/*<unowned JsonNode>*/ *output = NULL;
+	CoverageRecorder coverage;
+	GArray/*<guint>*/ **instance_points = NULL;  /* owned */
+	gboolean *valid = NULL;  /* owned */
+	gboolean *covered = NULL, *kept = NULL;  /* owned */
+	guint i, j, n_points, n_covered;
+
+	coverage.point_indices = g_hash_table_new_full (coverage_point_hash,
+	                                                coverage_point_equal,
+	                                                g_free, NULL);
+	instance_points = g_new0 (GArray *, nodes->len);
+	valid = g_new0 (gboolean, nodes->len);
+
+	/* Record the set of checks made by each candidate, and its verdict,
+	 * from a single apply. Instances which are filtered out are left
+	 * with no set of checks. */
+	for (i = 0; i < nodes->len; i++) {
+		GError *error = NULL;
+		guint *points, n_unique;
+
+		coverage.points = g_array_new (FALSE, FALSE, sizeof (guint));
+
+		apply_with_coverage (self, nodes->pdata[i], &coverage, &error);
+		valid[i] = (error == NULL);
+		g_clear_error (&error);
+
+		if (!generate_flags_keep_instance (flags, valid[i])) {
+			g_array_unref (coverage.points);
+			continue;
+		}
+
+		coverage_recorder_add (&coverage, NULL, NULL, valid[i]);
+
+		/* Remove duplicates. */
+		g_array_sort (coverage.points, compare_uints);
+		points = (guint *) coverage.points->data;
+
+		for (j = 0, n_unique = 0; j < coverage.points->len; j++) {
+			if (n_unique == 0 || points[j] != points[n_unique - 1]) {
+				points[n_unique++] = points[j];
+			}
+		}
+
+		g_array_set_size (coverage.points, n_unique);
+		instance_points[i] = coverage.points;  /* transfer */
+	}
+
+	/* Only the checks made by candidates need covering; mark the others
+	 * as covered already. */
+	covered = g_new (gboolean, g_hash_table_size (coverage.point_indices));
+
+	for (j = 0; j < g_hash_table_size (coverage.point_indices); j++) {
+		covered[j] = TRUE;
+	}
+
+	for (i = 0, n_points = 0; i < nodes->len; i++) {
+		for (j = 0; instance_points[i] != NULL &&
+		            j < instance_points[i]->len; j++) {
+			guint point = g_array_index (instance_points[i], guint, j);
+
+			if (covered[point]) {
+				covered[point] = FALSE;
+				n_points++;
+			}
+		}
+	}
+
+	/* Greedily cover them. Every check was made by at least one
+	 * candidate, so each iteration covers at least one more. */
+	kept = g_new0 (gboolean, nodes->len);
+
+	for (n_covered = 0; n_covered < n_points;) {
+		guint best = 0, best_gain = 0;
+
+		for (i = 0; i < nodes->len; i++) {
+			guint gain = 0;
+
+			if (kept[i] || instance_points[i] == NULL) {
+				continue;
+			}
+
+			for (j = 0; j < instance_points[i]->len; j++) {
+				if (!covered[g_array_index (instance_points[i], guint, j)]) {
+					gain++;
+				}
+			}
 
-	g_return_if_fail (WBL_IS_SCHEMA (self));
-	g_return_if_fail (instance != NULL);
-	g_return_if_fail (error == NULL || *error == NULL);
+			if (gain > best_gain) {
+				best = i;
+				best_gain = gain;
+			}
+		}
 
-	klass = WBL_SCHEMA_GET_CLASS (self);
-	priv = wbl_schema_get_instance_private (self);
+		g_assert (best_gain > 0);
 
-	/* Apply the schema to the instance. */
-	if (klass->apply_schema != NULL) {
-		klass->apply_schema (self, priv->schema, instance, error);
+		kept[best] = TRUE;
+		n_covered += best_gain;
+
+		for (j = 0; j < instance_points[best]->len; j++) {
+			covered[g_array_index (instance_points[best], guint, j)] = TRUE;
+		}
+	}
+
+	output = g_ptr_array_new ();
+	*verdicts = g_array_new (FALSE, FALSE, sizeof (gboolean));
+
+	for (i = 0; i < nodes->len; i++) {
+		if (kept[i]) {
+			g_ptr_array_add (output, nodes->pdata[i]);
+			g_array_append_val (*verdicts, valid[i]);
+		}
+
+		g_clear_pointer (&instance_points[i], g_array_unref);
 	}
+
+	g_free (kept);
+	g_free (covered);
+	g_free (valid);
+	g_free (instance_points);
+	g_hash_table_unref (coverage.point_indices);
+
+	return output;
 }
 
 /**
- * wbl_schema_generate_instances:
+ * wbl_schema_generate_instances_sharded:
  * @self: a #WblSchema
  * @flags: flags affecting how instances are generated
- *
- * Generate JSON instances for the given JSON Schema. These instances are
- * designed to be used as test vectors for code which parses and handles JSON
- * following this schema. By default, instances which are both valid and invalid
- * are generated, with the invalid schemas designed to test boundary conditions
- * of validity, and common parsing problems.
- *
- * All generated instances are correctly formed JSON, and all will parse
- * successfully. By design, however, some of the instances will not validate
- * according to the given #WblSchema.
+ * @shard_index: index of the shard to generate, less than @n_shards
+ * @n_shards: total number of shards, at least 1
+ *
+ * Generate one shard of the JSON instances which
+ * wbl_schema_generate_instances() would return for the given JSON Schema. This
+ * is intended for splitting validation and consumption of test vectors between
+ * several machines: each runs with the same @n_shards and a different
+ * @shard_index.
+ *
+ * Generation is divided between the shards before it happens. The expensive
+ * part of generating for most schemas is combining the instances of the
+ * subschemas of an array or object schema; for the root schema, each shard
+ * only combines its own share of the arrays of item subschemas or sets of
+ * properties, and mutates the resulting instances. The comparatively few
+ * instances generated from the root schema’s other keywords are generated by
+ * every shard and assigned to one of them by hashing. Subschemas below the
+ * root are generated in full by each shard which needs their instances. How
+ * evenly the work is divided therefore depends on how many arrays of item
+ * subschemas or sets of properties the root schema has.
+ *
+ * The union of the instances for all shards is the set of instances returned
+ * by wbl_schema_generate_instances() with the same @flags, unless the limits
+ * from wbl_schema_set_generation_limits() stop generation early. An instance
+ * which can be reached from the combinations of more than one shard, for
+ * example as a mutation of instances from two different sets of properties,
+ * is returned by each of those shards. The division is deterministic, and
+ * depends only on the schema, @flags and the version of Walbottle, so all
+ * shards must use the same version. The invalid JSON instance from
+ * %WBL_GENERATE_INSTANCE_INVALID_JSON is always in shard 0.
+ *
+ * %WBL_GENERATE_INSTANCE_MINIMISE needs to see all the candidate instances to
+ * choose which to keep, so with it generation is not divided: each shard
+ * generates and validates all the candidates, and then the kept instances are
+ * divided between the shards by hashing, so that each is returned by exactly
+ * one shard.
  *
  * Returns: (transfer container) (element-type WblGeneratedInstance): newly
  *   allocated array of #WblGeneratedInstances
  *
- * Since: 0.1.0
+ * Since: UNRELEASED
  */
 GPtrArray *
-wbl_schema_generate_instances (WblSchema *self,
-                               WblGenerateInstanceFlags flags)
+wbl_schema_generate_instances_sharded (WblSchema *self,
+                                       WblGenerateInstanceFlags flags,
+                                       guint shard_index,
+                                       guint n_shards)
 {
 	WblSchemaClass *klass;
 	WblSchemaPrivate *priv;
 	GHashTable/*<owned JsonNode>*/ *node_output = NULL;  /* owned */
 	GHashTableIter iter;
+	GPtrArray/*<unowned JsonNode>*/ *nodes = NULL;  /* owned */
 	GPtrArray/*<owned WblGeneratedInstance>*/ *output = NULL;  /* owned */
+	GArray/*<gboolean>*/ *verdicts = NULL;  /* owned; nullable */
 	JsonParser *parser = NULL;  /* owned */
 	gpointer key;
+	guint i;
+	guint generate_shard_index, generate_n_shards;
 
 	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+	g_return_val_if_fail (n_shards > 0, NULL);
+	g_return_val_if_fail (shard_index < n_shards, NULL);
 
 	klass = WBL_SCHEMA_GET_CLASS (self);
 	priv = wbl_schema_get_instance_private (self);
 
 	output = g_ptr_array_new_with_free_func ((GDestroyNotify) wbl_generated_instance_free);
 
+	/* Cached instances were generated with the flags from the previous
+	 * call; drop them if any of the flags which affect them have changed.
+	 * The generation limits, format checking and extension keywords also
+	 * affect them, and their setters drop the cache. */
+	if ((flags ^ priv->schema_instances_cache_flags) &
+	    INSTANCE_CACHE_FLAGS) {
+		g_clear_pointer (&priv->schema_instances_cache,
+		                 g_hash_table_unref);
+	}
+
+	priv->schema_instances_cache_flags = flags & INSTANCE_CACHE_FLAGS;
+
+	/* Divide generation of the root schema between the shards, unless
+	 * minimising, which needs all the candidates. Only the root schema’s
+	 * cached instances depend on the shard. */
+	if (flags & WBL_GENERATE_INSTANCE_MINIMISE) {
+		generate_shard_index = 0;
+		generate_n_shards = 1;
+	} else {
+		generate_shard_index = shard_index;
+		generate_n_shards = n_shards;
+	}
+
+	if (priv->schema_instances_cache != NULL &&
+	    priv->schema != NULL &&
+	    (generate_shard_index != priv->schema_instances_cache_shard_index ||
+	     generate_n_shards != priv->schema_instances_cache_n_shards)) {
+		g_hash_table_remove (priv->schema_instances_cache,
+		                     priv->schema->node);
+	}
+
+	priv->schema_instances_cache_shard_index = generate_shard_index;
+	priv->schema_instances_cache_n_shards = generate_n_shards;
+
 	/* Generate schema instances. */
+	priv->generate_flags = flags;
+	priv->generate_shard_index = generate_shard_index;
+	priv->generate_n_shards = generate_n_shards;
+
 	if (klass->generate_instance_nodes != NULL) {
 		node_output = klass->generate_instance_nodes (self,
 		                                              priv->schema);
 	}
 
+	priv->generate_flags = WBL_GENERATE_INSTANCE_NONE;
+	priv->generate_shard_index = 0;
+	priv->generate_n_shards = 1;
+
+	nodes = g_ptr_array_sized_new (g_hash_table_size (node_output));
+	g_hash_table_iter_init (&iter, node_output);
+
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_ptr_array_add (nodes, key);
+	}
+
+	/* Keep only enough instances to make every keyword check. This works
+	 * out the validity of the kept instances too. */
+	if (flags & WBL_GENERATE_INSTANCE_MINIMISE) {
+		GPtrArray/*<unowned JsonNode>*/ *minimised_nodes = NULL;
+
+		minimised_nodes = minimise_instance_nodes (self, nodes, flags,
+		                                           &verdicts);
+		g_ptr_array_unref (nodes);
+		nodes = minimised_nodes;
+	}
+
 	/* See if they are valid. We cannot do this constructively because
 	 * interactions between keywords change the validity of the overall
 	 * JSON instance. */
 	parser = json_parser_new ();
 
-	g_hash_table_iter_init (&iter, node_output);
-
-	while (g_hash_table_iter_next (&iter, &key, NULL)) {
-		JsonNode *node = key;  /* unowned */
+	for (i = 0; i < nodes->len; i++) {
+		JsonNode *node = nodes->pdata[i];  /* unowned */
 		gboolean valid;
 		GError *error = NULL;
 
-		/* Check the validity of this instance. */
-		wbl_schema_apply (self, node, &error);
-		valid = (error == NULL);
+		/* If generation was not divided between shards, skip
+		 * instances from other shards before doing any more work on
+		 * them. */
+		if (generate_n_shards != n_shards &&
+		    shard_hash_node (node) % n_shards != shard_index) {
+			continue;
+		}
 
-		g_clear_error (&error);
+		/* Check the validity of this instance, unless that is already
+		 * known. */
+		if (verdicts != NULL) {
+			valid = g_array_index (verdicts, gboolean, i);
+		} else {
+			wbl_schema_apply (self, node, &error);
+			valid = (error == NULL);
+
+			g_clear_error (&error);
+		}
 
 		/* Apply the filtering flags. */
-		if ((!(flags & WBL_GENERATE_INSTANCE_IGNORE_VALID) || !valid) &&
-		    (!(flags & WBL_GENERATE_INSTANCE_IGNORE_INVALID) || valid)) {
+		if (generate_flags_keep_instance (flags, valid)) {
 			WblGeneratedInstance *instance = NULL;
 			gchar *json = NULL;
 
@@ -7658,10 +13664,14 @@ wbl_schema_generate_instances (WblSchema *self,
 	}
 
 	g_object_unref (parser);
+	g_clear_pointer (&verdicts, g_array_unref);
+	g_ptr_array_unref (nodes);
 	g_hash_table_unref (node_output);
 
+	instance_cache_compact (self);
+
 	/* Potentially add some invalid JSON. */
-	if (flags & WBL_GENERATE_INSTANCE_INVALID_JSON) {
+	if ((flags & WBL_GENERATE_INSTANCE_INVALID_JSON) && shard_index == 0) {
 		g_ptr_array_add (output,
 		                 wbl_generated_instance_new_from_string ("☠",
 		                                                         FALSE));
@@ -7782,7 +13792,145 @@ wbl_schema_info_get_n_instances_generated (WblSchemaInfo *self)
 {
 	g_return_val_if_fail (self != NULL, 0);
 
-	return g_hash_table_size (self->cache_entry->instances);
+	return self->cache_entry->n_instances;
+}
+
+/**
+ * wbl_schema_info_get_allocation_estimates:
+ * @self: a #WblSchemaInfo
+ * @keyword: (nullable): name of a keyword to get statistics for, or %NULL to
+ *    get the totals for the schema
+ * @n_nodes: (out) (optional): return location for the estimated number of
+ *    #JsonNodes allocated
+ * @n_objects: (out) (optional): return location for the estimated number of
+ *    #JsonObjects allocated
+ * @n_arrays: (out) (optional): return location for the estimated number of
+ *    #JsonArrays allocated
+ * @n_hash_tables: (out) (optional): return location for the estimated number
+ *    of #GHashTables allocated
+ * @n_bytes: (out) (optional): return location for the estimated number of
+ *    bytes allocated
+ * @n_peak_bytes: (out) (optional): return location for the estimated largest
+ *    number of bytes held at once
+ *
+ * Get estimates of the memory allocated while generating instances of this
+ * schema, either in total, or by the generator for a single @keyword.
+ * The item and property keywords are generated together, and their
+ * statistics are available under the names `items` and `properties`
+ * respectively. See wbl_schema_info_dup_allocation_keywords() for a list of
+ * valid values for @keyword.
+ *
+ * Estimates are only available if the schema was generated by a call to
+ * wbl_schema_generate_instances() with
+ * %WBL_GENERATE_INSTANCE_ESTIMATE_ALLOCATIONS set. They are not measured from
+ * the allocator: they are computed by walking all the instances produced by
+ * each generator, including those which were later discarded as duplicates,
+ * and the intermediate sets of child instances which the `items` and
+ * `properties` generators combine. Instances of subschemas are accounted to
+ * those subschemas, and copies of them in instances of this schema are
+ * accounted here. Byte counts assume the layout of json-glib’s structures on
+ * LP64 platforms.
+ *
+ * @n_bytes is the total allocated over the whole of generation, whereas
+ * @n_peak_bytes is the most held at any one time: for a single @keyword, by
+ * its generator; and for the totals, by the schema’s instances plus the
+ * generator currently running. Peaks do not include memory held by the
+ * subschemas’ own instance sets, which are reported against those subschemas.
+ *
+ * Applying the schema is not covered: these are estimates for generation only.
+ *
+ * Returns: %TRUE if estimates are available, %FALSE otherwise (in which case
+ *    all the out arguments are set to zero)
+ * Since: UNRELEASED
+ */
+gboolean
+wbl_schema_info_get_allocation_estimates (WblSchemaInfo  *self,
+                                          const gchar    *keyword,
+                                          guint64        *n_nodes,
+                                          guint64        *n_objects,
+                                          guint64        *n_arrays,
+                                          guint64        *n_hash_tables,
+                                          guint64        *n_bytes,
+                                          guint64        *n_peak_bytes)
+{
+	const WblAllocationStats *stats = NULL;
+	const WblAllocationStats empty_stats = { 0, };
+
+	g_return_val_if_fail (self != NULL, FALSE);
+
+	if (keyword == NULL) {
+		stats = self->cache_entry->allocations;
+	} else if (self->cache_entry->keyword_allocations != NULL) {
+		stats = g_hash_table_lookup (self->cache_entry->keyword_allocations,
+		                             keyword);
+	}
+
+	if (stats == NULL) {
+		stats = &empty_stats;
+	}
+
+	if (n_nodes != NULL)
+		*n_nodes = stats->n_nodes;
+	if (n_objects != NULL)
+		*n_objects = stats->n_objects;
+	if (n_arrays != NULL)
+		*n_arrays = stats->n_arrays;
+	if (n_hash_tables != NULL)
+		*n_hash_tables = stats->n_hash_tables;
+	if (n_bytes != NULL)
+		*n_bytes = stats->n_bytes;
+	if (n_peak_bytes != NULL)
+		*n_peak_bytes = stats->n_peak_bytes;
+
+	return (stats != &empty_stats);
+}
+
+static gint
+sort_strings_cb (gconstpointer a,
+                 gconstpointer b)
+{
+	return g_strcmp0 (*((const gchar **) a), *((const gchar **) b));
+}
+
+/**
+ * wbl_schema_info_dup_allocation_keywords:
+ * @self: a #WblSchemaInfo
+ *
+ * Get the names of the keywords which have allocation estimates available
+ * through wbl_schema_info_get_allocation_estimates(), in alphabetical order.
+ * If allocation estimation was not enabled when generating this schema, the
+ * array will be empty.
+ *
+ * Returns: (transfer full) (array zero-terminated=1): a newly allocated
+ *    %NULL-terminated array of keyword names; free with g_strfreev()
+ * Since: UNRELEASED
+ */
+gchar **
+wbl_schema_info_dup_allocation_keywords (WblSchemaInfo *self)
+{
+	GPtrArray/*<owned utf8>*/ *keywords = NULL;  /* owned */
+
+	g_return_val_if_fail (self != NULL, NULL);
+
+	keywords = g_ptr_array_new ();
+
+	if (self->cache_entry->keyword_allocations != NULL) {
+		GHashTableIter iter;
+		gpointer key;
+
+		g_hash_table_iter_init (&iter,
+		                        self->cache_entry->keyword_allocations);
+
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			g_ptr_array_add (keywords, g_strdup (key));
+		}
+
+		g_ptr_array_sort (keywords, sort_strings_cb);
+	}
+
+	g_ptr_array_add (keywords, NULL);
+
+	return (gchar **) g_ptr_array_free (keywords, FALSE);
 }
 
 /**
@@ -7855,3 +14003,322 @@ wbl_schema_get_schema_info (WblSchema *self)
 
 	return out;
 }
+
+G_DEFINE_BOXED_TYPE (WblSchemaEstimate, wbl_schema_estimate,
+                     wbl_schema_estimate_copy, wbl_schema_estimate_free);
+
+/**
+ * wbl_schema_estimate_copy:
+ * @self: (transfer none): a #WblSchemaEstimate
+ *
+ * Copy a #WblSchemaEstimate into a newly allocated region of memory. This is
+ * a deep copy.
+ *
+ * Returns: (transfer full): newly allocated #WblSchemaEstimate
+ *
+ * Since: UNRELEASED
+ */
+WblSchemaEstimate *
+wbl_schema_estimate_copy (WblSchemaEstimate *self)
+{
+	WblSchemaEstimate *out = NULL;
+
+	g_return_val_if_fail (self != NULL, NULL);
+
+	out = g_slice_dup (WblSchemaEstimate, self);
+	out->schema = json_object_ref (self->schema);
+	out->path = g_strdup (self->path);
+
+	return out;
+}
+
+/**
+ * wbl_schema_estimate_free:
+ * @self: (transfer full): a #WblSchemaEstimate
+ *
+ * Free an allocated #WblSchemaEstimate.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_schema_estimate_free (WblSchemaEstimate *self)
+{
+	json_object_unref (self->schema);
+	g_free (self->path);
+	g_slice_free (WblSchemaEstimate, self);
+}
+
+/* Convert an estimate to an integer, saturating on overflow. */
+static guint64
+estimate_to_uint64 (gdouble value)
+{
+	if (value >= (gdouble) G_MAXUINT64) {
+		return G_MAXUINT64;
+	}
+
+	return (guint64) value;
+}
+
+/**
+ * wbl_schema_estimate_get_path:
+ * @self: a #WblSchemaEstimate
+ *
+ * Get a JSONPath expression for the location of this subschema within the
+ * top-level schema, which is `$`.
+ *
+ * Returns: JSONPath for the subschema
+ * Since: UNRELEASED
+ */
+const gchar *
+wbl_schema_estimate_get_path (WblSchemaEstimate *self)
+{
+	g_return_val_if_fail (self != NULL, NULL);
+
+	return self->path;
+}
+
+/**
+ * wbl_schema_estimate_get_n_instances:
+ * @self: a #WblSchemaEstimate
+ *
+ * Get the estimated number of instances which will be generated for this
+ * subschema. This is approximate: it does not account for duplicate
+ * instances generated by different keywords, so usually overestimates. If the
+ * estimate is too large to represent, %G_MAXUINT64 is returned.
+ *
+ * Returns: estimated number of instances
+ * Since: UNRELEASED
+ */
+guint64
+wbl_schema_estimate_get_n_instances (WblSchemaEstimate *self)
+{
+	g_return_val_if_fail (self != NULL, 0);
+
+	return estimate_to_uint64 (self->n_instances);
+}
+
+/**
+ * wbl_schema_estimate_get_cost:
+ * @self: a #WblSchemaEstimate
+ *
+ * Get the estimated cost of generating instances for this subschema,
+ * excluding the cost of generating instances for its subschemas. Costs are
+ * unitless, and are only meaningful relative to each other; they roughly count
+ * the JSON nodes and string characters built. If the estimate is too large to
+ * represent, %G_MAXUINT64 is returned.
+ *
+ * Returns: estimated relative cost of generation
+ * Since: UNRELEASED
+ */
+guint64
+wbl_schema_estimate_get_cost (WblSchemaEstimate *self)
+{
+	g_return_val_if_fail (self != NULL, 0);
+
+	return estimate_to_uint64 (self->cost);
+}
+
+/**
+ * wbl_schema_estimate_get_total_cost:
+ * @self: a #WblSchemaEstimate
+ *
+ * Get the estimated cost of generating instances for this subschema, including
+ * the cost of generating instances for all its subschemas. For the top-level
+ * schema, this is the estimated cost of wbl_schema_generate_instances(). See
+ * wbl_schema_estimate_get_cost() for details of the units.
+ *
+ * Returns: estimated relative cost of generation
+ * Since: UNRELEASED
+ */
+guint64
+wbl_schema_estimate_get_total_cost (WblSchemaEstimate *self)
+{
+	g_return_val_if_fail (self != NULL, 0);
+
+	return estimate_to_uint64 (self->total_cost);
+}
+
+/**
+ * wbl_schema_estimate_get_depth:
+ * @self: a #WblSchemaEstimate
+ *
+ * Get the number of `allOf`, `anyOf`, `oneOf` and `not` keywords this
+ * subschema is nested inside.
+ *
+ * Returns: nesting depth of the subschema
+ * Since: UNRELEASED
+ */
+guint
+wbl_schema_estimate_get_depth (WblSchemaEstimate *self)
+{
+	g_return_val_if_fail (self != NULL, 0);
+
+	return self->depth;
+}
+
+/**
+ * wbl_schema_estimate_get_keyword:
+ * @self: a #WblSchemaEstimate
+ *
+ * Get the name of the keyword which contributes most to
+ * wbl_schema_estimate_get_cost(). The item and property keywords are generated
+ * together, and are reported as `items` and `properties` respectively.
+ *
+ * Returns: (nullable): name of the most expensive keyword, or %NULL if the
+ *    subschema generates nothing
+ * Since: UNRELEASED
+ */
+const gchar *
+wbl_schema_estimate_get_keyword (WblSchemaEstimate *self)
+{
+	g_return_val_if_fail (self != NULL, NULL);
+
+	return self->keyword;
+}
+
+/**
+ * wbl_schema_estimate_get_flags:
+ * @self: a #WblSchemaEstimate
+ *
+ * Get flags highlighting the reasons this subschema may be expensive to
+ * generate instances for.
+ *
+ * Returns: flags for the subschema
+ * Since: UNRELEASED
+ */
+WblSchemaEstimateFlags
+wbl_schema_estimate_get_flags (WblSchemaEstimate *self)
+{
+	g_return_val_if_fail (self != NULL, WBL_SCHEMA_ESTIMATE_NONE);
+
+	return self->flags;
+}
+
+/**
+ * wbl_schema_estimate_build_json:
+ * @self: a #WblSchemaEstimate
+ *
+ * Build the JSON string for this subschema, in a human-readable format.
+ *
+ * Returns: (transfer full): a newly allocated string containing the JSON form
+ *    of the subschema
+ * Since: UNRELEASED
+ */
+gchar *
+wbl_schema_estimate_build_json (WblSchemaEstimate *self)
+{
+	JsonNode *node = NULL;
+	gchar *json = NULL;
+
+	g_return_val_if_fail (self != NULL, NULL);
+
+	node = json_node_new (JSON_NODE_OBJECT);
+	json_node_set_object (node, self->schema);
+	json = node_to_string (node);
+	json_node_free (node);
+
+	return json;
+}
+
+static gint
+sort_estimates_cb (gconstpointer a,
+                   gconstpointer b)
+{
+	const WblSchemaEstimate *estimate_a = *((const WblSchemaEstimate **) a);
+	const WblSchemaEstimate *estimate_b = *((const WblSchemaEstimate **) b);
+
+	if (estimate_a->cost > estimate_b->cost) {
+		return -1;
+	} else if (estimate_a->cost < estimate_b->cost) {
+		return 1;
+	}
+
+	return g_strcmp0 (estimate_a->path, estimate_b->path);
+}
+
+/**
+ * wbl_schema_estimate_generation:
+ * @self: a #WblSchema
+ *
+ * Estimate the number of instances, and the relative cost, of calling
+ * wbl_schema_generate_instances() on the loaded schema, without generating
+ * anything. This is a static analysis of the schema, and is cheap even for
+ * schemas which would be infeasible to generate instances for; so it can be
+ * used to reject or budget for expensive schemas up front.
+ *
+ * One #WblSchemaEstimate is returned for each subschema which instances would
+ * be generated for. The first is always for the top-level schema, and its
+ * total cost covers the entire schema. The rest are sorted by decreasing
+ * cost, so the subschemas which dominate generation come first; those whose
+ * own cost is a large share of the total are flagged with
+ * %WBL_SCHEMA_ESTIMATE_DOMINANT.
+ *
+ * The estimates model the default implementation of
+ * #WblSchemaClass.generate_instance_nodes, and are approximate: they are
+ * typically within a small factor of the real values.
+ *
+ * Returns: (transfer full) (element-type WblSchemaEstimate): a newly allocated
+ *    array of #WblSchemaEstimate structures
+ * Since: UNRELEASED
+ */
+GPtrArray *
+wbl_schema_estimate_generation (WblSchema *self)
+{
+	WblSchemaPrivate *priv;
+	GHashTable/*<unowned JsonObject, owned WblSchemaEstimate>*/ *estimates = NULL;  /* owned */
+	GPtrArray/*<owned WblSchemaEstimate>*/ *out = NULL;  /* owned */
+	GPtrArray/*<unowned WblSchemaEstimate>*/ *sorted = NULL;  /* owned */
+	WblSchemaEstimate *root_estimate;  /* unowned */
+	JsonNode *root_node = NULL;  /* owned */
+	GHashTableIter iter;
+	gpointer value;
+	guint i;
+
+	g_return_val_if_fail (WBL_IS_SCHEMA (self), NULL);
+
+	priv = wbl_schema_get_instance_private (self);
+
+	g_return_val_if_fail (priv->schema != NULL, NULL);
+
+	estimates = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	root_node = json_node_new (JSON_NODE_OBJECT);
+	json_node_set_object (root_node, priv->schema->node);
+	subschema_estimate (self, estimates, NULL, root_node, FALSE);
+	json_node_free (root_node);
+
+	root_estimate = g_hash_table_lookup (estimates, priv->schema->node);
+	g_assert (root_estimate != NULL);
+
+	/* Flag the dominant subschemas and sort the rest by cost. */
+	out = g_ptr_array_new_with_free_func ((GDestroyNotify) wbl_schema_estimate_free);
+	sorted = g_ptr_array_sized_new (g_hash_table_size (estimates));
+
+	g_hash_table_iter_init (&iter, estimates);
+
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		WblSchemaEstimate *estimate = value;
+
+		if (estimate->cost > 0.0 &&
+		    estimate->cost >= ESTIMATE_DOMINANT_SHARE * root_estimate->total_cost) {
+			estimate->flags |= WBL_SCHEMA_ESTIMATE_DOMINANT;
+		}
+
+		if (estimate != root_estimate) {
+			g_ptr_array_add (sorted, estimate);
+		}
+	}
+
+	g_ptr_array_sort (sorted, sort_estimates_cb);
+
+	g_ptr_array_add (out, root_estimate);  /* transfer */
+
+	for (i = 0; i < sorted->len; i++) {
+		g_ptr_array_add (out, sorted->pdata[i]);  /* transfer */
+	}
+
+	g_ptr_array_unref (sorted);
+	g_hash_table_unref (estimates);
+
+	return out;
+}
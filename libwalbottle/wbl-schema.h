@@ -110,6 +110,9 @@ typedef struct {
  *   all standard JSON Schema keywords, but overriding implementations could
  *   generate for extension keywords. If %NULL, no instances will be generated.
  *
+ * Simple extension keywords can be added with wbl_schema_add_keyword()
+ * instead of overriding these methods.
+ *
  * Most of the fields in the #WblSchemaClass structure are private and should
  * never be accessed directly.
  *
@@ -135,14 +138,56 @@ GType wbl_schema_get_type (void) G_GNUC_CONST;
 
 WblSchema *wbl_schema_new (void) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
 
+/**
+ * WblSchemaLoadMode:
+ * @WBL_SCHEMA_LOAD_MODE_VALIDATE: Validate the whole schema against the JSON
+ *    Schema standard when it is loaded, and fail to load it if it is invalid.
+ * @WBL_SCHEMA_LOAD_MODE_TRUSTED: Do not validate the schema when it is loaded.
+ *    Applying or generating instances for an invalid schema has undefined
+ *    results, so this must only be used for schemas which are known to be
+ *    valid, such as those which were validated when they were built. Schema
+ *    snapshots loaded in this mode are validated unless they record that
+ *    they were validated; see wbl_schema_load_from_snapshot().
+ * @WBL_SCHEMA_LOAD_MODE_LAZY: Do not validate the schema when it is loaded.
+ *    Instead, validate each subschema the first time it is applied or
+ *    generated for. Subschemas which are never reached are never validated.
+ *
+ * How much of a schema to validate when loading it, set using
+ * wbl_schema_set_load_mode(). In all modes, the validation messages for the
+ * whole schema are available from wbl_schema_get_validation_messages().
+ *
+ * Since: UNRELEASED
+ */
+typedef enum {
+	WBL_SCHEMA_LOAD_MODE_VALIDATE = 0,
+	WBL_SCHEMA_LOAD_MODE_TRUSTED,
+	WBL_SCHEMA_LOAD_MODE_LAZY,
+} WblSchemaLoadMode;
+
+void wbl_schema_set_load_mode (WblSchema         *self,
+                               WblSchemaLoadMode  mode);
+WblSchemaLoadMode wbl_schema_get_load_mode (WblSchema *self);
+
 void wbl_schema_load_from_data (WblSchema *self,
                                 const gchar *data,
                                 gssize length,
                                 GError **error);
 
+void wbl_schema_load_from_bytes (WblSchema *self,
+                                 GBytes *bytes,
+                                 GError **error);
+void wbl_schema_load_from_mapped_file (WblSchema *self,
+                                       GMappedFile *mapped_file,
+                                       GError **error);
+
 void wbl_schema_load_from_file (WblSchema *self,
                                 const gchar *filename,
                                 GError **error);
+void wbl_schema_load_from_files (WblSchema **schemas,
+                                 const gchar * const *filenames,
+                                 guint n_files,
+                                 GCancellable *cancellable,
+                                 GError **errors);
 
 void wbl_schema_load_from_stream (WblSchema *self,
                                   GInputStream *stream,
@@ -162,6 +207,11 @@ void wbl_schema_load_from_json (WblSchema     *self,
                                 GCancellable  *cancellable,
                                 GError       **error);
 
+void wbl_schema_load_from_snapshot (WblSchema  *self,
+                                    GBytes     *snapshot,
+                                    GError    **error);
+GBytes *wbl_schema_dup_snapshot (WblSchema *self);
+
 WblSchemaNode *
 wbl_schema_get_root (WblSchema *self);
 GPtrArray *
@@ -171,6 +221,109 @@ void
 wbl_schema_apply (WblSchema *self,
                   JsonNode *instance,
                   GError **error);
+void
+wbl_schema_apply_data (WblSchema    *self,
+                       const gchar  *data,
+                       gssize        length,
+                       GError      **error);
+GPtrArray *
+wbl_schema_apply_batch (WblSchema         *self,
+                        JsonNode * const  *instances,
+                        guint              n_instances);
+void
+wbl_schema_apply_async (WblSchema           *self,
+                        JsonNode            *instance,
+                        GCancellable        *cancellable,
+                        GAsyncReadyCallback  callback,
+                        gpointer             user_data);
+void
+wbl_schema_apply_finish (WblSchema     *self,
+                         GAsyncResult  *result,
+                         GError       **error);
+void
+wbl_schema_apply_batch_async (WblSchema           *self,
+                              JsonNode * const    *instances,
+                              guint                n_instances,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data);
+GPtrArray *
+wbl_schema_apply_batch_finish (WblSchema     *self,
+                               GAsyncResult  *result,
+                               GError       **error);
+
+/**
+ * WblKeywordValidateFunc:
+ * @schema: the #WblSchema being loaded
+ * @root: the subschema containing the keyword
+ * @schema_node: the value of the keyword in @root
+ * @error: return location for a #GError
+ * @user_data: user data passed to wbl_schema_add_keyword()
+ *
+ * Check that the value of an extension keyword in a schema is valid. If not,
+ * set @error to a message explaining why, which is added to the validation
+ * messages for the schema.
+ *
+ * Returns: %TRUE if @schema_node is valid, %FALSE otherwise
+ * Since: UNRELEASED
+ */
+typedef gboolean (*WblKeywordValidateFunc) (WblSchema   *schema,
+                                            JsonObject  *root,
+                                            JsonNode    *schema_node,
+                                            GError     **error,
+                                            gpointer     user_data);
+
+/**
+ * WblKeywordApplyFunc:
+ * @schema: the #WblSchema being applied
+ * @root: the subschema containing the keyword
+ * @schema_node: the value of the keyword in @root
+ * @instance_node: the instance to check
+ * @error: return location for a #GError
+ * @user_data: user data passed to wbl_schema_add_keyword()
+ *
+ * Check an instance against an extension keyword, setting @error if it is
+ * invalid. This may be called from several threads at once.
+ *
+ * The result must only depend on @schema_node and the contents of
+ * @instance_node (not, for example, its parent nodes), as the verdicts for
+ * identical instance subtrees are reused within each apply call.
+ *
+ * Since: UNRELEASED
+ */
+typedef void (*WblKeywordApplyFunc) (WblSchema   *schema,
+                                     JsonObject  *root,
+                                     JsonNode    *schema_node,
+                                     JsonNode    *instance_node,
+                                     GError     **error,
+                                     gpointer     user_data);
+
+/**
+ * WblKeywordGenerateFunc:
+ * @schema: the #WblSchema being generated for
+ * @root: the subschema containing the keyword
+ * @schema_node: the value of the keyword in @root
+ * @instances: (element-type JsonNode): array to add the generated instances to
+ * @user_data: user data passed to wbl_schema_add_keyword()
+ *
+ * Generate instances for an extension keyword, adding them to @instances.
+ * @instances frees its elements with json_node_free().
+ *
+ * Since: UNRELEASED
+ */
+typedef void (*WblKeywordGenerateFunc) (WblSchema  *schema,
+                                        JsonObject *root,
+                                        JsonNode   *schema_node,
+                                        GPtrArray  *instances,
+                                        gpointer    user_data);
+
+void wbl_schema_add_keyword (WblSchema              *self,
+                             const gchar            *name,
+                             WblKeywordValidateFunc  validate,
+                             WblKeywordApplyFunc     apply,
+                             WblKeywordGenerateFunc  generate,
+                             gpointer                user_data,
+                             GDestroyNotify          user_data_free);
 
 /**
  * WblValidateMessageLevel:
@@ -244,6 +397,28 @@ gchar *wbl_validate_message_build_json (WblValidateMessage *self);
  * @WBL_GENERATE_INSTANCE_IGNORE_INVALID: Do not return invalid instances.
  * @WBL_GENERATE_INSTANCE_INVALID_JSON: Generate a test vector containing
  *    invalid JSON. (Since: 0.2.0)
+ * @WBL_GENERATE_INSTANCE_ESTIMATE_ALLOCATIONS: Estimate the memory allocated
+ *    while generating each subschema, from the instances it produces. The
+ *    estimates are retrievable using
+ *    wbl_schema_info_get_allocation_estimates(). This slows generation down.
+ *    (Since: UNRELEASED)
+ * @WBL_GENERATE_INSTANCE_PAIRWISE_PROPERTIES: When choosing which properties to
+ *    include in generated object instances, cover every pair of properties
+ *    (both present, both absent, and either one present without the other)
+ *    using a covering array, rather than testing each property on its own.
+ *    This tests interactions between properties, and generates fewer instances
+ *    for objects with many properties. The covering array always has strength
+ *    2: every combination of each pair of properties is covered, but
+ *    combinations of three or more properties are only covered by chance.
+ *    (Since: UNRELEASED)
+ * @WBL_GENERATE_INSTANCE_MINIMISE: Only output a subset of the generated
+ *    instances which, between them, pass and fail every keyword check in the
+ *    schema that the full set of instances does. Instances which only repeat
+ *    checks made by other instances are dropped. If
+ *    %WBL_GENERATE_INSTANCE_IGNORE_VALID or
+ *    %WBL_GENERATE_INSTANCE_IGNORE_INVALID is also set, the instances they
+ *    drop are dropped first, and only the checks made by the remaining
+ *    instances need to be made. (Since: UNRELEASED)
  *
  * Flags affecting the generation of JSON instances for schemas using
  * wbl_schema_generate_instances().
@@ -255,6 +430,9 @@ typedef enum {
 	WBL_GENERATE_INSTANCE_IGNORE_VALID = (1 << 0),
 	WBL_GENERATE_INSTANCE_IGNORE_INVALID = (1 << 1),
 	WBL_GENERATE_INSTANCE_INVALID_JSON = (1 << 2),
+	WBL_GENERATE_INSTANCE_ESTIMATE_ALLOCATIONS = (1 << 3),
+	WBL_GENERATE_INSTANCE_PAIRWISE_PROPERTIES = (1 << 4),
+	WBL_GENERATE_INSTANCE_MINIMISE = (1 << 5),
 } WblGenerateInstanceFlags;
 
 /**
@@ -288,7 +466,35 @@ wbl_generated_instance_get_json (WblGeneratedInstance *self);
 gboolean
 wbl_generated_instance_is_valid (WblGeneratedInstance *self);
 
+void wbl_schema_set_generation_limits (WblSchema *self,
+                                       guint      max_depth,
+                                       gsize      max_instance_size,
+                                       gsize      max_total_size);
+void wbl_schema_get_generation_limits (WblSchema *self,
+                                       guint     *max_depth,
+                                       gsize     *max_instance_size,
+                                       gsize     *max_total_size);
+
+void wbl_schema_set_check_formats (WblSchema *self,
+                                   gboolean   check_formats);
+gboolean wbl_schema_get_check_formats (WblSchema *self);
+
+void wbl_schema_set_verdict_cache_size (WblSchema *self,
+                                        guint      n_verdicts);
+guint wbl_schema_get_verdict_cache_size (WblSchema *self);
+
+/* Memoising verdicts for repeated subtrees within each instance is switched
+ * separately from the verdict cache for whole instances above. */
+void wbl_schema_set_memoise_subtrees (WblSchema *self,
+                                      gboolean   memoise_subtrees);
+gboolean wbl_schema_get_memoise_subtrees (WblSchema *self);
+
+void wbl_schema_set_spill_threshold (WblSchema *self,
+                                     gsize      n_bytes);
+gsize wbl_schema_get_spill_threshold (WblSchema *self);
+
 GPtrArray *wbl_schema_generate_instances (WblSchema *self, WblGenerateInstanceFlags flags);
+GPtrArray *wbl_schema_generate_instances_sharded (WblSchema *self, WblGenerateInstanceFlags flags, guint shard_index, guint n_shards);
 
 /**
  * WblSchemaInfo:
@@ -313,10 +519,78 @@ gint64 wbl_schema_info_get_generation_time (WblSchemaInfo *self);
 guint wbl_schema_info_get_n_times_generated (WblSchemaInfo *self);
 guint wbl_schema_info_get_id (WblSchemaInfo *self);
 guint wbl_schema_info_get_n_instances_generated (WblSchemaInfo *self);
+gboolean wbl_schema_info_get_allocation_estimates (WblSchemaInfo  *self,
+                                                   const gchar    *keyword,
+                                                   guint64        *n_nodes,
+                                                   guint64        *n_objects,
+                                                   guint64        *n_arrays,
+                                                   guint64        *n_hash_tables,
+                                                   guint64        *n_bytes,
+                                                   guint64        *n_peak_bytes);
+gchar **wbl_schema_info_dup_allocation_keywords (WblSchemaInfo *self) G_GNUC_WARN_UNUSED_RESULT;
 gchar *wbl_schema_info_build_json (WblSchemaInfo *self);
 
 GPtrArray *wbl_schema_get_schema_info (WblSchema *self);
 
+/**
+ * WblSchemaEstimateFlags:
+ * @WBL_SCHEMA_ESTIMATE_NONE: No flags set.
+ * @WBL_SCHEMA_ESTIMATE_DOMINANT: The subschema accounts for a large share of
+ *    the estimated cost of generating the whole schema.
+ * @WBL_SCHEMA_ESTIMATE_LARGE_ARRAYS: The subschema generates arrays of many
+ *    different lengths, typically due to a large `maxItems`.
+ * @WBL_SCHEMA_ESTIMATE_LARGE_STRINGS: The subschema generates very long
+ *    strings, due to a large `maxLength` or `minLength`.
+ * @WBL_SCHEMA_ESTIMATE_MANY_PROPERTIES: The subschema generates objects with
+ *    many optional properties, from its `properties`, `patternProperties`,
+ *    `dependencies` or a large `maxProperties`.
+ * @WBL_SCHEMA_ESTIMATE_DEEP_NESTING: The subschema is nested deeply inside
+ *    `allOf`, `anyOf`, `oneOf` or `not` keywords.
+ *
+ * Flags highlighting why a subschema may be expensive to generate instances
+ * for, as returned by wbl_schema_estimate_get_flags().
+ *
+ * Since: UNRELEASED
+ */
+typedef enum {
+	WBL_SCHEMA_ESTIMATE_NONE = 0,
+	WBL_SCHEMA_ESTIMATE_DOMINANT = (1 << 0),
+	WBL_SCHEMA_ESTIMATE_LARGE_ARRAYS = (1 << 1),
+	WBL_SCHEMA_ESTIMATE_LARGE_STRINGS = (1 << 2),
+	WBL_SCHEMA_ESTIMATE_MANY_PROPERTIES = (1 << 3),
+	WBL_SCHEMA_ESTIMATE_DEEP_NESTING = (1 << 4),
+} WblSchemaEstimateFlags;
+
+/**
+ * WblSchemaEstimate:
+ *
+ * An allocated structure which stores a static estimate of the cost of
+ * generating instances for a particular schema or sub-schema, as returned by
+ * wbl_schema_estimate_generation().
+ *
+ * All the fields in the #WblSchemaEstimate structure are private and should
+ * never be accessed directly.
+ *
+ * Since: UNRELEASED
+ */
+typedef struct _WblSchemaEstimate WblSchemaEstimate;
+
+GType wbl_schema_estimate_get_type (void) G_GNUC_CONST;
+
+WblSchemaEstimate *wbl_schema_estimate_copy (WblSchemaEstimate *self);
+void wbl_schema_estimate_free (WblSchemaEstimate *self);
+
+const gchar *wbl_schema_estimate_get_path (WblSchemaEstimate *self);
+guint64 wbl_schema_estimate_get_n_instances (WblSchemaEstimate *self);
+guint64 wbl_schema_estimate_get_cost (WblSchemaEstimate *self);
+guint64 wbl_schema_estimate_get_total_cost (WblSchemaEstimate *self);
+guint wbl_schema_estimate_get_depth (WblSchemaEstimate *self);
+const gchar *wbl_schema_estimate_get_keyword (WblSchemaEstimate *self);
+WblSchemaEstimateFlags wbl_schema_estimate_get_flags (WblSchemaEstimate *self);
+gchar *wbl_schema_estimate_build_json (WblSchemaEstimate *self);
+
+GPtrArray *wbl_schema_estimate_generation (WblSchema *self);
+
 G_END_DECLS
 
 #endif /* !WBL_SCHEMA_H */
@@ -27,11 +27,7 @@
  * mathematical sense of a set. Each string is UTF-8.
  *
  * The API of #WblStringSet is designed to closely match the underlying
- * mathematical operations; this was prioritised as a design goal over
- * performance of the data structure. If performance is found to be a problem,
- * the structure can be improved to use copy-on-write internally, and to
- * implement its own hash table structure to avoid the allocations necessary for
- * using #GHashTable.
+ * mathematical operations.
  *
  * Each #WblStringSet is immutable after creation, and all operations produce
  * new immutable instances, rather than modifying their inputs.
@@ -42,6 +38,28 @@
  *
  * #WblStringSet is unsorted, and iteration over it may happen in any order.
  *
+ * Each set belongs to a #WblStringPool, which owns a single copy of each of its
+ * members, so adding a member which is already in another set does not copy
+ * it. Sets can only be combined with other sets from the same pool. The member
+ * strings returned by wbl_string_set_iter_next() come from the pool, so may be
+ * compared by pointer with members of other sets from it, and remain valid
+ * until the pool is freed. A #WblSchema keeps one pool, which is freed when
+ * another schema is loaded, so strings do not accumulate over the lifetime of
+ * the process.
+ *
+ * Internally, each set is a bitset indexed by the position of each member in
+ * its pool, so unions, equality checks and membership tests work on 64 members
+ * at a time and do not allocate per member. Pool indices are dense, and the
+ * property names from a schema tend to be added to the pool one after
+ * another, so the bitsets are short.
+ *
+ * Generated instances depend on the iteration order of sets, so that is kept
+ * the same as that of a #GHashTable built using the same sequence of
+ * operations. The order is worked out when each set is built, using the hash of
+ * each member cached in the pool, and stored in an array; so sets do not keep
+ * the sets they were built from alive, and can be iterated over from several
+ * threads without locking.
+ *
  * Since: 0.2.0
  */
 
@@ -60,35 +78,479 @@ typedef enum {
 	STATE_IMMUTABLE = (1 << 1),
 } WblStringSetState;
 
+#define BITS_PER_WORD 64
+
+/* A string in a #WblStringPool. Entries never move once added, so sets may
+ * point to them without holding the pool’s lock. */
+typedef struct {
+	gchar *string;  /* owned */
+	guint hash;  /* g_str_hash() of @string */
+	guint index;  /* in WblStringPool.entries */
+} PoolEntry;
+
+struct _WblStringPool {
+	volatile gint ref_count;
+
+	/* Sets from the same pool may be built in several threads, so
+	 * @entries and @by_string are protected by @lock. */
+	GMutex lock;
+	GPtrArray/*<owned PoolEntry>*/ *entries;  /* owned; indexed by index */
+	GHashTable/*<unowned utf8, unowned PoolEntry>*/ *by_string;  /* owned */
+};
+
 struct _WblStringSet {
 	volatile gint ref_count;
 	gint state;
+	WblStringPool *pool;  /* owned */
 	guint hash;  /* XOR of g_str_hash() of all members of @set;
 	              * 0 for the empty set */
-	GHashTable/*<owned utf8, unowned utf8>*/ *set;
+	guint size;
+
+	/* Bit b of @words[w] is set if the string with index (@base + w) * 64 +
+	 * b in @pool is a member. Zero words are never stored at either end,
+	 * so equal sets have equal bitsets; the empty set has @n_words == 0. */
+	guint base;
+	guint n_words;
+	guint64 *words;  /* owned; nullable */
+
+	/* The @size members of the set in iteration order; or %NULL if the set
+	 * is empty, or is a #WblDependencyClosure row. */
+	PoolEntry **members;  /* owned; nullable */
+};
+
+struct _WblDependencyClosure {
+	volatile gint ref_count;
+	WblStringPool *pool;  /* owned */
+	JsonObject *dependencies;  /* owned */
+
+	/* @rows[i - @first_index] is the set of properties which the property
+	 * with index i in @pool depends on, directly or transitively; or %NULL
+	 * if it has no property dependencies. Rows are only ever used as
+	 * bitsets, and have no iteration order. */
+	guint first_index;
+	guint n_rows;
+	WblStringSet **rows;  /* owned */
 };
 
 G_DEFINE_BOXED_TYPE (WblStringSet, wbl_string_set,
                      wbl_string_set_ref, wbl_string_set_unref);
 
+static inline guint
+count_bits (guint64 word)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll (word);
+#else
+	guint n_bits;
+
+	for (n_bits = 0; word != 0; n_bits++) {
+		word &= word - 1;
+	}
+
+	return n_bits;
+#endif
+}
+
+/* @word must be non-zero. */
+static inline guint
+lowest_bit (guint64 word)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll (word);
+#else
+	guint bit;
+
+	for (bit = 0; (word & 1) == 0; bit++) {
+		word >>= 1;
+	}
+
+	return bit;
+#endif
+}
+
+static void
+pool_entry_free (PoolEntry  *entry)
+{
+	g_free (entry->string);
+	g_free (entry);
+}
+
+/**
+ * wbl_string_pool_new:
+ *
+ * Create a new, empty #WblStringPool.
+ *
+ * Returns: (transfer full): a new #WblStringPool
+ *
+ * Since: UNRELEASED
+ */
+WblStringPool *
+wbl_string_pool_new (void)
+{
+	WblStringPool *pool = NULL;
+
+	pool = g_new0 (WblStringPool, 1);
+	pool->ref_count = 1;
+	g_mutex_init (&pool->lock);
+	pool->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) pool_entry_free);
+	pool->by_string = g_hash_table_new (g_str_hash, g_str_equal);
+
+	return pool;
+}
+
+/**
+ * wbl_string_pool_ref:
+ * @pool: a #WblStringPool
+ *
+ * Increase the reference count of @pool.
+ *
+ * Returns: (transfer full): pass through of @pool
+ *
+ * Since: UNRELEASED
+ */
+WblStringPool *
+wbl_string_pool_ref (WblStringPool  *pool)
+{
+	g_return_val_if_fail (pool != NULL, NULL);
+	g_return_val_if_fail (pool->ref_count > 0, NULL);
+
+	g_atomic_int_inc (&pool->ref_count);
+
+	return pool;
+}
+
+/**
+ * wbl_string_pool_unref:
+ * @pool: a #WblStringPool
+ *
+ * Decrease the reference count of @pool. If this reaches zero, free it and
+ * all its strings.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_string_pool_unref (WblStringPool  *pool)
+{
+	g_return_if_fail (pool != NULL);
+	g_return_if_fail (pool->ref_count > 0);
+
+	if (g_atomic_int_dec_and_test (&pool->ref_count)) {
+		g_hash_table_unref (pool->by_string);
+		g_ptr_array_unref (pool->entries);
+		g_mutex_clear (&pool->lock);
+		g_free (pool);
+	}
+}
+
+/**
+ * wbl_string_pool_get_size:
+ * @pool: a #WblStringPool
+ *
+ * Get the number of distinct strings which have been added to @pool by
+ * building sets from it.
+ *
+ * Returns: number of strings in @pool
+ *
+ * Since: UNRELEASED
+ */
+guint
+wbl_string_pool_get_size (WblStringPool  *pool)
+{
+	guint size;
+
+	g_return_val_if_fail (pool != NULL, 0);
+
+	g_mutex_lock (&pool->lock);
+	size = pool->entries->len;
+	g_mutex_unlock (&pool->lock);
+
+	return size;
+}
+
+/* Get the entry for @string in @pool, copying it into the pool if it is not
+ * there already.
+ *
+ * Complexity: O(1) */
+static PoolEntry *
+pool_add (WblStringPool  *pool,
+          const gchar    *string)
+{
+	PoolEntry *entry = NULL;
+
+	g_mutex_lock (&pool->lock);
+
+	entry = g_hash_table_lookup (pool->by_string, string);
+
+	if (entry == NULL) {
+		entry = g_new0 (PoolEntry, 1);
+		entry->string = g_strdup (string);
+		entry->hash = g_str_hash (string);
+		entry->index = pool->entries->len;
+
+		g_ptr_array_add (pool->entries, entry);
+		g_hash_table_insert (pool->by_string, entry->string, entry);
+	}
+
+	g_mutex_unlock (&pool->lock);
+
+	return entry;
+}
+
+/* Look up the entry for @string in @pool without adding it. Returns %NULL if it
+ * is not in the pool.
+ *
+ * Complexity: O(1) */
+static PoolEntry *
+pool_lookup (WblStringPool  *pool,
+             const gchar    *string)
+{
+	PoolEntry *entry = NULL;
+
+	g_mutex_lock (&pool->lock);
+	entry = g_hash_table_lookup (pool->by_string, string);
+	g_mutex_unlock (&pool->lock);
+
+	return entry;
+}
+
+/* XOR of the hashes of the members in @word, which is word @word_index of a
+ * bitset (counting from index 0) of strings in @pool. */
+static guint
+hash_word (WblStringPool  *pool,
+           guint64         word,
+           guint           word_index)
+{
+	guint hash = 0;
+
+	g_mutex_lock (&pool->lock);
+
+	while (word != 0) {
+		PoolEntry *entry;
+
+		entry = g_ptr_array_index (pool->entries,
+		                           word_index * BITS_PER_WORD +
+		                           lowest_bit (word));
+		hash ^= entry->hash;
+		word &= word - 1;
+	}
+
+	g_mutex_unlock (&pool->lock);
+
+	return hash;
+}
+
+/* Check whether @index is set in the bitset of @set. */
+static gboolean
+bitset_contains (WblStringSet  *set,
+                 guint          index)
+{
+	guint word_index = index / BITS_PER_WORD;
+
+	if (word_index < set->base ||
+	    word_index - set->base >= set->n_words) {
+		return FALSE;
+	}
+
+	return (set->words[word_index - set->base] >>
+	        (index % BITS_PER_WORD)) & 1;
+}
+
+/* Grow the bitset of @set so it covers words @start to @end (exclusive). */
+static void
+bitset_grow (WblStringSet  *set,
+             guint          start,
+             guint          end)
+{
+	guint64 *words = NULL;
+
+	if (set->n_words > 0) {
+		if (start >= set->base && end <= set->base + set->n_words) {
+			return;
+		}
+
+		start = MIN (start, set->base);
+		end = MAX (end, set->base + set->n_words);
+	}
+
+	words = g_new0 (guint64, end - start);
+
+	if (set->n_words > 0) {
+		memcpy (words + (set->base - start), set->words,
+		        set->n_words * sizeof (*words));
+	}
+
+	g_free (set->words);
+	set->words = words;
+	set->base = start;
+	set->n_words = end - start;
+}
+
+/* Set the bit for @entry in the bitset of @set, growing it if needed, and
+ * update the size and hash. Returns %TRUE if it was not already set. */
+static gboolean
+bitset_add (WblStringSet  *set,
+            PoolEntry     *entry)
+{
+	guint word_index = entry->index / BITS_PER_WORD;
+	guint64 bit = G_GUINT64_CONSTANT (1) << (entry->index % BITS_PER_WORD);
+
+	bitset_grow (set, word_index, word_index + 1);
+
+	if (set->words[word_index - set->base] & bit) {
+		return FALSE;
+	}
+
+	set->words[word_index - set->base] |= bit;
+	set->size++;
+	set->hash ^= entry->hash;
+
+	return TRUE;
+}
+
+/* Set all the bits from @other in the bitset of @set, growing it if needed,
+ * and update the size and hash. */
+static void
+bitset_or (WblStringSet  *set,
+           WblStringSet  *other)
+{
+	guint i;
+
+	if (other->n_words == 0) {
+		return;
+	}
+
+	bitset_grow (set, other->base, other->base + other->n_words);
+
+	for (i = 0; i < other->n_words; i++) {
+		guint word_index = other->base + i;
+		guint64 *word = &set->words[word_index - set->base];
+		guint64 added = other->words[i] & ~*word;
+
+		if (added != 0) {
+			*word |= added;
+			set->size += count_bits (added);
+			set->hash ^= hash_word (set->pool, added, word_index);
+		}
+	}
+}
+
+/* Get the transitive dependencies of the property with @index, or %NULL if it
+ * has none. */
+static WblStringSet *
+closure_lookup (WblDependencyClosure  *closure,
+                guint                  index)
+{
+	if (index < closure->first_index ||
+	    index - closure->first_index >= closure->n_rows) {
+		return NULL;
+	}
+
+	return closure->rows[index - closure->first_index];
+}
+
+/* Hash a #PoolEntry using the hash of its string, so that it is not hashed
+ * again.
+ *
+ * Complexity: O(1) */
+static guint
+pool_entry_hash (gconstpointer  key)
+{
+	const PoolEntry *entry = key;
+
+	return entry->hash;
+}
+
+/* Create a table for working out the iteration order of a new set, by adding
+ * its members in the same sequence as the operation building it. Members are
+ * hashed by content, rather than by pointer, so that the iteration order is the
+ * same from run to run.
+ *
+ * Complexity: O(1) */
+static GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/ *
+order_table_new (void)
+{
+	return g_hash_table_new (pool_entry_hash, g_direct_equal);
+}
+
+/* Add the members of the bitset of @set to @order, in index order.
+ *
+ * Complexity: O(N) in the size N of @set */
+static void
+order_table_add_bitset (GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/  *order,
+                        WblStringSet                                          *set)
+{
+	guint i;
+
+	g_mutex_lock (&set->pool->lock);
+
+	for (i = 0; i < set->n_words; i++) {
+		guint64 word = set->words[i];
+
+		while (word != 0) {
+			g_hash_table_add (order,
+			                  g_ptr_array_index (set->pool->entries,
+			                                     (set->base + i) * BITS_PER_WORD +
+			                                     lowest_bit (word)));
+			word &= word - 1;
+		}
+	}
+
+	g_mutex_unlock (&set->pool->lock);
+}
+
+/* Store the iteration order of @set from @order, which must contain exactly
+ * the members of @set, and free @order.
+ *
+ * Complexity: O(N) in the size N of @set */
+static void
+set_take_order (WblStringSet                                          *set,
+                GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/  *order)
+{
+	GHashTableIter iter;
+	gpointer key;
+	guint i = 0;
+
+	g_assert (g_hash_table_size (order) == set->size);
+
+	if (set->size > 0) {
+		set->members = g_new (PoolEntry *, set->size);
+		g_hash_table_iter_init (&iter, order);
+
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			set->members[i++] = key;
+		}
+	}
+
+	g_hash_table_unref (order);
+}
+
 /**
  * _wbl_string_set_add:
  * @set: a #WblStringSet
+ * @order: (nullable): table from order_table_new() to add @member to, or
+ *    %NULL if @set will never be iterated over
  * @member: new member
  *
- * Add a member to the string set. @set must not be immutable; it is modified
- * in place. This is an internal method.
+ * Add @member to the string set, and to its pool if it is not already there.
+ * @set must not be immutable; it is modified in place. This is an internal
+ * method.
  *
  * Since: 0.2.0
  */
 static void
-_wbl_string_set_add (WblStringSet  *set,
-                     const gchar   *member)
+_wbl_string_set_add (WblStringSet                                          *set,
+                     GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/  *order,
+                     const gchar                                           *member)
 {
+	PoolEntry *entry;
+
 	g_return_if_fail ((set->state & STATE_IMMUTABLE) == 0);
 
-	if (g_hash_table_add (set->set, g_strdup (member))) {
-		set->hash ^= g_str_hash (member);
+	entry = pool_add (set->pool, member);
+	bitset_add (set, entry);
+
+	if (order != NULL) {
+		g_hash_table_add (order, entry);
 	}
 }
 
@@ -110,32 +572,33 @@ _wbl_string_set_is_valid (WblStringSet  *set)
 
 /**
  * _wbl_string_set_new:
+ * @pool: the #WblStringPool the members will come from
  *
  * Create a new #WblStringSet with a floating reference and no members. It is
  * not yet marked as immutable; the caller must initialise the set’s members
- * then mark it as immutable.
+ * and iteration order, then mark it as immutable.
  *
  * Returns: (transfer full): a new #WblStringSet
  *
  * Since: 0.2.0
  */
 static WblStringSet *
-_wbl_string_set_new (void)
+_wbl_string_set_new (WblStringPool  *pool)
 {
 	WblStringSet *set = NULL;
 
 	set = g_new0 (WblStringSet, 1);
 	set->ref_count = 1;
 	set->state = STATE_FLOATING;
+	set->pool = wbl_string_pool_ref (pool);
 	set->hash = 0;
-	set->set = g_hash_table_new_full (g_str_hash, g_str_equal,
-	                                  (GDestroyNotify) g_free, NULL);
 
 	return set;
 }
 
 /**
  * wbl_string_set_new_empty:
+ * @pool: the #WblStringPool the set’s members will come from
  *
  * Create a new empty #WblStringSet. The set is returned with a floating
  * reference.
@@ -145,11 +608,13 @@ _wbl_string_set_new (void)
  * Since: 0.2.0
  */
 WblStringSet *
-wbl_string_set_new_empty (void)
+wbl_string_set_new_empty (WblStringPool  *pool)
 {
 	WblStringSet *output = NULL;
 
-	output = _wbl_string_set_new ();
+	g_return_val_if_fail (pool != NULL, NULL);
+
+	output = _wbl_string_set_new (pool);
 	output->state |= STATE_IMMUTABLE;
 
 	return output;
@@ -157,6 +622,7 @@ wbl_string_set_new_empty (void)
 
 /**
  * wbl_string_set_new_singleton:
+ * @pool: the #WblStringPool to add @element to
  * @element: the element to be in the set
  *
  * Create a new single-element #WblStringSet. The set is returned with a
@@ -167,12 +633,19 @@ wbl_string_set_new_empty (void)
  * Since: 0.2.0
  */
 WblStringSet *
-wbl_string_set_new_singleton (const gchar  *element)
+wbl_string_set_new_singleton (WblStringPool  *pool,
+                              const gchar    *element)
 {
 	WblStringSet *output = NULL;
+	GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/ *order = NULL;
 
-	output = _wbl_string_set_new ();
-	_wbl_string_set_add (output, element);
+	g_return_val_if_fail (pool != NULL, NULL);
+	g_return_val_if_fail (element != NULL, NULL);
+
+	output = _wbl_string_set_new (pool);
+	order = order_table_new ();
+	_wbl_string_set_add (output, order, element);
+	set_take_order (output, order);
 	output->state |= STATE_IMMUTABLE;
 
 	return output;
@@ -180,6 +653,7 @@ wbl_string_set_new_singleton (const gchar  *element)
 
 /**
  * wbl_string_set_new_from_object_members:
+ * @pool: the #WblStringPool to add the member names to
  * @obj: a JSON object
  *
  * Create a new #WblStringSet containing the set of names for the properties in
@@ -190,19 +664,25 @@ wbl_string_set_new_singleton (const gchar  *element)
  * Since: 0.2.0
  */
 WblStringSet *
-wbl_string_set_new_from_object_members (JsonObject  *obj)
+wbl_string_set_new_from_object_members (WblStringPool  *pool,
+                                        JsonObject     *obj)
 {
 	JsonObjectIter iter;
 	WblStringSet *set = NULL;
+	GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/ *order = NULL;
 	const gchar *member_name;
 
-	set = _wbl_string_set_new ();
+	g_return_val_if_fail (pool != NULL, NULL);
+
+	set = _wbl_string_set_new (pool);
+	order = order_table_new ();
 	json_object_iter_init (&iter, obj);
 
 	while (json_object_iter_next (&iter, &member_name, NULL)) {
-		_wbl_string_set_add (set, member_name);
+		_wbl_string_set_add (set, order, member_name);
 	}
 
+	set_take_order (set, order);
 	set->state |= STATE_IMMUTABLE;
 
 	return set;
@@ -210,6 +690,7 @@ wbl_string_set_new_from_object_members (JsonObject  *obj)
 
 /**
  * wbl_string_set_new_from_array_elements:
+ * @pool: the #WblStringPool to add the elements to
  * @array: a JSON array of UTF-8 strings
  *
  * Create a new #WblStringSet containing the values of all the elements in
@@ -223,18 +704,60 @@ wbl_string_set_new_from_object_members (JsonObject  *obj)
  * Since: 0.2.0
  */
 WblStringSet *
-wbl_string_set_new_from_array_elements (JsonArray  *array)
+wbl_string_set_new_from_array_elements (WblStringPool  *pool,
+                                        JsonArray      *array)
 {
 	WblStringSet *set = NULL;
+	GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/ *order = NULL;
 	guint i, len;
 
-	set = _wbl_string_set_new ();
+	g_return_val_if_fail (pool != NULL, NULL);
+
+	set = _wbl_string_set_new (pool);
+	order = order_table_new ();
 
 	for (i = 0, len = json_array_get_length (array); i < len; i++) {
-		_wbl_string_set_add (set,
+		_wbl_string_set_add (set, order,
 		                     json_array_get_string_element (array, i));
 	}
 
+	set_take_order (set, order);
+	set->state |= STATE_IMMUTABLE;
+
+	return set;
+}
+
+/**
+ * wbl_string_set_new_from_strv:
+ * @pool: the #WblStringPool to add the strings to
+ * @strv: (array zero-terminated=1): a %NULL-terminated array of UTF-8 strings
+ *
+ * Create a new #WblStringSet containing the strings in @strv, which may be
+ * empty. Duplicate elements are ignored.
+ *
+ * Returns: (transfer full): a new #WblStringSet
+ *
+ * Since: UNRELEASED
+ */
+WblStringSet *
+wbl_string_set_new_from_strv (WblStringPool        *pool,
+                              const gchar * const  *strv)
+{
+	WblStringSet *set = NULL;
+	GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/ *order = NULL;
+	guint i;
+
+	g_return_val_if_fail (pool != NULL, NULL);
+	g_return_val_if_fail (strv != NULL, NULL);
+
+	set = _wbl_string_set_new (pool);
+	order = order_table_new ();
+
+	for (i = 0; strv[i] != NULL; i++) {
+		_wbl_string_set_add (set, order, strv[i]);
+	}
+
+	set_take_order (set, order);
 	set->state |= STATE_IMMUTABLE;
 
 	return set;
@@ -254,7 +777,7 @@ wbl_string_set_new_from_array_elements (JsonArray  *array)
 WblStringSet *
 wbl_string_set_dup (WblStringSet  *set)
 {
-	return wbl_string_set_union (wbl_string_set_new_empty (), set);
+	return wbl_string_set_union (wbl_string_set_new_empty (set->pool), set);
 }
 
 /**
@@ -319,7 +842,9 @@ wbl_string_set_unref (WblStringSet  *set)
 	g_return_if_fail (_wbl_string_set_is_valid (set));
 
 	if (g_atomic_int_dec_and_test (&set->ref_count)) {
-		g_hash_table_unref (set->set);
+		g_free (set->members);
+		g_free (set->words);
+		wbl_string_pool_unref (set->pool);
 		g_free (set);
 	}
 }
@@ -329,10 +854,12 @@ wbl_string_set_unref (WblStringSet  *set)
  * @a: (transfer floating): a #WblStringSet
  * @b: (transfer floating): another #WblStringSet
  *
- * Create the union of the two sets, @a and @b. The result set will be returned
- * as a new instance with a floating reference. Neither @a or @b will be
- * modified, though floating references on them will be sunk.
+ * Create the union of the two sets, @a and @b, which must come from the same
+ * #WblStringPool. The result set will be returned as a new instance with a
+ * floating reference. Neither @a or @b will be modified, though floating
+ * references on them will be sunk.
  *
+ * Complexity: O(A + B) in the sizes A of @a and B of @b
  * Returns: (transfer full): the union of @a and @b
  *
  * Since: 0.2.0
@@ -342,112 +869,385 @@ wbl_string_set_union (WblStringSet  *a,
                       WblStringSet  *b)
 {
 	WblStringSet *output = NULL;
-	GHashTableIter iter;
-	gpointer key;
+	GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/ *order = NULL;
+	guint start, end, i;
 
-	output = _wbl_string_set_new ();
+	g_return_val_if_fail (_wbl_string_set_is_valid (a), NULL);
+	g_return_val_if_fail (_wbl_string_set_is_valid (b), NULL);
+	g_return_val_if_fail (a->pool == b->pool, NULL);
 
 	wbl_string_set_ref_sink (a);
 	wbl_string_set_ref_sink (b);
 
-	/* Add all from @a. */
-	g_hash_table_iter_init (&iter, a->set);
+	output = _wbl_string_set_new (a->pool);
+
+	start = G_MAXUINT;
+	end = 0;
 
-	while (g_hash_table_iter_next (&iter, &key, NULL)) {
-		const gchar *key_str = key;
-		_wbl_string_set_add (output, key_str);
+	if (a->n_words > 0) {
+		start = MIN (start, a->base);
+		end = MAX (end, a->base + a->n_words);
 	}
 
-	/* Add all from @b. */
-	g_hash_table_iter_init (&iter, b->set);
+	if (b->n_words > 0) {
+		start = MIN (start, b->base);
+		end = MAX (end, b->base + b->n_words);
+	}
+
+	if (start < end) {
+		output->base = start;
+		output->n_words = end - start;
+		output->words = g_new0 (guint64, output->n_words);
+
+		for (i = 0; i < a->n_words; i++) {
+			output->words[a->base - start + i] |= a->words[i];
+		}
+
+		for (i = 0; i < b->n_words; i++) {
+			output->words[b->base - start + i] |= b->words[i];
+		}
 
-	while (g_hash_table_iter_next (&iter, (gpointer *) &key, NULL)) {
-		const gchar *key_str = key;
-		_wbl_string_set_add (output, key_str);
+		for (i = 0; i < output->n_words; i++) {
+			output->size += count_bits (output->words[i]);
+		}
 	}
 
-	wbl_string_set_unref (b);
-	wbl_string_set_unref (a);
+	/* Members in both @a and @b cancel out in the XOR of their hashes,
+	 * so add them back in. */
+	output->hash = a->hash ^ b->hash;
+
+	for (i = MAX (a->base, b->base);
+	     i < MIN (a->base + a->n_words, b->base + b->n_words);
+	     i++) {
+		output->hash ^= hash_word (a->pool, a->words[i - a->base] &
+		                           b->words[i - b->base], i);
+	}
 
+	/* Add all from the first operand, then all from the second. */
+	order = order_table_new ();
+
+	for (i = 0; i < a->size; i++) {
+		g_hash_table_add (order, a->members[i]);
+	}
+
+	for (i = 0; i < b->size; i++) {
+		g_hash_table_add (order, b->members[i]);
+	}
+
+	set_take_order (output, order);
 	output->state |= STATE_IMMUTABLE;
 
+	wbl_string_set_unref (b);
+	wbl_string_set_unref (a);
+
 	return output;
 }
 
 /**
- * wbl_string_set_union_dependencies:
- * @set: (transfer floating): a #WblStringSet
+ * wbl_dependency_closure_new:
+ * @pool: the #WblStringPool of the sets the closure will be used with
  * @dependencies: a JSON object mapping property names to arrays of property
  *    names (or to object instances)
  *
+ * Precompute the transitive closure of the property dependencies in
+ * @dependencies, so that the dependencies of any set can be added using
+ * wbl_string_set_union_dependency_closure() without looking up each member
+ * in @dependencies. Schema dependencies (those mapping to object instances)
+ * are ignored.
+ *
+ * Complexity: O(D^2 * W) in the number D of @dependencies keys and the number
+ *    of words W in the bitset for the dependencies of each key
+ * Returns: (transfer full): a new #WblDependencyClosure
+ * Since: UNRELEASED
+ */
+WblDependencyClosure *
+wbl_dependency_closure_new (WblStringPool  *pool,
+                            JsonObject     *dependencies)
+{
+	WblDependencyClosure *closure = NULL;
+	JsonObjectIter iter;
+	const gchar *property_name;
+	JsonNode *dependency_value;
+	guint last_index = 0;
+	gboolean changed;
+	guint i, len, w;
+
+	g_return_val_if_fail (pool != NULL, NULL);
+	g_return_val_if_fail (dependencies != NULL, NULL);
+
+	closure = g_new0 (WblDependencyClosure, 1);
+	closure->ref_count = 1;
+	closure->pool = wbl_string_pool_ref (pool);
+	closure->dependencies = json_object_ref (dependencies);
+
+	/* Work out the range of indices for the keys, and add a row for each
+	 * of them containing its direct dependencies. */
+	json_object_iter_init (&iter, dependencies);
+
+	while (json_object_iter_next (&iter, &property_name, &dependency_value)) {
+		guint index;
+
+		if (!JSON_NODE_HOLDS_ARRAY (dependency_value)) {
+			continue;
+		}
+
+		index = pool_add (pool, property_name)->index;
+
+		if (closure->n_rows == 0 || index < closure->first_index) {
+			closure->first_index = index;
+		}
+
+		last_index = MAX (last_index, index);
+		closure->n_rows = last_index - closure->first_index + 1;
+	}
+
+	closure->rows = g_new0 (WblStringSet *, closure->n_rows);
+	json_object_iter_init (&iter, dependencies);
+
+	while (json_object_iter_next (&iter, &property_name, &dependency_value)) {
+		WblStringSet *row = NULL;
+		JsonArray *array;
+
+		if (!JSON_NODE_HOLDS_ARRAY (dependency_value)) {
+			continue;
+		}
+
+		row = _wbl_string_set_new (pool);
+		array = json_node_get_array (dependency_value);
+
+		for (i = 0, len = json_array_get_length (array); i < len; i++) {
+			_wbl_string_set_add (row, NULL,
+			                     json_array_get_string_element (array, i));
+		}
+
+		row->state |= STATE_IMMUTABLE;
+		closure->rows[pool_add (pool, property_name)->index -
+		              closure->first_index] = wbl_string_set_ref_sink (row);
+	}
+
+	/* Add the rows of each row’s members to it, until nothing changes.
+	 *
+	 * Formally, for each key k:
+	 *    closure(k) = dependencies(k) ∪ ⋃_{d ∈ closure(k)} closure(d)
+	 */
+	do {
+		changed = FALSE;
+
+		for (i = 0; i < closure->n_rows; i++) {
+			WblStringSet *row = closure->rows[i];
+			guint old_size;
+
+			if (row == NULL) {
+				continue;
+			}
+
+			old_size = row->size;
+
+			/* @row may grow while this loop runs; any members
+			 * which are added below its old start are handled in
+			 * the next round. */
+			for (w = row->base; w < row->base + row->n_words; w++) {
+				guint64 word = row->words[w - row->base];
+
+				while (word != 0) {
+					WblStringSet *other;
+
+					other = closure_lookup (closure,
+					                        w * BITS_PER_WORD +
+					                        lowest_bit (word));
+					word &= word - 1;
+
+					if (other != NULL && other != row) {
+						bitset_or (row, other);
+					}
+				}
+			}
+
+			changed = changed || (row->size != old_size);
+		}
+	} while (changed);
+
+	return closure;
+}
+
+/**
+ * wbl_dependency_closure_ref:
+ * @closure: a #WblDependencyClosure
+ *
+ * Increase the reference count of @closure.
+ *
+ * Returns: (transfer full): pass through of @closure
+ *
+ * Since: UNRELEASED
+ */
+WblDependencyClosure *
+wbl_dependency_closure_ref (WblDependencyClosure  *closure)
+{
+	g_return_val_if_fail (closure != NULL, NULL);
+	g_return_val_if_fail (closure->ref_count > 0, NULL);
+
+	g_atomic_int_inc (&closure->ref_count);
+
+	return closure;
+}
+
+/**
+ * wbl_dependency_closure_unref:
+ * @closure: a #WblDependencyClosure
+ *
+ * Decrease the reference count of @closure. If this reaches zero, free it.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_dependency_closure_unref (WblDependencyClosure  *closure)
+{
+	guint i;
+
+	g_return_if_fail (closure != NULL);
+	g_return_if_fail (closure->ref_count > 0);
+
+	if (g_atomic_int_dec_and_test (&closure->ref_count)) {
+		for (i = 0; i < closure->n_rows; i++) {
+			g_clear_pointer (&closure->rows[i],
+			                 wbl_string_set_unref);
+		}
+
+		g_free (closure->rows);
+		json_object_unref (closure->dependencies);
+		wbl_string_pool_unref (closure->pool);
+		g_free (closure);
+	}
+}
+
+/**
+ * wbl_string_set_union_dependency_closure:
+ * @set: (transfer floating): a #WblStringSet
+ * @closure: precomputed dependencies
+ *
  * Calculate the transitive union of the dependencies of the elements of an
- * initial @set and return it as a new #WblStringSet. @dependencies is treated
- * as a map of property names to dependencies; the function essentially
+ * initial @set and return it as a new #WblStringSet. The function essentially
  * calculates
  *    output = set ∪ ⋃_{d ϵ output} dependencies(d)
+ * by adding the precomputed closure for each member of @set. @closure must
+ * have been built for the #WblStringPool of @set.
  *
- * Complexity: O(S * D) in the size S of @set and number D of @dependencies keys
+ * Complexity: O(S * (W + N)) in the size S of @set, the number of words W
+ *    in the bitset for the dependencies of each member, and the number of
+ *    dependencies N of each member
  * Returns: the transitive dependency set of @set
- * Since: 0.2.0
+ * Since: UNRELEASED
  */
 WblStringSet *
-wbl_string_set_union_dependencies (WblStringSet  *set,
-                                   JsonObject    *dependencies)
+wbl_string_set_union_dependency_closure (WblStringSet          *set,
+                                         WblDependencyClosure  *closure)
 {
 	WblStringSet *output = NULL;
-	guint old_output_size;
+	GHashTable/*<unowned PoolEntry, unowned PoolEntry>*/ *order = NULL;
+	guint i, j, len;
 
 	g_return_val_if_fail (_wbl_string_set_is_valid (set), NULL);
-	g_return_val_if_fail (dependencies != NULL, NULL);
-
-	output = _wbl_string_set_new ();
+	g_return_val_if_fail (closure != NULL, NULL);
+	g_return_val_if_fail (closure->pool == set->pool, NULL);
 
 	wbl_string_set_ref_sink (set);
 
-	do {
-		GHashTableIter iter;
-		gpointer key;
+	output = _wbl_string_set_new (set->pool);
+	order = order_table_new ();
+
+	/* Start with a copy of @set. */
+	if (set->n_words > 0) {
+		output->base = set->base;
+		output->n_words = set->n_words;
+		output->words = g_new (guint64, set->n_words);
+		memcpy (output->words, set->words,
+		        set->n_words * sizeof (*set->words));
+		output->size = set->size;
+		output->hash = set->hash;
+	}
 
-		old_output_size = g_hash_table_size (output->set);
+	/* Add each member, followed by its direct dependencies in order and
+	 * then any transitive ones, so the iteration order is the same as if
+	 * they were added one at a time. */
+	for (i = 0; i < set->size; i++) {
+		PoolEntry *entry = set->members[i];
+		JsonNode *dependency_value;
+		WblStringSet *row;
 
-		g_hash_table_iter_init (&iter, set->set);
+		g_hash_table_add (order, entry);
 
-		while (g_hash_table_iter_next (&iter, &key, NULL)) {
-			const gchar *property_name = key;
-			JsonNode *dependency_value;
-			guint i, len;
-
-			/* Add the dependency key. */
-			_wbl_string_set_add (output, property_name);
-
-			/* See if there are any values associated with the
-			 * dependency key. */
-			dependency_value = json_object_get_member (dependencies,
-			                                           property_name);
-
-			/* Ignore schema dependencies; we only care about
-			 * property dependencies, for which we add all
-			 * dependent properties. */
-			if (dependency_value != NULL &&
-			    JSON_NODE_HOLDS_ARRAY (dependency_value)) {
-				JsonArray *array;
-
-				array = json_node_get_array (dependency_value);
-
-				for (i = 0, len = json_array_get_length (array);
-				     i < len;
-				     i++) {
-					_wbl_string_set_add (output,
-					                     json_array_get_string_element (array, i));
-				}
+		dependency_value = json_object_get_member (closure->dependencies,
+		                                           entry->string);
+
+		if (dependency_value != NULL &&
+		    JSON_NODE_HOLDS_ARRAY (dependency_value)) {
+			JsonArray *array;
+
+			array = json_node_get_array (dependency_value);
+
+			for (j = 0, len = json_array_get_length (array);
+			     j < len;
+			     j++) {
+				const gchar *member;
+
+				member = json_array_get_string_element (array, j);
+				g_hash_table_add (order,
+				                  pool_add (set->pool, member));
 			}
 		}
-	} while (old_output_size != g_hash_table_size (output->set));
 
-	wbl_string_set_unref (set);
+		row = closure_lookup (closure, entry->index);
 
+		if (row != NULL) {
+			order_table_add_bitset (order, row);
+			bitset_or (output, row);
+		}
+	}
+
+	set_take_order (output, order);
 	output->state |= STATE_IMMUTABLE;
 
+	wbl_string_set_unref (set);
+
+	return output;
+}
+
+/**
+ * wbl_string_set_union_dependencies:
+ * @set: (transfer floating): a #WblStringSet
+ * @dependencies: a JSON object mapping property names to arrays of property
+ *    names (or to object instances)
+ *
+ * Calculate the transitive union of the dependencies of the elements of an
+ * initial @set and return it as a new #WblStringSet. @dependencies is treated
+ * as a map of property names to dependencies; the function essentially
+ * calculates
+ *    output = set ∪ ⋃_{d ϵ output} dependencies(d)
+ *
+ * If this is going to be called repeatedly with the same @dependencies, it is
+ * faster to use wbl_dependency_closure_new() once, and then
+ * wbl_string_set_union_dependency_closure().
+ *
+ * Complexity: O(D^2 * W + S * W) in the size S of @set, number D of
+ *    @dependencies keys, and number of words W in the bitset for the
+ *    dependencies of each key
+ * Returns: the transitive dependency set of @set
+ * Since: 0.2.0
+ */
+WblStringSet *
+wbl_string_set_union_dependencies (WblStringSet  *set,
+                                   JsonObject    *dependencies)
+{
+	WblDependencyClosure *closure = NULL;
+	WblStringSet *output = NULL;
+
+	g_return_val_if_fail (_wbl_string_set_is_valid (set), NULL);
+	g_return_val_if_fail (dependencies != NULL, NULL);
+
+	closure = wbl_dependency_closure_new (set->pool, dependencies);
+	output = wbl_string_set_union_dependency_closure (set, closure);
+	wbl_dependency_closure_unref (closure);
+
 	return output;
 }
 
@@ -467,10 +1267,17 @@ gboolean
 wbl_string_set_contains (WblStringSet  *set,
                          const gchar   *member)
 {
+	PoolEntry *entry;
+
 	g_return_val_if_fail (_wbl_string_set_is_valid (set), FALSE);
 	g_return_val_if_fail (member != NULL, FALSE);
 
-	return g_hash_table_contains (set->set, member);
+	/* A string which is not in the pool cannot be a member. Look it up
+	 * without adding it, so that checking the property names of
+	 * arbitrary instances does not grow the pool. */
+	entry = pool_lookup (set->pool, member);
+
+	return (entry != NULL && bitset_contains (set, entry->index));
 }
 
 /**
@@ -489,7 +1296,7 @@ wbl_string_set_get_size (WblStringSet  *set)
 {
 	g_return_val_if_fail (_wbl_string_set_is_valid (set), 0);
 
-	return g_hash_table_size (set->set);
+	return set->size;
 }
 
 /**
@@ -532,9 +1339,6 @@ gboolean
 wbl_string_set_equal (WblStringSet  *a,
                       WblStringSet  *b)
 {
-	GHashTableIter iter;
-	gpointer key;
-
 	g_return_val_if_fail (_wbl_string_set_is_valid (a), FALSE);
 	g_return_val_if_fail (_wbl_string_set_is_valid (b), FALSE);
 
@@ -543,20 +1347,16 @@ wbl_string_set_equal (WblStringSet  *a,
 		return TRUE;
 	if (a->hash != b->hash)
 		return FALSE;
-	if (wbl_string_set_get_size (a) != wbl_string_set_get_size (b))
+	if (a->size != b->size)
 		return FALSE;
 
-	/* Compare elements. */
-	g_hash_table_iter_init (&iter, a->set);
-
-	while (g_hash_table_iter_next (&iter, &key, NULL)) {
-		const gchar *key_str = key;
-		if (!g_hash_table_contains (b->set, key_str)) {
-			return FALSE;
-		}
-	}
-
-	return TRUE;
+	/* Compare bitsets. Neither has zero words at either end, so they must
+	 * cover the same range. */
+	return (a->base == b->base &&
+	        a->n_words == b->n_words &&
+	        (a->n_words == 0 ||
+	         memcmp (a->words, b->words,
+	                 a->n_words * sizeof (*a->words)) == 0));
 }
 
 /**
@@ -628,7 +1428,7 @@ wbl_string_set_iter_init (WblStringSetIter  *iter,
 	g_return_if_fail (set->state & STATE_IMMUTABLE);
 
 	iter->set = set;
-	g_hash_table_iter_init (&iter->iter, set->set);
+	iter->index = 0;
 }
 
 /**
@@ -641,6 +1441,10 @@ wbl_string_set_iter_init (WblStringSetIter  *iter,
  * set is reached, %FALSE is returned and @member is set to an invalid value.
  * After that point, the @iter is invalid.
  *
+ * The returned @member is owned by the #WblStringPool of the set, so it may be
+ * compared by pointer with members of other sets from the same pool, and
+ * remains valid until the pool is freed.
+ *
  * Returns: %TRUE if @member is valid; %FALSE if the end of the set has been
  *    reached
  *
@@ -654,5 +1458,15 @@ wbl_string_set_iter_next (WblStringSetIter  *iter,
 	g_return_val_if_fail (_wbl_string_set_is_valid (iter->set), FALSE);
 	g_return_val_if_fail (iter->set->state & STATE_IMMUTABLE, FALSE);
 
-	return g_hash_table_iter_next (&iter->iter, (gpointer *) member, NULL);
+	if (iter->index >= iter->set->size) {
+		return FALSE;
+	}
+
+	if (member != NULL) {
+		*member = iter->set->members[iter->index]->string;
+	}
+
+	iter->index++;
+
+	return TRUE;
 }
@@ -39,6 +39,39 @@ G_BEGIN_DECLS
  */
 typedef struct _WblStringSet WblStringSet;
 
+/**
+ * WblStringPool:
+ *
+ * A reference counted store of the strings which are members of a group of
+ * #WblStringSets. Each distinct string is copied into the pool once, and given
+ * a dense index for use in the sets’ bitsets.
+ *
+ * All the fields in the #WblStringPool structure are private and should never
+ * be accessed directly.
+ *
+ * Since: UNRELEASED
+ */
+typedef struct _WblStringPool WblStringPool;
+
+/**
+ * WblDependencyClosure:
+ *
+ * A reference counted structure which stores the transitive closure of the
+ * property dependencies from a `dependencies` schema keyword, for use with
+ * wbl_string_set_union_dependency_closure().
+ *
+ * All the fields in the #WblDependencyClosure structure are private and should
+ * never be accessed directly.
+ *
+ * Since: UNRELEASED
+ */
+typedef struct _WblDependencyClosure WblDependencyClosure;
+
+WblStringPool *wbl_string_pool_new                   (void);
+WblStringPool *wbl_string_pool_ref                   (WblStringPool               *pool);
+void          wbl_string_pool_unref                  (WblStringPool               *pool);
+guint         wbl_string_pool_get_size               (WblStringPool               *pool);
+
 GType         wbl_string_set_get_type                (void) G_GNUC_CONST;
 #define       WBL_TYPE_STRING_SET                    (wbl_string_set_get_type ())
 
@@ -46,10 +79,15 @@ WblStringSet *wbl_string_set_ref_sink                (WblStringSet
 WblStringSet *wbl_string_set_ref                     (WblStringSet                *self);
 void          wbl_string_set_unref                   (WblStringSet                *self);
 
-WblStringSet *wbl_string_set_new_empty               (void);
-WblStringSet *wbl_string_set_new_singleton           (const gchar                 *element);
-WblStringSet *wbl_string_set_new_from_object_members (JsonObject                  *obj);
-WblStringSet *wbl_string_set_new_from_array_elements (JsonArray/*<owned utf8>*/   *array);
+WblStringSet *wbl_string_set_new_empty               (WblStringPool               *pool);
+WblStringSet *wbl_string_set_new_singleton           (WblStringPool               *pool,
+                                                      const gchar                 *element);
+WblStringSet *wbl_string_set_new_from_object_members (WblStringPool               *pool,
+                                                      JsonObject                  *obj);
+WblStringSet *wbl_string_set_new_from_array_elements (WblStringPool               *pool,
+                                                      JsonArray/*<owned utf8>*/   *array);
+WblStringSet *wbl_string_set_new_from_strv           (WblStringPool               *pool,
+                                                      const gchar * const         *strv);
 
 WblStringSet *wbl_string_set_dup                     (WblStringSet                *set);
 
@@ -58,6 +96,14 @@ WblStringSet *wbl_string_set_union                   (WblStringSet
 WblStringSet *wbl_string_set_union_dependencies      (WblStringSet                *set,
                                                       JsonObject                  *dependencies);
 
+WblDependencyClosure *wbl_dependency_closure_new     (WblStringPool               *pool,
+                                                      JsonObject                  *dependencies);
+WblDependencyClosure *wbl_dependency_closure_ref     (WblDependencyClosure        *closure);
+void          wbl_dependency_closure_unref           (WblDependencyClosure        *closure);
+
+WblStringSet *wbl_string_set_union_dependency_closure (WblStringSet               *set,
+                                                       WblDependencyClosure       *closure);
+
 gboolean      wbl_string_set_contains                (WblStringSet                *set,
                                                       const gchar                 *member);
 guint         wbl_string_set_get_size                (WblStringSet                *set);
@@ -81,8 +127,8 @@ gchar        *wbl_string_set_to_string               (WblStringSet
  */
 typedef struct {
 	/*< private >*/
-	GHashTableIter   iter;
 	WblStringSet    *set;  /* unowned */
+	guint            index;
 } WblStringSetIter;
 
 void          wbl_string_set_iter_init               (WblStringSetIter            *iter,
@@ -0,0 +1,1056 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SECTION:wbl-tape
+ * @short_description: Compact immutable storage for JSON values
+ * @stability: Private
+ * @include: libwalbottle/wbl-tape.h
+ *
+ * A #WblTape stores a list of JSON values in a single array of 32-bit cells,
+ * in depth-first order. The first cell of each value holds its type in the
+ * low 3 bits, and a payload in the rest:
+ *  - null, false and true: one cell, with no payload.
+ *  - Integers and doubles: one cell, followed by two cells holding the low and
+ *    high 32 bits of the value.
+ *  - Strings: one cell, whose payload is an index into the string table.
+ *  - Arrays: one cell, whose payload is the number of elements, followed by
+ *    the elements.
+ *  - Objects: one cell, whose payload is the number of members, followed by
+ *    each member as a cell holding the string table index of its name and then
+ *    its value.
+ *
+ * Strings are stored once each in the string table, so member names and
+ * values which are repeated between instances take no extra space. Object
+ * members are stored in the order they were added to the #JsonObject, so the
+ * #JsonNodes returned by wbl_tape_dup_node() serialise identically to the
+ * originals.
+ *
+ * Tapes are only a storage format. When a spill threshold is set (see
+ * wbl_schema_set_spill_threshold()), #WblSchema uses them to keep the cached
+ * instances of each subschema between generate calls; generation itself,
+ * including deduplicating and hashing instances, works on #JsonNodes, which
+ * are expanded from the tape with wbl_tape_dup_node() when a cached set is
+ * used. So tapes do not reduce the peak memory used while generating.
+ *
+ * As a tape is immutable, it can be moved out of memory and into a temporary
+ * file using wbl_tape_spill(), which then maps the file back into memory. The
+ * kernel can then page the tape in and out as needed, without using swap.
+ *
+ * A tape can also be serialised using wbl_tape_serialise(), and loaded again,
+ * possibly in another process, using wbl_tape_new_from_bytes(). The
+ * serialised form is the sections of the tape, back to back, after a header
+ * giving their lengths; so a tape loaded from a memory-mapped file uses the
+ * mapping directly. It uses the byte order of the machine which serialised it.
+ *
+ * Since: UNRELEASED
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "wbl-tape.h"
+
+typedef enum {
+	TAPE_NULL,
+	TAPE_FALSE,
+	TAPE_TRUE,
+	TAPE_INT,
+	TAPE_DOUBLE,
+	TAPE_STRING,
+	TAPE_ARRAY,
+	TAPE_OBJECT,
+} TapeTag;
+
+#define TAPE_TAG_BITS 3
+#define TAPE_TAG_MASK ((1 << TAPE_TAG_BITS) - 1)
+#define TAPE_PAYLOAD_MAX (G_MAXUINT32 >> TAPE_TAG_BITS)
+
+#define TAPE_CELL(tag, payload) \
+	((guint32) (tag) | ((guint32) (payload) << TAPE_TAG_BITS))
+#define TAPE_CELL_TAG(cell) ((TapeTag) ((cell) & TAPE_TAG_MASK))
+#define TAPE_CELL_PAYLOAD(cell) ((cell) >> TAPE_TAG_BITS)
+
+struct _WblTape {
+	gint ref_count;  /* atomic */
+
+	guint32 *cells;  /* owned */
+	gsize n_cells;
+
+	/* Offset of the first cell of each value. */
+	guint32 *values;  /* owned */
+	guint n_values;
+
+	/* Nul-terminated strings, stored back to back, and the offset of each
+	 * in @strings. */
+	gchar *strings;  /* owned */
+	gsize strings_length;
+	guint32 *string_offsets;  /* owned */
+	guint n_strings;
+
+	/* If the tape has been spilled to a file, or loaded from serialised
+	 * data, @cells, @values, @strings and @string_offsets all point into
+	 * this mapping or these bytes, rather than being owned. */
+	GMappedFile *mapped_file;  /* owned; NULL unless spilled */
+	GBytes *bytes;  /* owned; NULL unless loaded from serialised data */
+};
+
+/* Header of a serialised tape. The sections follow it in the order: cells,
+ * values, string offsets, strings. The sections with 32-bit elements come
+ * first, so they stay aligned. */
+typedef struct {
+	guint32 n_cells;
+	guint32 n_values;
+	guint32 n_strings;
+	guint32 strings_length;
+} TapeHeader;
+
+typedef struct {
+	GArray/*<guint32>*/ *cells;  /* owned */
+	GString *strings;  /* owned */
+	GArray/*<guint32>*/ *string_offsets;  /* owned */
+	GHashTable/*<unowned utf8, guint>*/ *string_indices;  /* owned */
+} TapeBuilder;
+
+/* Complexity: O(1) */
+static void
+builder_append_cell (TapeBuilder *builder,
+                     guint32      cell)
+{
+	g_array_append_val (builder->cells, cell);
+}
+
+/* Complexity: O(1) */
+static void
+builder_append_uint64 (TapeBuilder *builder,
+                       guint64      value)
+{
+	builder_append_cell (builder, (guint32) value);
+	builder_append_cell (builder, (guint32) (value >> 32));
+}
+
+/* Get the index of @str in the string table, adding it if needed. @str must
+ * remain valid until the builder is finished.
+ *
+ * Complexity: O(N) in the length of @str */
+static guint
+builder_intern_string (TapeBuilder *builder,
+                       const gchar *str)
+{
+	gpointer index;
+	guint32 offset;
+
+	if (g_hash_table_lookup_extended (builder->string_indices, str, NULL,
+	                                  &index)) {
+		return GPOINTER_TO_UINT (index);
+	}
+
+	g_assert (builder->string_offsets->len < TAPE_PAYLOAD_MAX);
+	g_assert (builder->strings->len < G_MAXUINT32);
+
+	offset = builder->strings->len;
+	g_string_append_len (builder->strings, str, strlen (str) + 1);
+	g_array_append_val (builder->string_offsets, offset);
+
+	index = GUINT_TO_POINTER (builder->string_offsets->len - 1);
+	g_hash_table_insert (builder->string_indices, (gpointer) str, index);
+
+	return GPOINTER_TO_UINT (index);
+}
+
+/* Complexity: O(N) in the size of @node */
+static void
+builder_append_node (TapeBuilder *builder,
+                     JsonNode    *node)
+{
+	switch (json_node_get_node_type (node)) {
+	case JSON_NODE_OBJECT: {
+		JsonObject *object;  /* unowned */
+		GList/*<unowned utf8>*/ *members = NULL, *l;  /* owned */
+
+		object = json_node_get_object (node);
+		g_assert (json_object_get_size (object) <= TAPE_PAYLOAD_MAX);
+
+		builder_append_cell (builder,
+		                     TAPE_CELL (TAPE_OBJECT,
+		                                json_object_get_size (object)));
+
+		/* Insertion order, which is the order members are
+		 * serialised in. */
+		members = json_object_get_members (object);
+
+		for (l = members; l != NULL; l = l->next) {
+			const gchar *member_name = l->data;
+
+			builder_append_cell (builder,
+			                     builder_intern_string (builder,
+			                                            member_name));
+			builder_append_node (builder,
+			                     json_object_get_member (object,
+			                                             member_name));
+		}
+
+		g_list_free (members);
+
+		break;
+	}
+	case JSON_NODE_ARRAY: {
+		JsonArray *array;  /* unowned */
+		guint i, len;
+
+		array = json_node_get_array (node);
+		len = json_array_get_length (array);
+		g_assert (len <= TAPE_PAYLOAD_MAX);
+
+		builder_append_cell (builder, TAPE_CELL (TAPE_ARRAY, len));
+
+		for (i = 0; i < len; i++) {
+			builder_append_node (builder,
+			                     json_array_get_element (array, i));
+		}
+
+		break;
+	}
+	case JSON_NODE_VALUE:
+		switch (json_node_get_value_type (node)) {
+		case G_TYPE_INT64:
+			builder_append_cell (builder, TAPE_CELL (TAPE_INT, 0));
+			builder_append_uint64 (builder,
+			                       (guint64) json_node_get_int (node));
+			break;
+		case G_TYPE_DOUBLE: {
+			gdouble value;
+			guint64 bits;
+
+			value = json_node_get_double (node);
+			memcpy (&bits, &value, sizeof (bits));
+
+			builder_append_cell (builder, TAPE_CELL (TAPE_DOUBLE, 0));
+			builder_append_uint64 (builder, bits);
+			break;
+		}
+		case G_TYPE_BOOLEAN:
+			builder_append_cell (builder,
+			                     TAPE_CELL (json_node_get_boolean (node) ?
+			                                TAPE_TRUE : TAPE_FALSE, 0));
+			break;
+		case G_TYPE_STRING:
+			builder_append_cell (builder,
+			                     TAPE_CELL (TAPE_STRING,
+			                                builder_intern_string (builder,
+			                                                       json_node_get_string (node))));
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+
+		break;
+	case JSON_NODE_NULL:
+		builder_append_cell (builder, TAPE_CELL (TAPE_NULL, 0));
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/**
+ * wbl_tape_new_from_nodes:
+ * @nodes: (array length=n_nodes): JSON values to store
+ * @n_nodes: number of elements in @nodes
+ *
+ * Create a new #WblTape holding copies of @nodes, in order.
+ *
+ * Complexity: O(N) in the total size of @nodes
+ * Returns: (transfer full): a new #WblTape
+ * Since: UNRELEASED
+ */
+WblTape *
+wbl_tape_new_from_nodes (JsonNode * const *nodes,
+                         guint             n_nodes)
+{
+	WblTape *self = NULL;  /* owned */
+	TapeBuilder builder;
+	guint i;
+
+	g_return_val_if_fail (nodes != NULL || n_nodes == 0, NULL);
+
+	builder.cells = g_array_new (FALSE, FALSE, sizeof (guint32));
+	builder.strings = g_string_new ("");
+	builder.string_offsets = g_array_new (FALSE, FALSE, sizeof (guint32));
+	builder.string_indices = g_hash_table_new (g_str_hash, g_str_equal);
+
+	self = g_slice_new0 (WblTape);
+	self->ref_count = 1;
+	self->values = g_new (guint32, n_nodes);
+	self->n_values = n_nodes;
+
+	for (i = 0; i < n_nodes; i++) {
+		g_assert (builder.cells->len < G_MAXUINT32);
+
+		self->values[i] = builder.cells->len;
+		builder_append_node (&builder, nodes[i]);
+	}
+
+	self->n_cells = builder.cells->len;
+	self->cells = (guint32 *) g_array_free (builder.cells, FALSE);
+	self->strings_length = builder.strings->len;
+	self->strings = g_string_free (builder.strings, FALSE);
+	self->n_strings = builder.string_offsets->len;
+	self->string_offsets = (guint32 *) g_array_free (builder.string_offsets,
+	                                                 FALSE);
+	g_hash_table_unref (builder.string_indices);
+
+	return self;
+}
+
+/**
+ * wbl_tape_ref:
+ * @self: (transfer none): a #WblTape
+ *
+ * Increment the reference count of @self.
+ *
+ * Returns: (transfer full): @self
+ * Since: UNRELEASED
+ */
+WblTape *
+wbl_tape_ref (WblTape *self)
+{
+	g_return_val_if_fail (self != NULL, NULL);
+
+	g_atomic_int_inc (&self->ref_count);
+
+	return self;
+}
+
+/**
+ * wbl_tape_unref:
+ * @self: (transfer full): a #WblTape
+ *
+ * Decrement the reference count of @self, freeing it if it reaches zero.
+ *
+ * Since: UNRELEASED
+ */
+void
+wbl_tape_unref (WblTape *self)
+{
+	g_return_if_fail (self != NULL);
+
+	if (!g_atomic_int_dec_and_test (&self->ref_count)) {
+		return;
+	}
+
+	if (self->mapped_file != NULL) {
+		g_mapped_file_unref (self->mapped_file);
+	} else if (self->bytes != NULL) {
+		g_bytes_unref (self->bytes);
+	} else {
+		g_free (self->string_offsets);
+		g_free (self->strings);
+		g_free (self->values);
+		g_free (self->cells);
+	}
+
+	g_slice_free (WblTape, self);
+}
+
+/**
+ * wbl_tape_get_n_values:
+ * @self: a #WblTape
+ *
+ * Get the number of values stored in @self.
+ *
+ * Returns: number of values
+ * Since: UNRELEASED
+ */
+guint
+wbl_tape_get_n_values (WblTape *self)
+{
+	g_return_val_if_fail (self != NULL, 0);
+
+	return self->n_values;
+}
+
+/**
+ * wbl_tape_get_n_bytes:
+ * @self: a #WblTape
+ *
+ * Get the number of bytes used by @self, whether in memory or, if it has been
+ * spilled, in a temporary file.
+ *
+ * Returns: size of @self, in bytes
+ * Since: UNRELEASED
+ */
+gsize
+wbl_tape_get_n_bytes (WblTape *self)
+{
+	g_return_val_if_fail (self != NULL, 0);
+
+	return (sizeof (*self) +
+	        self->n_cells * sizeof (*self->cells) +
+	        self->n_values * sizeof (*self->values) +
+	        self->strings_length +
+	        self->n_strings * sizeof (*self->string_offsets));
+}
+
+/* Point the sections of @self into @data, which holds them in serialised
+ * order, according to the lengths already set in @self.
+ *
+ * Complexity: O(1) */
+static void
+tape_set_sections (WblTape     *self,
+                   const gchar *data)
+{
+	gsize cells_size, values_size, string_offsets_size;
+
+	cells_size = self->n_cells * sizeof (*self->cells);
+	values_size = self->n_values * sizeof (*self->values);
+	string_offsets_size = self->n_strings * sizeof (*self->string_offsets);
+
+	self->cells = (guint32 *) data;
+	self->values = (guint32 *) (data + cells_size);
+	self->string_offsets = (guint32 *) (data + cells_size + values_size);
+	self->strings = (gchar *) (data + cells_size + values_size +
+	                           string_offsets_size);
+}
+
+/**
+ * wbl_tape_serialise:
+ * @self: a #WblTape
+ *
+ * Serialise @self so that it can be loaded again using
+ * wbl_tape_new_from_bytes().
+ *
+ * Complexity: O(N) in the size of @self
+ * Returns: (transfer full): serialised tape
+ * Since: UNRELEASED
+ */
+GBytes *
+wbl_tape_serialise (WblTape *self)
+{
+	GByteArray *data = NULL;  /* owned */
+	TapeHeader header;
+
+	g_return_val_if_fail (self != NULL, NULL);
+
+	g_assert (self->n_cells <= G_MAXUINT32);
+	g_assert (self->strings_length <= G_MAXUINT32);
+
+	header.n_cells = self->n_cells;
+	header.n_values = self->n_values;
+	header.n_strings = self->n_strings;
+	header.strings_length = self->strings_length;
+
+	data = g_byte_array_sized_new (wbl_tape_get_n_bytes (self));
+
+	g_byte_array_append (data, (const guint8 *) &header, sizeof (header));
+	g_byte_array_append (data, (const guint8 *) self->cells,
+	                     self->n_cells * sizeof (*self->cells));
+	g_byte_array_append (data, (const guint8 *) self->values,
+	                     self->n_values * sizeof (*self->values));
+	g_byte_array_append (data, (const guint8 *) self->string_offsets,
+	                     self->n_strings * sizeof (*self->string_offsets));
+	g_byte_array_append (data, (const guint8 *) self->strings,
+	                     self->strings_length);
+
+	return g_byte_array_free_to_bytes (data);
+}
+
+/* An array or object which tape_check_values() is part way through. */
+typedef struct {
+	guint32 n_remaining;  /* elements or members left to check */
+	gboolean is_object;
+} ContainerCheck;
+
+/* Check that the values in @self are well formed and lie back to back, in
+ * order, covering all the cells. Containers are tracked on an explicit stack,
+ * so arbitrarily deep values do not overflow the call stack.
+ *
+ * Complexity: O(N) in the number of cells */
+static gboolean
+tape_check_values (WblTape *self)
+{
+	GArray/*<ContainerCheck>*/ *stack = NULL;  /* owned */
+	gsize offset = 0;
+	guint i;
+	gboolean valid = TRUE;
+
+	stack = g_array_new (FALSE, FALSE, sizeof (ContainerCheck));
+
+	for (i = 0; i < self->n_values && valid; i++) {
+		ContainerCheck value = { 1, FALSE };
+
+		if (self->values[i] != offset) {
+			valid = FALSE;
+			break;
+		}
+
+		g_array_append_val (stack, value);
+
+		while (stack->len > 0 && valid) {
+			ContainerCheck *top, child = { 0, FALSE };
+			guint32 cell, payload;
+
+			top = &g_array_index (stack, ContainerCheck,
+			                      stack->len - 1);
+
+			if (top->n_remaining == 0) {
+				g_array_set_size (stack, stack->len - 1);
+				continue;
+			}
+
+			top->n_remaining--;
+
+			/* Member name. */
+			if (top->is_object) {
+				if (offset >= self->n_cells ||
+				    self->cells[offset] >= self->n_strings) {
+					valid = FALSE;
+					break;
+				}
+
+				offset++;
+			}
+
+			if (offset >= self->n_cells) {
+				valid = FALSE;
+				break;
+			}
+
+			cell = self->cells[offset++];
+			payload = TAPE_CELL_PAYLOAD (cell);
+
+			switch (TAPE_CELL_TAG (cell)) {
+			case TAPE_NULL:
+			case TAPE_FALSE:
+			case TAPE_TRUE:
+				break;
+			case TAPE_INT:
+			case TAPE_DOUBLE:
+				if (self->n_cells - offset < 2) {
+					valid = FALSE;
+				}
+
+				offset += 2;
+				break;
+			case TAPE_STRING:
+				valid = (payload < self->n_strings);
+				break;
+			case TAPE_ARRAY:
+			case TAPE_OBJECT:
+				child.n_remaining = payload;
+				child.is_object = (TAPE_CELL_TAG (cell) == TAPE_OBJECT);
+				g_array_append_val (stack, child);
+				break;
+			default:
+				g_assert_not_reached ();
+			}
+		}
+	}
+
+	g_array_unref (stack);
+
+	return (valid && offset == self->n_cells);
+}
+
+/**
+ * wbl_tape_new_from_bytes:
+ * @bytes: a tape serialised by wbl_tape_serialise()
+ * @error: return location for a #GError, or %NULL
+ *
+ * Load a tape serialised using wbl_tape_serialise(), which must have been
+ * done on a machine with the same byte order. The tape uses @bytes directly,
+ * and keeps a reference to it, unless @bytes is not aligned to 4 bytes, in
+ * which case it is copied. @bytes may come from an untrusted source: it is
+ * checked to be well formed, and %G_IO_ERROR_INVALID_DATA is returned if not.
+ *
+ * Complexity: O(N) in the size of @bytes
+ * Returns: (transfer full): a new #WblTape, or %NULL on error
+ * Since: UNRELEASED
+ */
+WblTape *
+wbl_tape_new_from_bytes (GBytes  *bytes,
+                         GError **error)
+{
+	WblTape *self = NULL;  /* owned */
+	TapeHeader header;
+	const gchar *data;
+	gsize length;
+	guint64 expected_length;
+	guint i;
+
+	g_return_val_if_fail (bytes != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	data = g_bytes_get_data (bytes, &length);
+
+	if (length < sizeof (header)) {
+		goto invalid;
+	}
+
+	memcpy (&header, data, sizeof (header));
+
+	expected_length = (sizeof (header) +
+	                   (guint64) header.n_cells * sizeof (guint32) +
+	                   (guint64) header.n_values * sizeof (guint32) +
+	                   (guint64) header.n_strings * sizeof (guint32) +
+	                   header.strings_length);
+
+	if (expected_length != length) {
+		goto invalid;
+	}
+
+	self = g_slice_new0 (WblTape);
+	self->ref_count = 1;
+	self->n_cells = header.n_cells;
+	self->n_values = header.n_values;
+	self->n_strings = header.n_strings;
+	self->strings_length = header.strings_length;
+
+	/* The sections are read as arrays of #guint32. */
+	if ((GPOINTER_TO_SIZE (data) % sizeof (guint32)) != 0) {
+		self->bytes = g_bytes_new (data, length);
+		data = g_bytes_get_data (self->bytes, NULL);
+	} else {
+		self->bytes = g_bytes_ref (bytes);
+	}
+
+	tape_set_sections (self, data + sizeof (header));
+
+	/* Every string must be nul-terminated and valid UTF-8. */
+	if (self->n_strings > 0 &&
+	    (self->strings_length == 0 ||
+	     self->strings[self->strings_length - 1] != '\0')) {
+		goto invalid;
+	}
+
+	for (i = 0; i < self->n_strings; i++) {
+		if (self->string_offsets[i] >= self->strings_length ||
+		    !g_utf8_validate (self->strings + self->string_offsets[i],
+		                      -1, NULL)) {
+			goto invalid;
+		}
+	}
+
+	if (!tape_check_values (self)) {
+		goto invalid;
+	}
+
+	return self;
+
+invalid:
+	g_clear_pointer (&self, wbl_tape_unref);
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+	                     _("Serialised tape is corrupt."));
+
+	return NULL;
+}
+
+/**
+ * wbl_tape_spill:
+ * @self: a #WblTape
+ * @error: return location for a #GError, or %NULL
+ *
+ * Move the contents of @self out of memory and into a temporary file in
+ * g_get_tmp_dir(), which is mapped back into memory. The file is deleted
+ * straight away, so is never visible to other processes for long, and its
+ * space is freed when @self is.
+ *
+ * This does not change the values in @self. If it fails, @self is left in
+ * memory, unchanged. Spilling a tape which has already been spilled, which was
+ * loaded using wbl_tape_new_from_bytes(), or which is empty, does nothing.
+ *
+ * Complexity: O(N) in the size of @self
+ * Returns: %TRUE on success, %FALSE otherwise
+ * Since: UNRELEASED
+ */
+gboolean
+wbl_tape_spill (WblTape  *self,
+                GError  **error)
+{
+	GFile *file = NULL;  /* owned */
+	GFileIOStream *stream = NULL;  /* owned */
+	GOutputStream *output_stream;  /* unowned */
+	GMappedFile *mapped_file = NULL;  /* owned */
+	GBytes *data = NULL;  /* owned */
+	gchar *path = NULL;  /* owned */
+	GError *child_error = NULL;
+
+	g_return_val_if_fail (self != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (self->mapped_file != NULL || self->bytes != NULL ||
+	    self->n_values == 0) {
+		return TRUE;
+	}
+
+	file = g_file_new_tmp ("walbottle-XXXXXX.tape", &stream, &child_error);
+
+	if (file == NULL) {
+		g_propagate_error (error, child_error);
+		return FALSE;
+	}
+
+	data = wbl_tape_serialise (self);
+	output_stream = g_io_stream_get_output_stream (G_IO_STREAM (stream));
+
+	if (g_output_stream_write_all (output_stream,
+	                               g_bytes_get_data (data, NULL),
+	                               g_bytes_get_size (data),
+	                               NULL, NULL, &child_error) &&
+	    g_io_stream_close (G_IO_STREAM (stream), NULL, &child_error)) {
+		path = g_file_get_path (file);
+		mapped_file = g_mapped_file_new (path, FALSE, &child_error);
+	}
+
+	/* The mapping stays valid after the file is deleted. */
+	g_file_delete (file, NULL, NULL);
+
+	g_bytes_unref (data);
+	g_free (path);
+	g_object_unref (stream);
+	g_object_unref (file);
+
+	if (mapped_file == NULL) {
+		g_propagate_error (error, child_error);
+		return FALSE;
+	}
+
+	g_free (self->string_offsets);
+	g_free (self->strings);
+	g_free (self->values);
+	g_free (self->cells);
+
+	tape_set_sections (self, g_mapped_file_get_contents (mapped_file) +
+	                         sizeof (TapeHeader));
+	self->mapped_file = mapped_file;  /* transfer */
+
+	return TRUE;
+}
+
+/**
+ * wbl_tape_is_spilled:
+ * @self: a #WblTape
+ *
+ * Get whether @self has been spilled to a file using wbl_tape_spill().
+ *
+ * Returns: %TRUE if @self is stored in a file, %FALSE if it is in memory
+ * Since: UNRELEASED
+ */
+gboolean
+wbl_tape_is_spilled (WblTape *self)
+{
+	g_return_val_if_fail (self != NULL, FALSE);
+
+	return (self->mapped_file != NULL);
+}
+
+/* Complexity: O(1) */
+static const gchar *
+tape_get_string (WblTape *self,
+                 guint32  index)
+{
+	g_assert (index < self->n_strings);
+
+	return self->strings + self->string_offsets[index];
+}
+
+/* Complexity: O(1) */
+static guint64
+tape_get_uint64 (WblTape *self,
+                 gsize    offset)
+{
+	return ((guint64) self->cells[offset] |
+	        ((guint64) self->cells[offset + 1] << 32));
+}
+
+/* Build a #JsonNode for the value starting at cell @*offset, and advance
+ * @offset past it.
+ *
+ * Complexity: O(N) in the size of the value */
+static JsonNode *
+tape_dup_node_at (WblTape *self,
+                  gsize   *offset)
+{
+	JsonNode *node = NULL;  /* owned */
+	guint32 cell, payload, i;
+
+	cell = self->cells[(*offset)++];
+	payload = TAPE_CELL_PAYLOAD (cell);
+
+	switch (TAPE_CELL_TAG (cell)) {
+	case TAPE_NULL:
+		node = json_node_new (JSON_NODE_NULL);
+		break;
+	case TAPE_FALSE:
+	case TAPE_TRUE:
+		node = json_node_new (JSON_NODE_VALUE);
+		json_node_set_boolean (node, TAPE_CELL_TAG (cell) == TAPE_TRUE);
+		break;
+	case TAPE_INT:
+		node = json_node_new (JSON_NODE_VALUE);
+		json_node_set_int (node, (gint64) tape_get_uint64 (self, *offset));
+		*offset += 2;
+		break;
+	case TAPE_DOUBLE: {
+		guint64 bits;
+		gdouble value;
+
+		bits = tape_get_uint64 (self, *offset);
+		memcpy (&value, &bits, sizeof (value));
+		*offset += 2;
+
+		node = json_node_new (JSON_NODE_VALUE);
+		json_node_set_double (node, value);
+		break;
+	}
+	case TAPE_STRING:
+		node = json_node_new (JSON_NODE_VALUE);
+		json_node_set_string (node, tape_get_string (self, payload));
+		break;
+	case TAPE_ARRAY: {
+		JsonArray *array = NULL;  /* owned */
+
+		/* Set the parent of each child, as #JsonParser does, so
+		 * paths to them can be built. */
+		array = json_array_sized_new (payload);
+		node = json_node_new (JSON_NODE_ARRAY);
+
+		for (i = 0; i < payload; i++) {
+			JsonNode *element = NULL;  /* owned */
+
+			element = tape_dup_node_at (self, offset);
+			json_node_set_parent (element, node);
+			json_array_add_element (array, element);
+		}
+
+		json_node_take_array (node, array);
+		break;
+	}
+	case TAPE_OBJECT: {
+		JsonObject *object = NULL;  /* owned */
+
+		object = json_object_new ();
+		node = json_node_new (JSON_NODE_OBJECT);
+
+		for (i = 0; i < payload; i++) {
+			const gchar *member_name;
+			JsonNode *member = NULL;  /* owned */
+
+			member_name = tape_get_string (self,
+			                               self->cells[(*offset)++]);
+			member = tape_dup_node_at (self, offset);
+			json_node_set_parent (member, node);
+			json_object_set_member (object, member_name, member);
+		}
+
+		json_node_take_object (node, object);
+		break;
+	}
+	default:
+		g_assert_not_reached ();
+	}
+
+	return node;
+}
+
+/* Check whether the value starting at cell @*offset is identical to @node,
+ * and advance @offset past it if so.
+ *
+ * Complexity: O(N) in the size of the value */
+static gboolean
+tape_equal_node_at (WblTape  *self,
+                    gsize    *offset,
+                    JsonNode *node)
+{
+	guint32 cell, payload, i;
+	JsonNodeType node_type;
+	GType value_type = G_TYPE_INVALID;
+
+	cell = self->cells[(*offset)++];
+	payload = TAPE_CELL_PAYLOAD (cell);
+	node_type = json_node_get_node_type (node);
+
+	if (node_type == JSON_NODE_VALUE) {
+		value_type = json_node_get_value_type (node);
+	}
+
+	switch (TAPE_CELL_TAG (cell)) {
+	case TAPE_NULL:
+		return (node_type == JSON_NODE_NULL);
+	case TAPE_FALSE:
+	case TAPE_TRUE:
+		return (value_type == G_TYPE_BOOLEAN &&
+		        (json_node_get_boolean (node) ? TAPE_TRUE : TAPE_FALSE) ==
+		        TAPE_CELL_TAG (cell));
+	case TAPE_INT: {
+		guint64 value;
+
+		if (value_type != G_TYPE_INT64) {
+			return FALSE;
+		}
+
+		value = tape_get_uint64 (self, *offset);
+		*offset += 2;
+
+		return (value == (guint64) json_node_get_int (node));
+	}
+	case TAPE_DOUBLE: {
+		gdouble value;
+		guint64 bits, node_bits;
+
+		if (value_type != G_TYPE_DOUBLE) {
+			return FALSE;
+		}
+
+		bits = tape_get_uint64 (self, *offset);
+		*offset += 2;
+
+		value = json_node_get_double (node);
+		memcpy (&node_bits, &value, sizeof (node_bits));
+
+		return (bits == node_bits);
+	}
+	case TAPE_STRING:
+		return (value_type == G_TYPE_STRING &&
+		        strcmp (tape_get_string (self, payload),
+		                json_node_get_string (node)) == 0);
+	case TAPE_ARRAY: {
+		JsonArray *array;  /* unowned */
+
+		if (node_type != JSON_NODE_ARRAY) {
+			return FALSE;
+		}
+
+		array = json_node_get_array (node);
+
+		if (json_array_get_length (array) != payload) {
+			return FALSE;
+		}
+
+		for (i = 0; i < payload; i++) {
+			if (!tape_equal_node_at (self, offset,
+			                         json_array_get_element (array,
+			                                                 i))) {
+				return FALSE;
+			}
+		}
+
+		return TRUE;
+	}
+	case TAPE_OBJECT: {
+		JsonObject *object;  /* unowned */
+		GList/*<unowned utf8>*/ *members = NULL, *l;  /* owned */
+		gboolean equal = TRUE;
+
+		if (node_type != JSON_NODE_OBJECT) {
+			return FALSE;
+		}
+
+		object = json_node_get_object (node);
+
+		if (json_object_get_size (object) != payload) {
+			return FALSE;
+		}
+
+		/* Members must be in the same order, as in
+		 * builder_append_node(). */
+		members = json_object_get_members (object);
+
+		for (l = members; l != NULL && equal; l = l->next) {
+			const gchar *member_name = l->data;
+
+			equal = (strcmp (tape_get_string (self,
+			                                  self->cells[(*offset)++]),
+			                 member_name) == 0 &&
+			         tape_equal_node_at (self, offset,
+			                             json_object_get_member (object,
+			                                                     member_name)));
+		}
+
+		g_list_free (members);
+
+		return equal;
+	}
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+/**
+ * wbl_tape_equal_node:
+ * @self: a #WblTape
+ * @index: index of the value to compare, less than wbl_tape_get_n_values()
+ * @node: a #JsonNode to compare it to
+ *
+ * Check whether the value at @index in @self is identical to @node: that is,
+ * whether wbl_tape_dup_node() would return a node which serialises
+ * identically to @node. Unlike wbl_json_node_equal(), integers and doubles
+ * are never equal to each other, and object members must be in the same
+ * order.
+ *
+ * Complexity: O(N) in the size of the value
+ * Returns: %TRUE if the value is identical to @node, %FALSE otherwise
+ * Since: UNRELEASED
+ */
+gboolean
+wbl_tape_equal_node (WblTape  *self,
+                     guint     index,
+                     JsonNode *node)
+{
+	gsize offset;
+
+	g_return_val_if_fail (self != NULL, FALSE);
+	g_return_val_if_fail (index < self->n_values, FALSE);
+	g_return_val_if_fail (node != NULL, FALSE);
+
+	offset = self->values[index];
+
+	return tape_equal_node_at (self, &offset, node);
+}
+
+/**
+ * wbl_tape_dup_node:
+ * @self: a #WblTape
+ * @index: index of the value to get, less than wbl_tape_get_n_values()
+ *
+ * Build a new #JsonNode for the value at @index in @self. It is equal to, and
+ * serialises identically to, the node it was created from.
+ *
+ * Complexity: O(N) in the size of the value
+ * Returns: (transfer full): a new #JsonNode
+ * Since: UNRELEASED
+ */
+JsonNode *
+wbl_tape_dup_node (WblTape *self,
+                   guint    index)
+{
+	gsize offset;
+
+	g_return_val_if_fail (self != NULL, NULL);
+	g_return_val_if_fail (index < self->n_values, NULL);
+
+	offset = self->values[index];
+
+	return tape_dup_node_at (self, &offset);
+}
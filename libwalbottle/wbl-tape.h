@@ -0,0 +1,69 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WBL_TAPE_H
+#define WBL_TAPE_H
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * WblTape:
+ *
+ * A reference counted, immutable list of JSON values, stored contiguously as
+ * a ‘tape’ of 32-bit cells, with each distinct string (including member names)
+ * stored once. This takes several times less memory than the equivalent
+ * #JsonNode trees, so is used for holding on to large numbers of generated
+ * instances.
+ *
+ * All the fields in the #WblTape structure are private and should never be
+ * accessed directly.
+ *
+ * Since: UNRELEASED
+ */
+typedef struct _WblTape WblTape;
+
+WblTape  *wbl_tape_new_from_nodes (JsonNode * const *nodes,
+                                   guint             n_nodes);
+WblTape  *wbl_tape_new_from_bytes (GBytes           *bytes,
+                                   GError          **error);
+
+WblTape  *wbl_tape_ref            (WblTape          *self);
+void      wbl_tape_unref          (WblTape          *self);
+
+guint     wbl_tape_get_n_values   (WblTape          *self);
+gsize     wbl_tape_get_n_bytes    (WblTape          *self);
+
+gboolean  wbl_tape_spill          (WblTape          *self,
+                                   GError          **error);
+gboolean  wbl_tape_is_spilled     (WblTape          *self);
+
+GBytes   *wbl_tape_serialise      (WblTape          *self);
+
+JsonNode *wbl_tape_dup_node       (WblTape          *self,
+                                   guint             index);
+gboolean  wbl_tape_equal_node     (WblTape          *self,
+                                   guint             index,
+                                   JsonNode         *node);
+
+G_END_DECLS
+
+#endif /* !WBL_TAPE_H */
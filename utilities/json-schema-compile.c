@@ -0,0 +1,2458 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <locale.h>
+#include <math.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <json-glib/json-glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wbl-schema.h"
+#include "utilities/wbl-utilities.h"
+
+/* Exit statuses. */
+typedef enum {
+	/* Success. */
+	EXIT_OK = 0,
+	/* Error parsing command line options. */
+	EXIT_INVALID_OPTIONS = 1,
+	/* JSON schema could not be parsed. */
+	EXIT_INVALID_SCHEMA = 2,
+} ExitStatus;
+
+/* Instance types, as bits in a mask. These are output as the
+ * ‘<PREFIX>_TYPE_*’ constants in the generated code. */
+typedef enum {
+	TYPE_NULL = 1 << 0,
+	TYPE_BOOLEAN = 1 << 1,
+	TYPE_INTEGER = 1 << 2,
+	TYPE_NUMBER = 1 << 3,
+	TYPE_STRING = 1 << 4,
+	TYPE_ARRAY = 1 << 5,
+	TYPE_OBJECT = 1 << 6,
+} TypeMask;
+
+#define TYPE_ALL (TYPE_NULL | TYPE_BOOLEAN | TYPE_INTEGER | TYPE_NUMBER | \
+                  TYPE_STRING | TYPE_ARRAY | TYPE_OBJECT)
+
+static const struct {
+	TypeMask type;
+	const gchar *schema_name;
+	const gchar *c_name;
+} types[] = {
+	{ TYPE_NULL, "null", "NULL" },
+	{ TYPE_BOOLEAN, "boolean", "BOOLEAN" },
+	{ TYPE_INTEGER, "integer", "INTEGER" },
+	{ TYPE_NUMBER, "number", "NUMBER" },
+	{ TYPE_STRING, "string", "STRING" },
+	{ TYPE_ARRAY, "array", "ARRAY" },
+	{ TYPE_OBJECT, "object", "OBJECT" },
+};
+
+/* Keywords which affect validation. A subschema with none of these always
+ * validates, so no code needs to be generated for it. */
+static const gchar * const validation_keywords[] = {
+	"multipleOf", "maximum", "minimum", "maxLength", "minLength",
+	"pattern", "enum", "type", "allOf", "anyOf", "oneOf", "not",
+	"items", "additionalItems", "maxItems", "minItems", "uniqueItems",
+	"maxProperties", "minProperties", "required", "additionalProperties",
+	"properties", "patternProperties", "dependencies",
+};
+
+/* Runtime helpers which are only output if the generated code uses them.
+ * In the templates, ‘@P@’ is replaced by the function name prefix, and ‘@PU@’
+ * by its upper case form. */
+typedef enum {
+	HELPER_TYPE = 1 << 0,
+	HELPER_DIVIDES = 1 << 1,
+	HELPER_STRING_HASH = 1 << 2,
+	HELPER_UNIQUE_ITEMS = 1 << 3,
+} Helpers;
+
+static const gchar type_enum_template[] =
+	"enum {\n"
+	"\t@PU@_TYPE_NULL = 1 << 0,\n"
+	"\t@PU@_TYPE_BOOLEAN = 1 << 1,\n"
+	"\t@PU@_TYPE_INTEGER = 1 << 2,\n"
+	"\t@PU@_TYPE_NUMBER = 1 << 3,\n"
+	"\t@PU@_TYPE_STRING = 1 << 4,\n"
+	"\t@PU@_TYPE_ARRAY = 1 << 5,\n"
+	"\t@PU@_TYPE_OBJECT = 1 << 6,\n"
+	"};\n"
+	"\n";
+
+static const gchar type_template[] =
+	"static guint\n"
+	"@P@_type (JsonNode *node)\n"
+	"{\n"
+	"\tGType value_type;\n"
+	"\n"
+	"\tswitch (json_node_get_node_type (node)) {\n"
+	"\tcase JSON_NODE_OBJECT:\n"
+	"\t\treturn @PU@_TYPE_OBJECT;\n"
+	"\tcase JSON_NODE_ARRAY:\n"
+	"\t\treturn @PU@_TYPE_ARRAY;\n"
+	"\tcase JSON_NODE_NULL:\n"
+	"\t\treturn @PU@_TYPE_NULL;\n"
+	"\tcase JSON_NODE_VALUE:\n"
+	"\t\tvalue_type = json_node_get_value_type (node);\n"
+	"\n"
+	"\t\tif (value_type == G_TYPE_INT64) {\n"
+	"\t\t\treturn @PU@_TYPE_INTEGER;\n"
+	"\t\t} else if (value_type == G_TYPE_DOUBLE) {\n"
+	"\t\t\treturn @PU@_TYPE_NUMBER;\n"
+	"\t\t} else if (value_type == G_TYPE_STRING) {\n"
+	"\t\t\treturn @PU@_TYPE_STRING;\n"
+	"\t\t} else if (value_type == G_TYPE_BOOLEAN) {\n"
+	"\t\t\treturn @PU@_TYPE_BOOLEAN;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\treturn 0;\n"
+	"\tdefault:\n"
+	"\t\treturn 0;\n"
+	"\t}\n"
+	"}\n"
+	"\n";
+
+/* Must match apply_multiple_of() in libwalbottle. */
+static const gchar divides_template[] =
+	"static gboolean\n"
+	"@P@_divides (gdouble i, gdouble s)\n"
+	"{\n"
+	"\tgint64 n = (gint64) trunc (i / s);\n"
+	"\n"
+	"\treturn (fabs (n * s - i) <= (ABS (n) + 1) * DBL_EPSILON);\n"
+	"}\n"
+	"\n";
+
+/* Must match string_hash() below. */
+static const gchar string_hash_template[] =
+	"static guint32\n"
+	"@P@_string_hash (const gchar *str, guint32 seed)\n"
+	"{\n"
+	"\tconst guchar *p;\n"
+	"\tguint32 h = 2166136261u ^ seed;\n"
+	"\n"
+	"\tfor (p = (const guchar *) str; *p != '\\0'; p++) {\n"
+	"\t\th = (h ^ *p) * 16777619u;\n"
+	"\t}\n"
+	"\n"
+	"\th ^= h >> 16;\n"
+	"\th *= 0x45d9f3bu;\n"
+	"\th ^= h >> 16;\n"
+	"\n"
+	"\treturn h;\n"
+	"}\n"
+	"\n";
+
+/* Must match wbl_json_node_hash() and wbl_json_node_equal() in libwalbottle,
+ * as used by apply_unique_items(). */
+static const gchar unique_items_template[] =
+	"static guint\n"
+	"@P@_node_hash (gconstpointer key)\n"
+	"{\n"
+	"\tJsonNode *node = (JsonNode *) key;\n"
+	"\tJsonArray *array;\n"
+	"\tguint length;\n"
+	"\tgint64 i;\n"
+	"\tgdouble d;\n"
+	"\n"
+	"\tswitch (@P@_type (node)) {\n"
+	"\tcase @PU@_TYPE_BOOLEAN:\n"
+	"\t\treturn json_node_get_boolean (node) ? 175 : 8823;\n"
+	"\tcase @PU@_TYPE_NULL:\n"
+	"\t\treturn 33866;\n"
+	"\tcase @PU@_TYPE_STRING:\n"
+	"\t\treturn g_str_hash (json_node_get_string (node));\n"
+	"\tcase @PU@_TYPE_INTEGER:\n"
+	"\t\ti = json_node_get_int (node);\n"
+	"\t\treturn g_int64_hash (&i);\n"
+	"\tcase @PU@_TYPE_NUMBER:\n"
+	"\t\td = json_node_get_double (node);\n"
+	"\t\treturn g_double_hash (&d);\n"
+	"\tcase @PU@_TYPE_ARRAY:\n"
+	"\t\tarray = json_node_get_array (node);\n"
+	"\t\tlength = json_array_get_length (array);\n"
+	"\n"
+	"\t\tif (length == 0) {\n"
+	"\t\t\treturn 7735;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\treturn (length | @P@_node_hash (json_array_get_element (array, 0)));\n"
+	"\tcase @PU@_TYPE_OBJECT:\n"
+	"\t\tlength = json_object_get_size (json_node_get_object (node)) + 23545;\n"
+	"\t\treturn g_int_hash (&length);\n"
+	"\tdefault:\n"
+	"\t\treturn 0;\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"static gboolean\n"
+	"@P@_node_equal (gconstpointer a, gconstpointer b)\n"
+	"{\n"
+	"\tJsonNode *node_a = (JsonNode *) a, *node_b = (JsonNode *) b;\n"
+	"\tguint type_a, type_b, length, i;\n"
+	"\tJsonArray *array_a, *array_b;\n"
+	"\tJsonObject *object_a, *object_b;\n"
+	"\tJsonObjectIter iter;\n"
+	"\tconst gchar *member_name;\n"
+	"\tJsonNode *member_a, *member_b;\n"
+	"\tconst guint numeric = @PU@_TYPE_INTEGER | @PU@_TYPE_NUMBER;\n"
+	"\n"
+	"\tif (node_a == node_b) {\n"
+	"\t\treturn TRUE;\n"
+	"\t}\n"
+	"\n"
+	"\ttype_a = @P@_type (node_a);\n"
+	"\ttype_b = @P@_type (node_b);\n"
+	"\n"
+	"\tif (type_a != type_b &&\n"
+	"\t    ((type_a & numeric) == 0 || (type_b & numeric) == 0)) {\n"
+	"\t\treturn FALSE;\n"
+	"\t}\n"
+	"\n"
+	"\tswitch (type_a) {\n"
+	"\tcase @PU@_TYPE_NULL:\n"
+	"\t\treturn TRUE;\n"
+	"\tcase @PU@_TYPE_BOOLEAN:\n"
+	"\t\treturn (json_node_get_boolean (node_a) ==\n"
+	"\t\t        json_node_get_boolean (node_b));\n"
+	"\tcase @PU@_TYPE_STRING:\n"
+	"\t\treturn g_str_equal (json_node_get_string (node_a),\n"
+	"\t\t                    json_node_get_string (node_b));\n"
+	"\tcase @PU@_TYPE_INTEGER:\n"
+	"\tcase @PU@_TYPE_NUMBER:\n"
+	"\t\tif (type_a == @PU@_TYPE_INTEGER && type_b == @PU@_TYPE_INTEGER) {\n"
+	"\t\t\treturn (json_node_get_int (node_a) ==\n"
+	"\t\t\t        json_node_get_int (node_b));\n"
+	"\t\t}\n"
+	"\n"
+	"\t\treturn (json_node_get_double (node_a) ==\n"
+	"\t\t        json_node_get_double (node_b));\n"
+	"\tcase @PU@_TYPE_ARRAY:\n"
+	"\t\tarray_a = json_node_get_array (node_a);\n"
+	"\t\tarray_b = json_node_get_array (node_b);\n"
+	"\t\tlength = json_array_get_length (array_a);\n"
+	"\n"
+	"\t\tif (length != json_array_get_length (array_b)) {\n"
+	"\t\t\treturn FALSE;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\tfor (i = 0; i < length; i++) {\n"
+	"\t\t\tif (!@P@_node_equal (json_array_get_element (array_a, i),\n"
+	"\t\t\t                     json_array_get_element (array_b, i))) {\n"
+	"\t\t\t\treturn FALSE;\n"
+	"\t\t\t}\n"
+	"\t\t}\n"
+	"\n"
+	"\t\treturn TRUE;\n"
+	"\tcase @PU@_TYPE_OBJECT:\n"
+	"\t\tobject_a = json_node_get_object (node_a);\n"
+	"\t\tobject_b = json_node_get_object (node_b);\n"
+	"\n"
+	"\t\tif (json_object_get_size (object_a) !=\n"
+	"\t\t    json_object_get_size (object_b)) {\n"
+	"\t\t\treturn FALSE;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\tjson_object_iter_init (&iter, object_a);\n"
+	"\n"
+	"\t\twhile (json_object_iter_next (&iter, &member_name, &member_a)) {\n"
+	"\t\t\tmember_b = json_object_get_member (object_b, member_name);\n"
+	"\n"
+	"\t\t\tif (member_b == NULL ||\n"
+	"\t\t\t    !@P@_node_equal (member_a, member_b)) {\n"
+	"\t\t\t\treturn FALSE;\n"
+	"\t\t\t}\n"
+	"\t\t}\n"
+	"\n"
+	"\t\treturn TRUE;\n"
+	"\tdefault:\n"
+	"\t\treturn FALSE;\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"static gboolean\n"
+	"@P@_unique_items (JsonArray *array)\n"
+	"{\n"
+	"\tGHashTable *set = NULL;\n"
+	"\tguint i, length;\n"
+	"\tgboolean unique = TRUE;\n"
+	"\n"
+	"\tlength = json_array_get_length (array);\n"
+	"\tset = g_hash_table_new (@P@_node_hash, @P@_node_equal);\n"
+	"\n"
+	"\tfor (i = 0; i < length && unique; i++) {\n"
+	"\t\tJsonNode *element = json_array_get_element (array, i);\n"
+	"\n"
+	"\t\tif (g_hash_table_contains (set, element)) {\n"
+	"\t\t\tunique = FALSE;\n"
+	"\t\t} else {\n"
+	"\t\t\tg_hash_table_add (set, element);\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\n"
+	"\tg_hash_table_unref (set);\n"
+	"\n"
+	"\treturn unique;\n"
+	"}\n"
+	"\n";
+
+/* Maximum number of seeds to try for each perfect hash table size, and the
+ * maximum table size to try, as a multiple of the number of strings. */
+#define PERFECT_HASH_MAX_SEEDS 1024
+#define PERFECT_HASH_MAX_LOAD_FACTOR 16
+
+/* State while compiling a schema. Each subschema is compiled to a static
+ * function, ‘<prefix>_schema_<id>()’, which returns whether an instance is
+ * valid against it. Regular expressions, property name lookups, enums and
+ * constants are compiled to further static functions, which are output before
+ * the subschemas. */
+typedef struct {
+	const gchar *prefix;  /* unowned */
+	gchar *prefix_upper;  /* owned */
+
+	GString *functions;  /* owned */
+	GString *prototypes;  /* owned */
+	GString *schemas;  /* owned */
+	Helpers helpers;
+
+	GHashTable/*<unowned JsonObject, uint>*/ *subschema_ids;  /* owned */
+	GQueue/*<unowned JsonObject>*/ pending_subschemas;
+	GHashTable/*<unowned utf8, uint>*/ *regex_ids;  /* owned */
+
+	guint n_lookups;
+	guint n_enums;
+	guint n_constants;
+} Compiler;
+
+static void
+compiler_init (Compiler    *compiler,
+               const gchar *prefix)
+{
+	compiler->prefix = prefix;
+	compiler->prefix_upper = g_ascii_strup (prefix, -1);
+
+	compiler->functions = g_string_new ("");
+	compiler->prototypes = g_string_new ("");
+	compiler->schemas = g_string_new ("");
+	compiler->helpers = 0;
+
+	compiler->subschema_ids = g_hash_table_new (g_direct_hash,
+	                                            g_direct_equal);
+	g_queue_init (&compiler->pending_subschemas);
+	compiler->regex_ids = g_hash_table_new (g_str_hash, g_str_equal);
+
+	compiler->n_lookups = 0;
+	compiler->n_enums = 0;
+	compiler->n_constants = 0;
+}
+
+static void
+compiler_clear (Compiler *compiler)
+{
+	g_hash_table_unref (compiler->regex_ids);
+	g_queue_clear (&compiler->pending_subschemas);
+	g_hash_table_unref (compiler->subschema_ids);
+
+	g_string_free (compiler->schemas, TRUE);
+	g_string_free (compiler->prototypes, TRUE);
+	g_string_free (compiler->functions, TRUE);
+
+	g_free (compiler->prefix_upper);
+}
+
+/* Append @template to @out, substituting the prefix for ‘@P@’ and ‘@PU@’.
+ *
+ * Complexity: O(N) in the length of @template */
+static void
+append_template (Compiler    *compiler,
+                 GString     *out,
+                 const gchar *template)
+{
+	const gchar *p;
+
+	for (p = template; *p != '\0'; p++) {
+		if (g_str_has_prefix (p, "@PU@")) {
+			g_string_append (out, compiler->prefix_upper);
+			p += strlen ("@PU@") - 1;
+		} else if (g_str_has_prefix (p, "@P@")) {
+			g_string_append (out, compiler->prefix);
+			p += strlen ("@P@") - 1;
+		} else {
+			g_string_append_c (out, *p);
+		}
+	}
+}
+
+/* Format @str as a C string literal. Everything outside printable ASCII is
+ * octal-escaped, as is ‘?’, to avoid trigraphs.
+ *
+ * Complexity: O(N) in the length of @str */
+static gchar *
+string_literal (const gchar *str)
+{
+	GString *out = NULL;  /* owned */
+	const guchar *p;
+
+	out = g_string_new ("\"");
+
+	for (p = (const guchar *) str; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\') {
+			g_string_append_c (out, '\\');
+			g_string_append_c (out, *p);
+		} else if (*p == '?' || *p < 0x20 || *p >= 0x7f) {
+			g_string_append_printf (out, "\\%03o", (guint) *p);
+		} else {
+			g_string_append_c (out, *p);
+		}
+	}
+
+	g_string_append_c (out, '"');
+
+	return g_string_free (out, FALSE);
+}
+
+/* Complexity: O(1) */
+static gchar *
+int64_literal (gint64 value)
+{
+	if (value == G_MININT64) {
+		return g_strdup ("G_MININT64");
+	}
+
+	return g_strdup_printf ("G_GINT64_CONSTANT (%" G_GINT64_FORMAT ")",
+	                        value);
+}
+
+/* Format @value as a C double literal which round-trips exactly.
+ *
+ * Complexity: O(1) */
+static gchar *
+double_literal (gdouble value)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	if (isinf (value)) {
+		return g_strdup ((value > 0.0) ? "HUGE_VAL" : "(-HUGE_VAL)");
+	}
+
+	g_ascii_formatd (buf, sizeof (buf), "%.17g", value);
+
+	if (strpbrk (buf, ".e") == NULL) {
+		return g_strconcat (buf, ".0", NULL);
+	}
+
+	return g_strdup (buf);
+}
+
+/* Format a single character as a C character literal for a case label.
+ *
+ * Complexity: O(1) */
+static gchar *
+char_literal (guchar c)
+{
+	if (g_ascii_isalnum (c) || c == '_' || c == '-' || c == '.' ||
+	    c == '$' || c == '@' || c == ' ') {
+		return g_strdup_printf ("'%c'", c);
+	}
+
+	return g_strdup_printf ("0x%02x", (guint) c);
+}
+
+/* Build a C expression for the bitwise OR of the types in @mask.
+ *
+ * Complexity: O(1) */
+static gchar *
+type_mask_expression (Compiler *compiler,
+                      guint     mask)
+{
+	GString *out = NULL;  /* owned */
+	gsize i;
+
+	out = g_string_new ("");
+
+	for (i = 0; i < G_N_ELEMENTS (types); i++) {
+		if (!(mask & types[i].type)) {
+			continue;
+		}
+
+		if (out->len > 0) {
+			g_string_append (out, " | ");
+		}
+
+		g_string_append_printf (out, "%s_TYPE_%s",
+		                        compiler->prefix_upper,
+		                        types[i].c_name);
+	}
+
+	return g_string_free (out, FALSE);
+}
+
+/* Convert a type keyword value to a #TypeMask. ‘number’ includes integers.
+ *
+ * Complexity: O(N) in the number of types in @type_node */
+static guint
+type_mask_from_node (JsonNode *type_node)
+{
+	JsonArray *type_array = NULL;  /* owned */
+	guint mask = 0, i;
+
+	if (JSON_NODE_HOLDS_ARRAY (type_node)) {
+		type_array = json_array_ref (json_node_get_array (type_node));
+	} else {
+		type_array = json_array_new ();
+		json_array_add_element (type_array, json_node_copy (type_node));
+	}
+
+	for (i = 0; i < json_array_get_length (type_array); i++) {
+		const gchar *name;
+		gsize j;
+
+		name = json_array_get_string_element (type_array, i);
+
+		for (j = 0; j < G_N_ELEMENTS (types); j++) {
+			if (g_strcmp0 (name, types[j].schema_name) == 0) {
+				mask |= types[j].type;
+			}
+		}
+
+		if (g_strcmp0 (name, "number") == 0) {
+			mask |= TYPE_INTEGER;
+		}
+	}
+
+	json_array_unref (type_array);
+
+	return mask;
+}
+
+/* Whether @schema validates every instance.
+ *
+ * Complexity: O(1) */
+static gboolean
+schema_is_trivial (JsonObject *schema)
+{
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS (validation_keywords); i++) {
+		if (json_object_has_member (schema, validation_keywords[i])) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Return the ID of the function for @schema, queueing it to be compiled if
+ * this is the first time it has been seen.
+ *
+ * Complexity: O(1) */
+static guint
+compiler_add_subschema (Compiler   *compiler,
+                        JsonObject *schema)
+{
+	gpointer id;
+	guint new_id;
+
+	if (g_hash_table_lookup_extended (compiler->subschema_ids, schema,
+	                                  NULL, &id)) {
+		return GPOINTER_TO_UINT (id);
+	}
+
+	new_id = g_hash_table_size (compiler->subschema_ids);
+	g_hash_table_insert (compiler->subschema_ids, schema,
+	                     GUINT_TO_POINTER (new_id));
+	g_queue_push_tail (&compiler->pending_subschemas, schema);
+
+	g_string_append_printf (compiler->prototypes,
+	                        "static gboolean %s_schema_%u "
+	                        "(JsonNode *instance);\n",
+	                        compiler->prefix, new_id);
+
+	return new_id;
+}
+
+/* Return the ID of the accessor function for @pattern, outputting it if this
+ * is the first time it has been seen. The regex is compiled on first use, in
+ * a thread-safe way.
+ *
+ * Complexity: O(1) */
+static guint
+compiler_add_regex (Compiler    *compiler,
+                    const gchar *pattern)
+{
+	gpointer id;
+	guint new_id;
+	gchar *literal = NULL;  /* owned */
+
+	if (g_hash_table_lookup_extended (compiler->regex_ids, pattern,
+	                                  NULL, &id)) {
+		return GPOINTER_TO_UINT (id);
+	}
+
+	new_id = g_hash_table_size (compiler->regex_ids);
+	g_hash_table_insert (compiler->regex_ids, (gpointer) pattern,
+	                     GUINT_TO_POINTER (new_id));
+
+	literal = string_literal (pattern);
+
+	g_string_append_printf (compiler->functions,
+	                        "static GRegex *\n"
+	                        "%s_regex_%u (void)\n"
+	                        "{\n"
+	                        "\tstatic gsize regex = 0;\n"
+	                        "\n"
+	                        "\tif (g_once_init_enter (&regex)) {\n"
+	                        "\t\tg_once_init_leave (&regex, (gsize) g_regex_new (%s, 0, 0, NULL));\n"
+	                        "\t}\n"
+	                        "\n"
+	                        "\treturn (GRegex *) regex;\n"
+	                        "}\n"
+	                        "\n",
+	                        compiler->prefix, new_id, literal);
+
+	g_free (literal);
+
+	return new_id;
+}
+
+typedef struct {
+	const gchar *name;  /* unowned */
+	gsize length;
+	guint index;
+} LookupEntry;
+
+static gint
+lookup_entry_compare (gconstpointer a,
+                      gconstpointer b)
+{
+	const LookupEntry *entry_a = a, *entry_b = b;
+
+	if (entry_a->length != entry_b->length) {
+		return (entry_a->length < entry_b->length) ? -1 : 1;
+	}
+
+	return strcmp (entry_a->name, entry_b->name);
+}
+
+/* Output a function which maps each of @names to its index in the array, and
+ * any other string to -1, by switching on the string length and then its
+ * first byte, then comparing the rest of the string. Return its ID.
+ *
+ * Complexity: O(N log N) in the number of @names */
+static guint
+compiler_add_lookup (Compiler                    *compiler,
+                     GPtrArray/*<unowned utf8>*/ *names)
+{
+	GArray/*<LookupEntry>*/ *entries = NULL;  /* owned */
+	GString *out;  /* unowned */
+	guint id, i;
+
+	id = compiler->n_lookups++;
+	out = compiler->functions;
+
+	entries = g_array_sized_new (FALSE, FALSE, sizeof (LookupEntry),
+	                             names->len);
+
+	for (i = 0; i < names->len; i++) {
+		LookupEntry entry;
+
+		entry.name = names->pdata[i];
+		entry.length = strlen (entry.name);
+		entry.index = i;
+		g_array_append_val (entries, entry);
+	}
+
+	g_array_sort (entries, lookup_entry_compare);
+
+	g_string_append_printf (out,
+	                        "static gint\n"
+	                        "%s_lookup_%u (const gchar *name)\n"
+	                        "{\n"
+	                        "\tswitch (strlen (name)) {\n",
+	                        compiler->prefix, id);
+
+	for (i = 0; i < entries->len;) {
+		const LookupEntry *first;
+		guint j;
+
+		first = &g_array_index (entries, LookupEntry, i);
+
+		g_string_append_printf (out, "\tcase %" G_GSIZE_FORMAT ":\n",
+		                        first->length);
+
+		if (first->length == 0) {
+			g_string_append_printf (out, "\t\treturn %u;\n",
+			                        first->index);
+			i++;
+			continue;
+		}
+
+		g_string_append (out, "\t\tswitch ((guchar) name[0]) {\n");
+
+		for (j = i;
+		     j < entries->len &&
+		     g_array_index (entries, LookupEntry, j).length == first->length;) {
+			const LookupEntry *entry;
+			gchar *c = NULL;  /* owned */
+
+			entry = &g_array_index (entries, LookupEntry, j);
+			c = char_literal (entry->name[0]);
+
+			g_string_append_printf (out, "\t\tcase %s:\n", c);
+			g_free (c);
+
+			/* All entries with this length and first byte. */
+			while (j < entries->len &&
+			       g_array_index (entries, LookupEntry, j).length == first->length &&
+			       g_array_index (entries, LookupEntry, j).name[0] == entry->name[0]) {
+				const LookupEntry *match;
+
+				match = &g_array_index (entries, LookupEntry, j);
+
+				if (match->length == 1) {
+					g_string_append_printf (out,
+					                        "\t\t\treturn %u;\n",
+					                        match->index);
+				} else {
+					gchar *rest = NULL;  /* owned */
+
+					rest = string_literal (match->name + 1);
+					g_string_append_printf (out,
+					                        "\t\t\tif (memcmp (name + 1, %s, %" G_GSIZE_FORMAT ") == 0) {\n"
+					                        "\t\t\t\treturn %u;\n"
+					                        "\t\t\t}\n",
+					                        rest,
+					                        match->length - 1,
+					                        match->index);
+					g_free (rest);
+				}
+
+				j++;
+			}
+
+			if (entry->length > 1) {
+				g_string_append (out, "\t\t\tbreak;\n");
+			}
+		}
+
+		g_string_append (out,
+		                 "\t\tdefault:\n"
+		                 "\t\t\tbreak;\n"
+		                 "\t\t}\n"
+		                 "\t\tbreak;\n");
+
+		i = j;
+	}
+
+	g_string_append (out,
+	                 "\tdefault:\n"
+	                 "\t\tbreak;\n"
+	                 "\t}\n"
+	                 "\n"
+	                 "\treturn -1;\n"
+	                 "}\n"
+	                 "\n");
+
+	g_array_unref (entries);
+
+	return id;
+}
+
+static guint compiler_add_constant (Compiler *compiler,
+                                    JsonNode *constant);
+
+/* Build a C boolean expression which checks whether the instance in
+ * @node_var (whose type is in @type_var) equals @constant, following
+ * wbl_json_node_equal(). Arrays and objects are checked by separate
+ * functions.
+ *
+ * Complexity: O(1), plus compiler_add_constant() for arrays and objects */
+static gchar *
+constant_expression (Compiler    *compiler,
+                     JsonNode    *constant,
+                     const gchar *node_var,
+                     const gchar *type_var)
+{
+	const gchar *pu = compiler->prefix_upper;
+	GType value_type;
+
+	switch (json_node_get_node_type (constant)) {
+	case JSON_NODE_NULL:
+		return g_strdup_printf ("%s == %s_TYPE_NULL", type_var, pu);
+	case JSON_NODE_ARRAY:
+	case JSON_NODE_OBJECT:
+		return g_strdup_printf ("%s_constant_%u (%s)", compiler->prefix,
+		                        compiler_add_constant (compiler,
+		                                               constant),
+		                        node_var);
+	case JSON_NODE_VALUE:
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	value_type = json_node_get_value_type (constant);
+
+	if (value_type == G_TYPE_BOOLEAN) {
+		return g_strdup_printf ("(%s == %s_TYPE_BOOLEAN && "
+		                        "%sjson_node_get_boolean (%s))",
+		                        type_var, pu,
+		                        json_node_get_boolean (constant) ? "" : "!",
+		                        node_var);
+	} else if (value_type == G_TYPE_INT64) {
+		gchar *literal = NULL;  /* owned */
+		gchar *retval = NULL;  /* owned */
+
+		literal = int64_literal (json_node_get_int (constant));
+		retval = g_strdup_printf ("((%s == %s_TYPE_INTEGER && "
+		                          "json_node_get_int (%s) == %s) || "
+		                          "(%s == %s_TYPE_NUMBER && "
+		                          "json_node_get_double (%s) == "
+		                          "(gdouble) %s))",
+		                          type_var, pu, node_var, literal,
+		                          type_var, pu, node_var, literal);
+		g_free (literal);
+
+		return retval;
+	} else if (value_type == G_TYPE_DOUBLE) {
+		gchar *literal = NULL;  /* owned */
+		gchar *retval = NULL;  /* owned */
+
+		literal = double_literal (json_node_get_double (constant));
+		retval = g_strdup_printf ("((%s & (%s_TYPE_INTEGER | "
+		                          "%s_TYPE_NUMBER)) != 0 && "
+		                          "json_node_get_double (%s) == %s)",
+		                          type_var, pu, pu, node_var, literal);
+		g_free (literal);
+
+		return retval;
+	} else if (value_type == G_TYPE_STRING) {
+		gchar *literal = NULL;  /* owned */
+		gchar *retval = NULL;  /* owned */
+
+		literal = string_literal (json_node_get_string (constant));
+		retval = g_strdup_printf ("(%s == %s_TYPE_STRING && "
+		                          "strcmp (json_node_get_string (%s), "
+		                          "%s) == 0)",
+		                          type_var, pu, node_var, literal);
+		g_free (literal);
+
+		return retval;
+	} else {
+		g_assert_not_reached ();
+	}
+}
+
+/* Append a check that the child instance returned by @getter equals
+ * @constant. Set @uses_child if the check needs the ‘child’ and ‘type’
+ * variables.
+ *
+ * Complexity: O(constant_expression) */
+static void
+append_child_constant_check (Compiler    *compiler,
+                             GString     *out,
+                             JsonNode    *constant,
+                             const gchar *getter,
+                             gboolean    *uses_child)
+{
+	gchar *expression = NULL;  /* owned */
+
+	if (JSON_NODE_HOLDS_ARRAY (constant) ||
+	    JSON_NODE_HOLDS_OBJECT (constant)) {
+		expression = constant_expression (compiler, constant, getter,
+		                                  NULL);
+		g_string_append_printf (out,
+		                        "\tif (!%s) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n",
+		                        expression);
+	} else {
+		expression = constant_expression (compiler, constant, "child",
+		                                  "type");
+		g_string_append_printf (out,
+		                        "\tchild = %s;\n"
+		                        "\n"
+		                        "\tif (child == NULL) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n"
+		                        "\ttype = %s_type (child);\n"
+		                        "\n"
+		                        "\tif (!(%s)) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n",
+		                        getter, compiler->prefix, expression);
+		*uses_child = TRUE;
+	}
+
+	g_free (expression);
+}
+
+/* Output a function which checks whether an instance equals the array or
+ * object @constant, and return its ID. Functions for any nested arrays and
+ * objects are output first.
+ *
+ * Complexity: O(N) in the size of @constant */
+static guint
+compiler_add_constant (Compiler *compiler,
+                       JsonNode *constant)
+{
+	GString *body = NULL;  /* owned */
+	gboolean uses_child = FALSE, uses_type = FALSE;
+	guint id;
+
+	body = g_string_new ("");
+
+	if (JSON_NODE_HOLDS_ARRAY (constant)) {
+		JsonArray *array;  /* unowned */
+		guint i;
+
+		array = json_node_get_array (constant);
+
+		g_string_append_printf (body,
+		                        "\tif (json_node_get_node_type (instance) != JSON_NODE_ARRAY) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n"
+		                        "\tarray = json_node_get_array (instance);\n"
+		                        "\n"
+		                        "\tif (json_array_get_length (array) != %u) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n",
+		                        json_array_get_length (array));
+
+		for (i = 0; i < json_array_get_length (array); i++) {
+			gchar *getter = NULL;  /* owned */
+
+			getter = g_strdup_printf ("json_array_get_element (array, %u)",
+			                          i);
+			append_child_constant_check (compiler, body,
+			                             json_array_get_element (array, i),
+			                             getter, &uses_child);
+			g_free (getter);
+		}
+
+		uses_type = uses_child;
+	} else {
+		JsonObject *object;  /* unowned */
+		JsonObjectIter iter;
+		const gchar *member_name;
+		JsonNode *member_node;  /* unowned */
+
+		object = json_node_get_object (constant);
+
+		g_string_append_printf (body,
+		                        "\tif (json_node_get_node_type (instance) != JSON_NODE_OBJECT) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n"
+		                        "\tobject = json_node_get_object (instance);\n"
+		                        "\n"
+		                        "\tif (json_object_get_size (object) != %u) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n",
+		                        json_object_get_size (object));
+
+		json_object_iter_init (&iter, object);
+
+		while (json_object_iter_next (&iter, &member_name,
+		                              &member_node)) {
+			gchar *literal = NULL;  /* owned */
+			gchar *getter = NULL;  /* owned */
+
+			/* Objects have to check for missing members, so always
+			 * go through the ‘child’ variable. */
+			literal = string_literal (member_name);
+			getter = g_strdup_printf ("json_object_get_member (object, %s)",
+			                          literal);
+
+			if (JSON_NODE_HOLDS_ARRAY (member_node) ||
+			    JSON_NODE_HOLDS_OBJECT (member_node)) {
+				gchar *expression = NULL;  /* owned */
+
+				expression = constant_expression (compiler,
+				                                  member_node,
+				                                  "child", NULL);
+				g_string_append_printf (body,
+				                        "\tchild = %s;\n"
+				                        "\n"
+				                        "\tif (child == NULL || !%s) {\n"
+				                        "\t\treturn FALSE;\n"
+				                        "\t}\n"
+				                        "\n",
+				                        getter, expression);
+				g_free (expression);
+				uses_child = TRUE;
+			} else {
+				gboolean uses_scalar = FALSE;
+
+				append_child_constant_check (compiler, body,
+				                             member_node,
+				                             getter,
+				                             &uses_scalar);
+				uses_child = uses_child || uses_scalar;
+				uses_type = uses_type || uses_scalar;
+			}
+
+			g_free (getter);
+			g_free (literal);
+		}
+	}
+
+	id = compiler->n_constants++;
+
+	g_string_append_printf (compiler->functions,
+	                        "static gboolean\n"
+	                        "%s_constant_%u (JsonNode *instance)\n"
+	                        "{\n",
+	                        compiler->prefix, id);
+
+	if (JSON_NODE_HOLDS_ARRAY (constant)) {
+		g_string_append (compiler->functions, "\tJsonArray *array;\n");
+	} else {
+		g_string_append (compiler->functions, "\tJsonObject *object;\n");
+	}
+
+	if (uses_child) {
+		g_string_append (compiler->functions, "\tJsonNode *child;\n");
+	}
+	if (uses_type) {
+		g_string_append (compiler->functions, "\tguint type;\n");
+		compiler->helpers |= HELPER_TYPE;
+	}
+
+	g_string_append_printf (compiler->functions,
+	                        "\n"
+	                        "%s"
+	                        "\treturn TRUE;\n"
+	                        "}\n"
+	                        "\n",
+	                        body->str);
+
+	g_string_free (body, TRUE);
+
+	return id;
+}
+
+static guint32
+string_hash (const gchar *str,
+             guint32      seed)
+{
+	const guchar *p;
+	guint32 h = 2166136261u ^ seed;
+
+	for (p = (const guchar *) str; *p != '\0'; p++) {
+		h = (h ^ *p) * 16777619u;
+	}
+
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+
+	return h;
+}
+
+/* Find a seed and a power-of-two number of buckets for which string_hash()
+ * maps each of @strings to a different bucket. The smallest table is tried
+ * first.
+ *
+ * Returns: %TRUE if a perfect hash was found; %FALSE otherwise
+ *
+ * Complexity: O(N * PERFECT_HASH_MAX_SEEDS * log(PERFECT_HASH_MAX_LOAD_FACTOR))
+ *    in the number of @strings */
+static gboolean
+find_perfect_hash (GPtrArray/*<unowned utf8>*/ *strings,
+                   guint32                     *seed_out,
+                   guint                       *n_buckets_out)
+{
+	guint n_buckets;
+
+	for (n_buckets = 1; n_buckets < strings->len; n_buckets *= 2);
+
+	for (; n_buckets <= strings->len * PERFECT_HASH_MAX_LOAD_FACTOR;
+	     n_buckets *= 2) {
+		gboolean *used = NULL;  /* owned */
+		guint32 seed;
+
+		used = g_new (gboolean, n_buckets);
+
+		for (seed = 0; seed < PERFECT_HASH_MAX_SEEDS; seed++) {
+			gboolean collision = FALSE;
+			guint i;
+
+			memset (used, 0, sizeof (*used) * n_buckets);
+
+			for (i = 0; i < strings->len && !collision; i++) {
+				guint bucket;
+
+				bucket = string_hash (strings->pdata[i], seed) &
+				         (n_buckets - 1);
+				collision = used[bucket];
+				used[bucket] = TRUE;
+			}
+
+			if (!collision) {
+				g_free (used);
+
+				*seed_out = seed;
+				*n_buckets_out = n_buckets;
+
+				return TRUE;
+			}
+		}
+
+		g_free (used);
+	}
+
+	return FALSE;
+}
+
+/* Output a function which checks whether an instance is one of @values, and
+ * return its ID. String values are looked up in a perfect hash table; other
+ * values are compared in turn.
+ *
+ * Complexity: O(find_perfect_hash + N * constant_expression) in the number
+ *    of @values */
+static guint
+compiler_add_enum (Compiler  *compiler,
+                   JsonArray *values)
+{
+	GPtrArray/*<unowned utf8>*/ *strings = NULL;  /* owned */
+	GString *others = NULL;  /* owned */
+	GString *out;  /* unowned */
+	guint id, i;
+
+	strings = g_ptr_array_new ();
+	others = g_string_new ("");
+
+	for (i = 0; i < json_array_get_length (values); i++) {
+		JsonNode *value;  /* unowned */
+		gchar *expression = NULL;  /* owned */
+
+		value = json_array_get_element (values, i);
+
+		if (JSON_NODE_HOLDS_VALUE (value) &&
+		    json_node_get_value_type (value) == G_TYPE_STRING) {
+			g_ptr_array_add (strings,
+			                 (gpointer) json_node_get_string (value));
+			continue;
+		}
+
+		expression = constant_expression (compiler, value, "instance",
+		                                  "type");
+
+		if (others->len > 0) {
+			g_string_append (others, " ||\n\t        ");
+		}
+
+		g_string_append (others, expression);
+		g_free (expression);
+	}
+
+	id = compiler->n_enums++;
+	out = compiler->functions;
+
+	g_string_append_printf (out,
+	                        "static gboolean\n"
+	                        "%s_enum_%u (JsonNode *instance,\n"
+	                        "%*s  guint     type)\n"
+	                        "{\n",
+	                        compiler->prefix, id,
+	                        (gint) (strlen (compiler->prefix) +
+	                                strlen ("_enum_") +
+	                                g_snprintf (NULL, 0, "%u", id)),
+	                        "");
+
+	if (strings->len == 1) {
+		gchar *literal = NULL;  /* owned */
+
+		literal = string_literal (strings->pdata[0]);
+		g_string_append_printf (out,
+		                        "\tif (type == %s_TYPE_STRING) {\n"
+		                        "\t\treturn (strcmp (json_node_get_string (instance), %s) == 0);\n"
+		                        "\t}\n"
+		                        "\n",
+		                        compiler->prefix_upper, literal);
+		g_free (literal);
+	} else if (strings->len > 1) {
+		guint32 seed;
+		guint n_buckets;
+
+		if (find_perfect_hash (strings, &seed, &n_buckets)) {
+			gchar **buckets = NULL;  /* owned */
+
+			compiler->helpers |= HELPER_STRING_HASH;
+			buckets = g_new0 (gchar *, n_buckets);
+
+			for (i = 0; i < strings->len; i++) {
+				buckets[string_hash (strings->pdata[i], seed) &
+				        (n_buckets - 1)] = string_literal (strings->pdata[i]);
+			}
+
+			g_string_append_printf (out,
+			                        "\tif (type == %s_TYPE_STRING) {\n"
+			                        "\t\tstatic const gchar * const strings[%u] = {\n",
+			                        compiler->prefix_upper,
+			                        n_buckets);
+
+			for (i = 0; i < n_buckets; i++) {
+				g_string_append_printf (out, "\t\t\t%s,\n",
+				                        (buckets[i] != NULL) ? buckets[i] : "NULL");
+				g_free (buckets[i]);
+			}
+
+			g_free (buckets);
+
+			g_string_append_printf (out,
+			                        "\t\t};\n"
+			                        "\t\tconst gchar *str, *candidate;\n"
+			                        "\n"
+			                        "\t\tstr = json_node_get_string (instance);\n"
+			                        "\t\tcandidate = strings[%s_string_hash (str, %uu) & %uu];\n"
+			                        "\n"
+			                        "\t\treturn (candidate != NULL && strcmp (str, candidate) == 0);\n"
+			                        "\t}\n"
+			                        "\n",
+			                        compiler->prefix, seed,
+			                        n_buckets - 1);
+		} else {
+			/* Fall back to comparing each string in turn. */
+			g_string_append (out,
+			                 "\tif (type == ");
+			g_string_append_printf (out,
+			                        "%s_TYPE_STRING) {\n"
+			                        "\t\tconst gchar *str = json_node_get_string (instance);\n"
+			                        "\n"
+			                        "\t\treturn (",
+			                        compiler->prefix_upper);
+
+			for (i = 0; i < strings->len; i++) {
+				gchar *literal = NULL;  /* owned */
+
+				literal = string_literal (strings->pdata[i]);
+				g_string_append_printf (out,
+				                        "%sstrcmp (str, %s) == 0",
+				                        (i > 0) ? " ||\n\t\t        " : "",
+				                        literal);
+				g_free (literal);
+			}
+
+			g_string_append (out,
+			                 ");\n"
+			                 "\t}\n"
+			                 "\n");
+		}
+	}
+
+	if (others->len > 0) {
+		g_string_append_printf (out,
+		                        "\treturn (%s);\n"
+		                        "}\n"
+		                        "\n",
+		                        others->str);
+	} else {
+		g_string_append (out,
+		                 "\treturn FALSE;\n"
+		                 "}\n"
+		                 "\n");
+	}
+
+	g_string_free (others, TRUE);
+	g_ptr_array_unref (strings);
+
+	return id;
+}
+
+/* Append a check which fails if the number instance compares to @limit with
+ * @op, following wbl_json_number_node_comparison(): integers are compared
+ * as integers, and anything else as doubles.
+ *
+ * Complexity: O(1) */
+static void
+append_number_limit (Compiler    *compiler,
+                     GString     *out,
+                     const gchar *keyword,
+                     JsonNode    *limit,
+                     const gchar *op)
+{
+	gchar *literal = NULL;  /* owned */
+
+	g_string_append_printf (out, "\t\t/* %s */\n", keyword);
+
+	if (json_node_get_value_type (limit) == G_TYPE_INT64) {
+		literal = int64_literal (json_node_get_int (limit));
+		g_string_append_printf (out,
+		                        "\t\tif (type == %s_TYPE_INTEGER) {\n"
+		                        "\t\t\tif (json_node_get_int (instance) %s %s) {\n"
+		                        "\t\t\t\treturn FALSE;\n"
+		                        "\t\t\t}\n"
+		                        "\t\t} else if (json_node_get_double (instance) %s (gdouble) %s) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        compiler->prefix_upper, op, literal,
+		                        op, literal);
+	} else {
+		literal = double_literal (json_node_get_double (limit));
+		g_string_append_printf (out,
+		                        "\t\tif (json_node_get_double (instance) %s %s) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        op, literal);
+	}
+
+	g_free (literal);
+}
+
+/* Whether the boolean keyword @keyword is present in @schema and true.
+ *
+ * Complexity: O(1) */
+static gboolean
+get_boolean_keyword (JsonObject  *schema,
+                     const gchar *keyword)
+{
+	JsonNode *node;  /* unowned */
+
+	node = json_object_get_member (schema, keyword);
+
+	return (node != NULL && JSON_NODE_HOLDS_VALUE (node) &&
+	        json_node_get_value_type (node) == G_TYPE_BOOLEAN &&
+	        json_node_get_boolean (node));
+}
+
+/* Get the integer keyword @keyword from @schema, or @default_value if it is
+ * not present.
+ *
+ * Complexity: O(1) */
+static gint64
+get_int_keyword (JsonObject  *schema,
+                 const gchar *keyword,
+                 gint64       default_value)
+{
+	JsonNode *node;  /* unowned */
+
+	node = json_object_get_member (schema, keyword);
+
+	if (node == NULL) {
+		return default_value;
+	}
+
+	return json_node_get_int (node);
+}
+
+/* multipleOf, maximum and minimum.
+ *
+ * Complexity: O(1) */
+static void
+compile_numbers (Compiler   *compiler,
+                 JsonObject *schema,
+                 GString    *out)
+{
+	JsonNode *multiple_of, *maximum, *minimum;  /* unowned */
+	const gchar *pu = compiler->prefix_upper;
+
+	multiple_of = json_object_get_member (schema, "multipleOf");
+	maximum = json_object_get_member (schema, "maximum");
+	minimum = json_object_get_member (schema, "minimum");
+
+	if (multiple_of == NULL && maximum == NULL && minimum == NULL) {
+		return;
+	}
+
+	g_string_append_printf (out,
+	                        "\tif ((type & (%s_TYPE_INTEGER | %s_TYPE_NUMBER)) != 0) {\n",
+	                        pu, pu);
+
+	if (multiple_of != NULL) {
+		gchar *literal = NULL;  /* owned */
+
+		compiler->helpers |= HELPER_DIVIDES;
+
+		g_string_append (out, "\t\t/* multipleOf */\n");
+
+		if (json_node_get_value_type (multiple_of) == G_TYPE_INT64) {
+			literal = int64_literal (json_node_get_int (multiple_of));
+			g_string_append_printf (out,
+			                        "\t\tif (type == %s_TYPE_INTEGER) {\n"
+			                        "\t\t\tif (json_node_get_int (instance) %% %s != 0) {\n"
+			                        "\t\t\t\treturn FALSE;\n"
+			                        "\t\t\t}\n"
+			                        "\t\t} else if (!%s_divides (json_node_get_double (instance), (gdouble) %s)) {\n"
+			                        "\t\t\treturn FALSE;\n"
+			                        "\t\t}\n"
+			                        "\n",
+			                        pu, literal, compiler->prefix,
+			                        literal);
+		} else {
+			literal = double_literal (json_node_get_double (multiple_of));
+			g_string_append_printf (out,
+			                        "\t\tif (type == %s_TYPE_INTEGER) {\n"
+			                        "\t\t\tif (!%s_divides (json_node_get_double (instance), %s)) {\n"
+			                        "\t\t\t\treturn FALSE;\n"
+			                        "\t\t\t}\n"
+			                        "\t\t} else if (fmod (json_node_get_double (instance), %s) != 0.0) {\n"
+			                        "\t\t\treturn FALSE;\n"
+			                        "\t\t}\n"
+			                        "\n",
+			                        pu, compiler->prefix, literal,
+			                        literal);
+		}
+
+		g_free (literal);
+	}
+
+	if (maximum != NULL) {
+		append_number_limit (compiler, out, "maximum", maximum,
+		                     get_boolean_keyword (schema, "exclusiveMaximum") ? ">=" : ">");
+	}
+
+	if (minimum != NULL) {
+		append_number_limit (compiler, out, "minimum", minimum,
+		                     get_boolean_keyword (schema, "exclusiveMinimum") ? "<=" : "<");
+	}
+
+	g_string_truncate (out, out->len - 1);
+	g_string_append (out, "\t}\n\n");
+}
+
+/* maxLength, minLength and pattern. The byte length of a string is an upper
+ * bound on its length in characters, so the characters only need counting if
+ * the byte length is out of bounds.
+ *
+ * Complexity: O(1) */
+static void
+compile_strings (Compiler   *compiler,
+                 JsonObject *schema,
+                 GString    *out)
+{
+	JsonNode *pattern;  /* unowned */
+	gint64 max_length, min_length;
+
+	max_length = get_int_keyword (schema, "maxLength", -1);
+	min_length = get_int_keyword (schema, "minLength", 0);
+	pattern = json_object_get_member (schema, "pattern");
+
+	if (max_length < 0 && min_length == 0 && pattern == NULL) {
+		return;
+	}
+
+	g_string_append_printf (out,
+	                        "\tif (type == %s_TYPE_STRING) {\n"
+	                        "\t\tconst gchar *str = json_node_get_string (instance);\n",
+	                        compiler->prefix_upper);
+
+	if (max_length >= 0 || min_length > 0) {
+		g_string_append (out,
+		                 "\t\tguint64 length = strlen (str);\n"
+		                 "\n"
+		                 "\t\t/* maxLength and minLength */\n");
+	} else {
+		g_string_append (out, "\n");
+	}
+
+	if (max_length >= 0 && min_length > 0) {
+		g_string_append_printf (out,
+		                        "\t\tif (length > G_GUINT64_CONSTANT (%" G_GINT64_FORMAT ") ||\n"
+		                        "\t\t    length < G_GUINT64_CONSTANT (%" G_GINT64_FORMAT ")) {\n"
+		                        "\t\t\tgint64 n_chars = g_utf8_strlen (str, -1);\n"
+		                        "\n"
+		                        "\t\t\tif (n_chars > G_GINT64_CONSTANT (%" G_GINT64_FORMAT ") ||\n"
+		                        "\t\t\t    n_chars < G_GINT64_CONSTANT (%" G_GINT64_FORMAT ")) {\n"
+		                        "\t\t\t\treturn FALSE;\n"
+		                        "\t\t\t}\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        max_length, min_length,
+		                        max_length, min_length);
+	} else if (max_length >= 0) {
+		g_string_append_printf (out,
+		                        "\t\tif (length > G_GUINT64_CONSTANT (%" G_GINT64_FORMAT ") &&\n"
+		                        "\t\t    g_utf8_strlen (str, -1) > G_GINT64_CONSTANT (%" G_GINT64_FORMAT ")) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        max_length, max_length);
+	} else if (min_length > 0) {
+		g_string_append_printf (out,
+		                        "\t\tif (length < G_GUINT64_CONSTANT (%" G_GINT64_FORMAT ") ||\n"
+		                        "\t\t    g_utf8_strlen (str, -1) < G_GINT64_CONSTANT (%" G_GINT64_FORMAT ")) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        min_length, min_length);
+	}
+
+	if (pattern != NULL) {
+		g_string_append_printf (out,
+		                        "\t\t/* pattern */\n"
+		                        "\t\tif (!g_regex_match (%s_regex_%u (), str, 0, NULL)) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        compiler->prefix,
+		                        compiler_add_regex (compiler,
+		                                            json_node_get_string (pattern)));
+	}
+
+	g_string_truncate (out, out->len - 1);
+	g_string_append (out, "\t}\n\n");
+}
+
+/* items, additionalItems, maxItems, minItems and uniqueItems. Tuple-style
+ * items are unrolled.
+ *
+ * Complexity: O(N) in the number of items schemas */
+static void
+compile_arrays (Compiler   *compiler,
+                JsonObject *schema,
+                GString    *out)
+{
+	GString *body = NULL;  /* owned */
+	JsonNode *items, *additional_items;  /* unowned */
+	gint64 max_items, min_items;
+	gboolean uses_i = FALSE;
+
+	body = g_string_new ("");
+
+	items = json_object_get_member (schema, "items");
+	additional_items = json_object_get_member (schema, "additionalItems");
+	max_items = get_int_keyword (schema, "maxItems", -1);
+	min_items = get_int_keyword (schema, "minItems", 0);
+
+	if (max_items >= 0) {
+		g_string_append_printf (body,
+		                        "\t\t/* maxItems */\n"
+		                        "\t\tif (length > G_GUINT64_CONSTANT (%" G_GINT64_FORMAT ")) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        max_items);
+	}
+
+	if (min_items > 0) {
+		g_string_append_printf (body,
+		                        "\t\t/* minItems */\n"
+		                        "\t\tif (length < G_GUINT64_CONSTANT (%" G_GINT64_FORMAT ")) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        min_items);
+	}
+
+	if (items != NULL && JSON_NODE_HOLDS_OBJECT (items) &&
+	    !schema_is_trivial (json_node_get_object (items))) {
+		g_string_append_printf (body,
+		                        "\t\t/* items */\n"
+		                        "\t\tfor (i = 0; i < length; i++) {\n"
+		                        "\t\t\tif (!%s_schema_%u (json_array_get_element (array, i))) {\n"
+		                        "\t\t\t\treturn FALSE;\n"
+		                        "\t\t\t}\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        compiler->prefix,
+		                        compiler_add_subschema (compiler,
+		                                                json_node_get_object (items)));
+		uses_i = TRUE;
+	} else if (items != NULL && JSON_NODE_HOLDS_ARRAY (items)) {
+		JsonArray *items_array;  /* unowned */
+		guint n_items, j;
+
+		items_array = json_node_get_array (items);
+		n_items = json_array_get_length (items_array);
+
+		if (additional_items != NULL &&
+		    JSON_NODE_HOLDS_VALUE (additional_items) &&
+		    !json_node_get_boolean (additional_items)) {
+			g_string_append_printf (body,
+			                        "\t\t/* additionalItems */\n"
+			                        "\t\tif (length > %u) {\n"
+			                        "\t\t\treturn FALSE;\n"
+			                        "\t\t}\n"
+			                        "\n",
+			                        n_items);
+		} else if (additional_items != NULL &&
+		           JSON_NODE_HOLDS_OBJECT (additional_items) &&
+		           !schema_is_trivial (json_node_get_object (additional_items))) {
+			g_string_append_printf (body,
+			                        "\t\t/* additionalItems */\n"
+			                        "\t\tfor (i = %u; i < length; i++) {\n"
+			                        "\t\t\tif (!%s_schema_%u (json_array_get_element (array, i))) {\n"
+			                        "\t\t\t\treturn FALSE;\n"
+			                        "\t\t\t}\n"
+			                        "\t\t}\n"
+			                        "\n",
+			                        n_items, compiler->prefix,
+			                        compiler_add_subschema (compiler,
+			                                                json_node_get_object (additional_items)));
+			uses_i = TRUE;
+		}
+
+		for (j = 0; j < n_items; j++) {
+			JsonObject *item;  /* unowned */
+
+			item = json_array_get_object_element (items_array, j);
+
+			if (schema_is_trivial (item)) {
+				continue;
+			}
+
+			g_string_append_printf (body,
+			                        "\t\t/* items[%u] */\n"
+			                        "\t\tif (length > %u &&\n"
+			                        "\t\t    !%s_schema_%u (json_array_get_element (array, %u))) {\n"
+			                        "\t\t\treturn FALSE;\n"
+			                        "\t\t}\n"
+			                        "\n",
+			                        j, j, compiler->prefix,
+			                        compiler_add_subschema (compiler,
+			                                                item),
+			                        j);
+		}
+	}
+
+	if (get_boolean_keyword (schema, "uniqueItems")) {
+		compiler->helpers |= HELPER_TYPE | HELPER_UNIQUE_ITEMS;
+		g_string_append_printf (body,
+		                        "\t\t/* uniqueItems */\n"
+		                        "\t\tif (!%s_unique_items (array)) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        compiler->prefix);
+	}
+
+	if (body->len > 0) {
+		g_string_append_printf (out,
+		                        "\tif (type == %s_TYPE_ARRAY) {\n"
+		                        "\t\tJsonArray *array = json_node_get_array (instance);\n"
+		                        "\t\tguint length = json_array_get_length (array);\n"
+		                        "%s"
+		                        "\n",
+		                        compiler->prefix_upper,
+		                        uses_i ? "\t\tguint i;\n" : "");
+		g_string_append_len (out, body->str, body->len - 1);
+		g_string_append (out, "\t}\n\n");
+	}
+
+	g_string_free (body, TRUE);
+}
+
+/* additionalProperties, properties and patternProperties. Each member of the
+ * instance is checked against the subschemas it matches, switching on the
+ * member name to find its properties subschema.
+ *
+ * Complexity: O(N) in the number of properties and patternProperties */
+static void
+compile_properties (Compiler   *compiler,
+                    JsonObject *schema,
+                    GString    *out)
+{
+	JsonNode *ap_node, *p_node, *pp_node;  /* unowned */
+	JsonObject *p_object = NULL, *pp_object = NULL;  /* unowned */
+	gboolean ap_is_false, ap_is_schema, need_matched;
+	GString *body = NULL;  /* owned */
+	JsonObjectIter iter;
+	const gchar *member_name;
+	JsonNode *member_node;  /* unowned */
+
+	ap_node = json_object_get_member (schema, "additionalProperties");
+	p_node = json_object_get_member (schema, "properties");
+	pp_node = json_object_get_member (schema, "patternProperties");
+
+	if (p_node != NULL) {
+		p_object = json_node_get_object (p_node);
+	}
+	if (pp_node != NULL) {
+		pp_object = json_node_get_object (pp_node);
+	}
+
+	ap_is_false = (ap_node != NULL && JSON_NODE_HOLDS_VALUE (ap_node) &&
+	               !json_node_get_boolean (ap_node));
+	ap_is_schema = (ap_node != NULL && JSON_NODE_HOLDS_OBJECT (ap_node) &&
+	                !schema_is_trivial (json_node_get_object (ap_node)));
+	need_matched = (ap_is_false || ap_is_schema);
+
+	body = g_string_new ("");
+
+	/* properties */
+	if (p_object != NULL && json_object_get_size (p_object) > 0) {
+		GPtrArray/*<unowned utf8>*/ *names = NULL;  /* owned */
+		GString *cases = NULL;  /* owned */
+
+		names = g_ptr_array_new ();
+		cases = g_string_new ("");
+
+		json_object_iter_init (&iter, p_object);
+
+		while (json_object_iter_next (&iter, &member_name,
+		                              &member_node)) {
+			JsonObject *child;  /* unowned */
+
+			child = json_node_get_object (member_node);
+
+			if (schema_is_trivial (child)) {
+				if (need_matched) {
+					g_string_append_printf (cases,
+					                        "\t\t\tcase %u:\n"
+					                        "\t\t\t\tmatched = TRUE;\n"
+					                        "\t\t\t\tbreak;\n",
+					                        names->len);
+				}
+			} else {
+				g_string_append_printf (cases,
+				                        "\t\t\tcase %u:\n"
+				                        "\t\t\t\tif (!%s_schema_%u (member_node)) {\n"
+				                        "\t\t\t\t\treturn FALSE;\n"
+				                        "\t\t\t\t}\n"
+				                        "%s"
+				                        "\t\t\t\tbreak;\n",
+				                        names->len, compiler->prefix,
+				                        compiler_add_subschema (compiler, child),
+				                        need_matched ? "\t\t\t\tmatched = TRUE;\n" : "");
+			}
+
+			g_ptr_array_add (names, (gpointer) member_name);
+		}
+
+		if (cases->len > 0) {
+			g_string_append_printf (body,
+			                        "\t\t\tswitch (%s_lookup_%u (member_name)) {\n"
+			                        "%s"
+			                        "\t\t\tdefault:\n"
+			                        "\t\t\t\tbreak;\n"
+			                        "\t\t\t}\n"
+			                        "\n",
+			                        compiler->prefix,
+			                        compiler_add_lookup (compiler, names),
+			                        cases->str);
+		}
+
+		g_string_free (cases, TRUE);
+		g_ptr_array_unref (names);
+	}
+
+	/* patternProperties */
+	if (pp_object != NULL) {
+		json_object_iter_init (&iter, pp_object);
+
+		while (json_object_iter_next (&iter, &member_name,
+		                              &member_node)) {
+			JsonObject *child;  /* unowned */
+			guint regex_id;
+
+			child = json_node_get_object (member_node);
+
+			if (schema_is_trivial (child) && !need_matched) {
+				continue;
+			}
+
+			regex_id = compiler_add_regex (compiler, member_name);
+
+			g_string_append_printf (body,
+			                        "\t\t\tif (g_regex_match (%s_regex_%u (), member_name, 0, NULL)) {\n",
+			                        compiler->prefix, regex_id);
+
+			if (!schema_is_trivial (child)) {
+				g_string_append_printf (body,
+				                        "\t\t\t\tif (!%s_schema_%u (member_node)) {\n"
+				                        "\t\t\t\t\treturn FALSE;\n"
+				                        "\t\t\t\t}\n",
+				                        compiler->prefix,
+				                        compiler_add_subschema (compiler, child));
+			}
+
+			if (need_matched) {
+				g_string_append (body, "\t\t\t\tmatched = TRUE;\n");
+			}
+
+			g_string_append (body,
+			                 "\t\t\t}\n"
+			                 "\n");
+		}
+	}
+
+	/* additionalProperties */
+	if (ap_is_false) {
+		g_string_append (body,
+		                 "\t\t\tif (!matched) {\n"
+		                 "\t\t\t\treturn FALSE;\n"
+		                 "\t\t\t}\n"
+		                 "\n");
+	} else if (ap_is_schema) {
+		g_string_append_printf (body,
+		                        "\t\t\tif (!matched && !%s_schema_%u (member_node)) {\n"
+		                        "\t\t\t\treturn FALSE;\n"
+		                        "\t\t\t}\n"
+		                        "\n",
+		                        compiler->prefix,
+		                        compiler_add_subschema (compiler,
+		                                                json_node_get_object (ap_node)));
+	}
+
+	if (body->len > 0) {
+		g_string_append_printf (out,
+		                        "\t\t/* properties, patternProperties and additionalProperties */\n"
+		                        "\t\tjson_object_iter_init (&iter, object);\n"
+		                        "\n"
+		                        "\t\twhile (json_object_iter_next (&iter, &member_name, &member_node)) {\n"
+		                        "%s",
+		                        need_matched ? "\t\t\tgboolean matched = FALSE;\n\n" : "");
+		g_string_append_len (out, body->str, body->len - 1);
+		g_string_append (out,
+		                 "\t\t}\n"
+		                 "\n");
+	}
+
+	g_string_free (body, TRUE);
+}
+
+/* maxProperties, minProperties, required, dependencies, and the properties
+ * keywords.
+ *
+ * Complexity: O(compile_properties + D) in the number of dependencies */
+static void
+compile_objects (Compiler   *compiler,
+                 JsonObject *schema,
+                 GString    *out)
+{
+	GString *body = NULL;  /* owned */
+	JsonNode *node;  /* unowned */
+	gint64 max_properties, min_properties;
+	gsize properties_start;
+
+	body = g_string_new ("");
+
+	max_properties = get_int_keyword (schema, "maxProperties", -1);
+	min_properties = get_int_keyword (schema, "minProperties", 0);
+
+	if (max_properties >= 0) {
+		g_string_append_printf (body,
+		                        "\t\t/* maxProperties */\n"
+		                        "\t\tif (json_object_get_size (object) > G_GUINT64_CONSTANT (%" G_GINT64_FORMAT ")) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        max_properties);
+	}
+
+	if (min_properties > 0) {
+		g_string_append_printf (body,
+		                        "\t\t/* minProperties */\n"
+		                        "\t\tif (json_object_get_size (object) < G_GUINT64_CONSTANT (%" G_GINT64_FORMAT ")) {\n"
+		                        "\t\t\treturn FALSE;\n"
+		                        "\t\t}\n"
+		                        "\n",
+		                        min_properties);
+	}
+
+	/* required */
+	node = json_object_get_member (schema, "required");
+
+	if (node != NULL) {
+		JsonArray *required;  /* unowned */
+		guint i;
+
+		required = json_node_get_array (node);
+		g_string_append (body, "\t\t/* required */\n");
+
+		for (i = 0; i < json_array_get_length (required); i++) {
+			gchar *literal = NULL;  /* owned */
+
+			literal = string_literal (json_array_get_string_element (required, i));
+			g_string_append_printf (body,
+			                        "\t\tif (!json_object_has_member (object, %s)) {\n"
+			                        "\t\t\treturn FALSE;\n"
+			                        "\t\t}\n",
+			                        literal);
+			g_free (literal);
+		}
+
+		g_string_append (body, "\n");
+	}
+
+	/* dependencies */
+	node = json_object_get_member (schema, "dependencies");
+
+	if (node != NULL) {
+		JsonObjectIter iter;
+		const gchar *member_name;
+		JsonNode *member_node;  /* unowned */
+
+		json_object_iter_init (&iter, json_node_get_object (node));
+
+		while (json_object_iter_next (&iter, &member_name,
+		                              &member_node)) {
+			gchar *literal = NULL;  /* owned */
+
+			if (JSON_NODE_HOLDS_OBJECT (member_node) &&
+			    schema_is_trivial (json_node_get_object (member_node))) {
+				continue;
+			} else if (JSON_NODE_HOLDS_ARRAY (member_node) &&
+			           json_array_get_length (json_node_get_array (member_node)) == 0) {
+				continue;
+			}
+
+			literal = string_literal (member_name);
+			g_string_append_printf (body,
+			                        "\t\t/* dependencies */\n"
+			                        "\t\tif (json_object_has_member (object, %s)) {\n",
+			                        literal);
+			g_free (literal);
+
+			if (JSON_NODE_HOLDS_OBJECT (member_node)) {
+				g_string_append_printf (body,
+				                        "\t\t\tif (!%s_schema_%u (instance)) {\n"
+				                        "\t\t\t\treturn FALSE;\n"
+				                        "\t\t\t}\n",
+				                        compiler->prefix,
+				                        compiler_add_subschema (compiler,
+				                                                json_node_get_object (member_node)));
+			} else {
+				JsonArray *properties;  /* unowned */
+				guint i;
+
+				properties = json_node_get_array (member_node);
+
+				for (i = 0; i < json_array_get_length (properties); i++) {
+					literal = string_literal (json_array_get_string_element (properties, i));
+					g_string_append_printf (body,
+					                        "\t\t\tif (!json_object_has_member (object, %s)) {\n"
+					                        "\t\t\t\treturn FALSE;\n"
+					                        "\t\t\t}\n",
+					                        literal);
+					g_free (literal);
+				}
+			}
+
+			g_string_append (body,
+			                 "\t\t}\n"
+			                 "\n");
+		}
+	}
+
+	properties_start = body->len;
+	compile_properties (compiler, schema, body);
+
+	if (body->len > 0) {
+		gboolean uses_iter = (body->len > properties_start);
+
+		g_string_append_printf (out,
+		                        "\tif (type == %s_TYPE_OBJECT) {\n"
+		                        "\t\tJsonObject *object = json_node_get_object (instance);\n"
+		                        "%s"
+		                        "\n",
+		                        compiler->prefix_upper,
+		                        uses_iter ?
+		                        "\t\tJsonObjectIter iter;\n"
+		                        "\t\tconst gchar *member_name;\n"
+		                        "\t\tJsonNode *member_node;\n" : "");
+		g_string_append_len (out, body->str, body->len - 1);
+		g_string_append (out, "\t}\n\n");
+	}
+
+	g_string_free (body, TRUE);
+}
+
+/* allOf, anyOf, oneOf and not.
+ *
+ * Complexity: O(N) in the number of subschemas */
+static void
+compile_combinators (Compiler   *compiler,
+                     JsonObject *schema,
+                     GString    *out,
+                     gboolean   *uses_n_valid)
+{
+	JsonNode *node;  /* unowned */
+	JsonArray *array;  /* unowned */
+	guint i;
+
+	/* allOf */
+	node = json_object_get_member (schema, "allOf");
+
+	if (node != NULL) {
+		array = json_node_get_array (node);
+
+		for (i = 0; i < json_array_get_length (array); i++) {
+			JsonObject *child;  /* unowned */
+
+			child = json_array_get_object_element (array, i);
+
+			if (schema_is_trivial (child)) {
+				continue;
+			}
+
+			g_string_append_printf (out,
+			                        "\t/* allOf[%u] */\n"
+			                        "\tif (!%s_schema_%u (instance)) {\n"
+			                        "\t\treturn FALSE;\n"
+			                        "\t}\n"
+			                        "\n",
+			                        i, compiler->prefix,
+			                        compiler_add_subschema (compiler,
+			                                                child));
+		}
+	}
+
+	/* anyOf; trivially valid if any of the subschemas is trivial. */
+	node = json_object_get_member (schema, "anyOf");
+
+	if (node != NULL) {
+		GString *condition = NULL;  /* owned */
+
+		array = json_node_get_array (node);
+		condition = g_string_new ("");
+
+		for (i = 0; i < json_array_get_length (array); i++) {
+			JsonObject *child;  /* unowned */
+
+			child = json_array_get_object_element (array, i);
+
+			if (schema_is_trivial (child)) {
+				g_string_truncate (condition, 0);
+				break;
+			}
+
+			g_string_append_printf (condition,
+			                        "%s!%s_schema_%u (instance)",
+			                        (i > 0) ? " &&\n\t    " : "",
+			                        compiler->prefix,
+			                        compiler_add_subschema (compiler,
+			                                                child));
+		}
+
+		if (condition->len > 0) {
+			g_string_append_printf (out,
+			                        "\t/* anyOf */\n"
+			                        "\tif (%s) {\n"
+			                        "\t\treturn FALSE;\n"
+			                        "\t}\n"
+			                        "\n",
+			                        condition->str);
+		}
+
+		g_string_free (condition, TRUE);
+	}
+
+	/* oneOf; stop as soon as two subschemas are valid. */
+	node = json_object_get_member (schema, "oneOf");
+
+	if (node != NULL) {
+		array = json_node_get_array (node);
+		*uses_n_valid = TRUE;
+
+		g_string_append (out,
+		                 "\t/* oneOf */\n"
+		                 "\tn_valid = 0;\n"
+		                 "\n");
+
+		for (i = 0; i < json_array_get_length (array); i++) {
+			JsonObject *child;  /* unowned */
+
+			child = json_array_get_object_element (array, i);
+
+			if (schema_is_trivial (child)) {
+				g_string_append (out,
+				                 "\tif (++n_valid > 1) {\n"
+				                 "\t\treturn FALSE;\n"
+				                 "\t}\n");
+			} else {
+				g_string_append_printf (out,
+				                        "\tif (%s_schema_%u (instance) && ++n_valid > 1) {\n"
+				                        "\t\treturn FALSE;\n"
+				                        "\t}\n",
+				                        compiler->prefix,
+				                        compiler_add_subschema (compiler,
+				                                                child));
+			}
+		}
+
+		g_string_append (out,
+		                 "\n"
+		                 "\tif (n_valid != 1) {\n"
+		                 "\t\treturn FALSE;\n"
+		                 "\t}\n"
+		                 "\n");
+	}
+
+	/* not */
+	node = json_object_get_member (schema, "not");
+
+	if (node != NULL) {
+		JsonObject *child;  /* unowned */
+
+		child = json_node_get_object (node);
+
+		if (schema_is_trivial (child)) {
+			g_string_append (out,
+			                 "\t/* not */\n"
+			                 "\treturn FALSE;\n"
+			                 "\n");
+		} else {
+			g_string_append_printf (out,
+			                        "\t/* not */\n"
+			                        "\tif (%s_schema_%u (instance)) {\n"
+			                        "\t\treturn FALSE;\n"
+			                        "\t}\n"
+			                        "\n",
+			                        compiler->prefix,
+			                        compiler_add_subschema (compiler,
+			                                                child));
+		}
+	}
+}
+
+/* Output the function for @schema. The cheapest checks are done first, and
+ * checks for instance types which the type keyword excludes are omitted.
+ *
+ * Complexity: O(N) in the number of keywords in @schema */
+static void
+compile_schema (Compiler   *compiler,
+                JsonObject *schema,
+                guint       id)
+{
+	GString *body = NULL;  /* owned */
+	JsonNode *node;  /* unowned */
+	guint mask = TYPE_ALL;
+	gsize typed_start;
+	gboolean uses_type = FALSE, uses_n_valid = FALSE;
+
+	body = g_string_new ("");
+
+	/* type */
+	node = json_object_get_member (schema, "type");
+
+	if (node != NULL) {
+		gchar *expression = NULL;  /* owned */
+
+		mask = type_mask_from_node (node);
+		expression = type_mask_expression (compiler, mask);
+
+		g_string_append_printf (body,
+		                        "\t/* type */\n"
+		                        "\tif ((type & (%s)) == 0) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n",
+		                        expression);
+		g_free (expression);
+		uses_type = TRUE;
+	}
+
+	/* enum */
+	node = json_object_get_member (schema, "enum");
+
+	if (node != NULL) {
+		g_string_append_printf (body,
+		                        "\t/* enum */\n"
+		                        "\tif (!%s_enum_%u (instance, type)) {\n"
+		                        "\t\treturn FALSE;\n"
+		                        "\t}\n"
+		                        "\n",
+		                        compiler->prefix,
+		                        compiler_add_enum (compiler,
+		                                           json_node_get_array (node)));
+		uses_type = TRUE;
+	}
+
+	typed_start = body->len;
+
+	if (mask & (TYPE_INTEGER | TYPE_NUMBER)) {
+		compile_numbers (compiler, schema, body);
+	}
+	if (mask & TYPE_STRING) {
+		compile_strings (compiler, schema, body);
+	}
+	if (mask & TYPE_ARRAY) {
+		compile_arrays (compiler, schema, body);
+	}
+	if (mask & TYPE_OBJECT) {
+		compile_objects (compiler, schema, body);
+	}
+
+	uses_type = uses_type || (body->len > typed_start);
+
+	compile_combinators (compiler, schema, body, &uses_n_valid);
+
+	g_string_append_printf (compiler->schemas,
+	                        "static gboolean\n"
+	                        "%s_schema_%u (JsonNode *instance)\n"
+	                        "{\n",
+	                        compiler->prefix, id);
+
+	if (uses_type) {
+		g_string_append_printf (compiler->schemas,
+		                        "\tguint type = %s_type (instance);\n",
+		                        compiler->prefix);
+		compiler->helpers |= HELPER_TYPE;
+	}
+	if (uses_n_valid) {
+		g_string_append (compiler->schemas, "\tguint n_valid;\n");
+	}
+	if (uses_type || uses_n_valid) {
+		g_string_append (compiler->schemas, "\n");
+	}
+
+	g_string_append_printf (compiler->schemas,
+	                        "%s"
+	                        "\treturn TRUE;\n"
+	                        "}\n"
+	                        "\n",
+	                        body->str);
+
+	g_string_free (body, TRUE);
+}
+
+/* Compile @root and all its subschemas, and return the generated code.
+ *
+ * Complexity: O(N) in the size of @root */
+static gchar *
+compile (const gchar *function_name,
+         const gchar *program_name,
+         JsonObject  *root)
+{
+	Compiler compiler;
+	GString *out = NULL;  /* owned */
+	JsonObject *schema;  /* unowned */
+
+	compiler_init (&compiler, function_name);
+
+	compiler_add_subschema (&compiler, root);
+
+	while ((schema = g_queue_pop_head (&compiler.pending_subschemas)) != NULL) {
+		compile_schema (&compiler, schema,
+		                GPOINTER_TO_UINT (g_hash_table_lookup (compiler.subschema_ids,
+		                                                       schema)));
+	}
+
+	/* Put it all together. This format is not stable, but the entry point
+	 * is. */
+	out = g_string_new ("");
+
+	g_string_append_printf (out,
+	                        "/* Generated by %s. Do not modify. */\n"
+	                        "\n"
+	                        "#include <float.h>\n"
+	                        "#include <math.h>\n"
+	                        "#include <string.h>\n"
+	                        "#include <glib.h>\n"
+	                        "#include <json-glib/json-glib.h>\n"
+	                        "\n"
+	                        "gboolean %s (JsonNode *instance);\n"
+	                        "\n",
+	                        program_name, function_name);
+
+	append_template (&compiler, out, type_enum_template);
+
+	if (compiler.helpers & HELPER_TYPE) {
+		append_template (&compiler, out, type_template);
+	}
+	if (compiler.helpers & HELPER_DIVIDES) {
+		append_template (&compiler, out, divides_template);
+	}
+	if (compiler.helpers & HELPER_STRING_HASH) {
+		append_template (&compiler, out, string_hash_template);
+	}
+	if (compiler.helpers & HELPER_UNIQUE_ITEMS) {
+		append_template (&compiler, out, unique_items_template);
+	}
+
+	g_string_append (out, compiler.functions->str);
+	g_string_append_printf (out, "%s\n", compiler.prototypes->str);
+	g_string_append (out, compiler.schemas->str);
+
+	g_string_append_printf (out,
+	                        "gboolean\n"
+	                        "%s (JsonNode *instance)\n"
+	                        "{\n"
+	                        "\tg_return_val_if_fail (instance != NULL, FALSE);\n"
+	                        "\n"
+	                        "\treturn %s_schema_0 (instance);\n"
+	                        "}\n",
+	                        function_name, function_name);
+
+	compiler_clear (&compiler);
+
+	return g_string_free (out, FALSE);
+}
+
+/* Whether @name is a valid C identifier.
+ *
+ * Complexity: O(N) in the length of @name */
+static gboolean
+is_c_identifier (const gchar *name)
+{
+	const gchar *p;
+
+	if (name == NULL ||
+	    !(g_ascii_isalpha (name[0]) || name[0] == '_')) {
+		return FALSE;
+	}
+
+	for (p = name + 1; *p != '\0'; p++) {
+		if (!g_ascii_isalnum (*p) && *p != '_') {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Command line parameters. */
+static gchar *option_c_function_name = NULL;
+static gchar **option_schema_filenames = NULL;
+
+static const GOptionEntry entries[] = {
+	{ "c-function-name", 0, 0, G_OPTION_ARG_STRING,
+	  &option_c_function_name,
+	  N_("Validation function name (default: "
+	     "‘json_schema_validate’)"), N_("NAME") },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY,
+	  &option_schema_filenames,
+	  N_("JSON schema file to compile"),
+	  N_("JSON-SCHEMA") },
+	{ NULL, },
+};
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context = NULL;  /* owned */
+	ExitStatus retval = EXIT_OK;
+	GPtrArray/*<owned WblSchema>*/ *loaded_schemas = NULL;  /* owned */
+	GError **load_errors = NULL;  /* owned */
+	GError *error = NULL;
+	WblSchemaNode *root;  /* unowned */
+	gchar *code = NULL;  /* owned */
+
+#if !GLIB_CHECK_VERSION (2, 35, 0)
+	g_type_init ();
+#endif
+
+	setlocale (LC_ALL, "");
+
+	/* Redirect debug output to stderr so that stdout is purely generated
+	 * code. */
+	g_log_set_default_handler (wbl_log, NULL);
+
+	/* Command line parsing. */
+	context = g_option_context_new (_("— compile a JSON schema to a C "
+	                                  "validation function"));
+	g_option_context_set_summary (context,
+	                              _("Compile a JSON Schema into a "
+	                                "specialised C function which checks "
+	                                "whether a JSON instance is valid "
+	                                "against it, giving the same results "
+	                                "as libwalbottle. The generated code "
+	                                "depends only on GLib and json-glib."
+	                                "\n\nRead about JSON Schema here: "
+	                                "http://json-schema.org/."));
+	g_option_context_add_main_entries (context, entries, PACKAGE_NAME);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		gchar *message;
+
+		message = g_strdup_printf (_("Option parsing failed: %s"),
+		                           error->message);
+		g_printerr ("%s: %s\n", argv[0], message);
+		g_free (message);
+
+		g_clear_error (&error);
+
+		retval = EXIT_INVALID_OPTIONS;
+		goto done;
+	}
+
+	if (option_c_function_name == NULL) {
+		option_c_function_name = g_strdup ("json_schema_validate");
+	} else if (!is_c_identifier (option_c_function_name)) {
+		gchar *message1, *message2;
+
+		message1 = g_strdup_printf (_("Invalid function name ‘%s’; it "
+		                              "must be a C identifier."),
+		                            option_c_function_name);
+		message2 = g_strdup_printf (_("Option parsing failed: %s"),
+		                            message1);
+		g_printerr ("%s: %s\n", argv[0], message2);
+		g_free (message2);
+		g_free (message1);
+
+		retval = EXIT_INVALID_OPTIONS;
+		goto done;
+	}
+
+	if (option_schema_filenames == NULL ||
+	    option_schema_filenames[0] == NULL ||
+	    option_schema_filenames[1] != NULL) {
+		const gchar *message = NULL;
+
+		message = _("Exactly one schema file must be specified.");
+		g_printerr ("%s: %s\n", argv[0], message);
+
+		retval = EXIT_INVALID_OPTIONS;
+		goto done;
+	}
+
+	/* Load the schema. */
+	loaded_schemas = wbl_load_schemas ((const gchar * const *) option_schema_filenames,
+	                                   FALSE, &load_errors);
+
+	if (load_errors[0] != NULL) {
+		gchar *message;
+
+		message = g_strdup_printf (_("Invalid JSON schema ‘%s’: %s"),
+		                           option_schema_filenames[0],
+		                           load_errors[0]->message);
+		g_printerr ("%s: %s\n", argv[0], message);
+		g_free (message);
+
+		retval = EXIT_INVALID_SCHEMA;
+		goto done;
+	}
+
+	/* Compile it. */
+	root = wbl_schema_get_root (loaded_schemas->pdata[0]);
+	code = compile (option_c_function_name, argv[0],
+	                wbl_schema_node_get_root (root));
+
+	g_print ("%s", code);
+
+done:
+	g_free (code);
+
+	if (context != NULL) {
+		g_option_context_free (context);
+	}
+	if (loaded_schemas != NULL) {
+		wbl_load_errors_free (load_errors, loaded_schemas->len);
+		g_ptr_array_unref (loaded_schemas);
+	}
+
+	return retval;
+}
@@ -66,6 +66,80 @@ sort_schema_info_cb (gconstpointer a,
 	return time_b - time_a;
 }
 
+static void
+print_allocations (WblSchemaInfo *info)
+{
+	gchar **keywords = NULL;
+	guint64 n_nodes, n_objects, n_arrays, n_hash_tables, n_bytes;
+	guint64 n_peak_bytes;
+	gsize i;
+
+	if (!wbl_schema_info_get_allocation_estimates (info, NULL, &n_nodes,
+	                                               &n_objects, &n_arrays,
+	                                               &n_hash_tables,
+	                                               &n_bytes,
+	                                               &n_peak_bytes)) {
+		return;
+	}
+
+	g_printerr ("   allocated an estimated %" G_GUINT64_FORMAT " nodes (%"
+	            G_GUINT64_FORMAT " objects, %" G_GUINT64_FORMAT " arrays, %"
+	            G_GUINT64_FORMAT " hash tables), ~%" G_GUINT64_FORMAT
+	            " bytes, peak ~%" G_GUINT64_FORMAT " bytes\n",
+	            n_nodes, n_objects, n_arrays, n_hash_tables, n_bytes,
+	            n_peak_bytes);
+
+	keywords = wbl_schema_info_dup_allocation_keywords (info);
+
+	for (i = 0; keywords[i] != NULL; i++) {
+		wbl_schema_info_get_allocation_estimates (info, keywords[i],
+		                                          &n_nodes, &n_objects,
+		                                          &n_arrays,
+		                                          &n_hash_tables,
+		                                          &n_bytes,
+		                                          &n_peak_bytes);
+
+		g_printerr ("    – %s: %" G_GUINT64_FORMAT " nodes (%"
+		            G_GUINT64_FORMAT " objects, %" G_GUINT64_FORMAT
+		            " arrays), ~%" G_GUINT64_FORMAT " bytes, peak ~%"
+		            G_GUINT64_FORMAT " bytes\n",
+		            keywords[i], n_nodes, n_objects, n_arrays, n_bytes,
+		            n_peak_bytes);
+	}
+
+	g_strfreev (keywords);
+}
+
+/* Parse a --shard value of the form ‘I/N’, where 1 ≤ I ≤ N. @shard_index is
+ * returned counting from 0. */
+static gboolean
+parse_shard (const gchar  *shard,
+             guint        *shard_index,
+             guint        *n_shards)
+{
+	guint64 i, n;
+	gchar *end = NULL;
+
+	i = g_ascii_strtoull (shard, &end, 10);
+
+	if (end == shard || *end != '/') {
+		return FALSE;
+	}
+
+	shard = end + 1;
+	n = g_ascii_strtoull (shard, &end, 10);
+
+	if (end == shard || *end != '\0' ||
+	    i < 1 || n < 1 || i > n || n > G_MAXUINT) {
+		return FALSE;
+	}
+
+	*shard_index = i - 1;
+	*n_shards = n;
+
+	return TRUE;
+}
+
 /* Command line parameters. */
 static gboolean option_quiet = FALSE;
 static gboolean option_valid_only = FALSE;
@@ -75,6 +149,15 @@ static gchar *option_format = NULL;
 static gchar **option_schema_filenames = NULL;
 static gchar *option_c_variable_name = NULL;
 static gboolean option_show_timings = FALSE;
+static gboolean option_show_allocations = FALSE;
+static gchar *option_shard = NULL;
+static gboolean option_pairwise_properties = FALSE;
+static gboolean option_minimise = FALSE;
+static gint option_max_depth = 0;
+static gint64 option_max_instance_size = 0;
+static gint64 option_max_total_size = 0;
+static gint64 option_spill_threshold = 0;
+static gboolean option_check_formats = FALSE;
 
 static const GOptionEntry entries[] = {
 	{ "quiet", 'q', 0, G_OPTION_ARG_NONE, &option_quiet,
@@ -94,6 +177,38 @@ static const GOptionEntry entries[] = {
 	{ "show-timings", 0, 0, G_OPTION_ARG_NONE, &option_show_timings,
 	  N_("Print timing information to stderr after outputting generated "
 	     "instances"), NULL },
+	{ "show-allocations", 0, 0, G_OPTION_ARG_NONE,
+	  &option_show_allocations,
+	  N_("Estimate memory allocations during generation, and include "
+	     "them in the timing information (implies --show-timings)"),
+	  NULL },
+	{ "shard", 0, 0, G_OPTION_ARG_STRING, &option_shard,
+	  N_("Only generate and output shard I of N of the instances, "
+	     "counting from 1"),
+	  N_("I/N") },
+	{ "pairwise-properties", 0, 0, G_OPTION_ARG_NONE,
+	  &option_pairwise_properties,
+	  N_("Cover every pair of object properties, rather than each "
+	     "property on its own"), NULL },
+	{ "minimise", 0, 0, G_OPTION_ARG_NONE, &option_minimise,
+	  N_("Only output enough instances to pass and fail every keyword "
+	     "check which the full set of instances does"), NULL },
+	{ "max-depth", 0, 0, G_OPTION_ARG_INT, &option_max_depth,
+	  N_("Maximum nesting depth of arrays and objects in each instance "
+	     "(default: unlimited)"), N_("DEPTH") },
+	{ "max-instance-size", 0, 0, G_OPTION_ARG_INT64,
+	  &option_max_instance_size,
+	  N_("Maximum size of each instance (default: unlimited)"),
+	  N_("BYTES") },
+	{ "max-total-size", 0, 0, G_OPTION_ARG_INT64, &option_max_total_size,
+	  N_("Maximum total size of the instances for each schema (default: "
+	     "unlimited)"), N_("BYTES") },
+	{ "spill-threshold", 0, 0, G_OPTION_ARG_INT64, &option_spill_threshold,
+	  N_("Store cached sub-schema instance sets of at least this size in "
+	     "temporary files (default: never)"), N_("BYTES") },
+	{ "check-formats", 0, 0, G_OPTION_ARG_NONE, &option_check_formats,
+	  N_("Check strings against their format keyword, and generate "
+	     "strings for each format"), NULL },
 	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY,
 	  &option_schema_filenames,
 	  N_("JSON schema files to generate from"),
@@ -108,10 +223,13 @@ main (int argc, char *argv[])
 	ExitStatus retval = EXIT_OK;
 	guint i;
 	GPtrArray/*<owned WblSchema>*/ *schemas = NULL;  /* owned */
+	GPtrArray/*<owned WblSchema>*/ *loaded_schemas = NULL;  /* owned */
+	GError **load_errors = NULL;  /* owned */
 	WblGenerateInstanceFlags flags;
 	OutputFormat output_format;
 	gboolean output_format_set = FALSE;
 	GError *error = NULL;
+	guint shard_index = 0, n_shards = 1;
 	gboolean generated_any_valid_instances = FALSE;
 	gboolean generated_any_invalid_instances = FALSE;
 	gboolean use_colour_stderr;
@@ -210,6 +328,37 @@ main (int argc, char *argv[])
 		goto done;
 	}
 
+	if (option_shard != NULL &&
+	    !parse_shard (option_shard, &shard_index, &n_shards)) {
+		gchar *message1, *message2;
+
+		message1 = g_strdup_printf (_("Invalid shard ‘%s’; it must be "
+		                              "of the form ‘I/N’, where I is "
+		                              "between 1 and N."),
+		                            option_shard);
+		message2 = g_strdup_printf (_("Option parsing failed: %s"),
+		                            message1);
+		g_printerr ("%s: %s\n", argv[0], message2);
+		g_free (message2);
+		g_free (message1);
+
+		retval = EXIT_INVALID_OPTIONS;
+		goto done;
+	}
+
+	if (option_max_depth < 0 || option_max_instance_size < 0 ||
+	    option_max_total_size < 0 || option_spill_threshold < 0) {
+		gchar *message = NULL;
+
+		message = g_strdup_printf (_("Option parsing failed: %s"),
+		                           _("Limits must not be negative."));
+		g_printerr ("%s: %s\n", argv[0], message);
+		g_free (message);
+
+		retval = EXIT_INVALID_OPTIONS;
+		goto done;
+	}
+
 	if (option_schema_filenames == NULL || option_schema_filenames[0] == NULL) {
 		const gchar *message = NULL;
 
@@ -220,17 +369,18 @@ main (int argc, char *argv[])
 		goto done;
 	}
 
-	/* Load the schemas. */
+	/* Load the schemas. They are all loaded and validated in parallel,
+	 * then the results are handled in order. */
 	schemas = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	loaded_schemas = wbl_load_schemas ((const gchar * const *) option_schema_filenames,
+	                                   FALSE, &load_errors);
 
-	for (i = 0;
-	     option_schema_filenames != NULL && option_schema_filenames[i] != NULL;
-	     i++) {
+	for (i = 0; i < loaded_schemas->len; i++) {
 		WblSchema *schema = NULL;  /* owned */
 
-		schema = wbl_schema_new ();
-		wbl_schema_load_from_file (schema, option_schema_filenames[i],
-		                           &error);
+		schema = g_object_ref (loaded_schemas->pdata[i]);
+		error = load_errors[i];
+		load_errors[i] = NULL;
 
 		if (error != NULL) {
 			if (!option_quiet) {
@@ -265,6 +415,16 @@ main (int argc, char *argv[])
 	if (!option_no_invalid_json) {
 		flags |= WBL_GENERATE_INSTANCE_INVALID_JSON;
 	}
+	if (option_show_allocations) {
+		flags |= WBL_GENERATE_INSTANCE_ESTIMATE_ALLOCATIONS;
+		option_show_timings = TRUE;
+	}
+	if (option_pairwise_properties) {
+		flags |= WBL_GENERATE_INSTANCE_PAIRWISE_PROPERTIES;
+	}
+	if (option_minimise) {
+		flags |= WBL_GENERATE_INSTANCE_MINIMISE;
+	}
 
 	/* Initial output. This format is part of the json-schema-generate ABI
 	 * and cannot be modified without a major version break. */
@@ -282,7 +442,14 @@ main (int argc, char *argv[])
 		guint j;
 
 		schema = schemas->pdata[i];
-		instances = wbl_schema_generate_instances (schema, flags);
+		wbl_schema_set_generation_limits (schema, option_max_depth,
+		                                  option_max_instance_size,
+		                                  option_max_total_size);
+		wbl_schema_set_spill_threshold (schema, option_spill_threshold);
+		wbl_schema_set_check_formats (schema, option_check_formats);
+		instances = wbl_schema_generate_instances_sharded (schema, flags,
+		                                                   shard_index,
+		                                                   n_shards);
 
 		/* Print out the instances. This format is part of the
 		 * json-schema-generate ABI and cannot be modified without a
@@ -376,6 +543,10 @@ main (int argc, char *argv[])
 				            wbl_schema_info_get_n_times_generated (info),
 				            n_instances,
 				            time_per_instance);
+
+				if (option_show_allocations) {
+					print_allocations (info);
+				}
 			}
 
 			g_printerr ("%s%s%s schemas (total: %u):\n",
@@ -400,8 +571,11 @@ main (int argc, char *argv[])
 		}
 	}
 
-	/* Sanity check. */
-	if (!option_invalid_only && !generated_any_valid_instances) {
+	/* Sanity check. A single shard may legitimately contain only valid or
+	 * only invalid instances, so only check when not sharding. */
+	if (n_shards > 1) {
+		/* Skip the check. */
+	} else if (!option_invalid_only && !generated_any_valid_instances) {
 		g_printerr ("%s: Warning: Failed to generate any valid "
 		            "instances. Test coverage may be low. This may "
 		            "indicate a bug in Walbottle; please report it.\n",
@@ -420,6 +594,10 @@ done:
 	if (schemas != NULL) {
 		g_ptr_array_unref (schemas);
 	}
+	if (loaded_schemas != NULL) {
+		wbl_load_errors_free (load_errors, loaded_schemas->len);
+		g_ptr_array_unref (loaded_schemas);
+	}
 
 	return retval;
 }
@@ -0,0 +1,312 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <locale.h>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <stdio.h>
+
+#include "wbl-schema.h"
+#include "utilities/wbl-utilities.h"
+
+/* Exit statuses. */
+typedef enum {
+	/* Success. */
+	EXIT_OK = 0,
+	/* Error parsing command line options. */
+	EXIT_INVALID_OPTIONS = 1,
+	/* JSON schema could not be parsed. */
+	EXIT_INVALID_SCHEMA = 2,
+	/* JSON schema exceeded the --max-instances or --max-cost budget. */
+	EXIT_OVER_BUDGET = 3,
+} ExitStatus;
+
+/* Human-readable descriptions of each #WblSchemaEstimateFlags. */
+static const struct {
+	WblSchemaEstimateFlags flag;
+	const gchar *description;
+} estimate_flags[] = {
+	{ WBL_SCHEMA_ESTIMATE_DOMINANT, N_("dominant") },
+	{ WBL_SCHEMA_ESTIMATE_LARGE_ARRAYS, N_("large arrays") },
+	{ WBL_SCHEMA_ESTIMATE_LARGE_STRINGS, N_("large strings") },
+	{ WBL_SCHEMA_ESTIMATE_MANY_PROPERTIES, N_("many properties") },
+	{ WBL_SCHEMA_ESTIMATE_DEEP_NESTING, N_("deep nesting") },
+};
+
+/* Build a comma-separated list of the descriptions of @flags, or return %NULL
+ * if no flags are set. */
+static gchar *
+build_flags_string (WblSchemaEstimateFlags flags)
+{
+	GString *out = NULL;
+	gsize i;
+
+	if (flags == WBL_SCHEMA_ESTIMATE_NONE) {
+		return NULL;
+	}
+
+	out = g_string_new ("");
+
+	for (i = 0; i < G_N_ELEMENTS (estimate_flags); i++) {
+		if (!(flags & estimate_flags[i].flag)) {
+			continue;
+		}
+
+		if (out->len > 0) {
+			g_string_append (out, ", ");
+		}
+
+		g_string_append (out, _(estimate_flags[i].description));
+	}
+
+	return g_string_free (out, FALSE);
+}
+
+/* Command line parameters. */
+static gboolean option_quiet = FALSE;
+static gint64 option_max_instances = 0;
+static gint64 option_max_cost = 0;
+static gint option_limit = 10;
+static gboolean option_show_schemas = FALSE;
+static gchar **option_schema_filenames = NULL;
+
+static const GOptionEntry entries[] = {
+	{ "quiet", 'q', 0, G_OPTION_ARG_NONE, &option_quiet,
+	  N_("Only print schemas which exceed the budget"), NULL },
+	{ "max-instances", 0, 0, G_OPTION_ARG_INT64, &option_max_instances,
+	  N_("Fail if more than this many instances would be generated for a "
+	     "schema (default: unlimited)"), N_("N") },
+	{ "max-cost", 0, 0, G_OPTION_ARG_INT64, &option_max_cost,
+	  N_("Fail if the estimated cost of generating instances for a schema "
+	     "exceeds this (default: unlimited)"), N_("COST") },
+	{ "limit", 'l', 0, G_OPTION_ARG_INT, &option_limit,
+	  N_("Number of subschemas to list for each schema, or 0 for all "
+	     "(default: 10)"), N_("N") },
+	{ "show-schemas", 0, 0, G_OPTION_ARG_NONE, &option_show_schemas,
+	  N_("Print the JSON for each listed subschema"), NULL },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY,
+	  &option_schema_filenames,
+	  N_("JSON schema files to analyse"),
+	  N_("JSON-SCHEMA [JSON-SCHEMA …]") },
+	{ NULL, },
+};
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context = NULL;  /* owned */
+	ExitStatus retval = EXIT_OK;
+	GPtrArray/*<owned WblSchema>*/ *loaded_schemas = NULL;  /* owned */
+	GError **load_errors = NULL;  /* owned */
+	GError *error = NULL;
+	gboolean use_colour;
+	const gchar *bold_escape, *reset_escape;
+	guint i;
+
+#if !GLIB_CHECK_VERSION (2, 35, 0)
+	g_type_init ();
+#endif
+
+	setlocale (LC_ALL, "");
+
+	/* Can we use colour output? */
+	use_colour = wbl_is_colour_supported (stdout);
+
+	if (use_colour) {
+		/* See: http://misc.flogisoft.com/bash/tip_colors_and_formatting */
+		bold_escape = "\033[1m";
+		reset_escape = "\033[0m";
+	} else {
+		bold_escape = "";
+		reset_escape = "";
+	}
+
+	/* Redirect debug output to stderr. */
+	g_log_set_default_handler (wbl_log, NULL);
+
+	/* Command line parsing. */
+	context = g_option_context_new (_("— estimate the cost of generating "
+	                                  "test vectors from JSON schemas"));
+	g_option_context_set_summary (context,
+	                              _("Estimate how many instances "
+	                                "json-schema-generate would generate "
+	                                "for one or more JSON Schemas, and how "
+	                                "expensive it would be, without "
+	                                "generating anything. The subschemas "
+	                                "which dominate the cost are listed, "
+	                                "with the reasons they are expensive."
+	                                "\n\nRead about JSON Schema here: "
+	                                "http://json-schema.org/."));
+	g_option_context_add_main_entries (context, entries, PACKAGE_NAME);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		gchar *message;
+
+		message = g_strdup_printf (_("Option parsing failed: %s"),
+		                           error->message);
+		g_printerr ("%s: %s\n", argv[0], message);
+		g_free (message);
+
+		g_clear_error (&error);
+
+		retval = EXIT_INVALID_OPTIONS;
+		goto done;
+	}
+
+	if (option_max_instances < 0 || option_max_cost < 0 ||
+	    option_limit < 0) {
+		const gchar *message = NULL;
+
+		message = _("Option parsing failed: Limits must not be "
+		            "negative.");
+		g_printerr ("%s: %s\n", argv[0], message);
+
+		retval = EXIT_INVALID_OPTIONS;
+		goto done;
+	}
+
+	if (option_schema_filenames == NULL || option_schema_filenames[0] == NULL) {
+		const gchar *message = NULL;
+
+		message = _("At least one schema file must be specified.");
+		g_printerr ("%s: %s\n", argv[0], message);
+
+		retval = EXIT_INVALID_OPTIONS;
+		goto done;
+	}
+
+	/* Load all the schemas in parallel, then analyse each of them. */
+	loaded_schemas = wbl_load_schemas ((const gchar * const *) option_schema_filenames,
+	                                   FALSE, &load_errors);
+
+	for (i = 0; i < loaded_schemas->len; i++) {
+		WblSchema *schema = NULL;  /* owned */
+		GPtrArray/*<owned WblSchemaEstimate>*/ *estimates = NULL;  /* owned */
+		WblSchemaEstimate *root;  /* unowned */
+		guint64 n_instances, total_cost;
+		gboolean over_budget;
+		guint j, n_listed;
+
+		schema = g_object_ref (loaded_schemas->pdata[i]);
+		error = load_errors[i];
+		load_errors[i] = NULL;
+
+		if (error != NULL) {
+			gchar *message;
+
+			message = g_strdup_printf (_("Invalid JSON schema ‘%s’: %s"),
+			                           option_schema_filenames[i],
+			                           error->message);
+			g_printerr ("%s: %s\n", argv[0], message);
+			g_free (message);
+
+			g_clear_error (&error);
+			g_object_unref (schema);
+
+			retval = EXIT_INVALID_SCHEMA;
+			continue;
+		}
+
+		estimates = wbl_schema_estimate_generation (schema);
+		root = estimates->pdata[0];
+		n_instances = wbl_schema_estimate_get_n_instances (root);
+		total_cost = wbl_schema_estimate_get_total_cost (root);
+
+		over_budget = ((option_max_instances > 0 &&
+		                n_instances > (guint64) option_max_instances) ||
+		               (option_max_cost > 0 &&
+		                total_cost > (guint64) option_max_cost));
+
+		if (over_budget && retval == EXIT_OK) {
+			retval = EXIT_OVER_BUDGET;
+		}
+
+		if (option_quiet && !over_budget) {
+			g_ptr_array_unref (estimates);
+			g_object_unref (schema);
+			continue;
+		}
+
+		/* Summary. This format is not stable. */
+		g_print ("%s%s%s: ~%" G_GUINT64_FORMAT " instances, cost %"
+		         G_GUINT64_FORMAT "%s\n",
+		         bold_escape, option_schema_filenames[i], reset_escape,
+		         n_instances, total_cost,
+		         over_budget ? _(" (over budget)") : "");
+
+		/* List the top-level schema, then the most expensive
+		 * subschemas in decreasing order of cost. */
+		n_listed = (option_limit > 0) ?
+		           MIN ((guint) option_limit, estimates->len) :
+		           estimates->len;
+
+		for (j = 0; j < n_listed; j++) {
+			WblSchemaEstimate *estimate = estimates->pdata[j];
+			const gchar *keyword;
+			gchar *flags = NULL;
+			gdouble share;
+
+			keyword = wbl_schema_estimate_get_keyword (estimate);
+			flags = build_flags_string (wbl_schema_estimate_get_flags (estimate));
+			share = (total_cost > 0) ?
+			        100.0 * wbl_schema_estimate_get_cost (estimate) / total_cost :
+			        0.0;
+
+			g_print (" • %s%s%s: ~%" G_GUINT64_FORMAT
+			         " instances, cost %" G_GUINT64_FORMAT
+			         " (%.1f%%), mostly from ‘%s’%s%s%s\n",
+			         bold_escape,
+			         wbl_schema_estimate_get_path (estimate),
+			         reset_escape,
+			         wbl_schema_estimate_get_n_instances (estimate),
+			         wbl_schema_estimate_get_cost (estimate),
+			         share,
+			         (keyword != NULL) ? keyword : "",
+			         (flags != NULL) ? " [" : "",
+			         (flags != NULL) ? flags : "",
+			         (flags != NULL) ? "]" : "");
+
+			if (option_show_schemas) {
+				gchar *json = NULL;
+
+				json = wbl_schema_estimate_build_json (estimate);
+				g_print ("      %s\n", json);
+				g_free (json);
+			}
+
+			g_free (flags);
+		}
+
+		g_ptr_array_unref (estimates);
+		g_object_unref (schema);
+	}
+
+done:
+	if (context != NULL) {
+		g_option_context_free (context);
+	}
+	if (loaded_schemas != NULL) {
+		wbl_load_errors_free (load_errors, loaded_schemas->len);
+		g_ptr_array_unref (loaded_schemas);
+	}
+
+	return retval;
+}
@@ -37,12 +37,15 @@ typedef enum {
 	EXIT_INVALID_SCHEMA = 2,
 	/* JSON file does not validate against the meta-schema. */
 	EXIT_SCHEMA_VALIDATION_FAILED = 3,
+	/* Snapshot of a JSON schema could not be written. */
+	EXIT_SNAPSHOT_FAILED = 4,
 } ExitStatus;
 
 /* Command line parameters. */
 static gboolean option_quiet = FALSE;
 static gboolean option_no_hyper = FALSE;
 static gboolean option_ignore_errors = FALSE;
+static gboolean option_write_snapshots = FALSE;
 static gchar **option_schema_filenames = NULL;
 
 static const GOptionEntry entries[] = {
@@ -54,6 +57,9 @@ static const GOptionEntry entries[] = {
 	{ "ignore-errors", 'i', 0, G_OPTION_ARG_NONE, &option_ignore_errors,
 	  N_("Continue validating after errors are encountered, rather than "
 	     "stopping at the first error"), NULL },
+	{ "write-snapshots", 0, 0, G_OPTION_ARG_NONE, &option_write_snapshots,
+	  N_("Write a snapshot of each valid schema next to it, with a "
+	     "‘.snapshot’ suffix, which loads faster than the schema"), NULL },
 	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY,
 	  &option_schema_filenames,
 	  N_("JSON schema files to validate"),
@@ -68,6 +74,8 @@ main (int argc, char *argv[])
 	ExitStatus retval = EXIT_OK;
 	guint i;
 	GPtrArray/*<owned WblSchema>*/ *schemas = NULL;  /* owned */
+	GPtrArray/*<owned WblSchema>*/ *loaded_schemas = NULL;  /* owned */
+	GError **load_errors = NULL;  /* owned */
 	WblSchema *meta_schema = NULL;  /* owned */
 	WblMetaSchemaType meta_schema_type;
 	const gchar *meta_schema_name;
@@ -114,17 +122,18 @@ main (int argc, char *argv[])
 		goto done;
 	}
 
-	/* Load the schemas. */
+	/* Load the schemas. They are all loaded and validated in parallel,
+	 * then the results are handled in order. */
 	schemas = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	loaded_schemas = wbl_load_schemas ((const gchar * const *) option_schema_filenames,
+	                                   FALSE, &load_errors);
 
-	for (i = 0;
-	     option_schema_filenames != NULL && option_schema_filenames[i] != NULL;
-	     i++) {
+	for (i = 0; i < loaded_schemas->len; i++) {
 		WblSchema *schema = NULL;  /* owned */
 
-		schema = wbl_schema_new ();
-		wbl_schema_load_from_file (schema, option_schema_filenames[i],
-		                           &error);
+		schema = g_object_ref (loaded_schemas->pdata[i]);
+		error = load_errors[i];
+		load_errors[i] = NULL;
 
 		/* Print error or other messages from validation. */
 		wbl_print_validate_messages (schema,
@@ -229,6 +238,50 @@ main (int argc, char *argv[])
 			if (!option_ignore_errors) {
 				goto done;
 			}
+
+			continue;
+		}
+
+		/* Save a snapshot of the now-validated schema. */
+		if (option_write_snapshots) {
+			GBytes *snapshot = NULL;  /* owned */
+			gchar *snapshot_filename = NULL;  /* owned */
+
+			snapshot = wbl_schema_dup_snapshot (schema);
+			snapshot_filename = g_strconcat (schema_filename,
+			                                 ".snapshot", NULL);
+
+			g_file_set_contents (snapshot_filename,
+			                     g_bytes_get_data (snapshot, NULL),
+			                     g_bytes_get_size (snapshot), &error);
+
+			g_bytes_unref (snapshot);
+
+			if (error != NULL) {
+				if (!option_quiet) {
+					gchar *message;
+
+					message = g_strdup_printf (_("Error writing snapshot ‘%s’: %s"),
+					                           snapshot_filename,
+					                           error->message);
+					g_printerr ("%s: %s\n", argv[0], message);
+					g_free (message);
+				}
+
+				if (retval == EXIT_OK) {
+					retval = EXIT_SNAPSHOT_FAILED;
+				}
+				g_clear_error (&error);
+				g_free (snapshot_filename);
+
+				if (!option_ignore_errors) {
+					goto done;
+				}
+
+				continue;
+			}
+
+			g_free (snapshot_filename);
 		}
 	}
 
@@ -239,6 +292,10 @@ done:
 	if (schemas != NULL) {
 		g_ptr_array_unref (schemas);
 	}
+	if (loaded_schemas != NULL) {
+		wbl_load_errors_free (load_errors, loaded_schemas->len);
+		g_ptr_array_unref (loaded_schemas);
+	}
 	g_clear_object (&meta_schema);
 
 	return retval;
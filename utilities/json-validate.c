@@ -43,6 +43,8 @@ typedef enum {
 /* Command line parameters. */
 static gboolean option_quiet = FALSE;
 static gboolean option_ignore_errors = FALSE;
+static gboolean option_check_formats = FALSE;
+static gboolean option_trust_snapshots = FALSE;
 static gchar **option_schema_filenames = NULL;
 static gchar **option_json_filenames = NULL;
 
@@ -56,6 +58,11 @@ static const GOptionEntry entries[] = {
 	{ "ignore-errors", 'i', 0, G_OPTION_ARG_NONE, &option_ignore_errors,
 	  N_("Continue validating after errors are encountered, rather than "
 	     "stopping at the first error"), NULL },
+	{ "check-formats", 0, 0, G_OPTION_ARG_NONE, &option_check_formats,
+	  N_("Check that strings are valid for their format keyword"), NULL },
+	{ "trust-snapshots", 0, 0, G_OPTION_ARG_NONE, &option_trust_snapshots,
+	  N_("Do not validate schema snapshots again if they were validated "
+	     "when they were written"), NULL },
 	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY,
 	  &option_json_filenames,
 	  N_("JSON files to validate"), N_("JSON-FILE [JSON-FILE …]") },
@@ -70,6 +77,8 @@ main (int argc, char *argv[])
 	guint i, j;
 	GPtrArray/*<owned JsonParser>*/ *json_files = NULL;  /* owned */
 	GPtrArray/*<owned WblSchema>*/ *schemas = NULL;  /* owned */
+	GPtrArray/*<owned WblSchema>*/ *loaded_schemas = NULL;  /* owned */
+	GError **load_errors = NULL;  /* owned */
 	GError *error = NULL;
 
 #if !GLIB_CHECK_VERSION (2, 35, 0)
@@ -149,17 +158,18 @@ main (int argc, char *argv[])
 		g_ptr_array_add (json_files, parser);  /* transfer */
 	}
 
-	/* Load the schemas. */
+	/* Load the schemas. They are all loaded and validated in parallel,
+	 * then the results are handled in order. */
 	schemas = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	loaded_schemas = wbl_load_schemas ((const gchar * const *) option_schema_filenames,
+	                                   option_trust_snapshots, &load_errors);
 
-	for (i = 0;
-	     option_schema_filenames != NULL && option_schema_filenames[i] != NULL;
-	     i++) {
+	for (i = 0; i < loaded_schemas->len; i++) {
 		WblSchema *schema = NULL;  /* owned */
 
-		schema = wbl_schema_new ();
-		wbl_schema_load_from_file (schema, option_schema_filenames[i],
-		                           &error);
+		schema = g_object_ref (loaded_schemas->pdata[i]);
+		error = load_errors[i];
+		load_errors[i] = NULL;
 
 		if (error != NULL) {
 			if (!option_quiet) {
@@ -185,6 +195,7 @@ main (int argc, char *argv[])
 			}
 		}
 
+		wbl_schema_set_check_formats (schema, option_check_formats);
 		g_object_set_data (G_OBJECT (schema),
 		                   "filename", option_schema_filenames[i]);
 		g_ptr_array_add (schemas, schema);  /* transfer */
@@ -261,6 +272,10 @@ done:
 	if (schemas != NULL) {
 		g_ptr_array_unref (schemas);
 	}
+	if (loaded_schemas != NULL) {
+		wbl_load_errors_free (load_errors, loaded_schemas->len);
+		g_ptr_array_unref (loaded_schemas);
+	}
 
 	return retval;
 }
@@ -0,0 +1,191 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Walbottle
+ * Copyright (C) Philip Withnall 2016 <philip@tecnocode.co.uk>
+ *
+ * Walbottle is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Walbottle is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Walbottle.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <locale.h>
+#include <string.h>
+
+#include "wbl-schema.h"
+
+/* Validators generated by json-schema-compile, and test vectors generated by
+ * json-schema-generate, from the compile-*.schema.json files. */
+#include "compile-numbers-validator.h"
+#include "compile-numbers-vectors.h"
+#include "compile-enum-validator.h"
+#include "compile-enum-vectors.h"
+#include "compile-objects-validator.h"
+#include "compile-objects-vectors.h"
+#include "compile-combinators-validator.h"
+#include "compile-combinators-vectors.h"
+
+typedef gboolean (*ValidateFunc) (JsonNode *instance);
+
+/* Check that @validate gives the same result as wbl_schema_apply() for the
+ * test vector @json, and that both agree with @is_valid. The vectors are
+ * generated with --no-invalid-json, so must all be well-formed. */
+static void
+check_vector (WblSchema    *schema,
+              ValidateFunc  validate,
+              const gchar  *json,
+              gsize         size,
+              gboolean      is_valid)
+{
+	JsonParser *parser = NULL;  /* owned */
+	JsonNode *instance;  /* unowned */
+	GError *error = NULL;
+	gboolean interpreted_is_valid, compiled_is_valid;
+
+	g_test_message ("Vector: %s", json);
+
+	parser = json_parser_new ();
+	json_parser_load_from_data (parser, json, size, &error);
+	g_assert_no_error (error);
+
+	instance = json_parser_get_root (parser);
+
+	wbl_schema_apply (schema, instance, &error);
+	interpreted_is_valid = (error == NULL);
+	g_clear_error (&error);
+
+	compiled_is_valid = validate (instance);
+
+	g_assert_cmpint (compiled_is_valid, ==, interpreted_is_valid);
+	g_assert_cmpint (compiled_is_valid, ==, is_valid);
+
+	g_object_unref (parser);
+}
+
+static WblSchema *
+load_schema (const gchar *schema_filename)
+{
+	WblSchema *schema = NULL;  /* owned */
+	GError *error = NULL;
+	gchar *path = NULL;  /* owned */
+
+	schema = wbl_schema_new ();
+
+	path = g_test_build_filename (G_TEST_DIST, schema_filename, NULL);
+	wbl_schema_load_from_file (schema, path, &error);
+	g_assert_no_error (error);
+	g_free (path);
+
+	return schema;
+}
+
+#define CHECK_VECTORS(schema, validate, vectors) \
+	G_STMT_START { \
+		gsize i; \
+		\
+		g_assert_cmpuint (G_N_ELEMENTS (vectors), >, 0); \
+		\
+		for (i = 0; i < G_N_ELEMENTS (vectors); i++) { \
+			check_vector (schema, validate, vectors[i].json, \
+			              vectors[i].size, vectors[i].is_valid); \
+		} \
+	} G_STMT_END
+
+/* Test the compiled validator for a schema with numeric and string keywords
+ * and a union type. */
+static void
+test_compile_numbers (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+
+	schema = load_schema ("compile-numbers.schema.json");
+	CHECK_VECTORS (schema, numbers_validate, numbers_vectors);
+	g_object_unref (schema);
+}
+
+/* Test the compiled validator for an enum of strings, which is looked up in a
+ * perfect hash table, and other values. */
+static void
+test_compile_enum (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+	JsonNode *node = NULL;  /* owned */
+
+	schema = load_schema ("compile-enum.schema.json");
+	CHECK_VECTORS (schema, enum_validate, enum_vectors);
+	g_object_unref (schema);
+
+	/* Strings which are not in the enum, but may hash to the same bucket
+	 * as one which is. */
+	node = json_node_new (JSON_NODE_VALUE);
+
+	json_node_set_string (node, "blue");
+	g_assert (enum_validate (node));
+	json_node_set_string (node, "blu");
+	g_assert (!enum_validate (node));
+	json_node_set_string (node, "");
+	g_assert (!enum_validate (node));
+	json_node_set_string (node, "purple");
+	g_assert (!enum_validate (node));
+
+	/* Integers and doubles compare equal. */
+	json_node_set_double (node, 1.0);
+	g_assert (enum_validate (node));
+	json_node_set_int (node, 2);
+	g_assert (!enum_validate (node));
+
+	json_node_free (node);
+}
+
+/* Test the compiled validator for a schema with object keywords, where
+ * property names are matched with a switch. */
+static void
+test_compile_objects (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+
+	schema = load_schema ("compile-objects.schema.json");
+	CHECK_VECTORS (schema, objects_validate, objects_vectors);
+	g_object_unref (schema);
+}
+
+/* Test the compiled validator for a schema with tuple items and the allOf,
+ * anyOf, oneOf and not keywords. */
+static void
+test_compile_combinators (void)
+{
+	WblSchema *schema = NULL;  /* owned */
+
+	schema = load_schema ("compile-combinators.schema.json");
+	CHECK_VECTORS (schema, combinators_validate, combinators_vectors);
+	g_object_unref (schema);
+}
+
+int
+main (int argc, char *argv[])
+{
+#if !GLIB_CHECK_VERSION (2, 35, 0)
+	g_type_init ();
+#endif
+
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/compile/numbers", test_compile_numbers);
+	g_test_add_func ("/compile/enum", test_compile_enum);
+	g_test_add_func ("/compile/objects", test_compile_objects);
+	g_test_add_func ("/compile/combinators", test_compile_combinators);
+
+	return g_test_run ();
+}
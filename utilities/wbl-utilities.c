@@ -182,3 +182,117 @@ wbl_print_validate_messages (WblSchema *schema,
 	if (messages != NULL)
 		print_validate_messages (messages, use_colour, "");
 }
+
+/* Load a snapshot written by `json-schema-validate --write-snapshots` into
+ * @schema from the memory-mapped file @filename. Its record of having been
+ * validated is only used if @trusted is %TRUE. */
+static void
+load_snapshot (WblSchema    *schema,
+               const gchar  *filename,
+               gboolean      trusted,
+               GError      **error)
+{
+	GMappedFile *mapped_file = NULL;  /* owned */
+	GBytes *bytes = NULL;  /* owned */
+	const gchar *data;
+
+	mapped_file = g_mapped_file_new (filename, FALSE, error);
+
+	if (mapped_file == NULL) {
+		return;
+	}
+
+	/* Empty files have %NULL contents. */
+	data = g_mapped_file_get_contents (mapped_file);
+	bytes = g_bytes_new_with_free_func ((data != NULL) ? data : "",
+	                                    g_mapped_file_get_length (mapped_file),
+	                                    (GDestroyNotify) g_mapped_file_unref,
+	                                    mapped_file);  /* transfer */
+
+	if (trusted) {
+		wbl_schema_set_load_mode (schema, WBL_SCHEMA_LOAD_MODE_TRUSTED);
+	}
+
+	wbl_schema_load_from_snapshot (schema, bytes, error);
+	g_bytes_unref (bytes);
+}
+
+/* Load each of the schema files in @filenames concurrently, returning a
+ * #WblSchema for each of them, in the same order. If loading `filenames[i]`
+ * failed, `(*errors)[i]` is set to the error. Free @errors with
+ * wbl_load_errors_free().
+ *
+ * Files with a `.snapshot` suffix are loaded as schema snapshots; they are
+ * validated unless @trust_snapshots is %TRUE and they record that they were
+ * validated when they were written. */
+GPtrArray/*<owned WblSchema>*/ *
+wbl_load_schemas (const gchar * const   *filenames,
+                  gboolean               trust_snapshots,
+                  GError              ***errors)
+{
+	GPtrArray/*<owned WblSchema>*/ *schemas = NULL;  /* owned */
+	GPtrArray/*<unowned WblSchema>*/ *json_schemas = NULL;  /* owned */
+	GPtrArray/*<unowned filename>*/ *json_filenames = NULL;  /* owned */
+	GArray/*<guint>*/ *json_indices = NULL;  /* owned */
+	GError **json_errors = NULL;  /* owned */
+	guint i, n_files;
+
+	n_files = (filenames != NULL) ? g_strv_length ((gchar **) filenames) : 0;
+	schemas = g_ptr_array_new_full (n_files,
+	                                (GDestroyNotify) g_object_unref);
+	json_schemas = g_ptr_array_new ();
+	json_filenames = g_ptr_array_new ();
+	json_indices = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	*errors = g_new0 (GError *, n_files);
+
+	for (i = 0; i < n_files; i++) {
+		WblSchema *schema = wbl_schema_new ();
+
+		g_ptr_array_add (schemas, schema);  /* transfer */
+
+		if (g_str_has_suffix (filenames[i], ".snapshot")) {
+			load_snapshot (schema, filenames[i], trust_snapshots,
+			               &(*errors)[i]);
+		} else {
+			g_ptr_array_add (json_schemas, schema);
+			g_ptr_array_add (json_filenames, (gpointer) filenames[i]);
+			g_array_append_val (json_indices, i);
+		}
+	}
+
+	/* Load the rest as JSON. */
+	g_ptr_array_add (json_filenames, NULL);
+	json_errors = g_new0 (GError *, json_schemas->len);
+	wbl_schema_load_from_files ((WblSchema **) json_schemas->pdata,
+	                            (const gchar * const *) json_filenames->pdata,
+	                            json_schemas->len, NULL, json_errors);
+
+	for (i = 0; i < json_indices->len; i++) {
+		(*errors)[g_array_index (json_indices, guint, i)] = json_errors[i];
+	}
+
+	g_free (json_errors);
+	g_array_unref (json_indices);
+	g_ptr_array_unref (json_filenames);
+	g_ptr_array_unref (json_schemas);
+
+	return schemas;
+}
+
+void
+wbl_load_errors_free (GError **errors,
+                      guint    n_errors)
+{
+	guint i;
+
+	if (errors == NULL) {
+		return;
+	}
+
+	for (i = 0; i < n_errors; i++) {
+		g_clear_error (&errors[i]);
+	}
+
+	g_free (errors);
+}
@@ -36,6 +36,12 @@ void wbl_log (const gchar     *log_domain,
 void wbl_print_validate_messages (WblSchema *schema,
                                   gboolean   use_colour);
 
+GPtrArray *wbl_load_schemas (const gchar * const   *filenames,
+                             gboolean               trust_snapshots,
+                             GError              ***errors);
+void wbl_load_errors_free (GError **errors,
+                           guint    n_errors);
+
 G_END_DECLS
 
 #endif /* !WBL_UTILITIES_H */